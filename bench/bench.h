@@ -0,0 +1,148 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/**
+ * Helpers shared by the benchmark programs in this folder.
+ * Each benchmark is its own program, see the bench targets
+ * of the makefile.
+ */
+
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "array_map.h"
+#include "dynamic_string.h"
+#include "ply.h"
+
+/**
+ * Get a monotonic time stamp.
+ * @return seconds.
+ */
+static double Bench_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Get the files to run on, either from the command
+ * line or every PLY file of the assets folder.
+ * @return Array of allocated paths.
+ */
+static Array* Bench_getFiles(int argc, char** argv) {
+  Array* files = new_Array(free);
+  for (int next = 1; next < argc; next++)
+    if (argv[next][0] != '-' && argv[next][0] != '\0')
+      Array_add(files, $(argv[next]));
+  if (files->length > 0) return files;
+
+  glob_t found;
+  if (glob("./assets/*.ply", 0, null, &found) == 0) {
+    for (size_t next = 0; next < found.gl_pathc; next++)
+      Array_add(files, $(found.gl_pathv[next]));
+    globfree(&found);
+  }
+  return files;
+}
+
+/**
+ * Check if a flag such as "--large" was passed.
+ */
+static bool Bench_hasFlag(int argc, char** argv, const char* flag) {
+  for (int next = 1; next < argc; next++)
+    if (isStringEqual(argv[next], flag)) return true;
+  return false;
+}
+
+/**
+ * Get the value of an option such as "--runs=5".
+ * @return the text after the "=", or null if not passed.
+ */
+static const char* Bench_getOption(int argc, char** argv, const char* option) {
+  size_t length = strlen(option);
+  for (int next = 1; next < argc; next++)
+    if (strncmp(argv[next], option, length) == 0 && argv[next][length] == '=')
+      return argv[next] + length + 1;
+  return null;
+}
+
+/**
+ * Write a synthetic ascii PLY of a bumpy grid made of
+ * triangles, or of quads, to the temporary folder.
+ * @param faceCount of the mesh, rounded to fill the grid.
+ * @param isQuad true for quads instead of triangles.
+ * @return allocated path of the file, null if it failed.
+ */
+static String Bench_writeSyntheticPly(long faceCount, bool isQuad) {
+  long cells = isQuad ? faceCount : (faceCount + 1) / 2;
+  long side = 1;
+  while (side * side < cells) side++;
+  long vertexCount = (side + 1) * (side + 1);
+  long faces = isQuad ? side * side : side * side * 2;
+
+  const char* folder = getenv("TMPDIR") != null ? getenv("TMPDIR") : "/tmp";
+  String path = $(folder, "/bench_", _(faces), isQuad ? "_quad" : "_tri",
+                  ".ply");
+  FILE* file = fopen(path, "w");
+  if (file == null) {
+    free(path);
+    return null;
+  }
+
+  fprintf(file,
+          "ply\nformat ascii 1.0\ncomment synthetic benchmark grid\n"
+          "element vertex %ld\nproperty float x\nproperty float y\n"
+          "property float z\nelement face %ld\n"
+          "property list uchar int vertex_indices\nend_header\n",
+          vertexCount, faces);
+  unsigned int seed = 1;
+  for (long row = 0; row <= side; row++)
+    for (long column = 0; column <= side; column++) {
+      seed = seed * 1103515245u + 12345u;
+      fprintf(file, "%g %g %g\n", (double)column / side - 0.5,
+              (seed >> 16 & 0x7fff) / 327680.0, (double)row / side - 0.5);
+    }
+  for (long row = 0; row < side; row++)
+    for (long column = 0; column < side; column++) {
+      long a = row * (side + 1) + column, b = a + 1;
+      long c = a + side + 1, d = c + 1;
+      if (isQuad) {
+        fprintf(file, "4 %ld %ld %ld %ld\n", a, c, d, b);
+      } else {
+        fprintf(file, "3 %ld %ld %ld\n", a, c, b);
+        fprintf(file, "3 %ld %ld %ld\n", b, c, d);
+      }
+    }
+  fclose(file);
+  return path;
+}
+
+/**
+ * Compare every column of two decoded schemas byte by byte.
+ * @return true if they hold exactly the same data.
+ */
+static bool Bench_isSameSchema(PlySchema* a, PlySchema* b) {
+  if (a->elements->length != b->elements->length) return false;
+  for_in(next, a->elements) {
+    PlyElement* first = a->elements->at[next];
+    PlyElement* second = b->elements->at[next];
+    if (first->count != second->count) return false;
+    for_in(index, first->properties) {
+      PlyProperty* x = first->properties->at[index];
+      PlyProperty* y = second->properties->at[index];
+      if (x->length != y->length || x->type != y->type) return false;
+      if (memcmp(x->values, y->values, x->length * PlyType_size(x->type)))
+        return false;
+      if (x->listOffsets != null &&
+          memcmp(x->listOffsets, y->listOffsets,
+                 sizeof(uint32_t) * (first->count + 1)))
+        return false;
+    }
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,372 @@
+/**
+ * Load throughput of new_Model, parsing the PLY and mapping
+ * its cache, over the assets and synthetic grids of 1e4 to
+ * 1e7 faces. Each measure has a warmup run, then the best
+ * and the median of the runs are kept, with the peak memory,
+ * the allocations and the arena of one load.
+ * Usage: bench-load [files...] [--quick] [--runs=5]
+ *        [--json=results.json] [--baseline=results.json]
+ *        [--tolerance=10]
+ */
+
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "model.h"
+
+// Runs of each measure after the warmup, by default.
+#define RUNS 5
+
+// Percents a median may be slower than the baseline.
+#define TOLERANCE 10
+
+typedef struct {
+  String name;
+  const char* loader;  // "ply" or "cache".
+  long faces;
+  size_t bytes;  // Of the source file.
+  int runs;
+  double best, median;  // Seconds.
+  double peakMegabytes;
+  long allocations;
+  size_t allocatedBytes;
+  size_t arenaUsed, arenaReserved;  // Bytes of the arena of the model.
+} LoadResult;
+
+/* -------------------------------------------------------------------------- */
+/*                                 Allocations                                */
+/* -------------------------------------------------------------------------- */
+
+static atomic_long _allocations;
+static atomic_size_t _allocatedBytes;
+
+#if defined(__GLIBC__)
+// Every allocation of the program, and of the libraries it
+// loads, comes through these and is counted.
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size) {
+  atomic_fetch_add_explicit(&_allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&_allocatedBytes, size, memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+  atomic_fetch_add_explicit(&_allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&_allocatedBytes, count * size,
+                            memory_order_relaxed);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+  atomic_fetch_add_explicit(&_allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&_allocatedBytes, size, memory_order_relaxed);
+  return __libc_realloc(pointer, size);
+}
+
+static const bool IS_COUNTING_ALLOCATIONS = true;
+#else
+static const bool IS_COUNTING_ALLOCATIONS = false;
+#endif
+
+/* -------------------------------------------------------------------------- */
+/*                                    Memory                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Start a new peak of the resident memory, which Linux
+ * allows through clear_refs.
+ * @return false if the peak is of the whole process.
+ */
+static bool resetPeakMemory() {
+  FILE* file = fopen("/proc/self/clear_refs", "w");
+  if (file == null) return false;
+  bool isReset = fputs("5", file) >= 0;
+  return fclose(file) == 0 && isReset;
+}
+
+/**
+ * Get the peak resident memory since the last reset, or
+ * of the whole process where it can not be reset.
+ */
+static double getPeakMegabytes() {
+  FILE* file = fopen("/proc/self/status", "r");
+  if (file != null) {
+    char line[256];
+    long kilobytes = -1;
+    while (fgets(line, sizeof(line), file) != null)
+      if (sscanf(line, "VmHWM: %ld kB", &kilobytes) == 1) break;
+    fclose(file);
+    if (kilobytes >= 0) return kilobytes / 1024.0;
+  }
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return usage.ru_maxrss / (1024.0 * 1024.0);  // Bytes.
+#else
+  return usage.ru_maxrss / 1024.0;  // Kilobytes.
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Measures                                  */
+/* -------------------------------------------------------------------------- */
+
+static int compareSeconds(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Load a file with caches on or off.
+ * @param cacheFolder to keep the caches in, null to parse.
+ */
+static Model* load(String path, const char* cacheFolder) {
+  if (cacheFolder != null) {
+    setenv("MODEL_CACHE", "on", 1);
+    setenv("MODEL_CACHE_DIR", cacheFolder, 1);
+  } else {
+    setenv("MODEL_CACHE", "off", 1);
+  }
+  return new_Model(path);
+}
+
+/**
+ * Measure the loads of a file. The warmup of the cache
+ * loader is a parse that writes the cache.
+ * @return false if the file did not load.
+ */
+static bool measure(String path, String name, const char* cacheFolder,
+                    int runs, LoadResult* result) {
+  Model* warmup = load(path, cacheFolder);
+  bool isLoaded = warmup != null && !warmup->hasError;
+  Model_free(warmup);
+  if (!isLoaded) return false;
+
+  double* seconds = malloc(sizeof(double) * runs);
+  result->name = $(name);
+  result->loader = cacheFolder != null ? "cache" : "ply";
+  result->runs = runs;
+  result->peakMegabytes = 0;
+  for (int run = 0; run < runs; run++) {
+    resetPeakMemory();
+    atomic_store(&_allocations, 0);
+    atomic_store(&_allocatedBytes, 0);
+    double start = Bench_now();
+    Model* model = load(path, cacheFolder);
+    seconds[run] = Bench_now() - start;
+    if (model == null) {
+      free(seconds);
+      return false;
+    }
+    result->allocations = atomic_load(&_allocations);
+    result->allocatedBytes = atomic_load(&_allocatedBytes);
+    double peak = getPeakMegabytes();
+    if (peak > result->peakMegabytes) result->peakMegabytes = peak;
+    result->faces = model->numOfFaces;
+    result->bytes = model->fileSize;
+    result->arenaUsed = model->arena->used;
+    result->arenaReserved = model->arena->reserved;
+    if (cacheFolder != null && model->cache == null)
+      result->loader = "ply, cache not written";
+    Model_free(model);
+  }
+  qsort(seconds, runs, sizeof(double), compareSeconds);
+  result->best = seconds[0];
+  result->median = runs % 2 == 1
+                       ? seconds[runs / 2]
+                       : (seconds[runs / 2 - 1] + seconds[runs / 2]) / 2;
+  free(seconds);
+  return true;
+}
+
+static void printResult(const LoadResult* result) {
+  double megabytes = result->bytes / (1024.0 * 1024.0);
+  String allocations =
+      IS_COUNTING_ALLOCATIONS
+          ? $(_(result->allocations), " allocations of ",
+              _(result->allocatedBytes / (1024.0 * 1024.0), 2), " MB")
+          : $("allocations not counted");
+  print("  ", result->loader, ": best ", _(result->best * 1000, 2),
+        " ms, median ", _(result->median * 1000, 2), " ms, ",
+        _(megabytes / result->median, 1), " MB/s, ",
+        _(result->faces / result->median / 1e6, 2), " M faces/s, peak ",
+        _(result->peakMegabytes, 1), " MB, ", allocations, ", arena ",
+        _(result->arenaUsed / 1024.0, 1), " of ",
+        _(result->arenaReserved / 1024.0, 1), " KB used");
+  free(allocations);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Results                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Write the results as a JSON array, an object per line so
+ * a baseline can be read back line by line.
+ */
+static bool writeResults(const char* path, LoadResult* results, int count) {
+  FILE* file = fopen(path, "w");
+  if (file == null) return false;
+  fprintf(file, "[\n");
+  for (int next = 0; next < count; next++) {
+    LoadResult* result = &results[next];
+    double megabytes = result->bytes / (1024.0 * 1024.0);
+    fprintf(file,
+            "  {\"name\": \"%s\", \"loader\": \"%s\", \"faces\": %ld, "
+            "\"bytes\": %zu, \"runs\": %d, \"best_ms\": %.4f, "
+            "\"median_ms\": %.4f, \"mb_per_s\": %.3f, \"faces_per_s\": %.0f, "
+            "\"peak_rss_mb\": %.2f, \"allocations\": %ld, "
+            "\"allocated_bytes\": %zu}%s\n",
+            result->name, result->loader, result->faces, result->bytes,
+            result->runs, result->best * 1000, result->median * 1000,
+            megabytes / result->median, result->faces / result->median,
+            result->peakMegabytes,
+            IS_COUNTING_ALLOCATIONS ? result->allocations : -1,
+            result->allocatedBytes, next + 1 < count ? "," : "");
+  }
+  fprintf(file, "]\n");
+  return fclose(file) == 0;
+}
+
+/**
+ * Get a string field of a result line.
+ * @return allocated value, or null if absent.
+ */
+static String getText(const char* line, const char* field) {
+  String key = $("\"", field, "\": \"");
+  const char* at = strstr(line, key);
+  size_t length = strlen(key);
+  free(key);
+  if (at == null) return null;
+  at += length;
+  const char* end = strchr(at, '"');
+  if (end == null) return null;
+  String value = $(at);
+  value[end - at] = '\0';
+  return value;
+}
+
+static double getNumber(const char* line, const char* field) {
+  String key = $("\"", field, "\": ");
+  const char* at = strstr(line, key);
+  size_t length = strlen(key);
+  free(key);
+  return at != null ? strtod(at + length, null) : -1;
+}
+
+/**
+ * Compare the medians with a baseline written by --json.
+ * @param tolerance in percents slower before it fails.
+ * @return the number of regressions.
+ */
+static int compareBaseline(const char* path, LoadResult* results, int count,
+                           double tolerance) {
+  FILE* file = fopen(path, "r");
+  if (file == null) {
+    print("Could not read the baseline ", path);
+    return 1;
+  }
+  print("Against ", path, " (", _(tolerance, 0), "% tolerance):");
+  int regressions = 0;
+  char line[4096];
+  while (fgets(line, sizeof(line), file) != null) {
+    String name = getText(line, "name");
+    String loader = getText(line, "loader");
+    double baseline = getNumber(line, "median_ms");
+    for (int next = 0; name != null && loader != null && next < count; next++) {
+      LoadResult* result = &results[next];
+      if (!isStringEqual(result->name, name) ||
+          !isStringEqual(result->loader, loader) || baseline <= 0)
+        continue;
+      double change = (result->median * 1000 / baseline - 1) * 100;
+      bool isSlower = change > tolerance;
+      regressions += isSlower;
+      print("  ", name, " ", loader, ": ", _(result->median * 1000, 2),
+            " ms, was ", _(baseline, 2), " ms, ", change >= 0 ? "+" : "",
+            _(change, 1), "%", isSlower ? " REGRESSION" : "");
+    }
+    dispose(name, loader);
+  }
+  fclose(file);
+  return regressions;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Main                                    */
+/* -------------------------------------------------------------------------- */
+
+int main(int argc, char** argv) {
+  const char* runsOption = Bench_getOption(argc, argv, "--runs");
+  const char* toleranceOption = Bench_getOption(argc, argv, "--tolerance");
+  const char* jsonPath = Bench_getOption(argc, argv, "--json");
+  const char* baselinePath = Bench_getOption(argc, argv, "--baseline");
+  int runs = runsOption != null ? atoi(runsOption) : RUNS;
+  if (runs < 1) runs = 1;
+  double tolerance =
+      toleranceOption != null ? atof(toleranceOption) : TOLERANCE;
+
+  // Paths to load, with the names they are reported under.
+  Array* paths = Bench_getFiles(argc, argv);
+  Array* names = new_Array(free);
+  for_in(next, paths) Array_add(names, $(paths->at[next]));
+  int assetCount = paths->length;
+  long largest = Bench_hasFlag(argc, argv, "--quick") ? 1000000 : 10000000;
+  for (long faces = 10000; faces <= largest; faces *= 10) {
+    String path = Bench_writeSyntheticPly(faces, false);
+    if (path == null) continue;
+    Array_add(paths, path);
+    Array_add(names, $("synthetic-", _(faces)));
+  }
+
+  const char* folder = getenv("TMPDIR") != null ? getenv("TMPDIR") : "/tmp";
+  String cacheFolder = $(folder, "/bench_load_caches");
+  mkdir(cacheFolder, 0777);
+
+  if (!IS_COUNTING_ALLOCATIONS)
+    print("Allocations are counted with glibc only.");
+  if (!resetPeakMemory())
+    print("The peak memory is of the whole process, it can not be reset.");
+  LoadResult* results = malloc(sizeof(LoadResult) * paths->length * 2);
+  int count = 0;
+  for_in(next, paths) {
+    String path = paths->at[next];
+    print((String)names->at[next]);
+    for (int loader = 0; loader < 2; loader++) {
+      if (!measure(path, names->at[next], loader == 0 ? null : cacheFolder,
+                   runs, &results[count])) {
+        print("  could not load ", path);
+        break;
+      }
+      printResult(&results[count++]);
+    }
+    // Remove the cache, and the synthetic files which are large.
+    setenv("MODEL_CACHE", "on", 1);
+    String cachePath = ModelCache_getPath(path);
+    if (cachePath != null) remove(cachePath);
+    free(cachePath);
+    if (next >= assetCount) remove(path);
+  }
+  rmdir(cacheFolder);
+
+  int status = 0;
+  if (jsonPath != null && !writeResults(jsonPath, results, count)) {
+    print("Could not write ", jsonPath);
+    status = 1;
+  }
+  if (baselinePath != null &&
+      compareBaseline(baselinePath, results, count, tolerance) > 0)
+    status = 1;
+
+  for (int next = 0; next < count; next++) free(results[next].name);
+  free(results);
+  free(cacheFolder);
+  Array_free(paths);
+  Array_free(names);
+  return status;
+}
@@ -0,0 +1,96 @@
+/**
+ * Throughput of the level of detail simplifier and the
+ * error of each level, in model units and in pixels seen
+ * from the camera of the program, on 1 thread and on all
+ * the cores.
+ * Usage: bench-lod [files...] [--large]
+ */
+
+#include <math.h>
+
+#include "bench.h"
+#include "mesh_lod.h"
+#include "model.h"
+#include "parallel.h"
+
+// Height of the window of the program.
+#define VIEWPORT_HEIGHT 500
+
+/**
+ * Set the matrices of the program camera, gluPerspective(40,
+ * 1, 20, 100) and gluLookAt(0, 8, 60, 0, 8, 0, 0, 1, 0).
+ * @param distance from the eye to the model, 60 in the program.
+ */
+static void getCamera(float projection[16], float modelview[16],
+                      float distance) {
+  memset(projection, 0, sizeof(float) * 16);
+  memset(modelview, 0, sizeof(float) * 16);
+  float focal = 1 / tan(20 * M_PI / 180);
+  projection[0] = projection[5] = focal;
+  projection[10] = -120.0 / 80;
+  projection[11] = -1;
+  projection[14] = -2 * 100.0 * 20 / 80;
+  modelview[0] = modelview[5] = modelview[10] = modelview[15] = 1;
+  modelview[13] = -8;
+  modelview[14] = -distance;
+}
+
+static void run(String path) {
+  Model* model = new_Model(path);
+  if (model == null || model->hasError) {
+    print("Could not load ", path);
+    Model_free(model);
+    return;
+  }
+  print(path, " (", _(model->numOfFaces), " faces)");
+
+  MeshLod* lod = null;
+  double single = 0;
+  int cores = Parallel_getThreadCount();
+  for (int threads = 1; threads <= cores; threads = threads == cores ? cores + 1
+                                                                     : cores) {
+    Parallel_setThreadCount(threads);
+    MeshLod_free(lod);
+    lod = new_MeshLod(model->faces, model->triangles, model->renderVertices,
+                      model->colors, model->vertices->count);
+    if (threads == 1) single = lod->seconds;
+    print("  ", _(threads), " threads: ", _(lod->seconds * 1000, 2), " ms, ",
+          _(lod->levels[0].triangleCount / lod->seconds / 1e6, 2),
+          " M triangles/s, ", _(lod->collapses), " collapses, speedup ",
+          _(single / lod->seconds, 2), "x");
+  }
+  Parallel_setThreadCount(0);
+
+  float projection[16], modelview[16];
+  getCamera(projection, modelview, 60);
+  for (int level = 0; level < lod->levelCount; level++) {
+    // The pixels of a level error at the distance of the program.
+    float pixels = lod->levels[level].error * projection[5] *
+                   VIEWPORT_HEIGHT / 2 / (60 - lod->radius);
+    print("  level ", _(level), ": ", _(lod->levels[level].triangleCount),
+          " triangles, error ", _(lod->levels[level].error, 5), " (",
+          _(pixels, 3), " px)");
+  }
+  for (int distance = 60; distance <= 480; distance *= 2) {
+    float pixelError;
+    getCamera(projection, modelview, distance);
+    int level = MeshLod_select(lod, projection, modelview, VIEWPORT_HEIGHT, 1,
+                               &pixelError);
+    print("  at ", _(distance), " units: level ", _(level), ", ",
+          _(lod->levels[level].triangleCount), " triangles, ",
+          _(pixelError, 3), " px");
+  }
+  MeshLod_free(lod);
+  Model_free(model);
+}
+
+int main(int argc, char** argv) {
+  Array* files = Bench_getFiles(argc, argv);
+  if (Bench_hasFlag(argc, argv, "--large")) {
+    String path = Bench_writeSyntheticPly(1000000, false);
+    if (path != null) Array_add(files, path);
+  }
+  for_in(next, files) run(files->at[next]);
+  Array_free(files);
+  return 0;
+}
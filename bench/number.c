@@ -0,0 +1,237 @@
+/**
+ * Microbenchmark of the PLY number parser against the
+ * atof path it replaces, and a check that it is bit-exact
+ * with strtod and strtof.
+ * Usage: bench-number [files...]
+ */
+
+#include <math.h>
+
+#include "bench.h"
+#include "mapped_file.h"
+#include "ply_number.h"
+#include "ply_scanner.h"
+#include "splitter.h"
+
+// Minimum time spent on each measure.
+#define MIN_SECONDS 0.25
+
+typedef struct {
+  const char* body;
+  size_t length;
+  long tokens;
+} Body;
+
+static Body getBody(MappedFile* file) {
+  PlyScanner scanner = PlyScanner_of(file->data, file->length);
+  PlyToken token;
+  while (!PlyScanner_isDone(&scanner)) {
+    bool isEnd = PlyScanner_nextToken(&scanner, &token) &&
+                 PlyToken_isEqual(token, "end_header");
+    PlyScanner_nextLine(&scanner);
+    if (isEnd) break;
+  }
+  Body body = {.body = scanner.at, .length = scanner.end - scanner.at};
+  while (!PlyScanner_isDone(&scanner)) {
+    while (PlyScanner_nextToken(&scanner, &token)) body.tokens++;
+    PlyScanner_nextLine(&scanner);
+  }
+  return body;
+}
+
+/**
+ * The path of the original loader: a copy of each line,
+ * a Splitter over it and atof on every token.
+ */
+static double runAtof(Body* body) {
+  double sum = 0;
+  char line[1024];
+  const char* at = body->body;
+  const char* end = at + body->length;
+  while (at < end) {
+    const char* newLine = memchr(at, '\n', end - at);
+    size_t length = (newLine == null ? end : newLine) - at;
+    if (length >= sizeof(line)) length = sizeof(line) - 1;
+    memcpy(line, at, length);
+    line[length] = '\0';
+    Splitter* split = new_Splitter(line, " ");
+    for (unsigned int next = 0; next < split->length; next++)
+      sum += atof(split->at[next]);
+    Splitter_free(split);
+    at = newLine == null ? end : newLine + 1;
+  }
+  return sum;
+}
+
+/**
+ * Zero-copy tokens with strtod on a stack copy.
+ */
+static double runStrtod(Body* body) {
+  double sum = 0;
+  PlyToken token;
+  PlyScanner scanner = PlyScanner_of(body->body, body->length);
+  while (!PlyScanner_isDone(&scanner)) {
+    while (PlyScanner_nextToken(&scanner, &token))
+      sum += PlyToken_toDouble(token);
+    PlyScanner_nextLine(&scanner);
+  }
+  return sum;
+}
+
+static double runPlyNumber(Body* body) {
+  double sum = 0;
+  PlyScanner scanner = PlyScanner_of(body->body, body->length);
+  while (!PlyScanner_isDone(&scanner)) {
+    while (PlyScanner_skipSpaces(&scanner)) {
+      float value;
+      scanner.at = PlyNumber_parseFloat(scanner.at, scanner.end, &value);
+      sum += value;
+    }
+    PlyScanner_nextLine(&scanner);
+  }
+  return sum;
+}
+
+static void measure(const char* name, double (*run)(Body*), Body* body,
+                    double* reference) {
+  long runs = 0;
+  double sum = 0;
+  double start = Bench_now();
+  do {
+    sum = run(body);
+    runs++;
+  } while (Bench_now() - start < MIN_SECONDS);
+  double seconds = (Bench_now() - start) / runs;
+  if (*reference == 0) *reference = seconds;
+  print("  ", name, ": ", _(seconds * 1e9 / body->tokens, 1), " ns/token, ",
+        _(body->length / (1024.0 * 1024.0) / seconds, 1), " MB/s, ",
+        _(*reference / seconds, 2), "x (checksum ", _(sum, 3), ")");
+}
+
+/**
+ * Compare one token with the C library, bit for bit.
+ * @return the number of mismatches, 0 to 2.
+ */
+static int checkToken(const char* token) {
+  size_t length = strlen(token);
+  double expectedDouble = strtod(token, null), actualDouble;
+  float expectedFloat = strtof(token, null), actualFloat;
+  PlyNumber_parseDouble(token, token + length, &actualDouble);
+  PlyNumber_parseFloat(token, token + length, &actualFloat);
+  int mismatches = 0;
+  if (memcmp(&expectedDouble, &actualDouble, sizeof(double)) != 0) {
+    print("  float64 mismatch on ", token);
+    mismatches++;
+  }
+  if (memcmp(&expectedFloat, &actualFloat, sizeof(float)) != 0) {
+    print("  float32 mismatch on ", token);
+    mismatches++;
+  }
+  return mismatches;
+}
+
+static int checkBody(Body* body) {
+  int mismatches = 0;
+  PlyToken token;
+  PlyScanner scanner = PlyScanner_of(body->body, body->length);
+  while (!PlyScanner_isDone(&scanner)) {
+    while (PlyScanner_nextToken(&scanner, &token)) {
+      char* buffer = malloc(token.length + 1);
+      memcpy(buffer, token.start, token.length);
+      buffer[token.length] = '\0';
+      mismatches += checkToken(buffer);
+      free(buffer);
+    }
+    PlyScanner_nextLine(&scanner);
+  }
+  return mismatches;
+}
+
+/**
+ * Random doubles and floats printed at full precision,
+ * short decimals and some exponents and odd spellings.
+ */
+static int checkRandom(long count) {
+  int mismatches = 0;
+  char buffer[128];
+  unsigned long long seed = 88172645463325252ull;
+  for (long next = 0; next < count; next++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    double real;
+    uint64_t bits = seed;
+    memcpy(&real, &bits, sizeof(real));
+    if (!isfinite(real)) real = (double)(seed >> 11) / 3.0;
+    switch (next % 6) {
+      case 0:
+        snprintf(buffer, sizeof(buffer), "%.17g", real);
+        break;
+      case 1:
+        snprintf(buffer, sizeof(buffer), "%.9g", (float)((seed >> 40) / 7.0));
+        break;
+      case 2:
+        snprintf(buffer, sizeof(buffer), "%.6f", (int64_t)seed / 1e15);
+        break;
+      case 3:
+        snprintf(buffer, sizeof(buffer), "%de%d", (int)(seed % 100000),
+                 (int)(seed >> 32) % 40 - 20);
+        break;
+      case 4:
+        snprintf(buffer, sizeof(buffer), "-%llu.%llu",
+                 (seed >> 20) % 100000000ull, seed % 1000000000000ull);
+        break;
+      default:
+        snprintf(buffer, sizeof(buffer), "%.*g", (int)(seed % 25) + 1,
+                 (double)(seed % 1000003) * 1e-5);
+    }
+    mismatches += checkToken(buffer);
+  }
+  const char* special[] = {"0", "-0", "1.", ".5", "1e", "nan", "-inf", "1e400",
+                           "4.9e-324", "2.2250738585072011e-308",
+                           "9007199254740993", "0.1000000000000000055511",
+                           "3.4028235e38", "1.17549435e-38", "0x1p3", "+7",
+                           "00000000000000000000001.5", "1e-45"};
+  for (size_t next = 0; next < GET_ARRAY_SIZE(special); next++)
+    mismatches += checkToken(special[next]);
+
+  // Tokens longer than the stack copy of the fallback.
+  char longToken[512];
+  memset(longToken, '0', sizeof(longToken));
+  longToken[0] = '1';
+  strcpy(&longToken[300], "e-300");
+  mismatches += checkToken(longToken);
+  memcpy(longToken, "0.", 2);
+  memset(&longToken[2], '3', 297);
+  strcpy(&longToken[299], "9");
+  mismatches += checkToken(longToken);
+  return mismatches;
+}
+
+int main(int argc, char** argv) {
+  Array* files = Bench_getFiles(argc, argv);
+  if (argc < 2 || isStringEqual(argv[1], "")) {
+    Array_free(files);
+    files = new_Array(free);
+    Array_add(files, $("./assets/cow.ply"));
+    Array_add(files, $("./assets/fracttree.ply"));
+  }
+
+  for_in(next, files) {
+    MappedFile* file = new_MappedFile(files->at[next]);
+    if (file == null) continue;
+    Body body = getBody(file);
+    print(files->at[next], ": ", _(body.tokens), " tokens, ",
+          _(checkBody(&body)), " mismatches with strtod and strtof");
+    double reference = 0;
+    measure("atof + Splitter", runAtof, &body, &reference);
+    measure("strtod on views", runStrtod, &body, &reference);
+    measure("PlyNumber      ", runPlyNumber, &body, &reference);
+    MappedFile_free(file);
+  }
+
+  print("Random tokens: ", _(checkRandom(2000000)),
+        " mismatches with strtod and strtof");
+  Array_free(files);
+  return 0;
+}
@@ -0,0 +1,110 @@
+/**
+ * Vertex cache reuse of the faces in the order of the file,
+ * shuffled, and after reordering, as the ACMR and the ATVR
+ * of a FIFO cache, with the time the reordering takes.
+ * Each reordered mesh is checked to hold the same faces.
+ * Usage: bench-order [files...] [--large]
+ */
+
+#include "bench.h"
+#include "mesh_order.h"
+#include "model.h"
+
+/**
+ * Hash the faces of a mesh, whatever their order, as the
+ * vertices they had before a remap.
+ * @param inverse old index of each new vertex, or null if not remapped.
+ */
+static uint64_t getFaceHash(const FaceBuffer* faces, const uint32_t* inverse) {
+  uint64_t hash = 0;
+  for (int face = 0; face < faces->count; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    uint64_t faceHash = count;
+    for (uint32_t corner = 0; corner < count; corner++) {
+      uint32_t vertex = inverse != null ? inverse[corners[corner]]
+                                        : corners[corner];
+      faceHash = (faceHash ^ vertex) * 0x9E3779B97F4A7C15ull;
+      faceHash ^= faceHash >> 29;
+    }
+    hash += faceHash;
+  }
+  return hash;
+}
+
+/**
+ * Shuffle the faces with a fixed seed, like an exporter
+ * that writes them in no useful order.
+ */
+static FaceBuffer* newShuffledFaces(const FaceBuffer* faces) {
+  uint32_t* order = malloc(sizeof(uint32_t) * (faces->count + 1));
+  for (int face = 0; face < faces->count; face++) order[face] = face;
+  unsigned int seed = 1;
+  for (int face = faces->count - 1; face > 0; face--) {
+    seed = seed * 1103515245u + 12345u;
+    int other = (int)(((uint64_t)seed << 15 ^ seed >> 16) % (face + 1));
+    uint32_t swapped = order[face];
+    order[face] = order[other];
+    order[other] = swapped;
+  }
+  uint32_t* offsets = malloc(sizeof(uint32_t) * (faces->count + 1));
+  offsets[0] = 0;
+  for (int face = 0; face < faces->count; face++)
+    offsets[face + 1] =
+        offsets[face] + FaceBuffer_getCornerCount(faces, order[face]);
+  FaceBuffer* shuffled = new_FaceBuffer(faces->count, offsets);
+  for (int face = 0; face < faces->count; face++)
+    memcpy(&shuffled->indices[offsets[face]],
+           FaceBuffer_getCorners(faces, order[face]),
+           sizeof(uint32_t) * FaceBuffer_getCornerCount(faces, order[face]));
+  dispose(order, offsets);
+  return shuffled;
+}
+
+static void runOrder(const char* name, FaceBuffer* faces, int vertexCount) {
+  uint64_t hash = getFaceHash(faces, null);
+  uint32_t* remap = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  MeshOrder order = MeshOrder_optimize(faces, vertexCount, remap);
+  uint32_t* inverse = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    inverse[remap[vertex]] = vertex;
+  bool isSame = getFaceHash(faces, inverse) == hash;
+  print("  ", name, ": ACMR ", _(order.before.acmr, 3), " to ",
+        _(order.after.acmr, 3), ", ATVR ", _(order.before.atvr, 3), " to ",
+        _(order.after.atvr, 3), " in ", _(order.seconds * 1000, 2), " ms (",
+        _(faces->count / order.seconds / 1e6, 2), " M faces/s), ",
+        isSame ? "same faces" : "FACES DIFFER");
+  dispose(remap, inverse);
+}
+
+static void run(String path) {
+  Model* model = new_Model(path);
+  if (model == null || model->hasError || model->faces == null) {
+    print("Could not load ", path);
+    Model_free(model);
+    return;
+  }
+  print(path, " (", _(model->numOfFaces), " faces)");
+  int vertexCount = model->vertices->count;
+  FaceBuffer* faces = new_FaceBufferCopy(model->faces);
+  runOrder("file order", faces, vertexCount);
+  FaceBuffer_free(faces);
+  faces = newShuffledFaces(model->faces);
+  runOrder("shuffled", faces, vertexCount);
+  FaceBuffer_free(faces);
+  Model_free(model);
+}
+
+int main(int argc, char** argv) {
+  // Measure the faces as the files have them.
+  setenv("MODEL_CACHE", "off", 1);
+  MeshOrder_setDefaultMode(MESH_ORDER_OFF);
+  Array* files = Bench_getFiles(argc, argv);
+  if (Bench_hasFlag(argc, argv, "--large")) {
+    String path = Bench_writeSyntheticPly(1000000, false);
+    if (path != null) Array_add(files, path);
+  }
+  for_in(next, files) run(files->at[next]);
+  Array_free(files);
+  return 0;
+}
@@ -0,0 +1,400 @@
+/**
+ * Frame time of the immediate and the buffered render
+ * paths, on a headless EGL context such as Mesa llvmpipe,
+ * so it runs on a Linux box without a GPU or a display.
+ * Each frame is the lit pass and the flattened shadow
+ * pass, the same two draws as the program makes. Then
+ * the projected shadow alone, drawn from the mesh under
+ * the shadow matrix and from its outline. Last the whole
+ * frame from GL against the software renderer, on more
+ * and more threads. Then zoomed in, with and without
+ * culling the faces outside the view frustum, and zoomed
+ * out, with and without the levels of detail.
+ * Usage: bench-render [files...] [--large]
+ */
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+
+#include "bench.h"
+#include "frame_stats.h"
+#include "model.h"
+#include "model_renderer.h"
+#include "model_shadow.h"
+#include "parallel.h"
+#include "software_renderer.h"
+
+// Size of the offscreen frame.
+#define WIDTH 500
+#define HEIGHT 500
+
+// Frames drawn per measure.
+#define FRAMES 20
+
+// Frames drawn per measure of the software renderer.
+#define SOFTWARE_FRAMES 5
+
+// Most threads the software renderer is measured on.
+#define MAX_THREADS 8
+
+/**
+ * Make a desktop GL context current with an offscreen
+ * frame buffer to draw into.
+ * @return false if no EGL display or context is available.
+ */
+static bool createContext() {
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+          "eglGetPlatformDisplayEXT");
+  EGLDisplay display =
+      getPlatformDisplay != null
+          ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                               EGL_DEFAULT_DISPLAY, null)
+          : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, null, null))
+    return false;
+  eglBindAPI(EGL_OPENGL_API);
+  EGLint attributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+  EGLConfig config;
+  EGLint configCount = 0;
+  eglChooseConfig(display, attributes, &config, 1, &configCount);
+  EGLContext context = eglCreateContext(
+      display, configCount > 0 ? config : null, EGL_NO_CONTEXT, null);
+  if (context == EGL_NO_CONTEXT ||
+      !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    return false;
+
+  GLuint frame, color, depth;
+  glGenFramebuffers(1, &frame);
+  glBindFramebuffer(GL_FRAMEBUFFER, frame);
+  glGenRenderbuffers(1, &color);
+  glBindRenderbuffer(GL_RENDERBUFFER, color);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, WIDTH, HEIGHT);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                            GL_RENDERBUFFER, color);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, WIDTH, HEIGHT);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+  print("Renderer: ", (char*)glGetString(GL_RENDERER));
+  return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+// Light of the program and the floor at y = 0.
+static const GLfloat LIGHT_POSITION[] = {12, 20, 0, 0};
+static const GLfloat FLOOR_PLANE[] = {0, 1, 0, 0};
+
+/**
+ * Set the camera and the light of the program.
+ */
+static void setupScene() {
+  GLfloat lightColor[] = {1, 0.3, 0.3, 1.0};
+  glViewport(0, 0, WIDTH, HEIGHT);
+  glEnable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+  glMatrixMode(GL_PROJECTION);
+  glLoadIdentity();
+  glFrustum(-20 * 0.36397, 20 * 0.36397, -20 * 0.36397, 20 * 0.36397, 20,
+            100);  // gluPerspective(40, 1, 20, 100)
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  glTranslatef(0, -8, -60);  // gluLookAt(0, 8, 60, 0, 8, 0, 0, 1, 0)
+  glRotatef(30, 1, 0, 0);
+  glRotatef(-150, 0, 1, 0);
+  glLightfv(GL_LIGHT0, GL_DIFFUSE, lightColor);
+  glLightfv(GL_LIGHT0, GL_POSITION, LIGHT_POSITION);
+  glEnable(GL_LIGHT0);
+  glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+}
+
+/**
+ * Draw frames with the lit and the shadow pass.
+ * @param pixels to be filled with the last frame.
+ * @return milliseconds per frame.
+ */
+static double drawFrames(ModelRenderer* renderer, unsigned char* pixels) {
+  // The first frame uploads the buffers, keep it out of the measure.
+  double start = 0;
+  for (int frame = 0; frame <= FRAMES; frame++) {
+    if (frame == 1) start = Bench_now();
+    glClearColor(1, 1, 1, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glEnable(GL_LIGHTING);
+    ModelRenderer_draw(renderer, false);
+    glDisable(GL_LIGHTING);
+    glPushMatrix();
+    glScalef(1, 0.001, 1);  // Flattened onto the floor like the shadow.
+    ModelRenderer_draw(renderer, true);
+    glPopMatrix();
+    glFinish();
+  }
+  double seconds = Bench_now() - start;
+  glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  return seconds * 1000 / FRAMES;
+}
+
+/**
+ * Draw frames of the shadow alone, blending every pixel
+ * once like the program does.
+ * @param shadow to draw from its outline, or null to draw
+ * the mesh under the shadow matrix.
+ * @return milliseconds per frame.
+ */
+static double drawShadows(ModelRenderer* renderer, ModelShadow* shadow,
+                          unsigned char* pixels) {
+  GLfloat matrix[16];
+  ModelShadow_getMatrix(matrix, FLOOR_PLANE, LIGHT_POSITION);
+  glDisable(GL_LIGHTING);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(-2.0, -1.0);
+  double start = 0;
+  for (int frame = 0; frame <= FRAMES; frame++) {
+    if (frame == 1) start = Bench_now();
+    glClearColor(1, 1, 1, 1);
+    glClearStencil(0);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glColor3f(0.3, 0.3, 0.3);  // As the shadow pass of the mesh.
+    if (shadow != null) {
+      ModelShadow_update(shadow, matrix, FLOOR_PLANE);
+      ModelShadow_draw(shadow);
+    } else {
+      glEnable(GL_STENCIL_TEST);
+      glStencilFunc(GL_EQUAL, 0, ~0u);
+      glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+      glPushMatrix();
+      glMultMatrixf(matrix);
+      ModelRenderer_draw(renderer, true);
+      glPopMatrix();
+      glDisable(GL_STENCIL_TEST);
+    }
+    glFinish();
+  }
+  double seconds = Bench_now() - start;
+  glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glDisable(GL_BLEND);
+  return seconds * 1000 / FRAMES;
+}
+
+/**
+ * Count the pixels that differ between two frames.
+ */
+static size_t countDifferent(const unsigned char* first,
+                             const unsigned char* second, size_t bytes) {
+  size_t different = 0;
+  for (size_t pixel = 0; pixel < bytes; pixel += 4)
+    if (memcmp(&first[pixel], &second[pixel], 4)) different++;
+  return different;
+}
+
+/**
+ * Draw the frame of the program with GL, the lit model and
+ * then its shadow from the outline.
+ */
+static void drawScene(ModelRenderer* renderer, ModelShadow* shadow,
+                      unsigned char* pixels) {
+  glClearColor(1, 1, 1, 1);
+  glClearStencil(0);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  glEnable(GL_LIGHTING);
+  ModelRenderer_draw(renderer, false);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_COLOR_MATERIAL);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(-2.0, -1.0);
+  glColor3f(0.3, 0.3, 0.3);
+  ModelShadow_draw(shadow);
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glDisable(GL_BLEND);
+  glFinish();
+  glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+/**
+ * Compare the software renderer with GL and time it.
+ */
+static void runSoftware(Model* model, ModelRenderer* renderer,
+                        ModelShadow* shadow, unsigned char* pixels) {
+  drawScene(renderer, shadow, pixels);
+  SoftwareScene scene = SoftwareScene_getDefault();
+  memcpy(scene.lightPosition, LIGHT_POSITION, sizeof(scene.lightPosition));
+  memcpy(scene.floorPlane, FLOOR_PLANE, sizeof(scene.floorPlane));
+  SoftwareRenderer* software = new_SoftwareRenderer(model, WIDTH, HEIGHT);
+  SoftwareRenderer_draw(software, &scene);
+
+  size_t bytes = WIDTH * HEIGHT * 4, different = 0, far = 0;
+  int most = 0;
+  for (size_t pixel = 0; pixel < bytes; pixel += 4) {
+    int difference = 0;
+    for (int channel = 0; channel < 3; channel++) {
+      int channelDifference = abs(pixels[pixel + channel] -
+                                  software->color[pixel + channel]);
+      if (channelDifference > difference) difference = channelDifference;
+    }
+    if (difference > 0) different++;
+    if (difference > 2) far++;
+    if (difference > most) most = difference;
+  }
+  print("  software: ", _(different), " pixels differ from GL, ", _(far),
+        " by more than 2, at most by ", _(most));
+
+  double single = 0;
+  for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+    Parallel_setThreadCount(threads);
+    double start = Bench_now();
+    for (int frame = 0; frame < SOFTWARE_FRAMES; frame++)
+      SoftwareRenderer_draw(software, &scene);
+    double milliseconds = (Bench_now() - start) * 1000 / SOFTWARE_FRAMES;
+    if (threads == 1) single = milliseconds;
+    print("  software on ", _(threads), " threads: ", _(milliseconds, 2),
+          " ms/frame, speedup ", _(single / milliseconds, 2), "x");
+  }
+  Parallel_setThreadCount(0);
+  SoftwareRenderer_free(software);
+}
+
+/**
+ * Time the buffered frames zoomed in four times, where
+ * most of the model is out of view, with and without
+ * culling the clusters outside the frustum.
+ */
+static void runCulling(ModelRenderer* renderer, unsigned char* wholePixels,
+                       unsigned char* culledPixels) {
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glFrustum(-5 * 0.36397, 5 * 0.36397, -5 * 0.36397, 5 * 0.36397, 20, 100);
+  glMatrixMode(GL_MODELVIEW);
+  renderer->isCulled = false;
+  double whole = drawFrames(renderer, wholePixels);
+  renderer->isCulled = true;
+  double culled = drawFrames(renderer, culledPixels);
+  FrameStats_begin();
+  ModelRenderer_draw(renderer, false);
+  FrameStats_end();
+  const FrameSample* sample = FrameStats_getLast();
+  print("  zoomed 4x: ", _(whole, 2), " ms/frame, culled ", _(culled, 2),
+        " ms/frame, speedup ", _(whole / culled, 2), "x, ",
+        _(sample->faces), " faces drawn, ", _(sample->culledFaces),
+        " culled, ", _(countDifferent(wholePixels, culledPixels,
+                                      WIDTH * HEIGHT * 4)),
+        " pixels differ");
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+/**
+ * Time the buffered frames zoomed out four times, where
+ * the model is small on the screen, with every face and
+ * with the level of detail picked for a pixel of error.
+ */
+static void runLod(Model* model, ModelRenderer* renderer,
+                   unsigned char* wholePixels, unsigned char* lodPixels) {
+  MeshLod* lod = new_MeshLod(model->faces, model->triangles,
+                             model->renderVertices, model->colors,
+                             model->vertices->count);
+  renderer->lod = lod;
+  renderer->lodPixels = 1;
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glFrustum(-80 * 0.36397, 80 * 0.36397, -80 * 0.36397, 80 * 0.36397, 20,
+            100);
+  glMatrixMode(GL_MODELVIEW);
+  double whole = drawFrames(renderer, wholePixels);
+  atomic_store(&renderer->isLodBuilt, true);
+  double simplified = drawFrames(renderer, lodPixels);
+  FrameStats_begin();
+  ModelRenderer_draw(renderer, false);
+  FrameStats_end();
+  const FrameSample* sample = FrameStats_getLast();
+  print("  zoomed out 4x: ", _(whole, 2), " ms/frame, level ",
+        _(sample->lodLevel), " ", _(simplified, 2), " ms/frame, speedup ",
+        _(whole / simplified, 2), "x, ", _(sample->faces), " faces, ",
+        _(sample->lodError, 3), " px error, ",
+        _(countDifferent(wholePixels, lodPixels, WIDTH * HEIGHT * 4)),
+        " pixels differ");
+  print("  simplified in ", _(lod->seconds * 1000, 2), " ms, ",
+        _(lod->levels[0].triangleCount / lod->seconds / 1e6, 2),
+        " M triangles/s");
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+static void run(String path) {
+  Model* model = new_Model(path);
+  if (model == null || model->hasError) {
+    print("Could not load ", path);
+    return;
+  }
+  print(path, " (", _(model->numOfFaces), " faces)");
+  size_t bytes = WIDTH * HEIGHT * 4;
+  unsigned char* immediatePixels = malloc(bytes);
+  unsigned char* bufferedPixels = malloc(bytes);
+
+  ModelRenderer* renderer = new_ModelRenderer(model);
+  renderer->lodPixels = 0;  // Built in runLod(), not in the background.
+  renderer->mode = RENDER_IMMEDIATE;
+  double immediate = drawFrames(renderer, immediatePixels);
+  renderer->mode = RENDER_BUFFERED;
+  double buffered = drawFrames(renderer, bufferedPixels);
+
+  size_t different = countDifferent(immediatePixels, bufferedPixels, bytes);
+  size_t covered = 0;
+  for (size_t pixel = 0; pixel < bytes; pixel += 4)
+    if (bufferedPixels[pixel] != 255 || bufferedPixels[pixel + 1] != 255 ||
+        bufferedPixels[pixel + 2] != 255)
+      covered++;
+  print("  immediate: ", _(immediate, 2), " ms/frame, ", _(covered),
+        " pixels covered");
+  print("  buffered:  ", _(buffered, 2), " ms/frame, speedup ",
+        _(immediate / buffered, 2), "x, ", _(different), " pixels differ");
+
+  // The mesh shadow goes in the immediate frame, the outline
+  // shadow in the buffered one.
+  double mesh = drawShadows(renderer, null, immediatePixels);
+  ModelShadow* shadow = new_ModelShadow(model);
+  double start = Bench_now();
+  GLfloat matrix[16];
+  ModelShadow_getMatrix(matrix, FLOOR_PLANE, LIGHT_POSITION);
+  ModelShadow_update(shadow, matrix, FLOOR_PLANE);
+  double build = Bench_now() - start;
+  double outline = drawShadows(renderer, shadow, bufferedPixels);
+  print("  shadow mesh:    ", _(mesh, 2), " ms/frame");
+  print("  shadow outline: ", _(outline, 2), " ms/frame, speedup ",
+        _(mesh / outline, 2), "x, ", _(shadow->triangleCount), " triangles, ",
+        _(build * 1000, 2), " ms to build, ",
+        _(countDifferent(immediatePixels, bufferedPixels, bytes)),
+        " pixels differ");
+  runSoftware(model, renderer, shadow, immediatePixels);
+  runCulling(renderer, immediatePixels, bufferedPixels);
+  runLod(model, renderer, immediatePixels, bufferedPixels);
+  ModelShadow_free(shadow);
+  ModelRenderer_free(renderer);
+  dispose(immediatePixels, bufferedPixels);
+}
+
+int main(int argc, char** argv) {
+  if (!createContext()) {
+    print("No headless GL context, is EGL with Mesa installed?");
+    return 1;
+  }
+  setupScene();
+  Array* files = Bench_getFiles(argc, argv);
+  if (Bench_hasFlag(argc, argv, "--large")) {
+    String path = Bench_writeSyntheticPly(1000000, false);
+    if (path != null) Array_add(files, path);
+  }
+  for_in(next, files) run(files->at[next]);
+  Array_free(files);
+  return 0;
+}
@@ -0,0 +1,78 @@
+/**
+ * Scaling of the chunked ascii decoder over the thread
+ * count, on the bundled assets and on synthetic grids.
+ * Usage: bench-threads [files...] [--large]
+ */
+
+#include "bench.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "ply.h"
+
+// Runs of each measure, the best one is kept.
+#define REPEAT 3
+
+/**
+ * Decode a mapped file into a new schema.
+ * @param seconds to be set with the decode time.
+ */
+static PlySchema* decode(MappedFile* file, double* seconds) {
+  double start = Bench_now();
+  PlyScanner scanner = PlyScanner_of(file->data, file->length);
+  PlySchema* schema = new_PlySchema(&scanner);
+  if (schema != null) PlySchema_decode(schema, &scanner);
+  *seconds = Bench_now() - start;
+  return schema;
+}
+
+static void run(String path) {
+  MappedFile* file = new_MappedFile(path);
+  if (file == null) {
+    print("Could not open ", path);
+    return;
+  }
+  double megabytes = file->length / (1024.0 * 1024.0);
+  print(path, " (", _(megabytes, 2), " MB)");
+
+  PlySchema* reference = null;
+  double baseline = 0;
+  int cores = Parallel_getThreadCount();
+  for (int threads = 1; threads <= 16; threads *= 2) {
+    Parallel_setThreadCount(threads);
+    double best = 1e30;
+    PlySchema* schema = null;
+    for (int run = 0; run < REPEAT; run++) {
+      double seconds;
+      PlySchema_free(schema);
+      schema = decode(file, &seconds);
+      if (seconds < best) best = seconds;
+    }
+    if (reference == null) {
+      reference = schema;
+      baseline = best;
+      schema = null;
+    }
+    bool isSame = schema == null || Bench_isSameSchema(reference, schema);
+    print("  threads ", _(threads), ": ", _(best * 1000, 2), " ms, ",
+          _(megabytes / best, 1), " MB/s, speedup ", _(baseline / best, 2),
+          "x, ", isSame ? "identical" : "DIFFERENT");
+    PlySchema_free(schema);
+    if (threads >= cores && threads >= 4) break;
+  }
+  PlySchema_free(reference);
+  Parallel_setThreadCount(0);
+  MappedFile_free(file);
+}
+
+int main(int argc, char** argv) {
+  Array* files = Bench_getFiles(argc, argv);
+  Array_add(files, Bench_writeSyntheticPly(100000, false));
+  Array_add(files, Bench_writeSyntheticPly(1000000, false));
+  if (Bench_hasFlag(argc, argv, "--large"))
+    Array_add(files, Bench_writeSyntheticPly(10000000, false));
+
+  print("Cores: ", _(Parallel_getThreadCount()));
+  for_in(next, files) run(files->at[next]);
+  Array_free(files);
+  return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * Throughput of the welding cleanup on 1 thread and on all
+ * the cores, over each file as it is and split into a
+ * triangle soup, every face with its own corners and every
+ * tenth face repeated, as some exporters write them.
+ * Usage: bench-weld [files...] [--large]
+ */
+
+#include <math.h>
+
+#include "bench.h"
+#include "mesh_weld.h"
+#include "model.h"
+#include "parallel.h"
+
+/**
+ * Give every corner of the faces its own vertex, and
+ * repeat every tenth face.
+ */
+static void newSoup(const Model* model, VertexBuffer** vertices,
+                    FaceBuffer** faces) {
+  const FaceBuffer* source = model->faces;
+  int repeats = (source->count + 9) / 10;
+  uint32_t* offsets = malloc(sizeof(uint32_t) * (source->count + repeats + 1));
+  offsets[0] = 0;
+  for (int face = 0; face < source->count + repeats; face++) {
+    int from = face < source->count ? face : (face - source->count) * 10;
+    offsets[face + 1] = offsets[face] + FaceBuffer_getCornerCount(source, from);
+  }
+  *faces = new_FaceBuffer(source->count + repeats, offsets);
+  *vertices = new_VertexBuffer((int)source->length, model->vertices->layout,
+                               model->vertices->precision);
+  for (size_t corner = 0; corner < source->length; corner++) {
+    (*faces)->indices[corner] = corner;
+    for (int axis = 0; axis < 3; axis++)
+      VertexBuffer_set(*vertices, corner, axis,
+                       VertexBuffer_get(model->vertices,
+                                        source->indices[corner], axis));
+  }
+  for (int face = source->count; face < source->count + repeats; face++)
+    memcpy(&(*faces)->indices[offsets[face]],
+           &(*faces)->indices[FaceBuffer_getStart(*faces,
+                                                  (face - source->count) * 10)],
+           sizeof(uint32_t) * FaceBuffer_getCornerCount(*faces, face));
+  free(offsets);
+}
+
+static void runWeld(const char* name, const Model* model, bool isSoup) {
+  double diagonal = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    double size = model->stats.max[axis] - model->stats.min[axis];
+    diagonal += size * size;
+  }
+  double distance = WELD_DISTANCE * sqrt(diagonal);
+  double single = 0;
+  int cores = Parallel_getThreadCount();
+  for (int threads = 1; threads <= cores; threads = threads == cores ? cores + 1
+                                                                     : cores) {
+    Parallel_setThreadCount(threads);
+    VertexBuffer* vertices;
+    FaceBuffer* faces;
+    if (isSoup) {
+      newSoup(model, &vertices, &faces);
+    } else {
+      vertices = new_VertexBuffer(model->vertices->count,
+                                  model->vertices->layout,
+                                  model->vertices->precision);
+      memcpy(vertices->data, model->vertices->data, model->vertices->bytes);
+      faces = new_FaceBufferCopy(model->faces);
+    }
+    VertexBuffer* oldVertices = vertices;
+    FaceBuffer* oldFaces = faces;
+    float* normals = null;
+    float* colors = null;
+    MeshWeld weld =
+        MeshWeld_apply(&vertices, &faces, &normals, &colors, distance);
+    VertexBuffer_free(oldVertices);
+    FaceBuffer_free(oldFaces);
+    if (threads == 1) single = weld.seconds;
+    print("  ", name, ", ", _(threads), " threads: ",
+          _(weld.vertexCount), " to ", _(vertices->count), " vertices, ",
+          _(weld.faceCount), " to ", _(faces->count), " faces (",
+          _(weld.degenerateFaces), " degenerate, ", _(weld.duplicateFaces),
+          " duplicate), ", _(weld.savedBytes / 1024.0, 1), " KB saved, ",
+          _(weld.seconds * 1000, 2), " ms, ",
+          _(weld.vertexCount / weld.seconds / 1e6, 2),
+          " M vertices/s, speedup ", _(single / weld.seconds, 2), "x");
+    VertexBuffer_free(vertices);
+    FaceBuffer_free(faces);
+  }
+  Parallel_setThreadCount(0);
+}
+
+static void run(String path) {
+  Model* model = new_Model(path);
+  if (model == null || model->hasError || model->faces == null) {
+    print("Could not load ", path);
+    Model_free(model);
+    return;
+  }
+  print(path, " (", _(model->numOfFaces), " faces)");
+  runWeld("as is", model, false);
+  runWeld("soup", model, true);
+  Model_free(model);
+}
+
+int main(int argc, char** argv) {
+  // Weld the faces as the files have them.
+  setenv("MODEL_CACHE", "off", 1);
+  MeshWeld_setDefaultDistance(-1);
+  Array* files = Bench_getFiles(argc, argv);
+  if (Bench_hasFlag(argc, argv, "--large")) {
+    String path = Bench_writeSyntheticPly(1000000, false);
+    if (path != null) Array_add(files, path);
+  }
+  for_in(next, files) run(files->at[next]);
+  Array_free(files);
+  return 0;
+}
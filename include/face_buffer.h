@@ -0,0 +1,119 @@
+#ifndef FACE_BUFFER_H
+#define FACE_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "dynamic_string.h"
+
+/**
+ * Faces as one flat index buffer. The corners of face f
+ * are indices[offsets[f]] up to indices[offsets[f + 1]].
+ * When every face has the same number of corners, such
+ * as an all-triangle or all-quad mesh, the offsets are
+ * dropped and face f starts at f * arity.
+ */
+typedef struct {
+  int count;          // Number of faces.
+  uint32_t arity;     // Corners of every face, 0 if they differ.
+  uint32_t* offsets;  // count + 1 starts, null when arity is set.
+  uint32_t* indices;  // Vertex index of every corner.
+  size_t length;      // Number of indices.
+  bool isOwned;       // False when the buffers live in a mapping or an arena.
+} FaceBuffer;
+
+/**
+ * Create a face buffer for the given face sizes. The
+ * indices are allocated but left for the caller to fill.
+ * @param count of faces.
+ * @param offsets count + 1 starts of each face, copied.
+ * @return the face buffer.
+ */
+FaceBuffer* new_FaceBuffer(int count, const uint32_t* offsets);
+
+/**
+ * Find the number of corners shared by every face.
+ * @param count of faces.
+ * @param offsets count + 1 starts of each face.
+ * @return the arity, or 0 if the faces differ.
+ */
+uint32_t FaceBuffer_findArity(int count, const uint32_t* offsets);
+
+/**
+ * Wrap buffers owned by someone else in a face buffer held
+ * by value, such as in an arena.
+ * @param count of faces.
+ * @param arity of every face, or 0 to use the offsets.
+ * @param offsets count + 1 starts, ignored when arity is set.
+ * @param indices of every corner.
+ * @return the face buffer, with nothing to free.
+ */
+FaceBuffer FaceBuffer_of(int count, uint32_t arity, uint32_t* offsets,
+                         uint32_t* indices);
+
+/**
+ * Wrap buffers owned by someone else, such as a mapped
+ * cache. They are not freed with the face buffer.
+ * @param count of faces.
+ * @param arity of every face, or 0 to use the offsets.
+ * @param offsets count + 1 starts, ignored when arity is set.
+ * @param indices of every corner.
+ * @return the face buffer.
+ */
+FaceBuffer* new_FaceBufferOf(int count, uint32_t arity, uint32_t* offsets,
+                             uint32_t* indices);
+
+/**
+ * Copy the buffers of a face buffer, which the copy owns.
+ * @param faces to be copied.
+ * @return the face buffer.
+ */
+FaceBuffer* new_FaceBufferCopy(const FaceBuffer* faces);
+
+/**
+ * Free the face buffer and the buffers it owns.
+ * @param self of the face buffer.
+ */
+void FaceBuffer_free(FaceBuffer* self);
+
+/**
+ * Format a face as "count i j k", the same as a face line.
+ * @param self of the face buffer.
+ * @param face index.
+ * @return allocated string.
+ */
+String FaceBuffer_toString(FaceBuffer* self, int face);
+
+/**
+ * Get where the corners of a face start in the indices.
+ * @param self of the face buffer.
+ * @param face index.
+ */
+static inline uint32_t FaceBuffer_getStart(const FaceBuffer* this, int face) {
+  return this->arity != 0 ? (uint32_t)face * this->arity : this->offsets[face];
+}
+
+/**
+ * Get the number of corners of a face.
+ * @param self of the face buffer.
+ * @param face index.
+ */
+static inline uint32_t FaceBuffer_getCornerCount(const FaceBuffer* this,
+                                                 int face) {
+  if (this->arity != 0) return this->arity;
+  return this->offsets[face + 1] - this->offsets[face];
+}
+
+/**
+ * Get the vertex indices of the corners of a face.
+ * @param self of the face buffer.
+ * @param face index.
+ */
+static inline const uint32_t* FaceBuffer_getCorners(const FaceBuffer* this,
+                                                    int face) {
+  return &this->indices[FaceBuffer_getStart(this, face)];
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Frames kept for the rolling statistics.
+#define FRAME_STATS_WINDOW 240
+
+/**
+ * Run a GL call that changes the pipeline state and count
+ * it, as FRAME_STATE(glEnable(GL_BLEND)).
+ */
+#define FRAME_STATE(call) ((call), FrameStats_countStates(1))
+
+/**
+ * Parts of a frame, in the order they are drawn.
+ */
+typedef enum {
+  FRAME_CLEAR,
+  FRAME_FLOOR,
+  FRAME_MODEL,
+  FRAME_SHADOW,
+  FRAME_OVERLAY,
+  FRAME_SWAP,
+  FRAME_PHASE_COUNT
+} FramePhase;
+
+/**
+ * What one frame took and submitted.
+ */
+typedef struct {
+  long index;
+  double time;                        // Seconds since the first frame.
+  double phases[FRAME_PHASE_COUNT];  // Milliseconds of each phase.
+  double total;                       // Milliseconds of the frame.
+  int drawCalls;
+  long vertices, faces;  // Submitted, faces being primitives.
+  long culledFaces;      // Left out, outside the view frustum.
+  int lodLevel;          // Of the model, 0 for every face.
+  double lodError;       // Pixels the level may be off by.
+  int stateChanges;
+  double p50, p95, p99;  // Of the total over the rolling window.
+} FrameSample;
+
+/**
+ * Start timing a frame. The first call opens the file set
+ * by $MODEL_STATS, CSV or JSON lines by its extension,
+ * which gets a line per frame.
+ */
+void FrameStats_begin();
+
+/**
+ * End the phase being timed, if any, and start another.
+ * @param phase to time until the next or the frame ends.
+ */
+void FrameStats_beginPhase(FramePhase phase);
+
+/**
+ * End the frame, update the rolling statistics and write
+ * its line to the file.
+ */
+void FrameStats_end();
+
+/**
+ * Count a draw call of the current frame.
+ * @param vertices submitted, indices for indexed draws.
+ * @param faces drawn, as triangles, quads or polygons.
+ */
+void FrameStats_countDraw(long vertices, long faces);
+
+/**
+ * Count faces of the current frame that were not drawn
+ * for being outside the view frustum.
+ * @param faces left out, in the primitives of the draw.
+ */
+void FrameStats_countCulled(long faces);
+
+/**
+ * Set the level of detail the model is drawn with in the
+ * current frame.
+ * @param level of detail, 0 for every face.
+ * @param pixelError of the level projected on the screen.
+ */
+void FrameStats_setLod(int level, double pixelError);
+
+/**
+ * Count GL state changes of the current frame, see
+ * FRAME_STATE().
+ * @param count of the changes.
+ */
+void FrameStats_countStates(int count);
+
+/**
+ * Get the last frame that ended.
+ * @return the sample, zeroed before the first frame.
+ */
+const FrameSample* FrameStats_getLast();
+
+/**
+ * Get the mean of a phase over the rolling window.
+ * @param phase to average.
+ * @return milliseconds.
+ */
+double FrameStats_getMean(FramePhase phase);
+
+/**
+ * Check if $MODEL_STATS_SYNC asks to wait for the GPU at
+ * the end of each phase, so the times include its work
+ * and not only the submission.
+ * @return true to call glFinish() before each phase.
+ */
+bool FrameStats_isSynced();
+
+/**
+ * Write the last frame as lines of text for an overlay.
+ * @param text to be filled, null terminated.
+ * @param size of the text.
+ */
+void FrameStats_format(char* text, size_t size);
+
+#endif
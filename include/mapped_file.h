@@ -0,0 +1,30 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dynamic_string.h"
+
+typedef struct {
+  const char* data;
+  size_t length;
+  bool isMapped;  // False for an empty file, which has nothing to map.
+} MappedFile;
+
+/**
+ * Map a whole file read-only into memory. The bytes are
+ * not copied and are not null terminated, so always use
+ * the length to bound any scanning.
+ * @param filePath of the file to be mapped.
+ * @return the mapped file, or null if it could not be opened.
+ */
+MappedFile* new_MappedFile(String filePath);
+
+/**
+ * Unmap the file and free the object.
+ * @param self of the mapped file object.
+ */
+void MappedFile_free(MappedFile* self);
+
+#endif
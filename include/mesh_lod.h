@@ -0,0 +1,90 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "face_buffer.h"
+#include "mesh_triangles.h"
+
+// Most levels of detail, the full mesh included.
+#define LOD_MAX_LEVELS 12
+
+// The coarsest level keeps at least these triangles.
+#define LOD_MIN_TRIANGLES 256
+
+// Pixels the error of a level may cover on the screen.
+#define LOD_PIXELS 1.0
+
+// Weight of the planes that hold the boundary edges in place.
+#define LOD_BOUNDARY_WEIGHT 10.0
+
+// Weight of the squared color difference of a collapse, per
+// squared length of its edge.
+#define LOD_COLOR_WEIGHT 1.0
+
+/**
+ * A level of detail, triangles over the vertices of the
+ * full mesh.
+ */
+typedef struct {
+  uint32_t* indices;  // Three vertex indices per triangle, null for level 0.
+  int triangleCount;
+  float error;  // Farthest the surface may have moved, in model units.
+} LodLevel;
+
+/**
+ * A chain of simplified meshes, each about half the
+ * triangles of the one before. Edges are collapsed into
+ * one of their vertices by quadric error metric, so the
+ * levels share the positions, normals and colors of the
+ * full mesh and only differ in their triangles.
+ */
+typedef struct {
+  LodLevel levels[LOD_MAX_LEVELS];  // Level 0 is the full mesh.
+  int levelCount;
+  float center[3], radius;  // Bounding sphere of the mesh.
+  long collapses;           // Edges collapsed over every level.
+  double seconds;           // Wall time spent simplifying.
+} MeshLod;
+
+/**
+ * Simplify the triangles of a mesh into levels of detail.
+ * The edge costs of each pass are found on all the
+ * threads, then the cheapest collapses that do not touch
+ * each other are made. Boundary edges only collapse along
+ * the boundary, and collapses that would flip a triangle
+ * are left out.
+ * @param faces of the mesh.
+ * @param triangles the faces were cut into.
+ * @param positions xyz per vertex.
+ * @param colors rgb per vertex, kept apart by the cost, or null.
+ * @param vertexCount of the positions.
+ * @return the levels.
+ */
+MeshLod* new_MeshLod(const FaceBuffer* faces, const MeshTriangles* triangles,
+                     const float* positions, const float* colors,
+                     int vertexCount);
+
+/**
+ * Free the levels.
+ * @param self of the levels.
+ */
+void MeshLod_free(MeshLod* self);
+
+/**
+ * Pick the coarsest level whose error stays under some
+ * pixels on the screen.
+ * @param self of the levels.
+ * @param projection matrix, column major as from glGetFloatv().
+ * @param modelview matrix, column major.
+ * @param viewportHeight in pixels.
+ * @param pixels the error may cover.
+ * @param pixelError to be set to the projected error of the level.
+ * @return the level, 0 for the full mesh.
+ */
+int MeshLod_select(const MeshLod* self, const float projection[16],
+                   const float modelview[16], int viewportHeight, float pixels,
+                   float* pixelError);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef MESH_NORMALS_H
+#define MESH_NORMALS_H
+
+#include <stdbool.h>
+
+#include "face_buffer.h"
+#include "vertex_buffer.h"
+
+/**
+ * Normals generated from the faces. Each vertex normal is
+ * the weighted sum of the normals of its faces, gathered
+ * per vertex through a vertex to corner adjacency so no
+ * two threads ever write the same normal.
+ */
+typedef enum {
+  NORMALS_AREA_WEIGHTED,   // Larger faces count more.
+  NORMALS_ANGLE_WEIGHTED,  // Faces count by their angle at the vertex.
+} NormalWeighting;
+
+typedef struct {
+  NormalWeighting weighting;
+  double creaseAngle;  // Degrees, 0 for smooth normals only.
+  bool isFlipped;      // For meshes wound clockwise.
+} MeshNormalsOptions;
+
+typedef struct {
+  float* vertices;  // Unit xyz per vertex.
+  float* corners;   // Unit xyz per face corner, null without a crease angle.
+} MeshNormals;
+
+/**
+ * Get the options for new models, from $MODEL_NORMALS
+ * ("area" or "angle", area by default) and
+ * $MODEL_CREASE_ANGLE in degrees.
+ */
+MeshNormalsOptions MeshNormals_getDefaultOptions();
+
+/**
+ * Generate the normals on all the threads, into buffers
+ * the caller provides. With a crease angle the normal of
+ * each face corner only gathers the faces within that
+ * angle of its own face, which splits the shading along
+ * hard edges.
+ * @param vertices of the mesh.
+ * @param faces of the mesh, every index must be in range.
+ * @param options of the normals.
+ * @param normals with room for xyz per vertex, and per
+ * face corner with a crease angle. Either can be null to
+ * skip it.
+ */
+void MeshNormals_generate(const VertexBuffer* vertices,
+                          const FaceBuffer* faces, MeshNormalsOptions options,
+                          MeshNormals* normals);
+
+/**
+ * Find the unit normal of each face of a run, on this
+ * thread, in the winding of the faces.
+ * @param vertices of the mesh.
+ * @param faces of the mesh, the run must be indexed.
+ * @param first face of the run.
+ * @param last face after the run.
+ * @param normals xyz per face, the run is written.
+ */
+void MeshNormals_ofFaces(const VertexBuffer* vertices, const FaceBuffer* faces,
+                         int first, int last, float* normals);
+
+#endif
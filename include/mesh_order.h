@@ -0,0 +1,101 @@
+#ifndef MESH_ORDER_H
+#define MESH_ORDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "face_buffer.h"
+#include "vertex_buffer.h"
+
+// Entries of the vertex cache the faces are ordered for.
+#define MESH_ORDER_CACHE_SIZE 32
+
+// Entries of the FIFO cache the reuse is measured with.
+#define MESH_ORDER_FIFO_SIZE 16
+
+/**
+ * When the faces and the vertices of a model are reordered.
+ */
+typedef enum {
+  MESH_ORDER_OFF,    // Kept in the order of the file.
+  MESH_ORDER_LOAD,   // Reordered once parsed, and cached that way.
+  MESH_ORDER_CACHE,  // Drawn as parsed, but cached reordered.
+} MeshOrderMode;
+
+/**
+ * How well a face order reuses the post-transform vertex
+ * cache. Polygons count as the triangles they fan into.
+ */
+typedef struct {
+  double acmr;  // Vertices transformed per triangle, 0.5 at best.
+  double atvr;  // Vertices transformed per vertex used, 1 at best.
+} MeshCacheStats;
+
+/**
+ * The outcome of a reordering.
+ */
+typedef struct {
+  MeshCacheStats before, after;
+  double seconds;  // Wall time spent reordering.
+  bool isReordered;
+} MeshOrder;
+
+/**
+ * Set when new models are reordered.
+ * @param mode of the reordering.
+ */
+void MeshOrder_setDefaultMode(MeshOrderMode mode);
+
+/**
+ * Get when new models are reordered, $MODEL_REORDER
+ * ("off", "load" or "cache") unless set, otherwise off.
+ */
+MeshOrderMode MeshOrder_getDefaultMode();
+
+/**
+ * Simulate a FIFO vertex cache of MESH_ORDER_FIFO_SIZE
+ * entries over the faces in order.
+ * @param faces of the mesh.
+ * @param vertexCount the faces index.
+ * @return the reuse of the cache.
+ */
+MeshCacheStats MeshOrder_measure(const FaceBuffer* faces, int vertexCount);
+
+/**
+ * Reorder the faces for the vertex cache, greedily taking
+ * the face whose corners score best in an LRU cache of
+ * MESH_ORDER_CACHE_SIZE entries, after Forsyth. Then number
+ * the vertices in the order the faces first use them, so
+ * they are fetched front to back. Unused vertices go last.
+ * @param faces of the mesh, reordered and renumbered in place.
+ * @param vertexCount the faces index.
+ * @param remap to be filled with the new index of each vertex.
+ * @return the reuse before and after.
+ */
+MeshOrder MeshOrder_optimize(FaceBuffer* faces, int vertexCount,
+                             uint32_t* remap);
+
+/**
+ * Copy values of a fixed size with every vertex moved to
+ * its new index.
+ * @param values one per vertex, or null to do nothing.
+ * @param size of a value in bytes.
+ * @param remap from MeshOrder_optimize().
+ * @param vertexCount of the values.
+ * @param moved room for the values, not overlapping them.
+ */
+void MeshOrder_remap(const void* values, size_t size, const uint32_t* remap,
+                     int vertexCount, void* moved);
+
+/**
+ * Copy positions with every vertex moved to its new index.
+ * @param vertices to be copied, in any layout.
+ * @param remap from MeshOrder_optimize().
+ * @param moved vertex buffer of the same count, in any
+ * layout and precision.
+ */
+void MeshOrder_remapVertices(const VertexBuffer* vertices,
+                             const uint32_t* remap, VertexBuffer* moved);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef MESH_STATS_H
+#define MESH_STATS_H
+
+#include <stdint.h>
+
+#include "face_buffer.h"
+#include "vertex_buffer.h"
+
+/**
+ * Statistics of a mesh, found in one parallel sweep over
+ * the vertex and the face buffers. Polygons are fanned
+ * into triangles from their first corner for the area and
+ * the volume.
+ */
+typedef struct {
+  double min[3], max[3];  // Axis aligned bounding box, 0 if empty.
+  double centroid[3];     // Mean of the vertex positions.
+  double area;            // Total surface area.
+  double volume;          // Signed, positive for outward wound faces.
+  uint32_t minIndex;      // Smallest vertex index used by a face.
+  uint32_t maxIndex;      // Largest vertex index used by a face.
+} MeshStats;
+
+/**
+ * Compute the statistics of a mesh on all the threads.
+ * Faces with an index out of range are left out of the
+ * area and the volume but still count for the index range.
+ * @param vertices of the mesh, may be null.
+ * @param faces of the mesh, may be null.
+ * @return the statistics.
+ */
+MeshStats MeshStats_of(const VertexBuffer* vertices, const FaceBuffer* faces);
+
+#endif
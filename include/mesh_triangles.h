@@ -0,0 +1,113 @@
+#ifndef MESH_TRIANGLES_H
+#define MESH_TRIANGLES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "face_buffer.h"
+#include "vertex_buffer.h"
+
+/**
+ * Every face of a mesh cut into triangles once, as one
+ * stream. Convex faces are fanned from their first corner
+ * and concave ones are ear clipped in their plane, so a
+ * face of n corners always gives n - 2 triangles in its
+ * winding. The triangles hold corners, the positions in
+ * the face indices, so attributes per corner still apply.
+ * The triangles of face f are faceStart(f) up to
+ * faceStart(f + 1), in the order of the faces.
+ */
+typedef struct {
+  int count;             // Triangles.
+  uint32_t arity;        // Corners of every face, 0 if they differ.
+  uint32_t* corners;     // Three per triangle, null if every face is one.
+  uint32_t* faceStarts;  // First triangle of each face, count + 1, or null.
+  int clippedCount;      // Concave faces that were ear clipped.
+  bool isOwned;          // False when the corners live elsewhere.
+} MeshTriangles;
+
+/**
+ * Cut the faces into triangles on all the threads.
+ * @param faces of the mesh.
+ * @param vertices the faces index.
+ * @return the triangles.
+ */
+MeshTriangles* new_MeshTriangles(const FaceBuffer* faces,
+                                 const VertexBuffer* vertices);
+
+/**
+ * Make room for the triangles of the faces, which are cut
+ * in runs with MeshTriangles_cut() as the faces arrive.
+ * Only the face offsets are read.
+ * @param faces to be cut.
+ * @return the triangles, with the corners still unset.
+ */
+MeshTriangles* new_MeshTrianglesUncut(const FaceBuffer* faces);
+
+/**
+ * Cut a run of faces into their triangles on all the
+ * threads. Runs that do not overlap can be cut in any
+ * order.
+ * @param self of the triangles, made for the faces.
+ * @param faces of the mesh, with the run indexed.
+ * @param vertices the faces index.
+ * @param first face of the run.
+ * @param last face after the run.
+ */
+void MeshTriangles_cut(MeshTriangles* self, const FaceBuffer* faces,
+                       const VertexBuffer* vertices, int first, int last);
+
+/**
+ * Wrap corners cut before, such as from a cache. They are
+ * not freed with the triangles.
+ * @param faces the corners were cut from.
+ * @param corners three per triangle, null if every face is a triangle.
+ * @return the triangles.
+ */
+MeshTriangles* new_MeshTrianglesOf(const FaceBuffer* faces, uint32_t* corners);
+
+/**
+ * Make the triangles of the faces held by value, around
+ * buffers owned by someone else, such as an arena. Only
+ * the face offsets are read.
+ * @param faces to be cut.
+ * @param faceStarts room for the face count plus one, only
+ * used when the faces differ in size.
+ * @param corners cut before, or room for three per
+ * triangle to cut with MeshTriangles_cut(), which can be
+ * set once the count is known. Ignored when every face is
+ * a triangle.
+ * @return the triangles, with nothing to free.
+ */
+MeshTriangles MeshTriangles_of(const FaceBuffer* faces, uint32_t* faceStarts,
+                               uint32_t* corners);
+
+/**
+ * Free the triangles and the corners they own.
+ * @param self of the triangles.
+ */
+void MeshTriangles_free(MeshTriangles* self);
+
+/**
+ * Get the first triangle of a face.
+ * @param self of the triangles.
+ * @param face index, up to the face count for the end.
+ */
+static inline uint32_t MeshTriangles_getFaceStart(const MeshTriangles* this,
+                                                  int face) {
+  if (this->faceStarts != null) return this->faceStarts[face];
+  return this->arity >= 3 ? (uint32_t)face * (this->arity - 2) : 0;
+}
+
+/**
+ * Get a corner of the triangles, three per triangle.
+ * @param self of the triangles.
+ * @param at index of the corner.
+ * @return the position in the face indices.
+ */
+static inline uint32_t MeshTriangles_getCorner(const MeshTriangles* this,
+                                               uint32_t at) {
+  return this->corners != null ? this->corners[at] : at;
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef MESH_WELD_H
+#define MESH_WELD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "face_buffer.h"
+#include "vertex_buffer.h"
+
+// Distance vertices are welded within, of the bounding box diagonal.
+#define WELD_DISTANCE 1e-6
+
+// Cosine of the most the normals of welded vertices may differ.
+#define WELD_NORMAL_COSINE 0.999
+
+// Most a color channel of welded vertices may differ.
+#define WELD_COLOR_TOLERANCE (1.0 / 512)
+
+/**
+ * What a cleanup removed.
+ */
+typedef struct {
+  int vertexCount, faceCount;  // Before the cleanup.
+  int weldedVertices;          // Merged into another vertex.
+  int degenerateFaces;  // With under 3 distinct corners or no area.
+  int duplicateFaces;   // Same corners in the same winding as another.
+  long savedTriangles;  // Of the faces fanned into triangles.
+  size_t savedBytes;    // Of the positions, attributes and indices.
+  double seconds;       // Wall time spent cleaning.
+  bool isWelded;
+} MeshWeld;
+
+/**
+ * Set the distance new models are welded within.
+ * @param distance of the bounding box diagonal, below 0 to not weld.
+ */
+void MeshWeld_setDefaultDistance(float distance);
+
+/**
+ * Get the distance new models are welded within,
+ * $MODEL_WELD unless set, "on" for WELD_DISTANCE or a
+ * fraction of the bounding box diagonal. Off by default.
+ * @return the fraction, or -1 to not weld.
+ */
+float MeshWeld_getDefaultDistance();
+
+/**
+ * Merge the vertices within a distance of each other whose
+ * normals and colors also match, found in a spatial hash
+ * grid on all the threads. Each vertex goes into the first
+ * vertex it matches. Then the faces are remapped, repeated
+ * corners are dropped, and the faces left with under 3
+ * corners or no area, and the repeats of a face, are
+ * removed. The old buffers are left to the caller.
+ * @param vertices to be replaced by the welded ones.
+ * @param faces to be replaced by the cleaned ones.
+ * @param normals xyz per vertex to be replaced, or null.
+ * @param colors rgb per vertex to be replaced, or null.
+ * @param distance in model units.
+ * @return what was removed.
+ */
+MeshWeld MeshWeld_apply(VertexBuffer** vertices, FaceBuffer** faces,
+                        float** normals, float** colors, double distance);
+
+#endif
@@ -1,20 +1,58 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <pthread.h>
+#include <stdatomic.h>
+
 #include "array_map.h"
 #include "dynamic_string.h"
-#include "file_reader.h"
+#include "face_buffer.h"
+#include "mapped_file.h"
+#include "mesh_normals.h"
+#include "mesh_order.h"
+#include "mesh_weld.h"
+#include "mesh_stats.h"
+#include "mesh_triangles.h"
+#include "model_arena.h"
+#include "model_cache.h"
+#include "model_transform.h"
+#include "ply.h"
+#include "ply_scanner.h"
 #include "point.h"
 #include "splitter.h"
+#include "vertex_buffer.h"
 
 typedef struct {
+  ModelArena* arena;  // The model and every buffer it built live in it.
   String fileName;
-  int numOfVertices, numOfFaces;
-  double *maxX, *maxY, *maxZ;
-  double *minX, *minY, *minZ;
-  Array* faceList;  // Array of  splits.
-  Array* vertices;  // Array of points.
+  int numOfVertices, numOfFaces;  // Of the model as drawn, once welded.
+  FaceBuffer* faces;       // Vertex indices of every face.
+  VertexBuffer* vertices;  // Position of every vertex.
+  MappedFile* cache;  // The .plyc the model was loaded from, or null.
+  float* normals;     // xyz per vertex, from the file or generated.
+  float* colors;      // rgb in [0, 1] per vertex from the file, null if absent.
+  float* cornerNormals;  // xyz per face corner with a crease angle.
+  float* faceNormals;    // xyz per face, lighting it while the faces stream
+                         // in without normals, null otherwise.
+  MeshTriangles* triangles;  // The faces cut into triangles to draw.
+  bool hasGeneratedNormals;
+  MeshNormalsOptions normalOptions;  // Of the generated normals.
+  MeshStats stats;           // Bounds, centroid, area and volume.
+  MeshOrder order;           // Vertex cache reuse, once reordered.
+  MeshWeld weld;             // What the cleanup removed, once welded.
+  ModelTransform transform;  // Fits the model in the scene.
+  float* renderVertices;     // Transformed xyz per vertex.
   bool hasError;
+  size_t fileSize;     // Bytes of the source file.
+  double loadSeconds;  // Wall time spent loading.
+  size_t bodyBytes;    // Bytes of the file after the header.
+  int sourceFaces;     // Faces of the file, before any are welded.
+  atomic_int loadedFaces;  // Faces ready to draw, all once prepared.
+  atomic_int builtFaces;   // Faces converted, for the progress.
+  atomic_size_t decodedBytes;  // Bytes of the body decoded, for the progress.
+  atomic_bool isLoading;   // True while a loader thread runs.
+  pthread_t loader;
+  bool hasLoader;
 } Model;
 
 /**
@@ -28,18 +66,81 @@ Model* Model_parsedData;
 void Model_parseModel(int argc, char** argv);
 
 /**
- * Create a new empty model.
+ * Parse the model data on a background thread. The model
+ * is printed once loaded. A failure is left for the main
+ * thread to find with Model_exitIfFailed().
+ */
+void Model_parseModelAsync(int argc, char** argv);
+
+/**
+ * Report that the model could not be parsed and exit, if
+ * it is done loading and failed. Call it on the thread
+ * that draws the model.
+ * @param self of the model object, null if out of memory.
+ */
+void Model_exitIfFailed(Model* self);
+
+/**
+ * Create a new empty model in an arena of its own.
+ * @return the model, or null if out of memory.
  */
 Model* __new_Model();
 
 /**
  * Create a new model object.
  * @param filePath to be parsed.
+ * @return the model, which has an error if it did not
+ * load, or null if out of memory.
  */
 Model* new_Model(String filePath);
 
 /**
- * Destroy and free the model.
+ * Create a new model object that loads on a background
+ * thread. The header is parsed before it returns, so the
+ * counts are known. When the faces are kept as parsed,
+ * they become drawable in batches, lit by faceNormals
+ * if the file has no normals, see
+ * Model_getLoadedFaceCount().
+ * @param filePath to be parsed.
+ * @param onLoaded called on the loader thread when
+ * done, with null if out of memory, can be null.
+ * @return the model, or null if out of memory.
+ */
+Model* new_ModelAsync(String filePath, void (*onLoaded)(Model*));
+
+/**
+ * Wait for a background load to finish.
+ * @param self of the model object.
+ */
+void Model_waitLoaded(Model* self);
+
+/**
+ * Get the number of faces that can be drawn. While the
+ * model loads the faces below this count are complete,
+ * along with every buffer the draw loop reads. It only
+ * reaches the face count once the model is prepared, its
+ * normals and stats final.
+ * @param self of the model object.
+ */
+int Model_getLoadedFaceCount(Model* self);
+
+/**
+ * Get how much of the model is loaded.
+ * @param self of the model object.
+ * @return from 0 to 1.
+ */
+double Model_getLoadProgress(Model* self);
+
+/**
+ * Get the load throughput of the model.
+ * @param self of the model object.
+ * @return megabytes of the source file parsed per second.
+ */
+double Model_loadThroughput(Model* self);
+
+/**
+ * Free the model with its arena, which holds every buffer
+ * it built, at once, and unmap its cache.
  * @param self of the model object.
  */
 void Model_free(Model* self);
@@ -0,0 +1,62 @@
+#ifndef MODEL_ARENA_H
+#define MODEL_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dynamic_string.h"
+
+// Bytes every allocation of an arena is aligned to.
+#define MODEL_ARENA_ALIGN 64
+
+// Bytes of the blocks the small allocations share.
+#define MODEL_ARENA_BLOCK 4096
+
+typedef struct ModelArenaBlock ModelArenaBlock;
+
+/**
+ * A region the parts of a model are allocated from. The
+ * small ones share blocks, each large one gets a block of
+ * its own, and nothing is freed until the whole arena is.
+ * One thread allocates at a time.
+ */
+typedef struct {
+  ModelArenaBlock* blocks;  // The one the small allocations use first.
+  size_t blockSize;         // Of the blocks the small allocations share.
+  size_t reserved;          // Bytes of every block.
+  size_t used;              // Bytes handed out, with the alignment.
+  int blockCount;
+} ModelArena;
+
+/**
+ * Create an arena, which lives in its own first block.
+ * @param blockSize of the blocks the small allocations share.
+ * @return the arena, or null if out of memory.
+ */
+ModelArena* new_ModelArena(size_t blockSize);
+
+/**
+ * Allocate from the arena, aligned to MODEL_ARENA_ALIGN.
+ * @param self of the arena.
+ * @param bytes to allocate.
+ * @return the memory, freed with the arena, or null if out
+ * of memory.
+ */
+void* ModelArena_alloc(ModelArena* self, size_t bytes);
+
+/**
+ * Copy a string into the arena.
+ * @param self of the arena.
+ * @param text to be copied.
+ * @return the copy, freed with the arena, or null if out
+ * of memory.
+ */
+String ModelArena_copyString(ModelArena* self, const char* text);
+
+/**
+ * Free every block of the arena, and the arena with them.
+ * @param self of the arena.
+ */
+void ModelArena_free(ModelArena* self);
+
+#endif
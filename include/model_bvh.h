@@ -0,0 +1,83 @@
+#ifndef MODEL_BVH_H
+#define MODEL_BVH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "face_buffer.h"
+
+// Most faces of a cluster, the leaves of the hierarchy.
+#define BVH_CLUSTER_FACES 256
+
+// Bins along the split axis for the surface area heuristic.
+#define BVH_BINS 16
+
+/**
+ * A box of the hierarchy. Each node covers the faces from
+ * first up to first + count in the face order of the
+ * hierarchy, so the faces under any node are one run.
+ */
+typedef struct {
+  float min[3], max[3];
+  uint32_t first, count;
+  int left;  // Index of the left child, the right follows, 0 for a leaf.
+} BvhNode;
+
+/**
+ * A bounding volume hierarchy over clusters of the faces,
+ * to leave out the clusters outside the view frustum.
+ */
+typedef struct {
+  BvhNode* nodes;  // The root first.
+  int nodeCount;
+  int clusterCount;  // Leaves.
+  uint32_t* order;   // Face at each position of the face order.
+  int faceCount;
+} ModelBvh;
+
+/**
+ * A run of positions in the face order of a hierarchy.
+ */
+typedef struct {
+  uint32_t first, count;
+} BvhRange;
+
+/**
+ * Build the hierarchy with binned surface area heuristic
+ * splits, the subtrees on all the threads. Nodes are split
+ * until they have at most BVH_CLUSTER_FACES faces, which
+ * keep the order of the mesh within each cluster.
+ * @param faces of the mesh.
+ * @param positions xyz per vertex the faces index.
+ * @return the hierarchy.
+ */
+ModelBvh* new_ModelBvh(const FaceBuffer* faces, const float* positions);
+
+/**
+ * Free the hierarchy.
+ * @param self of the hierarchy.
+ */
+void ModelBvh_free(ModelBvh* self);
+
+/**
+ * Get the planes of the view frustum in model space.
+ * @param projection matrix, column major as from glGetFloatv().
+ * @param modelview matrix, column major.
+ * @param planes to be filled with a, b, c and d of the left,
+ * right, bottom, top, near and far planes, facing inside.
+ */
+void ModelBvh_getFrustum(const float projection[16], const float modelview[16],
+                         float planes[6][4]);
+
+/**
+ * Find the faces of the clusters in or across a frustum.
+ * Runs next to each other are joined.
+ * @param self of the hierarchy.
+ * @param planes of the frustum, see ModelBvh_getFrustum().
+ * @param ranges to be filled, room for clusterCount.
+ * @return the number of ranges.
+ */
+int ModelBvh_cull(const ModelBvh* self, const float planes[6][4],
+                  BvhRange* ranges);
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dynamic_string.h"
+#include "mapped_file.h"
+#include "mesh_normals.h"
+#include "mesh_stats.h"
+#include "vertex_buffer.h"
+
+/**
+ * Precompiled model cache, a ".plyc" file next to the PLY
+ * file or in $MODEL_CACHE_DIR. It holds the finished model
+ * in the layout the program uses, so it is read with one
+ * mmap and no parsing. Set $MODEL_CACHE to "off" to skip it.
+ *
+ * The file is a ModelCacheHeader followed by the sections,
+ * each starting on a 64 byte boundary, in the byte order
+ * of the machine that wrote it.
+ */
+
+#define MODEL_CACHE_VERSION 8
+
+typedef enum {
+  MODEL_CACHE_VERTICES,      // VertexBuffer block.
+  MODEL_CACHE_FACE_OFFSETS,  // uint32 per face plus one, empty if uniform.
+  MODEL_CACHE_FACE_INDICES,  // uint32 per face corner.
+  MODEL_CACHE_NORMALS,       // float xyz per vertex, may be empty.
+  MODEL_CACHE_COLORS,        // float rgb per vertex, may be empty.
+  MODEL_CACHE_TRIANGLES,     // uint32 corners, empty if cut on load.
+  MODEL_CACHE_SECTION_COUNT
+} ModelCacheSection;
+
+typedef struct {
+  char magic[4];       // "PLYC"
+  uint32_t version;    // MODEL_CACHE_VERSION
+  uint32_t byteOrder;  // 0x01020304 as written by the machine.
+  uint32_t numOfVertices;
+  uint32_t numOfFaces;
+  uint32_t faceArity;  // Corners of every face, 0 if they differ.
+  uint32_t vertexLayout;     // VertexLayout of the vertices.
+  uint32_t vertexPrecision;  // VertexPrecision of the vertices.
+  uint32_t isReordered;  // 1 if ordered for the vertex cache.
+  float weldDistance;    // Of the diagonal welded within, -1 if not.
+  uint32_t hasGeneratedNormals;  // 1 if the normals were generated.
+  uint32_t normalWeighting;      // NormalWeighting they were generated with.
+  uint32_t isNormalsFlipped;     // 1 if generated for clockwise faces.
+  uint64_t sourceSize;
+  int64_t sourceModified;  // Modification time in nanoseconds.
+  uint64_t sourceHash;
+  MeshStats stats;
+  uint64_t offsets[MODEL_CACHE_SECTION_COUNT];  // 0 if the section is empty.
+  uint64_t lengths[MODEL_CACHE_SECTION_COUNT];  // Bytes of each section.
+} ModelCacheHeader;
+
+/**
+ * Everything written to a cache file.
+ */
+typedef struct {
+  int numOfVertices, numOfFaces;
+  uint32_t faceArity;
+  VertexLayout vertexLayout;
+  VertexPrecision vertexPrecision;
+  bool isReordered;
+  float weldDistance;
+  bool hasGeneratedNormals;
+  MeshNormalsOptions normalOptions;  // Of the generated normals.
+  MeshStats stats;
+  const void* sections[MODEL_CACHE_SECTION_COUNT];
+  size_t lengths[MODEL_CACHE_SECTION_COUNT];
+} ModelCacheContent;
+
+/**
+ * Get where the cache of a PLY file lives. In
+ * $MODEL_CACHE_DIR its name starts with a hash of the
+ * absolute path of the file.
+ * @param sourcePath of the PLY file.
+ * @return allocated path, or null if caching is off.
+ */
+String ModelCache_getPath(String sourcePath);
+
+/**
+ * Map the cache of a PLY file if it is still valid. It
+ * is valid if every section holds what the counts of its
+ * header call for, every face index and triangle corner is
+ * in range, the size of the source matches and
+ * either its modification time or its content hash
+ * matches. Otherwise the file is parsed again.
+ * @param sourcePath of the PLY file.
+ * @return the mapped cache, or null if there is none.
+ */
+MappedFile* ModelCache_open(String sourcePath);
+
+/**
+ * Get the header of a mapped cache.
+ * @param cache returned by ModelCache_open().
+ */
+const ModelCacheHeader* ModelCache_getHeader(MappedFile* cache);
+
+/**
+ * Get a section of a mapped cache.
+ * @param cache returned by ModelCache_open().
+ * @param section to get.
+ * @return the bytes, or null if the section is empty.
+ */
+const void* ModelCache_getSection(MappedFile* cache, ModelCacheSection section);
+
+/**
+ * Write the cache of a PLY file. It is written to a
+ * temporary file first and renamed, so readers never see
+ * a partial cache.
+ * @param sourcePath of the PLY file.
+ * @param source bytes of the PLY file, for the content hash.
+ * @param content to be written.
+ * @return true if the cache was written.
+ */
+bool ModelCache_save(String sourcePath, MappedFile* source,
+                     ModelCacheContent* content);
+
+/**
+ * Hash bytes for the cache key, 8 bytes at a time.
+ * @param bytes to be hashed.
+ * @param length of the bytes.
+ */
+uint64_t ModelCache_hash(const char* bytes, size_t length);
+
+#endif
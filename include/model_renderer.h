@@ -0,0 +1,84 @@
+#ifndef MODEL_RENDERER_H
+#define MODEL_RENDERER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "mesh_lod.h"
+#include "model.h"
+#include "model_bvh.h"
+
+/**
+ * Draws a model with fixed function OpenGL. The buffered
+ * mode uploads the positions, normals, colors and a
+ * triangle index buffer once, then draws the whole mesh
+ * with one glDrawElements() per pass. The immediate mode
+ * sends every corner with glBegin() and glEnd(), for GL
+ * implementations without buffer objects and to compare.
+ * Once loaded, both modes leave out the clusters of faces
+ * outside the view frustum, and levels of detail are built
+ * in the background to draw the model with fewer faces when
+ * it is small on the screen.
+ */
+typedef enum {
+  RENDER_BUFFERED,
+  RENDER_IMMEDIATE,
+} RenderMode;
+
+typedef struct {
+  Model* model;
+  RenderMode mode;
+  unsigned int buffers[4];  // Positions, normals, colors and indices.
+  int indexCount;           // Triangle indices uploaded.
+  bool isUploaded;
+  bool isCulled;          // Unless $MODEL_CULL is "off", set between frames.
+  ModelBvh* bvh;          // Built with the first frame of the loaded model.
+  BvhRange* ranges;       // Runs of faces in the frustum.
+  uint32_t* indexStarts;  // First index of each face in the order, if mixed.
+  int* counts;            // Indices of each run to draw.
+  const void** offsets;   // Bytes to each run in the index buffer.
+  float lodPixels;        // Error allowed on the screen, 0 for no levels.
+  MeshLod* lod;           // Set once isLodBuilt.
+  atomic_bool isLodBuilt;
+  pthread_t lodBuilder;
+  bool hasLodBuilder;
+  unsigned int* lodBuffers;  // Index buffer of each level past 0, once
+                             // uploaded, 0 for level 0.
+} ModelRenderer;
+
+/**
+ * Create a renderer for a model, which may still be
+ * loading. Nothing is uploaded until the model is loaded.
+ * @param model to be drawn.
+ * @return the renderer, in the mode of $MODEL_RENDER
+ * ("buffered" or "immediate"), buffered by default,
+ * culling unless $MODEL_CULL is "off", and with levels of
+ * detail up to the pixels of $MODEL_LOD, LOD_PIXELS by
+ * default or none when "off".
+ */
+ModelRenderer* new_ModelRenderer(Model* model);
+
+/**
+ * Draw the loaded faces of the model with the current
+ * transform and state. Needs a current GL context.
+ * @param self of the renderer.
+ * @param isShadowPass to leave out the model colors.
+ */
+void ModelRenderer_draw(ModelRenderer* self, bool isShadowPass);
+
+/**
+ * Check if the levels of detail are being built, so a
+ * frame should be drawn once they are.
+ * @param self of the renderer.
+ */
+bool ModelRenderer_isBuilding(ModelRenderer* self);
+
+/**
+ * Delete the GL buffers and free the renderer, but not
+ * the model. Needs the GL context it drew with.
+ * @param self of the renderer.
+ */
+void ModelRenderer_free(ModelRenderer* self);
+
+#endif
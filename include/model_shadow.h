@@ -0,0 +1,78 @@
+#ifndef MODEL_SHADOW_H
+#define MODEL_SHADOW_H
+
+#include <stdbool.h>
+
+#include "model.h"
+
+/**
+ * The projected shadow of a model on a plane, drawn from
+ * its outline instead of the whole mesh. The vertices are
+ * projected on the CPU, the edges shared by faces facing
+ * the plane cancel out, and the edges left are the outline.
+ * It is filled by its winding number in the stencil buffer,
+ * so every shadow pixel is blended once. The outline is kept
+ * until the projection or the loaded faces change.
+ */
+typedef struct {
+  Model* model;
+  float matrix[16];    // Projection the outline was built with.
+  float plane[4];      // Plane the outline was built on.
+  int faceCount;       // Faces loaded when it was built.
+  float* triangles;    // Fans of xyz triangles over the outline,
+                       // then two that cover them.
+  int triangleCount;
+  unsigned int buffer;  // The triangles once uploaded, 0 before.
+  bool isUploaded;      // Whether the buffer has the last build.
+  bool isBuilt;
+} ModelShadow;
+
+/**
+ * Create the shadow of a model, which may still be
+ * loading. Nothing is built until ModelShadow_update().
+ * @param model to cast the shadow.
+ * @return the shadow.
+ */
+ModelShadow* new_ModelShadow(Model* model);
+
+/**
+ * Make the matrix that projects onto a plane from a light,
+ * as the program's calcShadowMatrix().
+ * @param matrix to be filled, in column major.
+ * @param plane equation.
+ * @param light position, or direction with w = 0.
+ */
+void ModelShadow_getMatrix(float matrix[16], const float plane[4],
+                           const float light[4]);
+
+/**
+ * Build the outline again if the projection, the plane or
+ * the loaded faces changed since the last build.
+ * @param self of the shadow.
+ * @param matrix that projects the model onto the plane, in
+ * column major as for glMultMatrixf(), including anything
+ * applied to the model before it.
+ * @param plane equation, faces turned to its side cast
+ * the shadow.
+ * @return true if it was built again.
+ */
+bool ModelShadow_update(ModelShadow* self, const float matrix[16],
+                        const float plane[4]);
+
+/**
+ * Fill the outline with the current color and blending,
+ * under the current transform without the projection. The
+ * stencil must be zero where the shadow falls, it is left
+ * zero. Needs a current GL context.
+ * @param self of the shadow.
+ */
+void ModelShadow_draw(ModelShadow* self);
+
+/**
+ * Delete the GL buffer and free the shadow, but not the
+ * model. Needs the GL context it drew with.
+ * @param self of the shadow.
+ */
+void ModelShadow_free(ModelShadow* self);
+
+#endif
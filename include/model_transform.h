@@ -0,0 +1,37 @@
+#ifndef MODEL_TRANSFORM_H
+#define MODEL_TRANSFORM_H
+
+#include "mesh_stats.h"
+#include "vertex_buffer.h"
+
+/**
+ * The transform that fits a model in the scene: a vertex
+ * p is drawn at (p + offset) * scale. It is found once from
+ * the bounds and baked into the render positions, so the
+ * draw loop only reads a buffer.
+ */
+typedef struct {
+  double scale;
+  double offset[3];
+} ModelTransform;
+
+/**
+ * Find the transform from the bounds. The model is scaled
+ * so the mean of the bound magnitudes is 5 and lifted so
+ * it stands on the floor.
+ * @param stats of the model.
+ * @return the transform.
+ */
+ModelTransform ModelTransform_of(const MeshStats* stats);
+
+/**
+ * Transform every vertex into an interleaved float xyz
+ * array, on all the threads.
+ * @param self of the transform.
+ * @param vertices of the model.
+ * @param positions with room for xyz per vertex.
+ */
+void ModelTransform_bake(const ModelTransform* self,
+                         const VertexBuffer* vertices, float* positions);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+
+/**
+ * Set how many threads the parallel passes may use.
+ * @param count of the threads, 0 to go back to the default
+ * which is $MODEL_THREADS or the number of online cores.
+ */
+void Parallel_setThreadCount(int count);
+
+/**
+ * Get how many threads the parallel passes may use.
+ * @return at least 1.
+ */
+int Parallel_getThreadCount();
+
+/**
+ * Run tasks 0 to taskCount - 1 over the worker threads. Each
+ * thread pulls the next task index until none is left, so
+ * the tasks may be of uneven size. It returns once every
+ * task is done. With one thread, or one task, everything
+ * runs on the calling thread. The workers are started on the
+ * first call and wait for the next one, and calls from several
+ * threads at once share them.
+ * @param taskCount of the tasks.
+ * @param task to run for each index.
+ * @param context passed to each task.
+ */
+void Parallel_for(int taskCount, void (*task)(void* context, int index),
+                  void* context);
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef PLY_H
+#define PLY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "array_map.h"
+#include "dynamic_string.h"
+#include "model_arena.h"
+#include "ply_scanner.h"
+
+typedef enum {
+  PLY_ASCII,
+  PLY_BINARY_LITTLE_ENDIAN,
+  PLY_BINARY_BIG_ENDIAN
+} PlyFormat;
+
+typedef enum {
+  PLY_NONE,
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64
+} PlyType;
+
+/**
+ * A property of an element and its decoded column. Scalar
+ * properties hold one value per record. List properties
+ * hold all the items back to back and listOffsets[record]
+ * is where the items of a record start, with one extra
+ * entry at the end for the total length.
+ */
+typedef struct {
+  String name;
+  PlyType type;       // Type of the value, or of each item of a list.
+  PlyType countType;  // Type of the list length, PLY_NONE if not a list.
+  size_t offset;      // Byte offset inside a fixed size binary record.
+  void* values;       // Column of values stored as the declared type.
+  size_t length;      // Number of values in the column.
+  size_t capacity;    // Number of values the column has room for.
+  uint32_t* listOffsets;
+} PlyProperty;
+
+typedef struct {
+  String name;
+  int count;
+  Array* properties;  // Array of PlyProperty in declaration order.
+  size_t stride;      // Bytes of a binary record, 0 if it has a list.
+} PlyElement;
+
+typedef struct {
+  ModelArena* arena;  // The schema, its elements and their columns.
+  PlyFormat format;
+  Array* elements;  // Array of PlyElement in file order.
+  bool hasError;
+  size_t bodyBytes;             // Bytes after the end_header line.
+  atomic_size_t* decodedBytes;  // Bytes of the body decoded, if set.
+} PlySchema;
+
+/**
+ * Parse the header of a PLY file into a schema, from the
+ * "ply" magic line until and including the end_header line.
+ * The columns are left empty until PlySchema_decode().
+ * @param scanner positioned at the start of the file. It is
+ * left at the first byte of the body.
+ * @return the schema, hasError is set if it is malformed,
+ * or null if out of memory.
+ */
+PlySchema* new_PlySchema(PlyScanner* scanner);
+
+/**
+ * Free the schema, its elements and their columns, which
+ * all live in its arena.
+ * @param self of the schema object.
+ */
+void PlySchema_free(PlySchema* self);
+
+/**
+ * Decode the body of the file into the property columns.
+ * Set decodedBytes to a counter that outlives the schema
+ * to follow the progress from another thread.
+ * @param self of the schema object.
+ * @param scanner positioned at the first byte of the body.
+ * @return false if the body is truncated or malformed.
+ */
+bool PlySchema_decode(PlySchema* self, PlyScanner* scanner);
+
+/**
+ * Find an element by name.
+ * @param self of the schema object.
+ * @param name of the element, such as "vertex".
+ * @return the element or null if it is not declared.
+ */
+PlyElement* PlySchema_getElement(PlySchema* self, const char* name);
+
+/**
+ * Check if binary values have to be byte swapped
+ * to be read on this machine.
+ * @param self of the schema object.
+ */
+bool PlySchema_needsSwap(PlySchema* self);
+
+/**
+ * Find the position of a property in an element.
+ * @param self of the element.
+ * @param name of the property, such as "x".
+ * @return the index or -1 if it is not declared.
+ */
+int PlyElement_getPropertyIndex(PlyElement* self, const char* name);
+
+/**
+ * Get the property at a position of an element.
+ * @param self of the element.
+ * @param index of the property.
+ * @return the property or null if out of range.
+ */
+PlyProperty* PlyElement_getProperty(PlyElement* self, int index);
+
+/**
+ * Find a property by name.
+ * @param self of the element, can be null.
+ * @param name of the property.
+ * @return the property or null if it is not declared.
+ */
+PlyProperty* PlyElement_findProperty(PlyElement* self, const char* name);
+
+/**
+ * Get a value of the column as a double.
+ * @param self of the property.
+ * @param index of the value in the column.
+ */
+double PlyProperty_getValue(PlyProperty* self, size_t index);
+
+/**
+ * Get the length of the list of a record.
+ * @param self of a list property.
+ * @param record index in the element.
+ */
+int PlyProperty_getListLength(PlyProperty* self, int record);
+
+/**
+ * Check if the property is a plain scalar.
+ * @param self of the property, can be null.
+ */
+bool PlyProperty_isScalar(PlyProperty* self);
+
+/**
+ * Get the size in bytes of a binary scalar.
+ * @param type of the scalar.
+ */
+size_t PlyType_size(PlyType type);
+
+/**
+ * Check if the type is an integer type.
+ * @param type of the scalar.
+ */
+bool PlyType_isInteger(PlyType type);
+
+/**
+ * Check if the type is a signed integer type.
+ * @param type of the scalar.
+ */
+bool PlyType_isSigned(PlyType type);
+
+/**
+ * Get the largest value of an integer type.
+ * @param type of the scalar.
+ * @return the value, or 1 for the other types.
+ */
+double PlyType_getMax(PlyType type);
+
+/**
+ * Read a binary scalar as a double.
+ * @param bytes of the scalar, need not be aligned.
+ * @param type of the scalar.
+ * @param swap true to byte swap before reading.
+ */
+double PlyType_read(const char* bytes, PlyType type, bool swap);
+
+/**
+ * Write a double as a native scalar of the type.
+ * @param bytes to be written, need not be aligned.
+ * @param type of the scalar.
+ * @param value to be converted.
+ */
+void PlyType_write(char* bytes, PlyType type, double value);
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef PLY_NUMBER_H
+#define PLY_NUMBER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Locale independent number parsing for PLY text. Each
+ * function parses one token that starts at the given byte
+ * and ends at the next space, tab, carriage return, new
+ * line or at the end of the range, and never reads past
+ * the end. The result is bit-exact with strtod() or
+ * strtof() on the same token: common values take a fast
+ * path and anything it can not round exactly, such as
+ * more than 19 digits or "nan", falls back to the C
+ * library on a copy of the token.
+ */
+
+/**
+ * Parse a float64 token.
+ * @param at the first byte of the token.
+ * @param end of the bytes that can be read.
+ * @param value to be set, 0 if it is not a number.
+ * @return the first byte after the token.
+ */
+const char* PlyNumber_parseDouble(const char* at, const char* end,
+                                  double* value);
+
+/**
+ * Parse a float32 token, rounded once like strtof().
+ * @param at the first byte of the token.
+ * @param end of the bytes that can be read.
+ * @param value to be set, 0 if it is not a number.
+ * @return the first byte after the token.
+ */
+const char* PlyNumber_parseFloat(const char* at, const char* end,
+                                 float* value);
+
+/**
+ * Parse an integer token such as a list length or a
+ * vertex index. A token that is not a plain integer,
+ * like "3.0", is parsed as a double and truncated.
+ * @param at the first byte of the token.
+ * @param end of the bytes that can be read.
+ * @param value to be set, 0 if the token fails.
+ * @return the first byte after the token, or NULL if it
+ * is "nan" or out of the range of int64_t.
+ */
+const char* PlyNumber_parseInt(const char* at, const char* end,
+                               int64_t* value);
+
+/**
+ * Count the decimal digits at the start of a range, 16
+ * bytes at a time with SSE2 or NEON when available.
+ * @param at the first byte.
+ * @param end of the bytes that can be read.
+ * @return the number of leading digits.
+ */
+size_t PlyNumber_countDigits(const char* at, const char* end);
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef PLY_SCANNER_H
+#define PLY_SCANNER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Zero-copy tokenizer over the raw bytes of a PLY file.
+ * Tokens are views into the scanned buffer, so nothing
+ * is allocated per line or per token. The buffer does not
+ * need to be null terminated.
+ */
+typedef struct {
+  const char* at;
+  const char* end;
+} PlyScanner;
+
+typedef struct {
+  const char* start;
+  size_t length;
+} PlyToken;
+
+/**
+ * Create a scanner over a byte range.
+ * @param data of the bytes to be scanned.
+ * @param length of the bytes.
+ * @return the scanner positioned at the first byte.
+ */
+static inline PlyScanner PlyScanner_of(const char* data, size_t length) {
+  PlyScanner this = {.at = data, .end = data + length};
+  return this;
+}
+
+/**
+ * Check if there is nothing left to scan.
+ * @param self of the scanner.
+ */
+static inline bool PlyScanner_isDone(PlyScanner* this) {
+  return this->at >= this->end;
+}
+
+/**
+ * Get the next token on the current line. Spaces, tabs and
+ * carriage returns separate the tokens. It never moves
+ * past the end of the line.
+ * @param self of the scanner.
+ * @param token to be filled with the view of the token.
+ * @return false if the line has no more token.
+ */
+static inline bool PlyScanner_nextToken(PlyScanner* this, PlyToken* token) {
+  const char* at = this->at;
+  while (at < this->end && (*at == ' ' || *at == '\t' || *at == '\r')) at++;
+  if (at >= this->end || *at == '\n') {
+    this->at = at;
+    return false;
+  }
+  const char* start = at;
+  while (at < this->end && *at != ' ' && *at != '\t' && *at != '\r' &&
+         *at != '\n')
+    at++;
+  token->start = start;
+  token->length = (size_t)(at - start);
+  this->at = at;
+  return true;
+}
+
+/**
+ * Skip the spaces before the next token of the line.
+ * @param self of the scanner.
+ * @return true if a token starts at the new position.
+ */
+static inline bool PlyScanner_skipSpaces(PlyScanner* this) {
+  const char* at = this->at;
+  while (at < this->end && (*at == ' ' || *at == '\t' || *at == '\r')) at++;
+  this->at = at;
+  return at < this->end && *at != '\n';
+}
+
+/**
+ * Move the scanner to the start of the next line.
+ * @param self of the scanner.
+ */
+static inline void PlyScanner_nextLine(PlyScanner* this) {
+  const char* newLine = memchr(this->at, '\n', (size_t)(this->end - this->at));
+  this->at = newLine == NULL ? this->end : newLine + 1;
+}
+
+/**
+ * Check if the rest of the current line has no token.
+ * @param self of the scanner.
+ */
+static inline bool PlyScanner_isBlankLine(PlyScanner* this) {
+  const char* at = this->at;
+  while (at < this->end && (*at == ' ' || *at == '\t' || *at == '\r')) at++;
+  return at >= this->end || *at == '\n';
+}
+
+/**
+ * Compare the token with a string.
+ * @param token to be compared.
+ * @param text null terminated string.
+ * @return true if they are equal.
+ */
+static inline bool PlyToken_isEqual(PlyToken token, const char* text) {
+  return strlen(text) == token.length &&
+         memcmp(token.start, text, token.length) == 0;
+}
+
+/**
+ * Convert the token to a double. The token is copied to a
+ * small stack buffer so that strtod stops inside the view.
+ * @param token to be converted.
+ * @return the value, 0 if it is not a number.
+ */
+static inline double PlyToken_toDouble(PlyToken token) {
+  char buffer[64];
+  size_t length = token.length < sizeof(buffer) ? token.length : 63;
+  memcpy(buffer, token.start, length);
+  buffer[length] = '\0';
+  return strtod(buffer, NULL);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PNG_WRITER_H
+#define PNG_WRITER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dynamic_string.h"
+
+/**
+ * Write pixels to a PNG file as 8 bit RGB, dropping the
+ * alpha. Each row gets the PNG filter that leaves the
+ * smallest bytes, then the rows are deflated with LZ77 and
+ * the fixed Huffman codes, so no zlib is needed.
+ * @param filePath of the file, replaced if it exists.
+ * @param pixels as RGBA rows.
+ * @param width of the image.
+ * @param height of the image.
+ * @param isBottomUp true if the first row is the bottom one,
+ * as glReadPixels() and SoftwareRenderer give them.
+ * @return true if the file was written.
+ */
+bool PngWriter_write(String filePath, const uint8_t* pixels, int width,
+                     int height, bool isBottomUp);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef SOFTWARE_RENDERER_H
+#define SOFTWARE_RENDERER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "model.h"
+#include "model_shadow.h"
+
+/**
+ * What the program sets up in GL before it draws a frame:
+ * the gluPerspective() and gluLookAt() camera, the mouse
+ * turns of the scene and of the model, the light and the
+ * floor the shadow falls on.
+ */
+typedef struct {
+  double fieldOfView;               // Vertical, in degrees.
+  double aspect;                    // Width over height.
+  double zNear, zFar;               // Distances of the clip planes.
+  double eye[3], center[3], up[3];  // As gluLookAt().
+  double angleTwo;                  // Scene turn about x, in degrees.
+  double angle;                     // Then about y.
+  double rotate;                    // Model turn about y.
+  float lightPosition[4];           // Set after the scene turns.
+  float lightColor[4];              // Diffuse color of the light.
+  float lightAttenuation[3];        // Constant, linear and quadratic.
+  float floorPlane[4];              // Plane the shadow falls on.
+  float shadowColor[4];             // Blended by its alpha.
+  bool hasShadow;
+} SoftwareScene;
+
+struct __SoftwareBatch;
+
+/**
+ * Draws a model on the CPU, as the GL fixed function
+ * pipeline of the program would: vertex lighting, back
+ * face culling, a depth test and the stencil shadow of
+ * ModelShadow. The triangles are set up and binned to
+ * square tiles by face chunks, then the tiles are filled
+ * on all the threads, testing pixels 4 at a time.
+ */
+typedef struct {
+  Model* model;
+  ModelShadow* shadow;
+  int width, height;
+  uint8_t* color;    // RGBA rows, the bottom row first like glReadPixels().
+  float* depth;      // Window depth, from 0 to 1.
+  uint8_t* stencil;  // Left zero after each frame.
+  int tileColumns, tileRows;
+  float* clip;    // Clip position of each shaded vertex.
+  float* shades;  // Lit color of each shaded vertex.
+  int shadeCount;
+  struct __SoftwareBatch* batches;  // Triangles and tile bins per task.
+  int batchCount;
+} SoftwareRenderer;
+
+/**
+ * Get the scene the program starts with.
+ * @return the scene.
+ */
+SoftwareScene SoftwareScene_getDefault();
+
+/**
+ * Check if the software renderer was asked for, with
+ * $MODEL_RENDER set to "software".
+ * @return true to draw on the CPU.
+ */
+bool SoftwareRenderer_isRequested();
+
+/**
+ * Create a renderer with its own frame.
+ * @param model to be drawn, which may still be loading.
+ * @param width of the frame, up to 8192.
+ * @param height of the frame, up to 8192.
+ * @return the renderer.
+ */
+SoftwareRenderer* new_SoftwareRenderer(Model* model, int width, int height);
+
+/**
+ * Clear the frame and draw the loaded faces of the model
+ * and its shadow into it.
+ * @param self of the renderer.
+ * @param scene to draw the model in.
+ */
+void SoftwareRenderer_draw(SoftwareRenderer* self, const SoftwareScene* scene);
+
+/**
+ * Free the renderer and its frame, but not the model.
+ * @param self of the renderer.
+ */
+void SoftwareRenderer_free(SoftwareRenderer* self);
+
+#endif
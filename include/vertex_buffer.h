@@ -0,0 +1,157 @@
+#ifndef VERTEX_BUFFER_H
+#define VERTEX_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "dynamic_string.h"
+
+/**
+ * Positions of every vertex in one contiguous block. The
+ * layout is either structure of arrays, all x then all y
+ * then all z, or interleaved xyz per vertex. The values
+ * are float32 by default or float64 on request.
+ */
+typedef enum {
+  VERTEX_SOA,          // x[], y[], z[], each on a 64 byte boundary.
+  VERTEX_INTERLEAVED,  // xyz, xyz, ...
+} VertexLayout;
+
+typedef enum {
+  VERTEX_FLOAT32,
+  VERTEX_FLOAT64,
+} VertexPrecision;
+
+typedef struct {
+  int count;  // Number of vertices.
+  VertexLayout layout;
+  VertexPrecision precision;
+  void* axes[3];  // First x, y and z value.
+  size_t stride;  // Values from a vertex to the next on one axis.
+  void* data;     // The block holding every value.
+  size_t bytes;   // Size of the block.
+  bool isOwned;   // False when the block lives in a mapping or an arena.
+} VertexBuffer;
+
+/**
+ * Set the layout used for new models.
+ * @param layout of the vertices.
+ */
+void VertexBuffer_setDefaultLayout(VertexLayout layout);
+
+/**
+ * Get the layout used for new models, $MODEL_VERTEX_LAYOUT
+ * ("soa" or "interleaved") unless set, otherwise SoA.
+ */
+VertexLayout VertexBuffer_getDefaultLayout();
+
+/**
+ * Set the precision used for new models.
+ * @param precision of the vertices.
+ */
+void VertexBuffer_setDefaultPrecision(VertexPrecision precision);
+
+/**
+ * Get the precision used for new models,
+ * $MODEL_VERTEX_PRECISION ("float32" or "float64") unless
+ * set, otherwise float32.
+ */
+VertexPrecision VertexBuffer_getDefaultPrecision();
+
+/**
+ * Get the size of the block for a number of vertices.
+ * @param count of vertices.
+ * @param layout of the vertices.
+ * @param precision of the vertices.
+ */
+size_t VertexBuffer_getByteLength(int count, VertexLayout layout,
+                                  VertexPrecision precision);
+
+/**
+ * Create a vertex buffer with one allocation. The values
+ * are left for the caller to fill.
+ * @param count of vertices.
+ * @param layout of the vertices.
+ * @param precision of the vertices.
+ * @return the vertex buffer.
+ */
+VertexBuffer* new_VertexBuffer(int count, VertexLayout layout,
+                               VertexPrecision precision);
+
+/**
+ * Wrap a block owned by someone else in a vertex buffer
+ * held by value, such as in an arena.
+ * @param data of VertexBuffer_getByteLength() bytes.
+ * @return the vertex buffer, with nothing to free.
+ */
+VertexBuffer VertexBuffer_of(int count, VertexLayout layout,
+                             VertexPrecision precision, void* data);
+
+/**
+ * Wrap a block owned by someone else, such as a mapped
+ * cache. It is not freed with the vertex buffer.
+ * @param data of VertexBuffer_getByteLength() bytes.
+ * @return the vertex buffer.
+ */
+VertexBuffer* new_VertexBufferOf(int count, VertexLayout layout,
+                                 VertexPrecision precision, void* data);
+
+/**
+ * Free the vertex buffer and the block it owns.
+ * @param self of the vertex buffer.
+ */
+void VertexBuffer_free(VertexBuffer* self);
+
+/**
+ * Format a vertex the same way as Point_toString().
+ * @param self of the vertex buffer.
+ * @param index of the vertex.
+ * @return allocated string.
+ */
+String VertexBuffer_toString(VertexBuffer* self, int index);
+
+/**
+ * Get one coordinate of a vertex.
+ * @param self of the vertex buffer.
+ * @param index of the vertex.
+ * @param axis 0, 1 or 2 for x, y or z.
+ */
+static inline double VertexBuffer_get(const VertexBuffer* this, int index,
+                                      int axis) {
+  size_t at = (size_t)index * this->stride;
+  if (this->precision == VERTEX_FLOAT32)
+    return ((const float*)this->axes[axis])[at];
+  return ((const double*)this->axes[axis])[at];
+}
+
+/**
+ * Set one coordinate of a vertex.
+ * @param self of the vertex buffer.
+ * @param index of the vertex.
+ * @param axis 0, 1 or 2 for x, y or z.
+ * @param value of the coordinate.
+ */
+static inline void VertexBuffer_set(VertexBuffer* this, int index, int axis,
+                                    double value) {
+  size_t at = (size_t)index * this->stride;
+  if (this->precision == VERTEX_FLOAT32)
+    ((float*)this->axes[axis])[at] = (float)value;
+  else
+    ((double*)this->axes[axis])[at] = value;
+}
+
+/**
+ * Get the position of a vertex.
+ * @param self of the vertex buffer.
+ * @param index of the vertex.
+ * @param point to be filled with x, y and z.
+ */
+static inline void VertexBuffer_getPoint(const VertexBuffer* this, int index,
+                                         double point[3]) {
+  for (int axis = 0; axis < 3; axis++)
+    point[axis] = VertexBuffer_get(this, index, axis);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "face_buffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+uint32_t FaceBuffer_findArity(int count, const uint32_t* offsets) {
+  if (count <= 0) return 0;
+  uint32_t arity = offsets[1] - offsets[0];
+  if (offsets[0] != 0 || arity == 0) return 0;
+  for (int next = 1; next < count; next++)
+    if (offsets[next + 1] - offsets[next] != arity) return 0;
+  return arity;
+}
+
+FaceBuffer* new_FaceBuffer(int count, const uint32_t* offsets) {
+  FaceBuffer* this = malloc(sizeof(FaceBuffer));
+  this->count = count > 0 ? count : 0;
+  this->arity = FaceBuffer_findArity(this->count, offsets);
+  this->offsets = null;
+  this->length = this->count > 0 ? offsets[this->count] : 0;
+  this->isOwned = true;
+  if (this->arity == 0 && this->count > 0) {
+    this->offsets = malloc(sizeof(uint32_t) * (this->count + 1));
+    memcpy(this->offsets, offsets, sizeof(uint32_t) * (this->count + 1));
+  }
+  this->indices = malloc(sizeof(uint32_t) * (this->length + 1));
+  return this;
+}
+
+FaceBuffer FaceBuffer_of(int count, uint32_t arity, uint32_t* offsets,
+                         uint32_t* indices) {
+  FaceBuffer this;
+  this.count = count > 0 ? count : 0;
+  this.arity = arity;
+  this.offsets = arity != 0 ? null : offsets;
+  this.indices = indices;
+  this.length = arity != 0   ? (size_t)this.count * arity
+                : this.count ? offsets[this.count]
+                             : 0;
+  this.isOwned = false;
+  return this;
+}
+
+FaceBuffer* new_FaceBufferOf(int count, uint32_t arity, uint32_t* offsets,
+                             uint32_t* indices) {
+  FaceBuffer* this = malloc(sizeof(FaceBuffer));
+  *this = FaceBuffer_of(count, arity, offsets, indices);
+  return this;
+}
+
+FaceBuffer* new_FaceBufferCopy(const FaceBuffer* faces) {
+  FaceBuffer* this = malloc(sizeof(FaceBuffer));
+  *this = *faces;
+  this->isOwned = true;
+  if (faces->offsets != null) {
+    this->offsets = malloc(sizeof(uint32_t) * (faces->count + 1));
+    memcpy(this->offsets, faces->offsets,
+           sizeof(uint32_t) * (faces->count + 1));
+  }
+  this->indices = malloc(sizeof(uint32_t) * (faces->length + 1));
+  memcpy(this->indices, faces->indices, sizeof(uint32_t) * faces->length);
+  return this;
+}
+
+void FaceBuffer_free(FaceBuffer* this) {
+  if (this == null) return;
+  if (this->isOwned) {
+    dispose(this->offsets, this->indices);
+  }
+  free(this);
+}
+
+String FaceBuffer_toString(FaceBuffer* this, int face) {
+  uint32_t count = FaceBuffer_getCornerCount(this, face);
+  const uint32_t* corners = FaceBuffer_getCorners(this, face);
+  String text = malloc((size_t)count * 12 + 16);
+  char* at = text + sprintf(text, "%u", count);
+  for (uint32_t next = 0; next < count; next++)
+    at += sprintf(at, " %u", corners[next]);
+  return text;
+}
@@ -0,0 +1,187 @@
+#include "frame_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dynamic_string.h"
+
+static const char* FRAME_PHASE_NAMES[FRAME_PHASE_COUNT] = {
+    "clear", "floor", "model", "shadow", "overlay", "swap"};
+
+/**
+ * The frames are drawn on one thread, so the recorder is
+ * a single global the draw code counts into.
+ */
+static struct {
+  FrameSample current, last;
+  FrameSample window[FRAME_STATS_WINDOW];  // Ring of the last frames.
+  int windowCount;
+  double firstStart, frameStart, phaseStart;
+  int phase;  // Being timed, -1 for none.
+  FILE* file;
+  bool isJson;
+  bool isOpened;  // Whether $MODEL_STATS was looked up.
+} _stats = {.phase = -1};
+
+static double __FrameStats_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void __FrameStats_open() {
+  _stats.isOpened = true;
+  String path = getenv("MODEL_STATS");
+  if (path == null || path[0] == '\0') return;
+  _stats.file = fopen(path, "w");
+  if (_stats.file == null) {
+    print("Could not write the frame stats to ", path);
+    return;
+  }
+  size_t length = strlen(path);
+  _stats.isJson = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+  if (_stats.isJson) return;
+  fprintf(_stats.file, "frame,time");
+  for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+    fprintf(_stats.file, ",%s_ms", FRAME_PHASE_NAMES[phase]);
+  fprintf(_stats.file,
+          ",total_ms,draw_calls,vertices,faces,culled_faces,lod_level,"
+          "lod_error_px,state_changes,p50_ms,p95_ms,p99_ms\n");
+}
+
+static void __FrameStats_write(const FrameSample* sample) {
+  FILE* file = _stats.file;
+  if (_stats.isJson) {
+    fprintf(file, "{\"frame\":%ld,\"time\":%.4f", sample->index, sample->time);
+    for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+      fprintf(file, ",\"%s_ms\":%.4f", FRAME_PHASE_NAMES[phase],
+              sample->phases[phase]);
+    fprintf(file,
+            ",\"total_ms\":%.4f,\"draw_calls\":%d,\"vertices\":%ld,"
+            "\"faces\":%ld,\"culled_faces\":%ld,\"lod_level\":%d,"
+            "\"lod_error_px\":%.4f,\"state_changes\":%d,\"p50_ms\":%.4f,"
+            "\"p95_ms\":%.4f,\"p99_ms\":%.4f}\n",
+            sample->total, sample->drawCalls, sample->vertices, sample->faces,
+            sample->culledFaces, sample->lodLevel, sample->lodError,
+            sample->stateChanges, sample->p50, sample->p95, sample->p99);
+    return;
+  }
+  fprintf(file, "%ld,%.4f", sample->index, sample->time);
+  for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++)
+    fprintf(file, ",%.4f", sample->phases[phase]);
+  fprintf(file, ",%.4f,%d,%ld,%ld,%ld,%d,%.4f,%d,%.4f,%.4f,%.4f\n",
+          sample->total, sample->drawCalls, sample->vertices, sample->faces,
+          sample->culledFaces, sample->lodLevel, sample->lodError,
+          sample->stateChanges, sample->p50, sample->p95, sample->p99);
+}
+
+static int __FrameStats_compare(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Set the percentiles of the frame times in the window, by
+ * nearest rank.
+ */
+static void __FrameStats_setPercentiles(FrameSample* sample) {
+  double totals[FRAME_STATS_WINDOW];
+  int count = _stats.windowCount;
+  for (int next = 0; next < count; next++)
+    totals[next] = _stats.window[next].total;
+  qsort(totals, count, sizeof(double), __FrameStats_compare);
+  double* percentiles[3] = {&sample->p50, &sample->p95, &sample->p99};
+  const double ranks[3] = {0.50, 0.95, 0.99};
+  for (int next = 0; next < 3; next++) {
+    int rank = (int)(ranks[next] * count + 0.999999);
+    *percentiles[next] = totals[(rank < 1 ? 1 : rank) - 1];
+  }
+}
+
+void FrameStats_begin() {
+  if (!_stats.isOpened) __FrameStats_open();
+  double now = __FrameStats_now();
+  if (_stats.firstStart == 0) _stats.firstStart = now;
+  long index = _stats.last.index + 1;
+  memset(&_stats.current, 0, sizeof(FrameSample));
+  _stats.current.index = index;
+  _stats.current.time = now - _stats.firstStart;
+  _stats.frameStart = now;
+  _stats.phase = -1;
+}
+
+void FrameStats_beginPhase(FramePhase phase) {
+  double now = __FrameStats_now();
+  if (_stats.phase >= 0)
+    _stats.current.phases[_stats.phase] += (now - _stats.phaseStart) * 1000;
+  _stats.phase = phase;
+  _stats.phaseStart = now;
+}
+
+void FrameStats_end() {
+  double now = __FrameStats_now();
+  if (_stats.phase >= 0)
+    _stats.current.phases[_stats.phase] += (now - _stats.phaseStart) * 1000;
+  _stats.phase = -1;
+  FrameSample* sample = &_stats.current;
+  sample->total = (now - _stats.frameStart) * 1000;
+
+  _stats.window[(sample->index - 1) % FRAME_STATS_WINDOW] = *sample;
+  if (_stats.windowCount < FRAME_STATS_WINDOW) _stats.windowCount++;
+  __FrameStats_setPercentiles(sample);
+  _stats.last = *sample;
+  if (_stats.file != null) __FrameStats_write(sample);
+}
+
+void FrameStats_countDraw(long vertices, long faces) {
+  _stats.current.drawCalls++;
+  _stats.current.vertices += vertices;
+  _stats.current.faces += faces;
+}
+
+void FrameStats_countCulled(long faces) { _stats.current.culledFaces += faces; }
+
+void FrameStats_setLod(int level, double pixelError) {
+  _stats.current.lodLevel = level;
+  _stats.current.lodError = pixelError;
+}
+
+void FrameStats_countStates(int count) { _stats.current.stateChanges += count; }
+
+const FrameSample* FrameStats_getLast() { return &_stats.last; }
+
+double FrameStats_getMean(FramePhase phase) {
+  if (_stats.windowCount == 0) return 0;
+  double sum = 0;
+  for (int next = 0; next < _stats.windowCount; next++)
+    sum += _stats.window[next].phases[phase];
+  return sum / _stats.windowCount;
+}
+
+bool FrameStats_isSynced() {
+  static int isSynced = -1;
+  if (isSynced < 0) {
+    String setting = getenv("MODEL_STATS_SYNC");
+    isSynced = setting != null && isStringEqual(setting, "on");
+  }
+  return isSynced;
+}
+
+void FrameStats_format(char* text, size_t size) {
+  const FrameSample* last = &_stats.last;
+  int length = snprintf(text, size,
+                        "frame %ld: %.2f ms, p50 %.2f p95 %.2f p99 %.2f\n"
+                        "%d draws, %ld vertices, %ld faces, %ld culled, "
+                        "%d states\nlevel of detail %d, %.2f px error\n",
+                        last->index, last->total, last->p50, last->p95,
+                        last->p99, last->drawCalls, last->vertices,
+                        last->faces, last->culledFaces, last->stateChanges,
+                        last->lodLevel, last->lodError);
+  for (int phase = 0; phase < FRAME_PHASE_COUNT; phase++) {
+    if (length < 0 || (size_t)length >= size) return;
+    length += snprintf(text + length, size - length, "%-8s %6.2f ms avg\n",
+                       FRAME_PHASE_NAMES[phase], FrameStats_getMean(phase));
+  }
+}
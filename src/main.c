@@ -1,435 +1,650 @@
-/**
- * @author: Vicky Mohammad
- * @file This pogram parse the PLY model and creates the model.
- * using the model.
- * Reference:
- * https://www.opengl.org/archives/resources/code/samples/mjktips/TexShadowReflectLight.html
- */
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
-// MacOS OpenGL Headers
-#include <GLUT/glut.h>
-#include <OpenGL/gl.h>
-#include <OpenGL/glu.h>
-
-// My libraries
-#include "dynamic_string.h"
-#include "file_reader.h"
-#include "model.h"
-#include "point.h"
-
-// Show print if debug is true.
-#define DEBUG true
-#define SHOW_LIGHT_ARROW false
-#define SHOW_MOVING_LIGHT false
-#define SHOW_FLOOR false
-
-// The patsed data file of PLY.
-static double _rotate = 0;
-
-/* flags used to control the appearance of the image */
-static int _lineDrawing = 1;    // draw polygons as solid or lines
-static int _lighting = 0;       // use diffuse and specular lighting
-static int _smoothShading = 0;  // smooth or flat shading
-static int _textures = 0;
-static GLuint _textureID[1];
-
-// Colors
-const GLfloat _BLUE[] = {0.0, 0.0, 1.0, 1.0};
-const GLfloat _RED[] = {1.0, 0.0, 0.0, 1.0};
-const GLfloat _GREEN[] = {0.0, 1.0, 0.0, 1.0};
-const GLfloat _WHITE[] = {1.0, 1.0, 1.0, 1.0};
-
-// Attribute index for the array.
-enum PositionAttribute { X, Y, Z, W };
-
-// Variable controlling various rendering modes.
-static int _directionalLight = 1;
-static GLfloat _floorPlane[4];
-static GLfloat _floorShadow[4][4];
-
-// Control for the camera angle and lighting.
-static float _lightAngle = 0.0, _lightHeight = 20;
-GLfloat _angle = -150;   // in degrees
-GLfloat _angleTwo = 30;  // in degrees
-
-// Motion and lights
-Point _motion = {.x = 0, .y = 0, .z = 0};
-int _moving = 0;
-int _lightMoving = 0, _lightStartX = 0, _lightStartY = 0;
-
-static GLfloat _lightPosition[4];
-static GLfloat _lightColor[] = {1, 0.3, 0.3, 1.0};  // Red-tinted light.
-
-static GLfloat _floorVertices[4][3] = {
-    {-20.0, 0.0, 20.0},
-    {20.0, 0.0, 20.0},
-    {20.0, 0.0, -20.0},
-    {-20.0, 0.0, -20.0},
-};
-
-/* -------------------------------------------------------------------------- */
-/*                            Draw model functions                            */
-/* -------------------------------------------------------------------------- */
-
-/**
- * Draw the face from multiple vertex.
- * @param index of the face.
- */
-static void drawFace(int index) {
-  MEM_TRACK
-  Splitter *faceSplit = Model_parsedData->faceList->at[index];
-  if (isStringEqual(faceSplit->at[0], "3")) glBegin(GL_TRIANGLES);
-  if (isStringEqual(faceSplit->at[0], "4")) glBegin(GL_QUADS);
-  glColor3f(0.3, 0.3, 0.3);  // Shadow color
-  double offsetY = fabs(*Model_parsedData->minY);
-  for_in(next, faceSplit) {
-    if (next == 0) continue;
-    int curPos = atoi(faceSplit->at[next]);
-    Point *curVertex = Model_parsedData->vertices->at[curPos];
-    double sumOfBoundary =
-        fabs(*Model_parsedData->maxX) + fabs(*Model_parsedData->minX) +
-        fabs(*Model_parsedData->maxY) + fabs(*Model_parsedData->minY) +
-        fabs(*Model_parsedData->maxZ) + fabs(*Model_parsedData->minZ);
-    double avg = sumOfBoundary / 6.0;
-    double normalizer = (5.0 / avg);
-    double offsetMultiplyer =
-        fabs(*Model_parsedData->maxY) + fabs(*Model_parsedData->minY) / 2.0;
-    double x = curVertex->x * normalizer;
-    double y =
-        (double)(curVertex->y + offsetY + offsetMultiplyer) * (normalizer);
-    double z = curVertex->z * normalizer;
-    double distance = sqrt(x * x + y * y + z * z);
-    glNormal3f(x / distance, y / distance, z / distance);
-    glVertex3f(x, y, z);
-  }
-  glEnd();
-  MEM_SWEEP
-}
-
-/**
- * Draw Based on parsed data.
- */
-static void drawModel() {
-  for_in(next, Model_parsedData->faceList) drawFace(next);
-}
-
-static void redraw();
-static void update() {
-  _rotate -= 3.0;
-  redraw();
-}
-
-/* -------------------------------------------------------------------------- */
-/*                              Open GL Functions                             */
-/* -------------------------------------------------------------------------- */
-
-static void printLightPosition() {
-  print("x: ", _(_lightPosition[X], 4));
-  print("y: ", _(_lightPosition[Y], 4));
-  print("z: ", _(_lightPosition[Z], 4));
-  print("light: ", _(_lightPosition[W]));
-}
-
-/* Create a matrix that will project the desired shadow. */
-static void calcShadowMatrix(GLfloat shadowMat[4][4], GLfloat groundplane[4],
-                             GLfloat lightpos[4]) {
-  // Find dot product between light position vector and ground plane normal.
-  GLfloat dot = groundplane[X] * lightpos[X] + groundplane[Y] * lightpos[Y] +
-                groundplane[Z] * lightpos[Z] + groundplane[W] * lightpos[W];
-
-  shadowMat[0][0] = dot - lightpos[X] * groundplane[X];
-  shadowMat[1][0] = 0.f - lightpos[X] * groundplane[Y];
-  shadowMat[2][0] = 0.f - lightpos[X] * groundplane[Z];
-  shadowMat[3][0] = 0.f - lightpos[X] * groundplane[W];
-
-  shadowMat[0][1] = 0.f - lightpos[Y] * groundplane[X];
-  shadowMat[1][1] = dot - lightpos[Y] * groundplane[Y];
-  shadowMat[2][1] = 0.f - lightpos[Y] * groundplane[Z];
-  shadowMat[3][1] = 0.f - lightpos[Y] * groundplane[W];
-
-  shadowMat[0][2] = 0.f - lightpos[Z] * groundplane[X];
-  shadowMat[1][2] = 0.f - lightpos[Z] * groundplane[Y];
-  shadowMat[2][2] = dot - lightpos[Z] * groundplane[Z];
-  shadowMat[3][2] = 0.f - lightpos[Z] * groundplane[W];
-
-  shadowMat[0][3] = 0.f - lightpos[W] * groundplane[X];
-  shadowMat[1][3] = 0.f - lightpos[W] * groundplane[Y];
-  shadowMat[2][3] = 0.f - lightpos[W] * groundplane[Z];
-  shadowMat[3][3] = dot - lightpos[W] * groundplane[W];
-}
-
-/* Find the plane equation given 3 points. */
-static void findPlane(GLfloat plane[4], GLfloat v0[3], GLfloat v1[3],
-                      GLfloat v2[3]) {
-  GLfloat vec0[3], vec1[3];
-  /* Need 2 vectors to find cross product. */
-  vec0[X] = v1[X] - v0[X];
-  vec0[Y] = v1[Y] - v0[Y];
-  vec0[Z] = v1[Z] - v0[Z];
-
-  vec1[X] = v2[X] - v0[X];
-  vec1[Y] = v2[Y] - v0[Y];
-  vec1[Z] = v2[Z] - v0[Z];
-  /* find cross product to get A, B, and C of plane equation */
-  plane[0] = vec0[Y] * vec1[Z] - vec0[Z] * vec1[Y];
-  plane[1] = -(vec0[X] * vec1[Z] - vec0[Z] * vec1[X]);
-  plane[2] = vec0[X] * vec1[Y] - vec0[Y] * vec1[X];
-  plane[3] = -(plane[0] * v0[X] + plane[1] * v0[Y] + plane[2] * v0[Z]);
-}
-
-// Draw a floor
-static void drawFloor(void) {
-  glDisable(GL_LIGHTING);
-  glBegin(GL_QUADS);
-  glTexCoord2f(0.0, 0.0);
-  glVertex3fv(_floorVertices[X]);
-  glTexCoord2f(0.0, 16.0);
-  glVertex3fv(_floorVertices[Y]);
-  glTexCoord2f(16.0, 16.0);
-  glVertex3fv(_floorVertices[Z]);
-  glTexCoord2f(16.0, 0.0);
-  glVertex3fv(_floorVertices[W]);
-  glEnd();
-  glEnable(GL_LIGHTING);
-}
-
-static void redraw() {
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-  glClearColor(1, 1, 1, 1);
-
-  // Reposition of the light source.
-  _lightPosition[Y] = _lightHeight;
-  if (SHOW_MOVING_LIGHT) {
-    _lightPosition[X] = 12 * cos(_lightAngle);
-    _lightPosition[Z] = 12 * sin(_lightAngle);
-    if (_directionalLight)
-      _lightPosition[W] = 0.0;
-    else
-      _lightPosition[W] = 1.0;
-  }
-
-  calcShadowMatrix(_floorShadow, _floorPlane, _lightPosition);
-
-  glPushMatrix();
-  // Perform scene rotations based on user mouse input.
-  glRotatef(_angleTwo, 1.0, 0.0, 0.0);
-  glRotatef(_angle, 0.0, 1.0, 0.0);
-
-  // New light source position
-  glLightfv(GL_LIGHT0, GL_POSITION, _lightPosition);
-
-  /* Back face culling will get used to only draw either the top or the
-    bottom floor.  This let's us get a floor with two distinct
-    appearances.  The top floor surface is reflective and kind of red.
-    The bottom floor surface is not reflective and blue. */
-
-  // Bottom floor color.
-  if (SHOW_FLOOR) {
-    glFrontFace(GL_CW); /* Switch face orientation. */
-    glColor4f(0.1, 0.1, 0.1, 1.0);
-    drawFloor();
-    glFrontFace(GL_CCW);
-
-    glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_ALWAYS, 3, 0xffffffff);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-  }
-
-  // Draw top floor
-  if (SHOW_FLOOR) {
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glColor4f(1.0, 1.0, 1.0, 0.3);
-    drawFloor();
-    glDisable(GL_BLEND);
-  }
-
-  glRotatef(_rotate, 0, 1, 0);
-  drawModel();
-
-  glStencilFunc(GL_LESS, 2, 0xffffffff);
-  glStencilOp(GL_REPLACE, GL_REPLACE, GL_REPLACE);
-
-  glEnable(GL_POLYGON_OFFSET_FILL);
-
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  glDisable(GL_LIGHTING);  // Force the 50% black.
-  glColor4f(0.0, 0.0, 0.0, 0.5);
-
-  glPushMatrix();
-  glMultMatrixf((GLfloat *)_floorShadow);  // Draw shadows
-
-  drawModel();
-
-  glPopMatrix();
-
-  /// Setting
-  glDisable(GL_BLEND);
-  glEnable(GL_LIGHTING);
-  glDisable(GL_POLYGON_OFFSET_FILL);
-  glDisable(GL_STENCIL_TEST);
-
-  /// Determine whether to show
-  /// Where the light source comes from.
-  if (SHOW_LIGHT_ARROW) {
-    glPushMatrix();
-    glDisable(GL_LIGHTING);
-    glColor3f(1.0, 1.0, 0.0);
-    if (_directionalLight) {
-      /* Draw an arrowhead. */
-      glDisable(GL_CULL_FACE);
-      glTranslatef(_lightPosition[0], _lightPosition[1], _lightPosition[2]);
-      glRotatef(_lightAngle * -180.0 / M_PI, 0, 1, 0);
-      glRotatef(atan(_lightHeight / 12) * 180.0 / M_PI, 0, 0, 1);
-      glBegin(GL_TRIANGLE_FAN);
-      glVertex3f(0, 0, 0);
-      glVertex3f(2, 1, 1);
-      glVertex3f(2, -1, 1);
-      glVertex3f(2, -1, -1);
-      glVertex3f(2, 1, -1);
-      glVertex3f(2, 1, 1);
-      glEnd();
-      // Draw a white line from light direction.
-      glColor3f(1.0, 1.0, 1.0);
-      glBegin(GL_LINES);
-      glVertex3f(0, 0, 0);
-      glVertex3f(5, 0, 0);
-      glEnd();
-      glEnable(GL_CULL_FACE);
-    } else {
-      // Draw a yellow ball at the light source.
-      glTranslatef(_lightPosition[0], _lightPosition[1], _lightPosition[2]);
-      glutSolidSphere(1.0, 5, 5);
-    }
-    glEnable(GL_LIGHTING);
-    glPopMatrix();
-  }
-
-  glPopMatrix();
-  glutSwapBuffers();
-}
-
-/* -------------------------------------------------------------------------- */
-/*                                  Controls                                  */
-/* -------------------------------------------------------------------------- */
-
-// Mouse control.
-static void mouseControl(int button, int state, int x, int y) {
-  if (button == GLUT_LEFT_BUTTON) {
-    if (state == GLUT_DOWN) {
-      _moving = 1;
-      _motion.x = x;
-      _motion.y = y;
-    }
-    if (state == GLUT_UP) _moving = 0;
-  }
-  if (SHOW_MOVING_LIGHT)
-    if (button == GLUT_MIDDLE_BUTTON) {
-      if (state == GLUT_DOWN) {
-        _lightMoving = 1;
-        _lightStartX = x;
-        _lightStartY = y;
-      }
-      if (state == GLUT_UP) _lightMoving = 0;
-    }
-}
-
-// Special control for sizing the model.
-void specialControl(int key, int x, int y) {
-  const double CAMERA_MOVEMENT = 25;
-  if (key == 'q' || key == 27) {
-    exit(0);
-  } else if (key == 'w' || key == GLUT_KEY_UP) {
-    _motion.z += CAMERA_MOVEMENT;
-    redraw();
-    printf("w key is pressed, y=%f.\n", _motion.z);
-  } else if (key == 's' || key == GLUT_KEY_DOWN) {
-    _motion.z -= CAMERA_MOVEMENT;
-    redraw();
-    printf("s key is pressed, y=%f.\n", _motion.z);
-  }
-}
-
-// Camera motion.
-static void motion(int x, int y) {
-  if (_moving) {
-    _angle = _angle + (x - _motion.x);
-    _angleTwo = _angleTwo + (y - _motion.y);
-    _motion.x = x;
-    _motion.y = y;
-    glutPostRedisplay();
-  }
-  if (SHOW_MOVING_LIGHT)
-    if (_lightMoving) {
-      _lightAngle += (x - _lightStartX) / 40.0;
-      _lightHeight += (_lightStartY - y) / 20.0;
-      _lightStartX = x;
-      _lightStartY = y;
-      glutPostRedisplay();
-    }
-}
-
-// Press key to redraw if stopped  drawing.
-static void key(unsigned char c, int x, int y) {
-  if (c == 27) exit(0);  // Escape key
-  glutPostRedisplay();
-}
-
-/* ------------------------------------------------------------------------- */
-/*                                    Main                                    */
-/* -------------------------------------------------------------------------- */
-
-int main(int argc, char **argv) {
-  Model_parseModel(argc, argv);
-
-  // Init the window.
-  glutInit(&argc, argv);
-  glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL |
-                      GLUT_MULTISAMPLE);
-  glutInitWindowSize(500, 500);
-  glutCreateWindow(argv[1]);
-
-  // Init the open gl callbacks.
-  glutDisplayFunc(redraw);
-  glutMouseFunc(mouseControl);
-  glutMotionFunc(motion);
-  glutKeyboardFunc(key);
-  glutIdleFunc(update);
-  glutSpecialFunc(specialControl);
-
-  // Init the modes and enable.
-  glPolygonOffset(-2.0, -1.0);
-  glEnable(GL_CULL_FACE);
-  glEnable(GL_DEPTH_TEST);
-  glEnable(GL_TEXTURE_2D);
-  glLineWidth(3.0);
-  glMatrixMode(GL_PROJECTION);
-  gluPerspective(40.0,    // Field of view in degree
-                 1.0,     // Asplect ratio
-                 20.0,    // The z near
-                 100.0);  // The z far
-  glMatrixMode(GL_MODELVIEW);
-  gluLookAt(0.0, 8.0, 60.0,  // eye is at (0,0,30)
-            0.0, 8.0, 0.0,   // center is at (0,0,0)
-            0.0, 1.0, 0.);   // up is in positive Y direction
-
-  // Set the lighting
-  glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER, 1);
-  glLightfv(GL_LIGHT0, GL_DIFFUSE, _lightColor);
-  glLightf(GL_LIGHT0, GL_CONSTANT_ATTENUATION, 0.1);
-  glLightf(GL_LIGHT0, GL_LINEAR_ATTENUATION, 0.05);
-  glEnable(GL_LIGHT0);
-  glEnable(GL_LIGHTING);
-
-  // Setup floor plane for projected shadow calculations.
-  findPlane(_floorPlane, _floorVertices[1], _floorVertices[2],
-            _floorVertices[3]);
-
-  glutMainLoop();
-  return 0;
-}
+/**
+ * @author: Vicky Mohammad
+ * @file This pogram parse the PLY model and creates the model.
+ * using the model.
+ * Reference:
+ * https://www.opengl.org/archives/resources/code/samples/mjktips/TexShadowReflectLight.html
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// MacOS OpenGL Headers
+#include <GLUT/glut.h>
+#include <OpenGL/gl.h>
+#include <OpenGL/glu.h>
+#if defined(__APPLE__)
+#include <OpenGL/OpenGL.h>
+#endif
+
+// My libraries
+#include "dynamic_string.h"
+#include "file_reader.h"
+#include "frame_stats.h"
+#include "model.h"
+#include "model_renderer.h"
+#include "software_renderer.h"
+#include "model_shadow.h"
+#include "point.h"
+
+// Show print if debug is true.
+#define DEBUG true
+#define SHOW_LIGHT_ARROW false
+#define SHOW_MOVING_LIGHT false
+#define SHOW_FLOOR false
+
+// Turn of the model, 3 degrees a frame at 60 fps.
+#define TURNTABLE_SPEED 180.0  // Degrees per second.
+#define DEFAULT_FPS 60
+
+// Milliseconds between looks at the levels of detail being built.
+#define LOD_WATCH_INTERVAL 100
+
+// The patsed data file of PLY.
+static double _rotate = 0;
+
+/* flags used to control the appearance of the image */
+static int _lineDrawing = 1;    // draw polygons as solid or lines
+static int _lighting = 0;       // use diffuse and specular lighting
+static int _smoothShading = 0;  // smooth or flat shading
+static int _textures = 0;
+static GLuint _textureID[1];
+static ModelRenderer *_renderer = null;  // Created with the GL context.
+static SoftwareRenderer *_software = null;  // Set by $MODEL_RENDER.
+static ModelShadow *_shadow = null;      // Outline of the floor shadow.
+static bool _isStatsShown = false;       // Frame stats overlay, 'f' toggles.
+
+// Frame pacing, frames are only drawn when asked for.
+static bool _isTurning = true;            // Turntable, space toggles.
+static double _frameInterval = 1.0 / DEFAULT_FPS;  // Seconds, 0 uncapped.
+static double _lastFrame = -1;            // Start of the last frame.
+static double _lastTurn = -1;             // Of the last turning frame.
+static bool _isWatching = false;          // For the levels of detail.
+static bool _isFramePending = false;      // Asked for, not drawn yet.
+
+// Colors
+const GLfloat _BLUE[] = {0.0, 0.0, 1.0, 1.0};
+const GLfloat _RED[] = {1.0, 0.0, 0.0, 1.0};
+const GLfloat _GREEN[] = {0.0, 1.0, 0.0, 1.0};
+const GLfloat _WHITE[] = {1.0, 1.0, 1.0, 1.0};
+
+// Attribute index for the array.
+enum PositionAttribute { X, Y, Z, W };
+
+// Variable controlling various rendering modes.
+static int _directionalLight = 1;
+static GLfloat _floorPlane[4];
+static GLfloat _floorShadow[4][4];
+
+// Control for the camera angle and lighting.
+static float _lightAngle = 0.0, _lightHeight = 20;
+GLfloat _angle = -150;   // in degrees
+GLfloat _angleTwo = 30;  // in degrees
+
+// Motion and lights
+Point _motion = {.x = 0, .y = 0, .z = 0};
+int _moving = 0;
+int _lightMoving = 0, _lightStartX = 0, _lightStartY = 0;
+
+static GLfloat _lightPosition[4];
+static GLfloat _lightColor[] = {1, 0.3, 0.3, 1.0};  // Red-tinted light.
+
+static GLfloat _floorVertices[4][3] = {
+    {-20.0, 0.0, 20.0},
+    {20.0, 0.0, 20.0},
+    {20.0, 0.0, -20.0},
+    {-20.0, 0.0, -20.0},
+};
+
+/* -------------------------------------------------------------------------- */
+/*                            Draw model functions                            */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Draw Based on parsed data.
+ */
+static void drawModel() {
+  if (_renderer == null) _renderer = new_ModelRenderer(Model_parsedData);
+  ModelRenderer_draw(_renderer, false);
+}
+
+/**
+ * Draw the shadow of the model on the floor, from its
+ * outline which is only built again when the light moves.
+ */
+static void drawShadow() {
+  if (_shadow == null) _shadow = new_ModelShadow(Model_parsedData);
+  ModelShadow_update(_shadow, (GLfloat *)_floorShadow, _floorPlane);
+  glColor3f(0.3, 0.3, 0.3);  // Shadow color, as the mesh was drawn.
+  ModelShadow_draw(_shadow);
+}
+
+/**
+ * Draw the frame on the CPU and copy it to the window,
+ * with the camera, the turns and the light set up in GL.
+ */
+static void drawSoftware() {
+  SoftwareScene scene = SoftwareScene_getDefault();
+  scene.angle = _angle;
+  scene.angleTwo = _angleTwo;
+  scene.rotate = _rotate;
+  for (int i = 0; i < 4; i++) {
+    scene.lightPosition[i] = _lightPosition[i];
+    scene.lightColor[i] = _lightColor[i];
+    scene.floorPlane[i] = _floorPlane[i];
+  }
+  SoftwareRenderer_draw(_software, &scene);
+
+  // Place the frame at the lower left corner of the window.
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+  glRasterPos2i(-1, -1);
+  glDrawPixels(_software->width, _software->height, GL_RGBA, GL_UNSIGNED_BYTE,
+               _software->color);
+  FrameStats_countDraw(0, 0);
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+}
+
+/**
+ * Show the load progress in the window title.
+ */
+static void showLoadProgress() {
+  static bool isTitleReset = false;
+  if (isTitleReset) return;
+  double progress = Model_getLoadProgress(Model_parsedData);
+  if (progress >= 1) {
+    glutSetWindowTitle(Model_parsedData->fileName);
+    isTitleReset = true;
+    return;
+  }
+  char title[256];
+  snprintf(title, sizeof(title), "%s - loading %d%%",
+           Model_parsedData->fileName, (int)(progress * 100));
+  glutSetWindowTitle(title);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Frame pacing                                */
+/* -------------------------------------------------------------------------- */
+
+static double now() { return glutGet(GLUT_ELAPSED_TIME) / 1000.0; }
+
+/**
+ * Check if the scene changes without input, which is while
+ * the turntable turns or the model still loads.
+ */
+static bool isAnimating() {
+  return _isTurning || Model_getLoadProgress(Model_parsedData) < 1;
+}
+
+static void onFrameTimer(int value) {
+  (void)value;
+  glutPostRedisplay();
+}
+
+/**
+ * Ask for a frame. Requests until it is drawn make the same
+ * frame, and it waits for the frame interval since the last.
+ */
+static void requestFrame() {
+  if (_isFramePending) return;
+  _isFramePending = true;
+  double wait = _lastFrame + _frameInterval - now();
+  if (_frameInterval <= 0 || _lastFrame < 0 || wait <= 0)
+    glutPostRedisplay();
+  else
+    glutTimerFunc((unsigned int)(wait * 1000 + 0.5), onFrameTimer, 0);
+}
+
+/**
+ * Look in on the levels of detail being built in the
+ * background, and ask for a frame once they are.
+ */
+static void watchRenderer(int value) {
+  (void)value;
+  _isWatching = ModelRenderer_isBuilding(_renderer);
+  if (_isWatching)
+    glutTimerFunc(LOD_WATCH_INTERVAL, watchRenderer, 0);
+  else
+    requestFrame();
+}
+
+/**
+ * Turn the model by the time since the last turning frame,
+ * so its speed does not depend on the frame rate.
+ */
+static void turn(double frameStart) {
+  if (!_isTurning) {
+    _lastTurn = -1;
+    return;
+  }
+  if (_lastTurn >= 0)
+    _rotate = fmod(_rotate - TURNTABLE_SPEED * (frameStart - _lastTurn), 360);
+  _lastTurn = frameStart;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Open GL Functions                             */
+/* -------------------------------------------------------------------------- */
+
+static void printLightPosition() {
+  print("x: ", _(_lightPosition[X], 4));
+  print("y: ", _(_lightPosition[Y], 4));
+  print("z: ", _(_lightPosition[Z], 4));
+  print("light: ", _(_lightPosition[W]));
+}
+
+/* Create a matrix that will project the desired shadow. */
+static void calcShadowMatrix(GLfloat shadowMat[4][4], GLfloat groundplane[4],
+                             GLfloat lightpos[4]) {
+  // Find dot product between light position vector and ground plane normal.
+  GLfloat dot = groundplane[X] * lightpos[X] + groundplane[Y] * lightpos[Y] +
+                groundplane[Z] * lightpos[Z] + groundplane[W] * lightpos[W];
+
+  shadowMat[0][0] = dot - lightpos[X] * groundplane[X];
+  shadowMat[1][0] = 0.f - lightpos[X] * groundplane[Y];
+  shadowMat[2][0] = 0.f - lightpos[X] * groundplane[Z];
+  shadowMat[3][0] = 0.f - lightpos[X] * groundplane[W];
+
+  shadowMat[0][1] = 0.f - lightpos[Y] * groundplane[X];
+  shadowMat[1][1] = dot - lightpos[Y] * groundplane[Y];
+  shadowMat[2][1] = 0.f - lightpos[Y] * groundplane[Z];
+  shadowMat[3][1] = 0.f - lightpos[Y] * groundplane[W];
+
+  shadowMat[0][2] = 0.f - lightpos[Z] * groundplane[X];
+  shadowMat[1][2] = 0.f - lightpos[Z] * groundplane[Y];
+  shadowMat[2][2] = dot - lightpos[Z] * groundplane[Z];
+  shadowMat[3][2] = 0.f - lightpos[Z] * groundplane[W];
+
+  shadowMat[0][3] = 0.f - lightpos[W] * groundplane[X];
+  shadowMat[1][3] = 0.f - lightpos[W] * groundplane[Y];
+  shadowMat[2][3] = 0.f - lightpos[W] * groundplane[Z];
+  shadowMat[3][3] = dot - lightpos[W] * groundplane[W];
+}
+
+/* Find the plane equation given 3 points. */
+static void findPlane(GLfloat plane[4], GLfloat v0[3], GLfloat v1[3],
+                      GLfloat v2[3]) {
+  GLfloat vec0[3], vec1[3];
+  /* Need 2 vectors to find cross product. */
+  vec0[X] = v1[X] - v0[X];
+  vec0[Y] = v1[Y] - v0[Y];
+  vec0[Z] = v1[Z] - v0[Z];
+
+  vec1[X] = v2[X] - v0[X];
+  vec1[Y] = v2[Y] - v0[Y];
+  vec1[Z] = v2[Z] - v0[Z];
+  /* find cross product to get A, B, and C of plane equation */
+  plane[0] = vec0[Y] * vec1[Z] - vec0[Z] * vec1[Y];
+  plane[1] = -(vec0[X] * vec1[Z] - vec0[Z] * vec1[X]);
+  plane[2] = vec0[X] * vec1[Y] - vec0[Y] * vec1[X];
+  plane[3] = -(plane[0] * v0[X] + plane[1] * v0[Y] + plane[2] * v0[Z]);
+}
+
+// Draw a floor
+static void drawFloor(void) {
+  FRAME_STATE(glDisable(GL_LIGHTING));
+  glBegin(GL_QUADS);
+  glTexCoord2f(0.0, 0.0);
+  glVertex3fv(_floorVertices[X]);
+  glTexCoord2f(0.0, 16.0);
+  glVertex3fv(_floorVertices[Y]);
+  glTexCoord2f(16.0, 16.0);
+  glVertex3fv(_floorVertices[Z]);
+  glTexCoord2f(16.0, 0.0);
+  glVertex3fv(_floorVertices[W]);
+  glEnd();
+  FrameStats_countDraw(4, 1);
+  FRAME_STATE(glEnable(GL_LIGHTING));
+}
+
+/**
+ * Time the next phase of the frame. With $MODEL_STATS_SYNC
+ * the GPU finishes the last phase first, so its time is in.
+ */
+static void beginPhase(FramePhase phase) {
+  if (FrameStats_isSynced()) glFinish();
+  FrameStats_beginPhase(phase);
+}
+
+/**
+ * Draw the frame stats over the scene, from the top left.
+ */
+static void drawStats() {
+  char text[1024];
+  FrameStats_format(text, sizeof(text));
+  int height = glutGet(GLUT_WINDOW_HEIGHT);
+
+  FRAME_STATE(glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT));
+  FRAME_STATE(glDisable(GL_LIGHTING));
+  FRAME_STATE(glDisable(GL_DEPTH_TEST));
+  FRAME_STATE(glDisable(GL_TEXTURE_2D));
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  gluOrtho2D(0, glutGet(GLUT_WINDOW_WIDTH), 0, height);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glColor3f(0, 0, 0);
+  int line = 1;
+  glRasterPos2i(8, height - 15 * line);
+  for (char *next = text; *next != '\0'; next++) {
+    if (*next == '\n') {
+      glRasterPos2i(8, height - 15 * ++line);
+      continue;
+    }
+    glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *next);
+  }
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  FRAME_STATE(glPopAttrib());
+}
+
+/**
+ * Draw the overlay, swap and end the frame stats.
+ * @param isAnimated if the scene was moving when the frame
+ * started, then the next frame is asked for. A load that
+ * ends during the frame still gets a frame of its own.
+ */
+static void endFrame(bool isAnimated) {
+  beginPhase(FRAME_OVERLAY);
+  if (_isStatsShown) drawStats();
+  beginPhase(FRAME_SWAP);
+  glutSwapBuffers();
+  if (FrameStats_isSynced()) glFinish();
+  FrameStats_end();
+  if (isAnimated)
+    requestFrame();
+  else if (!_isWatching && ModelRenderer_isBuilding(_renderer))
+    watchRenderer(0);
+}
+
+static void redraw() {
+  bool isAnimated = isAnimating();
+  // While the model loads, another frame follows this one to check again.
+  Model_exitIfFailed(Model_parsedData);
+  _isFramePending = false;
+  _lastFrame = now();
+  turn(_lastFrame);
+  showLoadProgress();
+  FrameStats_begin();
+  beginPhase(FRAME_CLEAR);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+  glClearColor(1, 1, 1, 1);
+
+  // Reposition of the light source.
+  _lightPosition[Y] = _lightHeight;
+  if (SHOW_MOVING_LIGHT) {
+    _lightPosition[X] = 12 * cos(_lightAngle);
+    _lightPosition[Z] = 12 * sin(_lightAngle);
+    if (_directionalLight)
+      _lightPosition[W] = 0.0;
+    else
+      _lightPosition[W] = 1.0;
+  }
+
+  calcShadowMatrix(_floorShadow, _floorPlane, _lightPosition);
+
+  if (_software != null) {
+    beginPhase(FRAME_MODEL);
+    drawSoftware();
+    endFrame(isAnimated);
+    return;
+  }
+
+  glPushMatrix();
+  // Perform scene rotations based on user mouse input.
+  glRotatef(_angleTwo, 1.0, 0.0, 0.0);
+  glRotatef(_angle, 0.0, 1.0, 0.0);
+
+  // New light source position
+  FRAME_STATE(glLightfv(GL_LIGHT0, GL_POSITION, _lightPosition));
+
+  /* Back face culling will get used to only draw either the top or the
+    bottom floor.  This let's us get a floor with two distinct
+    appearances.  The top floor surface is reflective and kind of red.
+    The bottom floor surface is not reflective and blue. */
+
+  // Bottom floor color.
+  beginPhase(FRAME_FLOOR);
+  if (SHOW_FLOOR) {
+    FRAME_STATE(glFrontFace(GL_CW)); /* Switch face orientation. */
+    glColor4f(0.1, 0.1, 0.1, 1.0);
+    drawFloor();
+    FRAME_STATE(glFrontFace(GL_CCW));
+  }
+
+  // Draw top floor
+  if (SHOW_FLOOR) {
+    FRAME_STATE(glEnable(GL_BLEND));
+    FRAME_STATE(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+    glColor4f(1.0, 1.0, 1.0, 0.3);
+    drawFloor();
+    FRAME_STATE(glDisable(GL_BLEND));
+  }
+
+  beginPhase(FRAME_MODEL);
+  glRotatef(_rotate, 0, 1, 0);
+  drawModel();
+
+  // The shadow blends each pixel once through the stencil.
+  beginPhase(FRAME_SHADOW);
+  FRAME_STATE(glEnable(GL_POLYGON_OFFSET_FILL));
+
+  FRAME_STATE(glEnable(GL_BLEND));
+  FRAME_STATE(glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA));
+  FRAME_STATE(glDisable(GL_LIGHTING));  // Force the 50% black.
+  glColor4f(0.0, 0.0, 0.0, 0.5);
+
+  drawShadow();
+
+  /// Setting
+  FRAME_STATE(glDisable(GL_BLEND));
+  FRAME_STATE(glEnable(GL_LIGHTING));
+  FRAME_STATE(glDisable(GL_POLYGON_OFFSET_FILL));
+
+  /// Determine whether to show
+  /// Where the light source comes from, timed with the floor.
+  beginPhase(FRAME_FLOOR);
+  if (SHOW_LIGHT_ARROW) {
+    glPushMatrix();
+    glDisable(GL_LIGHTING);
+    glColor3f(1.0, 1.0, 0.0);
+    if (_directionalLight) {
+      /* Draw an arrowhead. */
+      glDisable(GL_CULL_FACE);
+      glTranslatef(_lightPosition[0], _lightPosition[1], _lightPosition[2]);
+      glRotatef(_lightAngle * -180.0 / M_PI, 0, 1, 0);
+      glRotatef(atan(_lightHeight / 12) * 180.0 / M_PI, 0, 0, 1);
+      glBegin(GL_TRIANGLE_FAN);
+      glVertex3f(0, 0, 0);
+      glVertex3f(2, 1, 1);
+      glVertex3f(2, -1, 1);
+      glVertex3f(2, -1, -1);
+      glVertex3f(2, 1, -1);
+      glVertex3f(2, 1, 1);
+      glEnd();
+      // Draw a white line from light direction.
+      glColor3f(1.0, 1.0, 1.0);
+      glBegin(GL_LINES);
+      glVertex3f(0, 0, 0);
+      glVertex3f(5, 0, 0);
+      glEnd();
+      glEnable(GL_CULL_FACE);
+    } else {
+      // Draw a yellow ball at the light source.
+      glTranslatef(_lightPosition[0], _lightPosition[1], _lightPosition[2]);
+      glutSolidSphere(1.0, 5, 5);
+    }
+    glEnable(GL_LIGHTING);
+    glPopMatrix();
+  }
+
+  glPopMatrix();
+  endFrame(isAnimated);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Controls                                  */
+/* -------------------------------------------------------------------------- */
+
+// Mouse control.
+static void mouseControl(int button, int state, int x, int y) {
+  if (button == GLUT_LEFT_BUTTON) {
+    if (state == GLUT_DOWN) {
+      _moving = 1;
+      _motion.x = x;
+      _motion.y = y;
+    }
+    if (state == GLUT_UP) _moving = 0;
+  }
+  if (SHOW_MOVING_LIGHT)
+    if (button == GLUT_MIDDLE_BUTTON) {
+      if (state == GLUT_DOWN) {
+        _lightMoving = 1;
+        _lightStartX = x;
+        _lightStartY = y;
+      }
+      if (state == GLUT_UP) _lightMoving = 0;
+    }
+}
+
+// Special control for sizing the model.
+void specialControl(int key, int x, int y) {
+  const double CAMERA_MOVEMENT = 25;
+  if (key == 'q' || key == 27) {
+    exit(0);
+  } else if (key == 'w' || key == GLUT_KEY_UP) {
+    _motion.z += CAMERA_MOVEMENT;
+    requestFrame();
+    printf("w key is pressed, y=%f.\n", _motion.z);
+  } else if (key == 's' || key == GLUT_KEY_DOWN) {
+    _motion.z -= CAMERA_MOVEMENT;
+    requestFrame();
+    printf("s key is pressed, y=%f.\n", _motion.z);
+  }
+}
+
+// Camera motion.
+static void motion(int x, int y) {
+  if (_moving) {
+    _angle = _angle + (x - _motion.x);
+    _angleTwo = _angleTwo + (y - _motion.y);
+    _motion.x = x;
+    _motion.y = y;
+    requestFrame();
+  }
+  if (SHOW_MOVING_LIGHT)
+    if (_lightMoving) {
+      _lightAngle += (x - _lightStartX) / 40.0;
+      _lightHeight += (_lightStartY - y) / 20.0;
+      _lightStartX = x;
+      _lightStartY = y;
+      requestFrame();
+    }
+}
+
+// Press key to redraw if stopped  drawing.
+static void key(unsigned char c, int x, int y) {
+  if (c == 27) exit(0);  // Escape key
+  if (c == 'f') _isStatsShown = !_isStatsShown;
+  if (c == ' ') _isTurning = !_isTurning;
+  requestFrame();
+}
+
+/**
+ * Set the frame rate cap from $MODEL_FPS, a number, 0 for
+ * none or "vsync" to let the swap wait for the display.
+ */
+static void setFrameRate() {
+  String setting = getenv("MODEL_FPS");
+  if (setting == null) return;
+  if (isStringEqual(setting, "vsync")) {
+    _frameInterval = 0;
+#if defined(__APPLE__)
+    GLint interval = 1;
+    CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &interval);
+#endif
+    return;
+  }
+  double rate = atof(setting);
+  _frameInterval = rate > 0 ? 1 / rate : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/*                                    Main                                    */
+/* -------------------------------------------------------------------------- */
+
+int main(int argc, char **argv) {
+  // Load in the background while the window comes up.
+  Model_parseModelAsync(argc, argv);
+
+  // Init the window.
+  glutInit(&argc, argv);
+  glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL |
+                      GLUT_MULTISAMPLE);
+  glutInitWindowSize(500, 500);
+  glutCreateWindow(argv[1]);
+  String overlay = getenv("MODEL_STATS_OVERLAY");
+  _isStatsShown = overlay != null && isStringEqual(overlay, "on");
+  String turntable = getenv("MODEL_TURNTABLE");
+  _isTurning = turntable == null || !isStringEqual(turntable, "off");
+  setFrameRate();
+  if (SoftwareRenderer_isRequested())
+    _software = new_SoftwareRenderer(Model_parsedData, 500, 500);
+
+  // Init the open gl callbacks.
+  glutDisplayFunc(redraw);
+  glutMouseFunc(mouseControl);
+  glutMotionFunc(motion);
+  glutKeyboardFunc(key);
+  glutSpecialFunc(specialControl);
+
+  // Init the modes and enable.
+  glPolygonOffset(-2.0, -1.0);
+  glEnable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+  glEnable(GL_TEXTURE_2D);
+  glLineWidth(3.0);
+  glMatrixMode(GL_PROJECTION);
+  gluPerspective(40.0,    // Field of view in degree
+                 1.0,     // Asplect ratio
+                 20.0,    // The z near
+                 100.0);  // The z far
+  glMatrixMode(GL_MODELVIEW);
+  gluLookAt(0.0, 8.0, 60.0,  // eye is at (0,0,30)
+            0.0, 8.0, 0.0,   // center is at (0,0,0)
+            0.0, 1.0, 0.);   // up is in positive Y direction
+
+  // Set the lighting
+  glLightModeli(GL_LIGHT_MODEL_LOCAL_VIEWER, 1);
+  glLightfv(GL_LIGHT0, GL_DIFFUSE, _lightColor);
+  glLightf(GL_LIGHT0, GL_CONSTANT_ATTENUATION, 0.1);
+  glLightf(GL_LIGHT0, GL_LINEAR_ATTENUATION, 0.05);
+  glEnable(GL_LIGHT0);
+  glEnable(GL_LIGHTING);
+
+  // Let the vertex colors of the file drive the lit material.
+  glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+
+  // Setup floor plane for projected shadow calculations.
+  findPlane(_floorPlane, _floorVertices[1], _floorVertices[2],
+            _floorVertices[3]);
+
+  glutMainLoop();
+  return 0;
+}
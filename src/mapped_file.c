@@ -0,0 +1,48 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile* new_MappedFile(String filePath) {
+  if (filePath == null) return null;
+  int fd = open(filePath, O_RDONLY);
+  if (fd < 0) return null;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+    close(fd);
+    return null;
+  }
+
+  MappedFile* this = malloc(sizeof(MappedFile));
+  this->length = (size_t)info.st_size;
+  this->isMapped = false;
+  this->data = null;
+
+  // An empty file can not be mapped, leave it as a zero length view.
+  if (this->length == 0) {
+    close(fd);
+    return this;
+  }
+
+  void* bytes = mmap(null, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (bytes == MAP_FAILED) {
+    free(this);
+    return null;
+  }
+
+  // The whole file is scanned front to back once.
+  madvise(bytes, this->length, MADV_SEQUENTIAL);
+  this->data = bytes;
+  this->isMapped = true;
+  return this;
+}
+
+void MappedFile_free(MappedFile* this) {
+  if (this == null) return;
+  if (this->isMapped) munmap((void*)this->data, this->length);
+  free(this);
+}
@@ -0,0 +1,669 @@
+#include "mesh_lod.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "parallel.h"
+
+// Vertices or triangles handled by one task.
+#define LOD_CHUNK 16384
+
+// Cosine of the most a triangle may turn in a collapse.
+#define LOD_MIN_NORMAL_COSINE 0.2
+
+// Vertices around one vertex the collapse checks look at.
+#define LOD_MAX_VALENCE 64
+
+// Marks a vertex without a collapse.
+#define LOD_NONE UINT32_MAX
+
+/**
+ * The sum of the squared distances to some planes, as the
+ * upper triangle of a symmetric 4x4 matrix: aa ab ac ad bb
+ * bc bd cc cd dd.
+ */
+typedef struct {
+  double values[10];
+} __LodQuadric;
+
+/**
+ * The cheapest collapse of a vertex into a neighbor.
+ */
+typedef struct {
+  float cost;
+  uint32_t vertex, target;
+} __LodCollapse;
+
+typedef struct {
+  const float* positions;
+  const float* colors;
+  int vertexCount;
+  __LodQuadric* quadrics;
+  bool* isBoundary;
+  uint32_t* triangles;
+  int triangleCount;
+  uint32_t* starts;    // Of the triangles around each vertex, count + 1.
+  uint32_t* adjacent;  // Triangles around each vertex.
+  __LodCollapse* collapses;
+  uint32_t* remap;
+  bool* isLocked;
+  int* chunkCounts;  // Triangles kept by each task of a pass.
+  uint32_t* kept;    // Triangles of the pass being written.
+  uint32_t* parents;  // Vertex each vertex collapsed into, or itself.
+  float* chunkErrors;  // Largest error each task measured.
+  long collapseCount;
+} __LodSimplifier;
+
+static double __MeshLod_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void __LodQuadric_addPlane(__LodQuadric* this, const double plane[4],
+                                  double weight) {
+  double a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+  double products[10] = {a * a, a * b, a * c, a * d, b * b,
+                         b * c, b * d, c * c, c * d, d * d};
+  for (int next = 0; next < 10; next++)
+    this->values[next] += products[next] * weight;
+}
+
+static double __LodQuadric_evaluate(const __LodQuadric* this,
+                                    const float* point) {
+  const double* q = this->values;
+  double x = point[0], y = point[1], z = point[2];
+  return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+         q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z +
+         2 * q[8] * z + q[9];
+}
+
+/**
+ * Get the normal of a triangle, as long as twice its area.
+ */
+static void __MeshLod_getNormal(const float* a, const float* b, const float* c,
+                                double normal[3]) {
+  double u[3], v[3];
+  for (int axis = 0; axis < 3; axis++) {
+    u[axis] = b[axis] - a[axis];
+    v[axis] = c[axis] - a[axis];
+  }
+  normal[0] = u[1] * v[2] - u[2] * v[1];
+  normal[1] = u[2] * v[0] - u[0] * v[2];
+  normal[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+static double __MeshLod_dot(const double a[3], const double b[3]) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/**
+ * Find the triangles around each vertex.
+ */
+static void __MeshLod_findAdjacent(__LodSimplifier* this) {
+  uint32_t* starts = this->starts;
+  memset(starts, 0, sizeof(uint32_t) * (this->vertexCount + 1));
+  size_t length = (size_t)this->triangleCount * 3;
+  for (size_t corner = 0; corner < length; corner++)
+    starts[this->triangles[corner] + 1]++;
+  for (int vertex = 0; vertex < this->vertexCount; vertex++)
+    starts[vertex + 1] += starts[vertex];
+  // Fill each run from its end, which leaves every start one
+  // vertex ahead.
+  for (size_t corner = length; corner-- > 0;) {
+    uint32_t vertex = this->triangles[corner];
+    this->adjacent[--starts[vertex + 1]] = corner / 3;
+  }
+  memmove(&starts[0], &starts[1], sizeof(uint32_t) * this->vertexCount);
+  starts[this->vertexCount] = length;
+}
+
+static bool __MeshLod_hasCorner(const uint32_t* triangle, uint32_t vertex) {
+  return triangle[0] == vertex || triangle[1] == vertex ||
+         triangle[2] == vertex;
+}
+
+/**
+ * Count the triangles around a vertex that have another.
+ */
+static int __MeshLod_countShared(const __LodSimplifier* this, uint32_t vertex,
+                                 uint32_t other) {
+  int count = 0;
+  for (uint32_t at = this->starts[vertex]; at < this->starts[vertex + 1]; at++)
+    if (__MeshLod_hasCorner(&this->triangles[this->adjacent[at] * 3], other))
+      count++;
+  return count;
+}
+
+/**
+ * Gather the vertices around a vertex, without it.
+ * @return how many, or -1 if more than LOD_MAX_VALENCE.
+ */
+static int __MeshLod_getRing(const __LodSimplifier* this, uint32_t vertex,
+                             uint32_t ring[LOD_MAX_VALENCE]) {
+  int count = 0;
+  for (uint32_t at = this->starts[vertex]; at < this->starts[vertex + 1];
+       at++) {
+    const uint32_t* triangle = &this->triangles[this->adjacent[at] * 3];
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t other = triangle[corner];
+      bool isKnown = other == vertex;
+      for (int next = 0; next < count && !isKnown; next++)
+        isKnown = ring[next] == other;
+      if (isKnown) continue;
+      if (count == LOD_MAX_VALENCE) return -1;
+      ring[count++] = other;
+    }
+  }
+  return count;
+}
+
+/**
+ * Check that collapsing an edge keeps the surface a
+ * manifold: the vertices around both ends are only the
+ * ones across the triangles of the edge.
+ * @param ring around the vertex, count of them.
+ */
+static bool __MeshLod_isLinked(const __LodSimplifier* this,
+                               const uint32_t* ring, int count,
+                               uint32_t target, int sharedCount) {
+  uint32_t targetRing[LOD_MAX_VALENCE];
+  int targetCount = __MeshLod_getRing(this, target, targetRing);
+  if (targetCount < 0) return false;
+  int common = 0;
+  for (int next = 0; next < count; next++)
+    for (int other = 0; other < targetCount; other++)
+      if (ring[next] == targetRing[other]) common++;
+  return common == sharedCount;
+}
+
+/**
+ * Check that no triangle around a vertex turns over or
+ * folds when the vertex moves onto a neighbor.
+ */
+static bool __MeshLod_isFlat(const __LodSimplifier* this, uint32_t vertex,
+                             uint32_t target) {
+  const float* positions = this->positions;
+  const float* to = &positions[target * 3];
+  for (uint32_t at = this->starts[vertex]; at < this->starts[vertex + 1];
+       at++) {
+    const uint32_t* triangle = &this->triangles[this->adjacent[at] * 3];
+    if (__MeshLod_hasCorner(triangle, target)) continue;
+    const float* corners[3];
+    for (int corner = 0; corner < 3; corner++)
+      corners[corner] = &positions[triangle[corner] * 3];
+    double before[3], after[3];
+    __MeshLod_getNormal(corners[0], corners[1], corners[2], before);
+    for (int corner = 0; corner < 3; corner++)
+      if (triangle[corner] == vertex) corners[corner] = to;
+    __MeshLod_getNormal(corners[0], corners[1], corners[2], after);
+    double lengths = sqrt(__MeshLod_dot(before, before) *
+                          __MeshLod_dot(after, after));
+    if (!(__MeshLod_dot(before, after) > LOD_MIN_NORMAL_COSINE * lengths))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Get the cost of moving a vertex onto a neighbor, the
+ * error of their quadrics at the neighbor.
+ */
+static float __MeshLod_getCost(const __LodSimplifier* this, uint32_t vertex,
+                               uint32_t target) {
+  const float* to = &this->positions[target * 3];
+  double cost = __LodQuadric_evaluate(&this->quadrics[vertex], to) +
+                __LodQuadric_evaluate(&this->quadrics[target], to);
+  if (cost < 0) cost = 0;
+  if (this->colors != null) {
+    double difference = 0, length = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      double color = this->colors[vertex * 3 + axis] -
+                     this->colors[target * 3 + axis];
+      double side = this->positions[vertex * 3 + axis] - to[axis];
+      difference += color * color;
+      length += side * side;
+    }
+    cost += LOD_COLOR_WEIGHT * difference * length;
+  }
+  return (float)cost;
+}
+
+/**
+ * Find the cheapest neighbor of each vertex it can move
+ * onto. The costs are cheap to find, so the checks that
+ * the collapse keeps the surface whole only run from the
+ * cheapest until one passes.
+ */
+static void __MeshLod_findCollapses(void* context, int index) {
+  __LodSimplifier* this = context;
+  int first = index * LOD_CHUNK;
+  int last = first + LOD_CHUNK;
+  if (last > this->vertexCount) last = this->vertexCount;
+  uint32_t ring[LOD_MAX_VALENCE];
+  float costs[LOD_MAX_VALENCE];
+  for (int vertex = first; vertex < last; vertex++) {
+    __LodCollapse* collapse = &this->collapses[vertex];
+    *collapse = (__LodCollapse){FLT_MAX, vertex, LOD_NONE};
+    int count = __MeshLod_getRing(this, vertex, ring);
+    for (int next = 0; next < count; next++)
+      costs[next] = __MeshLod_getCost(this, vertex, ring[next]);
+    while (count > 0) {
+      int best = -1;
+      for (int next = 0; next < count; next++)
+        if (costs[next] < FLT_MAX &&
+            (best < 0 || costs[next] < costs[best] ||
+             (costs[next] == costs[best] && ring[next] < ring[best])))
+          best = next;
+      if (best < 0) break;
+      uint32_t target = ring[best];
+      int sharedCount = __MeshLod_countShared(this, vertex, target);
+      // Boundary vertices only slide along the boundary.
+      bool isAllowed = !this->isBoundary[vertex] ||
+                       (this->isBoundary[target] && sharedCount == 1);
+      if (isAllowed && sharedCount <= 2 &&
+          __MeshLod_isLinked(this, ring, count, target, sharedCount) &&
+          __MeshLod_isFlat(this, vertex, target)) {
+        collapse->cost = costs[best];
+        collapse->target = target;
+        break;
+      }
+      costs[best] = FLT_MAX;
+    }
+  }
+}
+
+static int __MeshLod_compareCollapses(const void* a, const void* b) {
+  const __LodCollapse *x = a, *y = b;
+  if (x->cost != y->cost) return x->cost < y->cost ? -1 : 1;
+  return (x->vertex > y->vertex) - (x->vertex < y->vertex);
+}
+
+/**
+ * Lock the vertices of the triangles around a vertex.
+ */
+static void __MeshLod_lockRing(__LodSimplifier* this, uint32_t vertex) {
+  for (uint32_t at = this->starts[vertex]; at < this->starts[vertex + 1];
+       at++) {
+    const uint32_t* triangle = &this->triangles[this->adjacent[at] * 3];
+    for (int corner = 0; corner < 3; corner++)
+      this->isLocked[triangle[corner]] = true;
+  }
+}
+
+static void __MeshLod_countKept(void* context, int index) {
+  __LodSimplifier* this = context;
+  int first = index * LOD_CHUNK;
+  int last = first + LOD_CHUNK;
+  if (last > this->triangleCount) last = this->triangleCount;
+  int count = 0;
+  for (int triangle = first; triangle < last; triangle++) {
+    uint32_t a = this->remap[this->triangles[triangle * 3]];
+    uint32_t b = this->remap[this->triangles[triangle * 3 + 1]];
+    uint32_t c = this->remap[this->triangles[triangle * 3 + 2]];
+    if (a != b && b != c && c != a) count++;
+  }
+  this->chunkCounts[index] = count;
+}
+
+/**
+ * Write the triangles a task keeps after the collapses,
+ * from where the tasks before it stop.
+ */
+static void __MeshLod_writeKept(void* context, int index) {
+  __LodSimplifier* this = context;
+  int first = index * LOD_CHUNK;
+  int last = first + LOD_CHUNK;
+  if (last > this->triangleCount) last = this->triangleCount;
+  uint32_t* out = &this->kept[(size_t)this->chunkCounts[index] * 3];
+  for (int triangle = first; triangle < last; triangle++) {
+    uint32_t a = this->remap[this->triangles[triangle * 3]];
+    uint32_t b = this->remap[this->triangles[triangle * 3 + 1]];
+    uint32_t c = this->remap[this->triangles[triangle * 3 + 2]];
+    if (a == b || b == c || c == a) continue;
+    *out++ = a;
+    *out++ = b;
+    *out++ = c;
+  }
+}
+
+/**
+ * Make one pass of collapses that do not touch each other,
+ * the cheapest first, until the target is reached.
+ * @param target triangles.
+ * @return false if nothing could be collapsed.
+ */
+static bool __MeshLod_pass(__LodSimplifier* this, int target) {
+  __MeshLod_findAdjacent(this);
+  int vertexTasks = (this->vertexCount + LOD_CHUNK - 1) / LOD_CHUNK;
+  Parallel_for(vertexTasks, __MeshLod_findCollapses, this);
+
+  int candidateCount = 0;
+  for (int vertex = 0; vertex < this->vertexCount; vertex++)
+    if (this->collapses[vertex].target != LOD_NONE)
+      this->collapses[candidateCount++] = this->collapses[vertex];
+  qsort(this->collapses, candidateCount, sizeof(__LodCollapse),
+        __MeshLod_compareCollapses);
+
+  memset(this->isLocked, 0, sizeof(bool) * this->vertexCount);
+  int removed = 0, needed = this->triangleCount - target, accepted = 0;
+  for (int next = 0; next < candidateCount && removed < needed; next++) {
+    __LodCollapse* collapse = &this->collapses[next];
+    uint32_t vertex = collapse->vertex, to = collapse->target;
+    if (this->isLocked[vertex] || this->isLocked[to]) continue;
+    removed += __MeshLod_countShared(this, vertex, to);
+    __MeshLod_lockRing(this, vertex);
+    __MeshLod_lockRing(this, to);
+    this->remap[vertex] = to;
+    this->parents[vertex] = to;
+    for (int value = 0; value < 10; value++)
+      this->quadrics[to].values[value] += this->quadrics[vertex].values[value];
+    this->collapses[accepted++] = *collapse;
+  }
+  if (accepted == 0) return false;
+
+  int triangleTasks = (this->triangleCount + LOD_CHUNK - 1) / LOD_CHUNK;
+  Parallel_for(triangleTasks, __MeshLod_countKept, this);
+  int keptCount = 0;
+  for (int task = 0; task < triangleTasks; task++) {
+    int count = this->chunkCounts[task];
+    this->chunkCounts[task] = keptCount;
+    keptCount += count;
+  }
+  Parallel_for(triangleTasks, __MeshLod_writeKept, this);
+  uint32_t* triangles = this->triangles;
+  this->triangles = this->kept;
+  this->kept = triangles;
+  this->triangleCount = keptCount;
+  for (int next = 0; next < accepted; next++)
+    this->remap[this->collapses[next].vertex] = this->collapses[next].vertex;
+  this->collapseCount += accepted;
+  return true;
+}
+
+/**
+ * Get the squared distance from a point to a triangle, to
+ * its closest point found by the region the point is in.
+ */
+static double __MeshLod_getDistance(const float* point, const float* a,
+                                    const float* b, const float* c) {
+  double ab[3], ac[3], ap[3], bp[3], cp[3];
+  for (int axis = 0; axis < 3; axis++) {
+    ab[axis] = b[axis] - a[axis];
+    ac[axis] = c[axis] - a[axis];
+    ap[axis] = point[axis] - a[axis];
+    bp[axis] = point[axis] - b[axis];
+    cp[axis] = point[axis] - c[axis];
+  }
+  double d1 = __MeshLod_dot(ab, ap), d2 = __MeshLod_dot(ac, ap);
+  double d3 = __MeshLod_dot(ab, bp), d4 = __MeshLod_dot(ac, bp);
+  double d5 = __MeshLod_dot(ab, cp), d6 = __MeshLod_dot(ac, cp);
+  double va = d3 * d6 - d5 * d4, vb = d5 * d2 - d1 * d6,
+         vc = d1 * d4 - d3 * d2;
+  // Weights of b and c at the closest point.
+  double v, w;
+  if (d1 <= 0 && d2 <= 0) {
+    v = w = 0;
+  } else if (d3 >= 0 && d4 <= d3) {
+    v = 1, w = 0;
+  } else if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+    v = d1 / (d1 - d3), w = 0;
+  } else if (d6 >= 0 && d5 <= d6) {
+    v = 0, w = 1;
+  } else if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+    v = 0, w = d2 / (d2 - d6);
+  } else if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+    w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    v = 1 - w;
+  } else {
+    double sum = va + vb + vc;
+    v = sum != 0 ? vb / sum : 0;
+    w = sum != 0 ? vc / sum : 0;
+  }
+  double distance = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    double side = ap[axis] - ab[axis] * v - ac[axis] * w;
+    distance += side * side;
+  }
+  return distance;
+}
+
+static void __MeshLod_measureChunk(void* context, int index) {
+  __LodSimplifier* this = context;
+  int first = index * LOD_CHUNK;
+  int last = first + LOD_CHUNK;
+  if (last > this->vertexCount) last = this->vertexCount;
+  const float* positions = this->positions;
+  double largest = 0;
+  for (int vertex = first; vertex < last; vertex++) {
+    uint32_t root = this->remap[vertex];
+    if (root == (uint32_t)vertex) continue;
+    double nearest = -1;
+    for (uint32_t at = this->starts[root]; at < this->starts[root + 1]; at++) {
+      const uint32_t* triangle = &this->triangles[this->adjacent[at] * 3];
+      double distance = __MeshLod_getDistance(
+          &positions[vertex * 3], &positions[triangle[0] * 3],
+          &positions[triangle[1] * 3], &positions[triangle[2] * 3]);
+      if (nearest < 0 || distance < nearest) nearest = distance;
+    }
+    if (nearest > largest) largest = nearest;
+  }
+  this->chunkErrors[index] = sqrt(largest);
+}
+
+/**
+ * Measure how far the current triangles are from the full
+ * mesh, as the largest distance from a vertex collapsed
+ * away to the triangles around the vertex it ended in.
+ * @return the distance in model units.
+ */
+static float __MeshLod_measure(__LodSimplifier* this) {
+  // Follow each vertex to where it ended, in remap for now.
+  for (int vertex = 0; vertex < this->vertexCount; vertex++) {
+    uint32_t root = this->parents[vertex];
+    while (this->parents[root] != root) root = this->parents[root];
+    this->parents[vertex] = root;
+    this->remap[vertex] = root;
+  }
+  __MeshLod_findAdjacent(this);
+  int tasks = (this->vertexCount + LOD_CHUNK - 1) / LOD_CHUNK;
+  Parallel_for(tasks, __MeshLod_measureChunk, this);
+  float error = 0;
+  for (int task = 0; task < tasks; task++)
+    if (this->chunkErrors[task] > error) error = this->chunkErrors[task];
+  for (int vertex = 0; vertex < this->vertexCount; vertex++)
+    this->remap[vertex] = vertex;
+  return error;
+}
+
+/**
+ * Gather the corners of the triangles of the faces, leaving
+ * out those with a corner out of range or twice.
+ */
+static void __MeshLod_gather(__LodSimplifier* this, const FaceBuffer* faces,
+                             const MeshTriangles* triangles) {
+  size_t length = (size_t)triangles->count * 3;
+  this->triangles = malloc(sizeof(uint32_t) * (length + 3));
+  this->kept = malloc(sizeof(uint32_t) * (length + 3));
+  size_t at = 0;
+  for (uint32_t corner = 0; corner < length; corner += 3) {
+    uint32_t a = faces->indices[MeshTriangles_getCorner(triangles, corner)];
+    uint32_t b = faces->indices[MeshTriangles_getCorner(triangles, corner + 1)];
+    uint32_t c = faces->indices[MeshTriangles_getCorner(triangles, corner + 2)];
+    if (a >= (uint32_t)this->vertexCount || b >= (uint32_t)this->vertexCount ||
+        c >= (uint32_t)this->vertexCount || a == b || b == c || c == a)
+      continue;
+    this->triangles[at++] = a;
+    this->triangles[at++] = b;
+    this->triangles[at++] = c;
+  }
+  this->triangleCount = at / 3;
+}
+
+/**
+ * Sum the planes of the triangles into the quadrics of
+ * their corners, and hold the boundary edges with planes
+ * across them.
+ */
+static void __MeshLod_addPlanes(__LodSimplifier* this) {
+  __MeshLod_findAdjacent(this);
+  const float* positions = this->positions;
+  for (int triangle = 0; triangle < this->triangleCount; triangle++) {
+    const uint32_t* corners = &this->triangles[triangle * 3];
+    const float* points[3];
+    for (int corner = 0; corner < 3; corner++)
+      points[corner] = &positions[corners[corner] * 3];
+    double normal[3];
+    __MeshLod_getNormal(points[0], points[1], points[2], normal);
+    double length = sqrt(__MeshLod_dot(normal, normal));
+    if (length == 0) continue;
+    double plane[4] = {normal[0] / length, normal[1] / length,
+                       normal[2] / length, 0};
+    plane[3] = -(plane[0] * points[0][0] + plane[1] * points[0][1] +
+                 plane[2] * points[0][2]);
+    for (int corner = 0; corner < 3; corner++)
+      __LodQuadric_addPlane(&this->quadrics[corners[corner]], plane, 1);
+
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t from = corners[corner], to = corners[(corner + 1) % 3];
+      if (__MeshLod_countShared(this, from, to) != 1) continue;
+      this->isBoundary[from] = this->isBoundary[to] = true;
+      const float* a = points[corner];
+      const float* b = points[(corner + 1) % 3];
+      double edge[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      double across[3] = {edge[1] * plane[2] - edge[2] * plane[1],
+                          edge[2] * plane[0] - edge[0] * plane[2],
+                          edge[0] * plane[1] - edge[1] * plane[0]};
+      double acrossLength = sqrt(__MeshLod_dot(across, across));
+      if (acrossLength == 0) continue;
+      double side[4] = {across[0] / acrossLength, across[1] / acrossLength,
+                        across[2] / acrossLength, 0};
+      side[3] = -(side[0] * a[0] + side[1] * a[1] + side[2] * a[2]);
+      __LodQuadric_addPlane(&this->quadrics[from], side, LOD_BOUNDARY_WEIGHT);
+      __LodQuadric_addPlane(&this->quadrics[to], side, LOD_BOUNDARY_WEIGHT);
+    }
+  }
+}
+
+/**
+ * Set the bounding sphere of the mesh, around the middle
+ * of its bounding box.
+ */
+static void __MeshLod_setBounds(MeshLod* this, const float* positions,
+                                int vertexCount) {
+  float min[3] = {0, 0, 0}, max[3] = {0, 0, 0};
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    for (int axis = 0; axis < 3; axis++) {
+      float value = positions[vertex * 3 + axis];
+      if (vertex == 0 || value < min[axis]) min[axis] = value;
+      if (vertex == 0 || value > max[axis]) max[axis] = value;
+    }
+  double radius = 0;
+  for (int axis = 0; axis < 3; axis++)
+    this->center[axis] = (min[axis] + max[axis]) / 2;
+  for (int vertex = 0; vertex < vertexCount; vertex++) {
+    double distance = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      double side = positions[vertex * 3 + axis] - this->center[axis];
+      distance += side * side;
+    }
+    if (distance > radius) radius = distance;
+  }
+  this->radius = sqrt(radius);
+}
+
+MeshLod* new_MeshLod(const FaceBuffer* faces, const MeshTriangles* triangles,
+                     const float* positions, const float* colors,
+                     int vertexCount) {
+  double start = __MeshLod_now();
+  MeshLod* this = malloc(sizeof(MeshLod));
+  memset(this, 0, sizeof(MeshLod));
+  __MeshLod_setBounds(this, positions, vertexCount);
+
+  __LodSimplifier simplifier = {
+      .positions = positions,
+      .colors = colors,
+      .vertexCount = vertexCount,
+      .quadrics = calloc(vertexCount + 1, sizeof(__LodQuadric)),
+      .isBoundary = calloc(vertexCount + 1, sizeof(bool)),
+      .starts = malloc(sizeof(uint32_t) * (vertexCount + 1)),
+      .collapses = malloc(sizeof(__LodCollapse) * (vertexCount + 1)),
+      .remap = malloc(sizeof(uint32_t) * (vertexCount + 1)),
+      .isLocked = malloc(sizeof(bool) * (vertexCount + 1)),
+      .parents = malloc(sizeof(uint32_t) * (vertexCount + 1)),
+      .chunkErrors = malloc(sizeof(float) * (vertexCount / LOD_CHUNK + 1)),
+  };
+  __MeshLod_gather(&simplifier, faces, triangles);
+  simplifier.adjacent =
+      malloc(sizeof(uint32_t) * ((size_t)simplifier.triangleCount * 3 + 1));
+  simplifier.chunkCounts =
+      malloc(sizeof(int) * (simplifier.triangleCount / LOD_CHUNK + 1));
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    simplifier.remap[vertex] = simplifier.parents[vertex] = vertex;
+  __MeshLod_addPlanes(&simplifier);
+
+  this->levels[0] = (LodLevel){.triangleCount = simplifier.triangleCount};
+  this->levelCount = 1;
+  int target = simplifier.triangleCount / 2;
+  while (this->levelCount < LOD_MAX_LEVELS && target >= LOD_MIN_TRIANGLES) {
+    int before = simplifier.triangleCount;
+    while (simplifier.triangleCount > target)
+      if (!__MeshLod_pass(&simplifier, target)) break;
+    // Stop once the collapses left would barely thin the mesh.
+    if (simplifier.triangleCount > before * 3 / 4) break;
+    size_t bytes = sizeof(uint32_t) * simplifier.triangleCount * 3;
+    LodLevel* level = &this->levels[this->levelCount++];
+    level->indices = malloc(bytes + sizeof(uint32_t));
+    memcpy(level->indices, simplifier.triangles, bytes);
+    level->triangleCount = simplifier.triangleCount;
+    // The error only grows along the chain, so the pick is steady.
+    float error = __MeshLod_measure(&simplifier);
+    float previous = this->levels[this->levelCount - 2].error;
+    level->error = error > previous ? error : previous;
+    target = simplifier.triangleCount / 2;
+  }
+
+  this->collapses = simplifier.collapseCount;
+  dispose(simplifier.quadrics, simplifier.isBoundary, simplifier.triangles,
+          simplifier.kept, simplifier.starts, simplifier.adjacent,
+          simplifier.collapses, simplifier.remap, simplifier.isLocked,
+          simplifier.chunkCounts, simplifier.parents, simplifier.chunkErrors);
+  this->seconds = __MeshLod_now() - start;
+  return this;
+}
+
+void MeshLod_free(MeshLod* this) {
+  if (this == null) return;
+  for (int level = 1; level < this->levelCount; level++)
+    free(this->levels[level].indices);
+  free(this);
+}
+
+int MeshLod_select(const MeshLod* this, const float projection[16],
+                   const float modelview[16], int viewportHeight, float pixels,
+                   float* pixelError) {
+  *pixelError = 0;
+  // The model is only turned and moved, so any column gives the scale.
+  float scale = sqrtf(modelview[0] * modelview[0] + modelview[1] * modelview[1] +
+                      modelview[2] * modelview[2]);
+  float depth = -(modelview[2] * this->center[0] +
+                  modelview[6] * this->center[1] +
+                  modelview[10] * this->center[2] + modelview[14]);
+  // Pixels per model unit at the nearest point of the bounds.
+  float pixelsPerUnit = projection[5] * viewportHeight / 2 * scale;
+  if (projection[15] == 0) {
+    float distance = depth - this->radius * scale;
+    if (distance <= 0) return 0;
+    pixelsPerUnit /= distance;
+  }
+  for (int level = this->levelCount - 1; level > 0; level--) {
+    float error = this->levels[level].error * pixelsPerUnit;
+    if (error <= pixels) {
+      *pixelError = error;
+      return level;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,231 @@
+#include "mesh_normals.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "parallel.h"
+
+// Faces or vertices handled by one task.
+#define MESH_NORMALS_CHUNK 32768
+
+typedef struct {
+  const VertexBuffer* vertices;
+  const FaceBuffer* faces;
+  MeshNormalsOptions options;
+  float* faceNormals;      // Unit xyz per face.
+  float* cornerWeights;    // Weight of each corner for its vertex.
+  uint32_t* cornerFaces;   // Face of each corner.
+  uint32_t* firstCorners;  // Adjacency, vertex count plus one starts.
+  uint32_t* adjacency;     // Corners of each vertex.
+  MeshNormals normals;
+} __MeshNormalsJob;
+
+MeshNormalsOptions MeshNormals_getDefaultOptions() {
+  MeshNormalsOptions options = {.weighting = NORMALS_AREA_WEIGHTED,
+                                .creaseAngle = 0,
+                                .isFlipped = false};
+  String weighting = getenv("MODEL_NORMALS");
+  if (weighting != null && isStringEqual(weighting, "angle"))
+    options.weighting = NORMALS_ANGLE_WEIGHTED;
+  String creaseAngle = getenv("MODEL_CREASE_ANGLE");
+  if (creaseAngle != null) options.creaseAngle = atof(creaseAngle);
+  return options;
+}
+
+static void __MeshNormals_normalize(double vector[3], float* normal) {
+  double length = sqrt(vector[0] * vector[0] + vector[1] * vector[1] +
+                       vector[2] * vector[2]);
+  if (length == 0) length = 1;
+  for (int axis = 0; axis < 3; axis++) normal[axis] = vector[axis] / length;
+}
+
+static int __MeshNormals_countTasks(int count) {
+  return (count + MESH_NORMALS_CHUNK - 1) / MESH_NORMALS_CHUNK;
+}
+
+/**
+ * Sum the cross products around a face with Newell's
+ * method, which also handles polygons. It points along the
+ * normal and is twice as long as the area.
+ */
+static void __MeshNormals_sumFace(const VertexBuffer* vertices,
+                                  const FaceBuffer* faces, int face,
+                                  double sum[3]) {
+  uint32_t count = FaceBuffer_getCornerCount(faces, face);
+  const uint32_t* corners = &faces->indices[FaceBuffer_getStart(faces, face)];
+  double current[3], following[3];
+  sum[0] = sum[1] = sum[2] = 0;
+  for (uint32_t next = 0; next < count; next++) {
+    VertexBuffer_getPoint(vertices, corners[next], current);
+    VertexBuffer_getPoint(vertices, corners[(next + 1) % count], following);
+    sum[0] += (current[1] - following[1]) * (current[2] + following[2]);
+    sum[1] += (current[2] - following[2]) * (current[0] + following[0]);
+    sum[2] += (current[0] - following[0]) * (current[1] + following[1]);
+  }
+}
+
+void MeshNormals_ofFaces(const VertexBuffer* vertices, const FaceBuffer* faces,
+                         int first, int last, float* normals) {
+  double sum[3];
+  for (int face = first; face < last; face++) {
+    __MeshNormals_sumFace(vertices, faces, face, sum);
+    __MeshNormals_normalize(sum, &normals[face * 3]);
+  }
+}
+
+/**
+ * Find the normal of each face and the weight of each of
+ * its corners.
+ */
+static void __MeshNormals_faceTask(void* context, int index) {
+  __MeshNormalsJob* job = context;
+  const FaceBuffer* faces = job->faces;
+  int first = index * MESH_NORMALS_CHUNK;
+  int last = first + MESH_NORMALS_CHUNK;
+  if (last > faces->count) last = faces->count;
+  double sign = job->options.isFlipped ? -1 : 1;
+  for (int face = first; face < last; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    uint32_t start = FaceBuffer_getStart(faces, face);
+    const uint32_t* corners = &faces->indices[start];
+    double sum[3];
+    __MeshNormals_sumFace(job->vertices, faces, face, sum);
+    for (int axis = 0; axis < 3; axis++) sum[axis] *= sign;
+    __MeshNormals_normalize(sum, &job->faceNormals[face * 3]);
+    double area =
+        0.5 * sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+
+    for (uint32_t next = 0; next < count; next++) {
+      job->cornerFaces[start + next] = face;
+      if (job->options.weighting == NORMALS_AREA_WEIGHTED) {
+        job->cornerWeights[start + next] = area;
+        continue;
+      }
+      // The angle between the two edges leaving the corner.
+      double at[3], before[3], after[3];
+      VertexBuffer_getPoint(job->vertices, corners[next], at);
+      VertexBuffer_getPoint(job->vertices, corners[(next + count - 1) % count],
+                            before);
+      VertexBuffer_getPoint(job->vertices, corners[(next + 1) % count], after);
+      double dot = 0, beforeLength = 0, afterLength = 0;
+      for (int axis = 0; axis < 3; axis++) {
+        before[axis] -= at[axis];
+        after[axis] -= at[axis];
+        dot += before[axis] * after[axis];
+        beforeLength += before[axis] * before[axis];
+        afterLength += after[axis] * after[axis];
+      }
+      double lengths = sqrt(beforeLength * afterLength);
+      double cosine = lengths > 0 ? dot / lengths : 1;
+      if (cosine > 1) cosine = 1;
+      if (cosine < -1) cosine = -1;
+      job->cornerWeights[start + next] = acos(cosine);
+    }
+  }
+}
+
+/**
+ * Build the corners of each vertex. Counting and filling
+ * is one cheap pass over the indices, so it stays serial.
+ */
+static void __MeshNormals_buildAdjacency(__MeshNormalsJob* job) {
+  int vertexCount = job->vertices->count;
+  const FaceBuffer* faces = job->faces;
+  uint32_t* firstCorners = calloc(vertexCount + 1, sizeof(uint32_t));
+  for (size_t next = 0; next < faces->length; next++)
+    firstCorners[faces->indices[next] + 1]++;
+  for (int next = 0; next < vertexCount; next++)
+    firstCorners[next + 1] += firstCorners[next];
+  uint32_t* filled = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  memcpy(filled, firstCorners, sizeof(uint32_t) * (vertexCount + 1));
+  uint32_t* adjacency = malloc(sizeof(uint32_t) * (faces->length + 1));
+  for (size_t next = 0; next < faces->length; next++)
+    adjacency[filled[faces->indices[next]]++] = next;
+  free(filled);
+  job->firstCorners = firstCorners;
+  job->adjacency = adjacency;
+}
+
+/**
+ * Sum the weighted normals of the faces around a vertex.
+ * @param around the face normal the faces must be within
+ * the crease angle of, or null to take every face.
+ */
+static void __MeshNormals_gather(__MeshNormalsJob* job, uint32_t vertex,
+                                 const float* around, double minCosine,
+                                 float* normal) {
+  double sum[3] = {0, 0, 0};
+  for (uint32_t next = job->firstCorners[vertex];
+       next < job->firstCorners[vertex + 1]; next++) {
+    uint32_t corner = job->adjacency[next];
+    const float* faceNormal = &job->faceNormals[job->cornerFaces[corner] * 3];
+    if (around != null && around[0] * faceNormal[0] +
+                                  around[1] * faceNormal[1] +
+                                  around[2] * faceNormal[2] <
+                              minCosine)
+      continue;
+    double weight = job->cornerWeights[corner];
+    for (int axis = 0; axis < 3; axis++) sum[axis] += weight * faceNormal[axis];
+  }
+  __MeshNormals_normalize(sum, normal);
+}
+
+static void __MeshNormals_vertexTask(void* context, int index) {
+  __MeshNormalsJob* job = context;
+  int first = index * MESH_NORMALS_CHUNK;
+  int last = first + MESH_NORMALS_CHUNK;
+  if (last > job->vertices->count) last = job->vertices->count;
+  for (int vertex = first; vertex < last; vertex++)
+    __MeshNormals_gather(job, vertex, null, 0,
+                         &job->normals.vertices[vertex * 3]);
+}
+
+static void __MeshNormals_cornerTask(void* context, int index) {
+  __MeshNormalsJob* job = context;
+  const FaceBuffer* faces = job->faces;
+  double minCosine = cos(job->options.creaseAngle * M_PI / 180.0);
+  int first = index * MESH_NORMALS_CHUNK;
+  int last = first + MESH_NORMALS_CHUNK;
+  if (last > faces->count) last = faces->count;
+  for (int face = first; face < last; face++) {
+    uint32_t start = FaceBuffer_getStart(faces, face);
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    for (uint32_t corner = start; corner < start + count; corner++)
+      __MeshNormals_gather(job, faces->indices[corner],
+                           &job->faceNormals[face * 3], minCosine,
+                           &job->normals.corners[corner * 3]);
+  }
+}
+
+void MeshNormals_generate(const VertexBuffer* vertices,
+                          const FaceBuffer* faces, MeshNormalsOptions options,
+                          MeshNormals* normals) {
+  __MeshNormalsJob job = {.vertices = vertices,
+                          .faces = faces,
+                          .options = options,
+                          .normals = *normals};
+  int vertexCount = vertices->count;
+  int faceCount = faces != null ? faces->count : 0;
+  size_t cornerCount = faces != null ? faces->length : 0;
+  if (faceCount == 0) {
+    // Vertices without faces have no direction.
+    if (normals->vertices != null)
+      memset(normals->vertices, 0, sizeof(float) * 3 * vertexCount);
+    return;
+  }
+
+  job.faceNormals = malloc(sizeof(float) * 3 * faceCount);
+  job.cornerWeights = malloc(sizeof(float) * cornerCount);
+  job.cornerFaces = malloc(sizeof(uint32_t) * cornerCount);
+  Parallel_for(__MeshNormals_countTasks(faceCount), __MeshNormals_faceTask,
+               &job);
+  __MeshNormals_buildAdjacency(&job);
+  if (job.normals.vertices != null)
+    Parallel_for(__MeshNormals_countTasks(vertexCount),
+                 __MeshNormals_vertexTask, &job);
+  if (job.normals.corners != null && options.creaseAngle > 0)
+    Parallel_for(__MeshNormals_countTasks(faceCount), __MeshNormals_cornerTask,
+                 &job);
+  dispose(job.faceNormals, job.cornerWeights, job.cornerFaces,
+          job.firstCorners, job.adjacency);
+}
@@ -0,0 +1,337 @@
+#include "mesh_order.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+// Score of the corners of the last face, which stay in the cache.
+#define ORDER_LAST_FACE_SCORE 0.75f
+
+// How fast the score falls down the cache.
+#define ORDER_CACHE_DECAY_POWER 1.5f
+
+// Bonus of the vertices with few faces left, to finish them off.
+#define ORDER_VALENCE_BOOST_SCALE 2.0f
+#define ORDER_VALENCE_BOOST_POWER 0.5f
+
+// Marks a vertex not in the cache, or not numbered yet.
+#define ORDER_NONE UINT32_MAX
+
+static int _defaultMode = -1;
+
+void MeshOrder_setDefaultMode(MeshOrderMode mode) { _defaultMode = mode; }
+
+MeshOrderMode MeshOrder_getDefaultMode() {
+  if (_defaultMode >= 0) return _defaultMode;
+  String fromEnvironment = getenv("MODEL_REORDER");
+  if (fromEnvironment == null) return MESH_ORDER_OFF;
+  if (isStringEqual(fromEnvironment, "load")) return MESH_ORDER_LOAD;
+  if (isStringEqual(fromEnvironment, "cache")) return MESH_ORDER_CACHE;
+  return MESH_ORDER_OFF;
+}
+
+static double __MeshOrder_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+MeshCacheStats MeshOrder_measure(const FaceBuffer* faces, int vertexCount) {
+  MeshCacheStats stats = {0, 0};
+  if (faces == null || vertexCount <= 0) return stats;
+  // The miss count when each vertex last entered the cache, -1 if never.
+  long* cachedAt = malloc(sizeof(long) * vertexCount);
+  for (int vertex = 0; vertex < vertexCount; vertex++) cachedAt[vertex] = -1;
+  long misses = 0, triangles = 0, used = 0;
+  for (int face = 0; face < faces->count; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    for (uint32_t corner = 1; corner + 1 < count; corner++) {
+      uint32_t triangle[3] = {corners[0], corners[corner], corners[corner + 1]};
+      for (int next = 0; next < 3; next++) {
+        uint32_t vertex = triangle[next];
+        if (cachedAt[vertex] >= 0 &&
+            misses - cachedAt[vertex] <= MESH_ORDER_FIFO_SIZE)
+          continue;
+        if (cachedAt[vertex] < 0) used++;
+        cachedAt[vertex] = misses++;
+      }
+      triangles++;
+    }
+  }
+  free(cachedAt);
+  if (triangles > 0) stats.acmr = (double)misses / triangles;
+  if (used > 0) stats.atvr = (double)misses / used;
+  return stats;
+}
+
+/**
+ * The state of the greedy reordering.
+ */
+typedef struct {
+  const FaceBuffer* faces;
+  uint32_t* valences;  // Faces left around each vertex.
+  uint32_t* starts;    // Of the faces around each vertex, count + 1.
+  uint32_t* adjacent;  // Faces around each vertex, the ones left first.
+  int* positions;      // In the cache, -1 if out.
+  float* vertexScores;
+  float* faceScores;  // -1 once the face is taken.
+  uint32_t* cache;    // Vertices from the most recent.
+  int cacheCount;
+  uint32_t* nextCache;  // The cache being built, room for a face more.
+  uint32_t* stamps;     // Face that last put each vertex in the next cache.
+  float positionScores[MESH_ORDER_CACHE_SIZE];
+  int lastCount;  // Corners of the last face the position scores are for.
+} __MeshOrderer;
+
+static float __MeshOrderer_getScore(__MeshOrderer* this, uint32_t vertex) {
+  uint32_t valence = this->valences[vertex];
+  if (valence == 0) return -1;
+  int position = this->positions[vertex];
+  float score = position >= 0 ? this->positionScores[position] : 0;
+  return score + ORDER_VALENCE_BOOST_SCALE *
+                     powf((float)valence, -ORDER_VALENCE_BOOST_POWER);
+}
+
+/**
+ * Score the cache positions after a face, whose corners
+ * are the most recent entries.
+ */
+static void __MeshOrderer_scorePositions(__MeshOrderer* this, int lastCount) {
+  if (lastCount == this->lastCount) return;
+  this->lastCount = lastCount;
+  for (int position = 0; position < MESH_ORDER_CACHE_SIZE; position++) {
+    if (position < lastCount) {
+      this->positionScores[position] = ORDER_LAST_FACE_SCORE;
+      continue;
+    }
+    float fade = 1 - (float)(position - lastCount) /
+                         (MESH_ORDER_CACHE_SIZE - lastCount);
+    this->positionScores[position] = powf(fade, ORDER_CACHE_DECAY_POWER);
+  }
+}
+
+/**
+ * List the faces around each vertex.
+ */
+static void __MeshOrderer_findAdjacent(__MeshOrderer* this, int vertexCount) {
+  const FaceBuffer* faces = this->faces;
+  uint32_t* starts = this->starts;
+  memset(starts, 0, sizeof(uint32_t) * (vertexCount + 1));
+  for (size_t next = 0; next < faces->length; next++)
+    starts[faces->indices[next] + 1]++;
+  for (int vertex = 0; vertex < vertexCount; vertex++) {
+    this->valences[vertex] = starts[vertex + 1];
+    starts[vertex + 1] += starts[vertex];
+  }
+  // Fill each list from its end, which leaves its start one to the right.
+  for (int face = faces->count - 1; face >= 0; face--) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    for (uint32_t corner = 0; corner < count; corner++)
+      this->adjacent[--starts[corners[corner] + 1]] = face;
+  }
+  memmove(starts, starts + 1, sizeof(uint32_t) * vertexCount);
+  starts[vertexCount] = (uint32_t)faces->length;
+}
+
+/**
+ * Take a face out of the lists of its corners.
+ */
+static void __MeshOrderer_take(__MeshOrderer* this, int face) {
+  uint32_t count = FaceBuffer_getCornerCount(this->faces, face);
+  const uint32_t* corners = FaceBuffer_getCorners(this->faces, face);
+  this->faceScores[face] = -1;
+  for (uint32_t corner = 0; corner < count; corner++) {
+    uint32_t vertex = corners[corner];
+    uint32_t* around = &this->adjacent[this->starts[vertex]];
+    uint32_t last = --this->valences[vertex];
+    for (uint32_t next = 0; next <= last; next++) {
+      if (around[next] != (uint32_t)face) continue;
+      around[next] = around[last];
+      around[last] = face;
+      break;
+    }
+  }
+}
+
+/**
+ * Put the corners of a face in front of the cache and
+ * rescore what moved.
+ * @return the face left around the cache that scores best, or -1.
+ */
+static int __MeshOrderer_update(__MeshOrderer* this, int face) {
+  uint32_t count = FaceBuffer_getCornerCount(this->faces, face);
+  const uint32_t* corners = FaceBuffer_getCorners(this->faces, face);
+  int nextCount = 0;
+  for (uint32_t corner = 0; corner < count; corner++) {
+    uint32_t vertex = corners[corner];
+    if (this->stamps[vertex] == (uint32_t)face) continue;
+    this->stamps[vertex] = face;
+    this->nextCache[nextCount++] = vertex;
+  }
+  int lastCount = nextCount;
+  for (int next = 0; next < this->cacheCount; next++) {
+    uint32_t vertex = this->cache[next];
+    if (this->stamps[vertex] == (uint32_t)face) continue;
+    this->stamps[vertex] = face;
+    this->nextCache[nextCount++] = vertex;
+  }
+
+  // Rescore the vertices, the ones pushed out included.
+  __MeshOrderer_scorePositions(this, lastCount);
+  for (int next = 0; next < nextCount; next++) {
+    uint32_t vertex = this->nextCache[next];
+    this->positions[vertex] = next < MESH_ORDER_CACHE_SIZE ? next : -1;
+    this->vertexScores[vertex] = __MeshOrderer_getScore(this, vertex);
+  }
+
+  // Rescore the faces left around them.
+  int best = -1;
+  float bestScore = -1;
+  for (int next = 0; next < nextCount; next++) {
+    uint32_t vertex = this->nextCache[next];
+    const uint32_t* around = &this->adjacent[this->starts[vertex]];
+    for (uint32_t at = 0; at < this->valences[vertex]; at++) {
+      int neighbor = around[at];
+      uint32_t neighborCount = FaceBuffer_getCornerCount(this->faces, neighbor);
+      const uint32_t* neighborCorners =
+          FaceBuffer_getCorners(this->faces, neighbor);
+      float score = 0;
+      for (uint32_t corner = 0; corner < neighborCount; corner++)
+        score += this->vertexScores[neighborCorners[corner]];
+      this->faceScores[neighbor] = score;
+      if (next < MESH_ORDER_CACHE_SIZE && score > bestScore) {
+        bestScore = score;
+        best = neighbor;
+      }
+    }
+  }
+
+  this->cacheCount =
+      nextCount < MESH_ORDER_CACHE_SIZE ? nextCount : MESH_ORDER_CACHE_SIZE;
+  memcpy(this->cache, this->nextCache, sizeof(uint32_t) * this->cacheCount);
+  return best;
+}
+
+/**
+ * Find the order of the faces.
+ * @param order to be filled with the face at each position.
+ */
+static void __MeshOrder_sortFaces(const FaceBuffer* faces, int vertexCount,
+                                  uint32_t* order) {
+  uint32_t maxCount = 0;
+  for (int face = 0; face < faces->count; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    if (count > maxCount) maxCount = count;
+  }
+  __MeshOrderer orderer = {
+      .faces = faces,
+      .valences = malloc(sizeof(uint32_t) * (vertexCount + 1)),
+      .starts = malloc(sizeof(uint32_t) * (vertexCount + 2)),
+      .adjacent = malloc(sizeof(uint32_t) * (faces->length + 1)),
+      .positions = malloc(sizeof(int) * (vertexCount + 1)),
+      .vertexScores = malloc(sizeof(float) * (vertexCount + 1)),
+      .faceScores = malloc(sizeof(float) * (faces->count + 1)),
+      .cache = malloc(sizeof(uint32_t) * MESH_ORDER_CACHE_SIZE),
+      .cacheCount = 0,
+      .nextCache =
+          malloc(sizeof(uint32_t) * (MESH_ORDER_CACHE_SIZE + maxCount)),
+      .stamps = malloc(sizeof(uint32_t) * (vertexCount + 1)),
+      .lastCount = -1};
+  __MeshOrderer* this = &orderer;
+  __MeshOrderer_findAdjacent(this, vertexCount);
+  __MeshOrderer_scorePositions(this, 3);
+  for (int vertex = 0; vertex < vertexCount; vertex++) {
+    this->positions[vertex] = -1;
+    this->stamps[vertex] = ORDER_NONE;
+    this->vertexScores[vertex] = __MeshOrderer_getScore(this, vertex);
+  }
+  for (int face = 0; face < faces->count; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    float score = 0;
+    for (uint32_t corner = 0; corner < count; corner++)
+      score += this->vertexScores[corners[corner]];
+    this->faceScores[face] = score;
+  }
+
+  // Past a dead end, go on from the first face left in the file order.
+  int best = -1, cursor = 0;
+  for (int taken = 0; taken < faces->count; taken++) {
+    if (best < 0) {
+      while (this->faceScores[cursor] < 0) cursor++;
+      best = cursor;
+    }
+    order[taken] = best;
+    __MeshOrderer_take(this, best);
+    best = __MeshOrderer_update(this, best);
+  }
+
+  dispose(orderer.valences, orderer.starts, orderer.adjacent,
+          orderer.positions, orderer.vertexScores, orderer.faceScores,
+          orderer.cache, orderer.nextCache, orderer.stamps);
+}
+
+MeshOrder MeshOrder_optimize(FaceBuffer* faces, int vertexCount,
+                             uint32_t* remap) {
+  double start = __MeshOrder_now();
+  MeshOrder result = {.isReordered = true};
+  result.before = MeshOrder_measure(faces, vertexCount);
+  uint32_t* order = malloc(sizeof(uint32_t) * (faces->count + 1));
+  __MeshOrder_sortFaces(faces, vertexCount, order);
+
+  // Number the vertices as the faces first use them.
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    remap[vertex] = ORDER_NONE;
+  uint32_t numbered = 0;
+  for (int position = 0; position < faces->count; position++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, order[position]);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, order[position]);
+    for (uint32_t corner = 0; corner < count; corner++)
+      if (remap[corners[corner]] == ORDER_NONE)
+        remap[corners[corner]] = numbered++;
+  }
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    if (remap[vertex] == ORDER_NONE) remap[vertex] = numbered++;
+
+  // Write the faces in their order with the new numbers.
+  uint32_t* indices = malloc(sizeof(uint32_t) * (faces->length + 1));
+  uint32_t* offsets =
+      faces->offsets != null ? malloc(sizeof(uint32_t) * (faces->count + 1))
+                             : null;
+  uint32_t at = 0;
+  for (int position = 0; position < faces->count; position++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, order[position]);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, order[position]);
+    if (offsets != null) offsets[position] = at;
+    for (uint32_t corner = 0; corner < count; corner++)
+      indices[at++] = remap[corners[corner]];
+  }
+  memcpy(faces->indices, indices, sizeof(uint32_t) * faces->length);
+  if (offsets != null) {
+    offsets[faces->count] = at;
+    memcpy(faces->offsets, offsets, sizeof(uint32_t) * (faces->count + 1));
+  }
+  dispose(indices, offsets, order);
+
+  result.after = MeshOrder_measure(faces, vertexCount);
+  result.seconds = __MeshOrder_now() - start;
+  return result;
+}
+
+void MeshOrder_remap(const void* values, size_t size, const uint32_t* remap,
+                     int vertexCount, void* moved) {
+  if (values == null) return;
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    memcpy((char*)moved + remap[vertex] * size,
+           (const char*)values + vertex * size, size);
+}
+
+void MeshOrder_remapVertices(const VertexBuffer* vertices,
+                             const uint32_t* remap, VertexBuffer* moved) {
+  for (int axis = 0; axis < 3; axis++)
+    for (int vertex = 0; vertex < vertices->count; vertex++)
+      VertexBuffer_set(moved, remap[vertex], axis,
+                       VertexBuffer_get(vertices, vertex, axis));
+}
@@ -0,0 +1,204 @@
+#include "mesh_stats.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "parallel.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Vertices and faces swept by one task.
+#define MESH_STATS_VERTEX_CHUNK 65536
+#define MESH_STATS_FACE_CHUNK 32768
+
+/**
+ * The statistics of one chunk, merged in order afterwards
+ * so the result does not depend on the thread count.
+ */
+typedef struct {
+  double min[3], max[3], sum[3];
+  double area, volume;
+  uint32_t minIndex, maxIndex;
+  bool hasVertex, hasIndex;
+} __MeshStatsPart;
+
+typedef struct {
+  const VertexBuffer* vertices;
+  const FaceBuffer* faces;
+  int vertexTasks;
+  __MeshStatsPart* parts;
+} __MeshStatsJob;
+
+/**
+ * Sweep one axis of a range of vertices. Contiguous
+ * float32 values go four at a time, summed in doubles.
+ */
+static void __MeshStats_sweepAxis(const VertexBuffer* vertices, int axis,
+                                  int first, int last, double* min,
+                                  double* max, double* sum) {
+  double low = VertexBuffer_get(vertices, first, axis), high = low, total = 0;
+  int next = first;
+#if defined(__SSE2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+  if (vertices->stride == 1 && vertices->precision == VERTEX_FLOAT32 &&
+      last - first >= 4) {
+    const float* values = (const float*)vertices->axes[axis];
+#if defined(__SSE2__)
+    __m128 lows = _mm_set1_ps(values[first]), highs = lows;
+    __m128d totals = _mm_setzero_pd();
+    for (; next + 4 <= last; next += 4) {
+      __m128 four = _mm_loadu_ps(values + next);
+      lows = _mm_min_ps(lows, four);
+      highs = _mm_max_ps(highs, four);
+      totals = _mm_add_pd(totals, _mm_cvtps_pd(four));
+      totals = _mm_add_pd(totals, _mm_cvtps_pd(_mm_movehl_ps(four, four)));
+    }
+    float lowLanes[4], highLanes[4];
+    double totalLanes[2];
+    _mm_storeu_ps(lowLanes, lows);
+    _mm_storeu_ps(highLanes, highs);
+    _mm_storeu_pd(totalLanes, totals);
+    for (int lane = 0; lane < 4; lane++) {
+      if (lowLanes[lane] < low) low = lowLanes[lane];
+      if (highLanes[lane] > high) high = highLanes[lane];
+    }
+    total = totalLanes[0] + totalLanes[1];
+#else
+    float32x4_t lows = vdupq_n_f32(values[first]), highs = lows;
+    float64x2_t totals = vdupq_n_f64(0);
+    for (; next + 4 <= last; next += 4) {
+      float32x4_t four = vld1q_f32(values + next);
+      lows = vminq_f32(lows, four);
+      highs = vmaxq_f32(highs, four);
+      totals = vaddq_f64(totals, vcvt_f64_f32(vget_low_f32(four)));
+      totals = vaddq_f64(totals, vcvt_high_f64_f32(four));
+    }
+    low = vminvq_f32(lows);
+    high = vmaxvq_f32(highs);
+    total = vaddvq_f64(totals);
+#endif
+  }
+#endif
+  for (; next < last; next++) {
+    double value = VertexBuffer_get(vertices, next, axis);
+    if (value < low) low = value;
+    if (value > high) high = value;
+    total += value;
+  }
+  *min = low;
+  *max = high;
+  *sum = total;
+}
+
+static void __MeshStats_sweepVertices(const VertexBuffer* vertices, int first,
+                                      int last, __MeshStatsPart* part) {
+  if (first >= last) return;
+  for (int axis = 0; axis < 3; axis++)
+    __MeshStats_sweepAxis(vertices, axis, first, last, &part->min[axis],
+                          &part->max[axis], &part->sum[axis]);
+  part->hasVertex = true;
+}
+
+static void __MeshStats_sweepFaces(const VertexBuffer* vertices,
+                                   const FaceBuffer* faces, int first,
+                                   int last, __MeshStatsPart* part) {
+  uint32_t vertexCount = vertices != null ? vertices->count : 0;
+  for (int face = first; face < last; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    bool isInRange = true;
+    for (uint32_t next = 0; next < count; next++) {
+      uint32_t index = corners[next];
+      if (!part->hasIndex || index < part->minIndex) part->minIndex = index;
+      if (!part->hasIndex || index > part->maxIndex) part->maxIndex = index;
+      part->hasIndex = true;
+      if (index >= vertexCount) isInRange = false;
+    }
+    if (!isInRange || count < 3) continue;
+
+    // Fan the polygon from its first corner.
+    double a[3], b[3], c[3];
+    VertexBuffer_getPoint(vertices, corners[0], a);
+    VertexBuffer_getPoint(vertices, corners[1], b);
+    for (uint32_t next = 2; next < count; next++) {
+      VertexBuffer_getPoint(vertices, corners[next], c);
+      double u[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      double v[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+      double cross[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                         u[0] * v[1] - u[1] * v[0]};
+      part->area += 0.5 * sqrt(cross[0] * cross[0] + cross[1] * cross[1] +
+                               cross[2] * cross[2]);
+      // Signed volume of the tetrahedron with the origin.
+      part->volume += (a[0] * (b[1] * c[2] - b[2] * c[1]) +
+                       a[1] * (b[2] * c[0] - b[0] * c[2]) +
+                       a[2] * (b[0] * c[1] - b[1] * c[0])) /
+                      6.0;
+      memcpy(b, c, sizeof(b));
+    }
+  }
+}
+
+static void __MeshStats_task(void* context, int index) {
+  __MeshStatsJob* job = context;
+  __MeshStatsPart* part = &job->parts[index];
+  if (index < job->vertexTasks) {
+    int first = index * MESH_STATS_VERTEX_CHUNK;
+    int last = first + MESH_STATS_VERTEX_CHUNK;
+    if (last > job->vertices->count) last = job->vertices->count;
+    __MeshStats_sweepVertices(job->vertices, first, last, part);
+  } else {
+    int first = (index - job->vertexTasks) * MESH_STATS_FACE_CHUNK;
+    int last = first + MESH_STATS_FACE_CHUNK;
+    if (last > job->faces->count) last = job->faces->count;
+    __MeshStats_sweepFaces(job->vertices, job->faces, first, last, part);
+  }
+}
+
+static int __MeshStats_countTasks(int count, int chunk) {
+  return count > 0 ? (count + chunk - 1) / chunk : 0;
+}
+
+MeshStats MeshStats_of(const VertexBuffer* vertices, const FaceBuffer* faces) {
+  __MeshStatsJob job = {.vertices = vertices, .faces = faces};
+  job.vertexTasks = __MeshStats_countTasks(
+      vertices != null ? vertices->count : 0, MESH_STATS_VERTEX_CHUNK);
+  int faceTasks = __MeshStats_countTasks(faces != null ? faces->count : 0,
+                                         MESH_STATS_FACE_CHUNK);
+  int taskCount = job.vertexTasks + faceTasks;
+  job.parts = calloc(taskCount + 1, sizeof(__MeshStatsPart));
+  Parallel_for(taskCount, __MeshStats_task, &job);
+
+  // Merge the chunks in order.
+  MeshStats stats;
+  memset(&stats, 0, sizeof(stats));
+  double sum[3] = {0, 0, 0};
+  bool hasVertex = false, hasIndex = false;
+  for (int next = 0; next < taskCount; next++) {
+    __MeshStatsPart* part = &job.parts[next];
+    for (int axis = 0; axis < 3 && part->hasVertex; axis++) {
+      if (!hasVertex || part->min[axis] < stats.min[axis])
+        stats.min[axis] = part->min[axis];
+      if (!hasVertex || part->max[axis] > stats.max[axis])
+        stats.max[axis] = part->max[axis];
+      sum[axis] += part->sum[axis];
+    }
+    hasVertex = hasVertex || part->hasVertex;
+    if (part->hasIndex) {
+      if (!hasIndex || part->minIndex < stats.minIndex)
+        stats.minIndex = part->minIndex;
+      if (!hasIndex || part->maxIndex > stats.maxIndex)
+        stats.maxIndex = part->maxIndex;
+      hasIndex = true;
+    }
+    stats.area += part->area;
+    stats.volume += part->volume;
+  }
+  if (hasVertex)
+    for (int axis = 0; axis < 3; axis++)
+      stats.centroid[axis] = sum[axis] / vertices->count;
+  free(job.parts);
+  return stats;
+}
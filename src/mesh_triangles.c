@@ -0,0 +1,247 @@
+#include "mesh_triangles.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "parallel.h"
+
+// Faces handled by one task.
+#define TRIANGLES_CHUNK 16384
+
+// Corners of a face kept on the stack while it is clipped.
+#define TRIANGLES_STACK_CORNERS 64
+
+typedef struct {
+  const FaceBuffer* faces;
+  const VertexBuffer* vertices;
+  MeshTriangles* triangles;
+  int first, last;    // Faces to cut.
+  int* chunkClipped;  // Faces each task ear clipped.
+} __MeshTriangulator;
+
+/**
+ * Get twice the signed area of the 2D triangle a, b, c,
+ * above 0 when it turns left.
+ */
+static double __MeshTriangles_cross(const double* a, const double* b,
+                                    const double* c) {
+  return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+/**
+ * Check if a 2D point is in the triangle a, b, c that turns
+ * left, or on its edges.
+ */
+static bool __MeshTriangles_isInside(const double* point, const double* a,
+                                     const double* b, const double* c) {
+  return __MeshTriangles_cross(a, b, point) >= 0 &&
+         __MeshTriangles_cross(b, c, point) >= 0 &&
+         __MeshTriangles_cross(c, a, point) >= 0;
+}
+
+/**
+ * Project the corners of a face on the plane of its Newell
+ * normal, dropping its largest axis and turning it so the
+ * face winds to the left.
+ * @return false if the face has no area to project on.
+ */
+static bool __MeshTriangles_project(const VertexBuffer* vertices,
+                                    const uint32_t* corners, uint32_t count,
+                                    double* points) {
+  double normal[3] = {0, 0, 0};
+  double previous[3], current[3];
+  VertexBuffer_getPoint(vertices, corners[count - 1], previous);
+  for (uint32_t corner = 0; corner < count; corner++) {
+    VertexBuffer_getPoint(vertices, corners[corner], current);
+    for (int axis = 0; axis < 3; axis++)
+      normal[axis] += (previous[(axis + 1) % 3] - current[(axis + 1) % 3]) *
+                      (previous[(axis + 2) % 3] + current[(axis + 2) % 3]);
+    memcpy(previous, current, sizeof(current));
+  }
+  int dropped = 0;
+  for (int axis = 1; axis < 3; axis++)
+    if (fabs(normal[axis]) > fabs(normal[dropped])) dropped = axis;
+  if (normal[dropped] == 0) return false;
+  int u = (dropped + 1) % 3, v = (dropped + 2) % 3;
+  double flip = normal[dropped] > 0 ? 1 : -1;
+  for (uint32_t corner = 0; corner < count; corner++) {
+    VertexBuffer_getPoint(vertices, corners[corner], current);
+    points[corner * 2] = current[u];
+    points[corner * 2 + 1] = current[v] * flip;
+  }
+  return true;
+}
+
+/**
+ * Cut a concave face into triangles by clipping the ear
+ * at each convex corner with no other corner inside it.
+ * When rounding leaves no ear, the next corner is clipped
+ * anyway so the face still gives count - 2 triangles.
+ * @param points 2D corners of the face, winding to the left.
+ * @param start of the face in the indices.
+ * @param next scratch of count links around the face.
+ * @param out three corners per triangle.
+ */
+static void __MeshTriangles_clip(const double* points, uint32_t count,
+                                 uint32_t start, uint32_t* next,
+                                 uint32_t* out) {
+  for (uint32_t corner = 0; corner < count; corner++)
+    next[corner] = (corner + 1) % count;
+  uint32_t previous = count - 1, left = count, misses = 0;
+  while (left > 3) {
+    uint32_t ear = next[previous], after = next[ear];
+    const double* a = &points[previous * 2];
+    const double* b = &points[ear * 2];
+    const double* c = &points[after * 2];
+    bool isEar = __MeshTriangles_cross(a, b, c) > 0;
+    for (uint32_t other = next[after]; isEar && other != previous;
+         other = next[other])
+      isEar = !__MeshTriangles_isInside(&points[other * 2], a, b, c);
+    if (!isEar && ++misses < left) {
+      previous = ear;
+      continue;
+    }
+    *out++ = start + previous;
+    *out++ = start + ear;
+    *out++ = start + after;
+    next[previous] = after;
+    left--;
+    misses = 0;
+  }
+  *out++ = start + previous;
+  *out++ = start + next[previous];
+  *out++ = start + next[next[previous]];
+}
+
+/**
+ * Check if the 2D corners of a face all turn the same way.
+ */
+static bool __MeshTriangles_isConvex(const double* points, uint32_t count) {
+  for (uint32_t corner = 0; corner < count; corner++) {
+    const double* a = &points[corner * 2];
+    const double* b = &points[(corner + 1) % count * 2];
+    const double* c = &points[(corner + 2) % count * 2];
+    if (__MeshTriangles_cross(a, b, c) < 0) return false;
+  }
+  return true;
+}
+
+static void __MeshTriangulator_cut(void* context, int chunk) {
+  __MeshTriangulator* this = context;
+  const FaceBuffer* faces = this->faces;
+  MeshTriangles* triangles = this->triangles;
+  int begin = this->first + chunk * TRIANGLES_CHUNK;
+  int end = begin + TRIANGLES_CHUNK;
+  if (end > this->last) end = this->last;
+  double stackPoints[TRIANGLES_STACK_CORNERS * 2];
+  uint32_t stackNext[TRIANGLES_STACK_CORNERS];
+  int clipped = 0;
+  for (int face = begin; face < end; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    if (count < 3) continue;
+    uint32_t start = FaceBuffer_getStart(faces, face);
+    uint32_t* out =
+        &triangles->corners[MeshTriangles_getFaceStart(triangles, face) * 3];
+    double* points = stackPoints;
+    uint32_t* next = stackNext;
+    if (count > TRIANGLES_STACK_CORNERS) {
+      points = malloc(sizeof(double) * 2 * count);
+      next = malloc(sizeof(uint32_t) * count);
+    }
+    if (count > 3 &&
+        __MeshTriangles_project(this->vertices, &faces->indices[start], count,
+                                points) &&
+        !__MeshTriangles_isConvex(points, count)) {
+      __MeshTriangles_clip(points, count, start, next, out);
+      clipped++;
+    } else {
+      for (uint32_t corner = 1; corner + 1 < count; corner++) {
+        *out++ = start;
+        *out++ = start + corner;
+        *out++ = start + corner + 1;
+      }
+    }
+    if (count > TRIANGLES_STACK_CORNERS) dispose(points, next);
+  }
+  this->chunkClipped[chunk] = clipped;
+}
+
+MeshTriangles MeshTriangles_of(const FaceBuffer* faces, uint32_t* faceStarts,
+                               uint32_t* corners) {
+  MeshTriangles this = {.arity = faces->arity,
+                        .corners = faces->arity == 3 ? null : corners,
+                        .faceStarts = null,
+                        .clippedCount = 0,
+                        .isOwned = false};
+  if (faces->arity != 0) {
+    this.count = faces->arity >= 3 ? faces->count * (faces->arity - 2) : 0;
+    return this;
+  }
+  // Find where the triangles of each face start, as the faces differ.
+  this.faceStarts = faceStarts;
+  uint32_t count = 0;
+  for (int face = 0; face < faces->count; face++) {
+    faceStarts[face] = count;
+    uint32_t cornerCount = FaceBuffer_getCornerCount(faces, face);
+    if (cornerCount >= 3) count += cornerCount - 2;
+  }
+  faceStarts[faces->count] = count;
+  this.count = count;
+  return this;
+}
+
+/**
+ * Count the triangles of the faces, and find where those of
+ * each face start when the faces differ in size.
+ */
+static MeshTriangles* __new_MeshTriangles(const FaceBuffer* faces) {
+  MeshTriangles* this = malloc(sizeof(MeshTriangles));
+  uint32_t* faceStarts =
+      faces->arity == 0 ? malloc(sizeof(uint32_t) * (faces->count + 1)) : null;
+  *this = MeshTriangles_of(faces, faceStarts, null);
+  this->isOwned = true;
+  return this;
+}
+
+MeshTriangles* new_MeshTriangles(const FaceBuffer* faces,
+                                 const VertexBuffer* vertices) {
+  MeshTriangles* this = new_MeshTrianglesUncut(faces);
+  MeshTriangles_cut(this, faces, vertices, 0, faces->count);
+  return this;
+}
+
+MeshTriangles* new_MeshTrianglesUncut(const FaceBuffer* faces) {
+  MeshTriangles* this = __new_MeshTriangles(faces);
+  if (faces->arity != 3)
+    this->corners = malloc(sizeof(uint32_t) * 3 * ((size_t)this->count + 1));
+  return this;
+}
+
+void MeshTriangles_cut(MeshTriangles* this, const FaceBuffer* faces,
+                       const VertexBuffer* vertices, int first, int last) {
+  if (this->corners == null || first >= last) return;
+  int chunks = (last - first + TRIANGLES_CHUNK - 1) / TRIANGLES_CHUNK;
+  __MeshTriangulator triangulator = {faces, vertices, this, first, last,
+                                     calloc(chunks + 1, sizeof(int))};
+  Parallel_for(chunks, __MeshTriangulator_cut, &triangulator);
+  for (int chunk = 0; chunk < chunks; chunk++)
+    this->clippedCount += triangulator.chunkClipped[chunk];
+  free(triangulator.chunkClipped);
+}
+
+MeshTriangles* new_MeshTrianglesOf(const FaceBuffer* faces,
+                                   uint32_t* corners) {
+  MeshTriangles* this = __new_MeshTriangles(faces);
+  this->corners = corners;
+  this->isOwned = false;
+  return this;
+}
+
+void MeshTriangles_free(MeshTriangles* this) {
+  if (this == null) return;
+  if (this->isOwned) {
+    free(this->corners);
+  }
+  free(this->faceStarts);
+  free(this);
+}
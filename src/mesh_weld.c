@@ -0,0 +1,422 @@
+#include "mesh_weld.h"
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "parallel.h"
+
+// Vertices or faces handled by one task.
+#define WELD_CHUNK 16384
+
+// Size of the grid cells, in weld distances. Only the cells
+// within two distances of a vertex are searched, so most
+// vertices look in a few of the cells around them.
+#define WELD_CELL_SCALE 8
+
+// Marks an empty slot of the face table.
+#define WELD_NONE UINT32_MAX
+
+static float _defaultDistance = -2;
+
+void MeshWeld_setDefaultDistance(float distance) {
+  _defaultDistance = distance < 0 ? -1 : distance;
+}
+
+float MeshWeld_getDefaultDistance() {
+  if (_defaultDistance >= -1) return _defaultDistance;
+  String fromEnvironment = getenv("MODEL_WELD");
+  if (fromEnvironment == null || isStringEqual(fromEnvironment, "off"))
+    return -1;
+  if (isStringEqual(fromEnvironment, "on")) return WELD_DISTANCE;
+  char* end;
+  float distance = strtof(fromEnvironment, &end);
+  return end != fromEnvironment && distance >= 0 ? distance : -1;
+}
+
+typedef struct {
+  const VertexBuffer* vertices;
+  const float* normals;
+  const float* colors;
+  double distance;
+  double cellSize;
+  uint32_t mask;      // Of the buckets, a power of 2 less 1.
+  uint32_t* buckets;  // Of each vertex.
+  uint32_t* starts;   // Of the vertices in each bucket, mask + 2.
+  uint32_t* sorted;   // Vertices by bucket, ascending in each.
+  uint32_t* targets;  // First vertex each vertex matches, or itself.
+  const FaceBuffer* faces;
+  uint32_t* remap;     // New index of each vertex.
+  uint32_t* kept;      // Old index of each new vertex.
+  uint32_t* corners;   // Cleaned corners of each face, at its old start.
+  uint32_t* counts;    // Cleaned corners of each face, 0 if removed.
+  uint64_t* hashes;    // Of the corners of each face, whatever the start.
+  int* chunkDegenerates;  // Faces each task found degenerate.
+} __MeshWelder;
+
+static double __MeshWeld_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static uint32_t __MeshWelder_hashCell(const __MeshWelder* this,
+                                      const int64_t cell[3]) {
+  uint64_t hash = (uint64_t)cell[0] * 0x9E3779B97F4A7C15ull ^
+                  (uint64_t)cell[1] * 0xC2B2AE3D27D4EB4Full ^
+                  (uint64_t)cell[2] * 0x165667B19E3779F9ull;
+  return (uint32_t)(hash ^ hash >> 32) & this->mask;
+}
+
+static void __MeshWelder_getCell(const __MeshWelder* this, uint32_t vertex,
+                                 int64_t cell[3]) {
+  for (int axis = 0; axis < 3; axis++)
+    cell[axis] = (int64_t)floor(VertexBuffer_get(this->vertices, vertex, axis) /
+                                this->cellSize);
+}
+
+static void __MeshWelder_hashVertices(void* context, int chunk) {
+  __MeshWelder* this = context;
+  int end = (chunk + 1) * WELD_CHUNK;
+  if (end > this->vertices->count) end = this->vertices->count;
+  for (int vertex = chunk * WELD_CHUNK; vertex < end; vertex++) {
+    int64_t cell[3];
+    __MeshWelder_getCell(this, vertex, cell);
+    this->buckets[vertex] = __MeshWelder_hashCell(this, cell);
+  }
+}
+
+/**
+ * Check if two vertices are close enough and look the same.
+ */
+static bool __MeshWelder_isSame(const __MeshWelder* this, uint32_t a,
+                                uint32_t b) {
+  double squared = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    double delta = VertexBuffer_get(this->vertices, a, axis) -
+                   VertexBuffer_get(this->vertices, b, axis);
+    squared += delta * delta;
+  }
+  if (squared > this->distance * this->distance) return false;
+  if (this->normals != null) {
+    const float* first = &this->normals[a * 3];
+    const float* second = &this->normals[b * 3];
+    double dot = first[0] * second[0] + first[1] * second[1] +
+                 first[2] * second[2];
+    if (dot < WELD_NORMAL_COSINE) return false;
+  }
+  if (this->colors != null)
+    for (int channel = 0; channel < 3; channel++)
+      if (fabsf(this->colors[a * 3 + channel] - this->colors[b * 3 + channel]) >
+          WELD_COLOR_TOLERANCE)
+        return false;
+  return true;
+}
+
+/**
+ * Find the first vertex each vertex matches in its cell and
+ * the cells next to it it comes near.
+ */
+static void __MeshWelder_matchVertices(void* context, int chunk) {
+  __MeshWelder* this = context;
+  int end = (chunk + 1) * WELD_CHUNK;
+  if (end > this->vertices->count) end = this->vertices->count;
+  // A margin over the distance, for the rounding of the cells.
+  double margin = this->distance * 2;
+  for (int vertex = chunk * WELD_CHUNK; vertex < end; vertex++) {
+    int64_t cell[3], around[3];
+    int low[3], high[3];
+    __MeshWelder_getCell(this, vertex, cell);
+    for (int axis = 0; axis < 3; axis++) {
+      double inside = VertexBuffer_get(this->vertices, vertex, axis) -
+                      cell[axis] * this->cellSize;
+      low[axis] = inside <= margin ? -1 : 0;
+      high[axis] = this->cellSize - inside <= margin ? 1 : 0;
+    }
+    uint32_t target = vertex;
+    for (int z = low[2]; z <= high[2]; z++)
+      for (int y = low[1]; y <= high[1]; y++)
+        for (int x = low[0]; x <= high[0]; x++) {
+          around[0] = cell[0] + x;
+          around[1] = cell[1] + y;
+          around[2] = cell[2] + z;
+          uint32_t bucket = __MeshWelder_hashCell(this, around);
+          // The bucket is ascending, so its first match is its smallest.
+          for (uint32_t at = this->starts[bucket];
+               at < this->starts[bucket + 1]; at++) {
+            uint32_t other = this->sorted[at];
+            if (other >= target) break;
+            if (!__MeshWelder_isSame(this, other, vertex)) continue;
+            target = other;
+            break;
+          }
+        }
+    this->targets[vertex] = target;
+  }
+}
+
+/**
+ * Hash the corners of a face from its smallest one, so
+ * the same face hashes the same whatever corner it starts at.
+ */
+static uint64_t __MeshWeld_hashFace(const uint32_t* corners, uint32_t count) {
+  uint32_t start = 0;
+  for (uint32_t corner = 1; corner < count; corner++)
+    if (corners[corner] < corners[start]) start = corner;
+  uint64_t hash = count;
+  for (uint32_t corner = 0; corner < count; corner++) {
+    hash = (hash ^ corners[(start + corner) % count]) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+/**
+ * Remap the corners of the faces, drop the repeated ones
+ * and find the faces left without area.
+ */
+static void __MeshWelder_cleanFaces(void* context, int chunk) {
+  __MeshWelder* this = context;
+  const FaceBuffer* faces = this->faces;
+  int end = (chunk + 1) * WELD_CHUNK;
+  if (end > faces->count) end = faces->count;
+  int degenerates = 0;
+  for (int face = chunk * WELD_CHUNK; face < end; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    uint32_t* cleaned = &this->corners[FaceBuffer_getStart(faces, face)];
+    uint32_t cleanCount = 0;
+    for (uint32_t corner = 0; corner < count; corner++) {
+      uint32_t vertex = this->remap[corners[corner]];
+      if (cleanCount == 0 || cleaned[cleanCount - 1] != vertex)
+        cleaned[cleanCount++] = vertex;
+    }
+    while (cleanCount > 1 && cleaned[cleanCount - 1] == cleaned[0])
+      cleanCount--;
+
+    // Sum the cross products of the fan into the area vector.
+    double area[3] = {0, 0, 0};
+    for (uint32_t corner = 1; corner + 1 < cleanCount; corner++) {
+      double edges[2][3];
+      for (int axis = 0; axis < 3; axis++) {
+        double origin =
+            VertexBuffer_get(this->vertices, this->kept[cleaned[0]], axis);
+        edges[0][axis] = VertexBuffer_get(this->vertices,
+                                          this->kept[cleaned[corner]], axis) -
+                         origin;
+        edges[1][axis] = VertexBuffer_get(this->vertices,
+                                          this->kept[cleaned[corner + 1]],
+                                          axis) -
+                         origin;
+      }
+      for (int axis = 0; axis < 3; axis++)
+        area[axis] += edges[0][(axis + 1) % 3] * edges[1][(axis + 2) % 3] -
+                      edges[0][(axis + 2) % 3] * edges[1][(axis + 1) % 3];
+    }
+    double doubleArea =
+        sqrt(area[0] * area[0] + area[1] * area[1] + area[2] * area[2]);
+    if (cleanCount < 3 || doubleArea <= this->distance * this->distance) {
+      this->counts[face] = 0;
+      degenerates++;
+      continue;
+    }
+    this->counts[face] = cleanCount;
+    this->hashes[face] = __MeshWeld_hashFace(cleaned, cleanCount);
+  }
+  this->chunkDegenerates[chunk] = degenerates;
+}
+
+/**
+ * Check if two cleaned faces have the same corners in the
+ * same winding, whatever corner they start at.
+ */
+static bool __MeshWelder_isSameFace(const __MeshWelder* this, int a, int b) {
+  uint32_t count = this->counts[a];
+  if (this->counts[b] != count) return false;
+  const uint32_t* first =
+      &this->corners[FaceBuffer_getStart(this->faces, a)];
+  const uint32_t* second =
+      &this->corners[FaceBuffer_getStart(this->faces, b)];
+  uint32_t shift = 0;
+  while (shift < count && second[shift] != first[0]) shift++;
+  if (shift == count) return false;
+  for (uint32_t corner = 1; corner < count; corner++)
+    if (first[corner] != second[(shift + corner) % count]) return false;
+  return true;
+}
+
+/**
+ * Remove the repeats of a face, keeping the first.
+ * @return the number removed.
+ */
+static int __MeshWelder_removeDuplicates(__MeshWelder* this) {
+  int faceCount = this->faces->count;
+  uint32_t mask = 1;
+  while (mask < (uint32_t)faceCount * 2) mask <<= 1;
+  mask--;
+  uint32_t* table = malloc(sizeof(uint32_t) * (mask + 1));
+  for (uint32_t slot = 0; slot <= mask; slot++) table[slot] = WELD_NONE;
+  int duplicates = 0;
+  for (int face = 0; face < faceCount; face++) {
+    if (this->counts[face] == 0) continue;
+    uint64_t hash = this->hashes[face];
+    uint32_t slot = (uint32_t)(hash ^ hash >> 32) & mask;
+    for (;; slot = (slot + 1) & mask) {
+      uint32_t other = table[slot];
+      if (other == WELD_NONE) {
+        table[slot] = face;
+        break;
+      }
+      if (this->hashes[other] == hash &&
+          __MeshWelder_isSameFace(this, other, face)) {
+        this->counts[face] = 0;
+        duplicates++;
+        break;
+      }
+    }
+  }
+  free(table);
+  return duplicates;
+}
+
+/**
+ * Get the triangles the faces fan into.
+ */
+static long __MeshWeld_countTriangles(const FaceBuffer* faces) {
+  long triangles = 0;
+  for (int face = 0; face < faces->count; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    if (count >= 3) triangles += count - 2;
+  }
+  return triangles;
+}
+
+/**
+ * Get the bytes of the positions, the attributes and the
+ * indices of a mesh.
+ */
+static size_t __MeshWeld_getBytes(const VertexBuffer* vertices,
+                                  const FaceBuffer* faces, int attributes) {
+  size_t bytes = vertices->bytes +
+                 (size_t)vertices->count * sizeof(float) * 3 * attributes +
+                 faces->length * sizeof(uint32_t);
+  if (faces->offsets != null) bytes += (faces->count + 1) * sizeof(uint32_t);
+  return bytes;
+}
+
+/**
+ * Copy the attributes of the vertices that are kept.
+ */
+static float* __MeshWeld_keep(float* values, const uint32_t* kept,
+                              int keptCount) {
+  if (values == null) return null;
+  float* moved = malloc(sizeof(float) * 3 * (keptCount + 1));
+  for (int vertex = 0; vertex < keptCount; vertex++)
+    memcpy(&moved[vertex * 3], &values[kept[vertex] * 3], sizeof(float) * 3);
+  return moved;
+}
+
+MeshWeld MeshWeld_apply(VertexBuffer** vertices, FaceBuffer** faces,
+                        float** normals, float** colors, double distance) {
+  double start = __MeshWeld_now();
+  VertexBuffer* oldVertices = *vertices;
+  FaceBuffer* oldFaces = *faces;
+  int vertexCount = oldVertices->count, faceCount = oldFaces->count;
+  MeshWeld result = {.vertexCount = vertexCount,
+                     .faceCount = faceCount,
+                     .isWelded = true};
+  __MeshWelder welder = {
+      .vertices = oldVertices,
+      .normals = *normals,
+      .colors = *colors,
+      .distance = distance,
+      .cellSize = distance > 0 ? distance * WELD_CELL_SCALE : 1,
+      .faces = oldFaces};
+  __MeshWelder* this = &welder;
+
+  // Sort the vertices into the buckets of their cells.
+  this->mask = 1;
+  while (this->mask < (uint32_t)vertexCount * 2) this->mask <<= 1;
+  this->mask--;
+  this->buckets = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  this->starts = calloc(this->mask + 2, sizeof(uint32_t));
+  this->sorted = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  this->targets = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  int vertexChunks = (vertexCount + WELD_CHUNK - 1) / WELD_CHUNK;
+  Parallel_for(vertexChunks, __MeshWelder_hashVertices, this);
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    this->starts[this->buckets[vertex] + 1]++;
+  for (uint32_t bucket = 0; bucket <= this->mask; bucket++)
+    this->starts[bucket + 1] += this->starts[bucket];
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    this->sorted[this->starts[this->buckets[vertex]]++] = vertex;
+  memmove(this->starts + 1, this->starts, sizeof(uint32_t) * this->mask);
+  this->starts[0] = 0;
+  Parallel_for(vertexChunks, __MeshWelder_matchVertices, this);
+
+  // Follow each match to the vertex it ends in, then number those.
+  this->remap = this->buckets;
+  this->kept = this->sorted;
+  int keptCount = 0;
+  for (int vertex = 0; vertex < vertexCount; vertex++) {
+    uint32_t target = this->targets[this->targets[vertex]];
+    this->targets[vertex] = target;
+    if (target == (uint32_t)vertex) {
+      this->kept[keptCount] = vertex;
+      this->remap[vertex] = keptCount++;
+    } else {
+      this->remap[vertex] = this->remap[target];
+    }
+  }
+  result.weldedVertices = vertexCount - keptCount;
+
+  // Clean the faces, then drop the removed ones.
+  this->corners = malloc(sizeof(uint32_t) * (oldFaces->length + 1));
+  this->counts = malloc(sizeof(uint32_t) * (faceCount + 1));
+  this->hashes = malloc(sizeof(uint64_t) * (faceCount + 1));
+  int faceChunks = (faceCount + WELD_CHUNK - 1) / WELD_CHUNK;
+  this->chunkDegenerates = calloc(faceChunks + 1, sizeof(int));
+  Parallel_for(faceChunks, __MeshWelder_cleanFaces, this);
+  for (int chunk = 0; chunk < faceChunks; chunk++)
+    result.degenerateFaces += this->chunkDegenerates[chunk];
+  result.duplicateFaces = __MeshWelder_removeDuplicates(this);
+
+  int cleanCount = faceCount - result.degenerateFaces - result.duplicateFaces;
+  uint32_t* offsets = malloc(sizeof(uint32_t) * (cleanCount + 1));
+  offsets[0] = 0;
+  for (int face = 0, at = 0; face < faceCount; face++)
+    if (this->counts[face] > 0) {
+      offsets[at + 1] = offsets[at] + this->counts[face];
+      at++;
+    }
+  FaceBuffer* cleanFaces = new_FaceBuffer(cleanCount, offsets);
+  for (int face = 0, at = 0; face < faceCount; face++)
+    if (this->counts[face] > 0) {
+      memcpy(&cleanFaces->indices[offsets[at]],
+             &this->corners[FaceBuffer_getStart(oldFaces, face)],
+             sizeof(uint32_t) * this->counts[face]);
+      at++;
+    }
+
+  VertexBuffer* keptVertices =
+      new_VertexBuffer(keptCount, oldVertices->layout, oldVertices->precision);
+  for (int axis = 0; axis < 3; axis++)
+    for (int vertex = 0; vertex < keptCount; vertex++)
+      VertexBuffer_set(keptVertices, vertex, axis,
+                       VertexBuffer_get(oldVertices, this->kept[vertex], axis));
+  int attributes = (*normals != null) + (*colors != null);
+  result.savedBytes = __MeshWeld_getBytes(oldVertices, oldFaces, attributes) -
+                      __MeshWeld_getBytes(keptVertices, cleanFaces, attributes);
+  result.savedTriangles = __MeshWeld_countTriangles(oldFaces) -
+                          __MeshWeld_countTriangles(cleanFaces);
+  *normals = __MeshWeld_keep(*normals, this->kept, keptCount);
+  *colors = __MeshWeld_keep(*colors, this->kept, keptCount);
+  *vertices = keptVertices;
+  *faces = cleanFaces;
+
+  dispose(this->buckets, this->starts, this->sorted, this->targets,
+          this->corners, this->counts, this->hashes, this->chunkDegenerates,
+          offsets);
+  result.seconds = __MeshWeld_now() - start;
+  return result;
+}
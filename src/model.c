@@ -1,7 +1,16 @@
 #include "model.h"
 
-void Model_parseModel(int argc, char** argv) {
-  const bool debug = true;
+#include <math.h>
+#include <time.h>
+
+// Faces built between two publications to the draw loop.
+#define MODEL_FACE_BATCH 4096
+
+/**
+ * Check that a file was passed on the command line,
+ * otherwise print the feedback and exit.
+ */
+static void __Model_checkArguments(int argc, char** argv) {
   print("______________________________________________________");
   print("Running script...\n");
 
@@ -12,144 +21,827 @@ void Model_parseModel(int argc, char** argv) {
         "provided for more information.");
     print("\nScript complete.\n");
     exit(0);
-    return;
   }
+}
+
+/**
+ * Print the parsed model. A model that failed to parse is
+ * left to Model_exitIfFailed() on the main thread.
+ */
+static void __Model_reportParsed(Model* this) {
+  const bool debug = true;
+  if (this == null || this->hasError) return;
+  if (debug) Model_print(this);
+  print("Loaded ", _(this->fileSize / 1024.0, 1), " KB in ",
+        _(this->loadSeconds * 1000.0, 3), " ms (",
+        _(Model_loadThroughput(this), 2), " MB/s).");
+  MeshWeld* weld = &this->weld;
+  if (weld->isWelded)
+    print("Welded ", _(weld->weldedVertices), " vertices and removed ",
+          _(weld->degenerateFaces), " degenerate and ",
+          _(weld->duplicateFaces), " duplicate faces in ",
+          _(weld->seconds * 1000.0, 3), " ms, saving ",
+          _(weld->savedBytes / 1024.0, 1), " KB and ",
+          _(weld->savedTriangles), " triangles a frame.");
+  if (this->triangles != null && this->triangles->clippedCount > 0)
+    print("Ear clipped ", _(this->triangles->clippedCount),
+          " concave faces into triangles.");
+  MeshOrder* order = &this->order;
+  bool isCacheOnly = MeshOrder_getDefaultMode() == MESH_ORDER_CACHE;
+  if (order->isReordered)
+    print(isCacheOnly ? "Cached" : "Reordered", " for the vertex cache in ",
+          _(order->seconds * 1000.0, 3), " ms, ACMR ",
+          _(order->before.acmr, 3), " to ", _(order->after.acmr, 3),
+          ", ATVR ", _(order->before.atvr, 3), " to ",
+          _(order->after.atvr, 3), ".");
+}
 
-  // Parse and print if it failed to parse.
+void Model_parseModel(int argc, char** argv) {
+  __Model_checkArguments(argc, argv);
   Model_parsedData = new_Model(argv[1]);
-  if (Model_parsedData->hasError) {
-    print(
-        "\nCould not parse the file. Please make sure it is in the correct"
-        "format. File path might be incorrect or does not exist.");
-    print("\nScript complete.\n");
-    print("______________________________________________________");
-    Model_free(Model_parsedData);
-    exit(0);
+  Model_exitIfFailed(Model_parsedData);
+  __Model_reportParsed(Model_parsedData);
+}
+
+void Model_parseModelAsync(int argc, char** argv) {
+  __Model_checkArguments(argc, argv);
+  Model_parsedData = new_ModelAsync(argv[1], __Model_reportParsed);
+  // The file may fail before the loader thread starts.
+  Model_exitIfFailed(Model_parsedData);
+}
+
+void Model_exitIfFailed(Model* this) {
+  // The loader sets hasError before it clears isLoading.
+  if (this != null && (atomic_load(&this->isLoading) || !this->hasError))
     return;
-  }
-  if (debug) Model_print(Model_parsedData);
+  print(
+      "\nCould not parse the file. Please make sure it is in the correct"
+      "format. File path might be incorrect or does not exist.");
+  print("\nScript complete.\n");
+  print("______________________________________________________");
+  Model_waitLoaded(this);
+  Model_free(this);
+  exit(0);
 }
 
 Model* __new_Model() {
-  Model* this = malloc(sizeof(Model));
-  this->faceList = 0;
-  this->vertices = 0;
-  this->faceList = new_Array(Splitter_free);
-  this->vertices = new_Array(Point_free);
+  ModelArena* arena = new_ModelArena(MODEL_ARENA_BLOCK);
+  if (arena == null) return null;
+  Model* this = ModelArena_alloc(arena, sizeof(Model));
+  String fileName = ModelArena_copyString(arena, "");
+  if (this == null || fileName == null) {
+    ModelArena_free(arena);
+    return null;
+  }
+  this->arena = arena;
+  this->faces = null;
+  this->vertices = null;
   this->hasError = false;
-  this->minX = null;
-  this->maxX = null;
-  this->minY = null;
-  this->maxY = null;
-  this->minZ = null;
-  this->maxZ = null;
-  this->fileName = $("");
+  memset(&this->stats, 0, sizeof(MeshStats));
+  memset(&this->order, 0, sizeof(MeshOrder));
+  memset(&this->weld, 0, sizeof(MeshWeld));
+  this->transform = ModelTransform_of(&this->stats);
+  this->renderVertices = null;
+  this->cornerNormals = null;
+  this->faceNormals = null;
+  this->triangles = null;
+  this->hasGeneratedNormals = false;
+  memset(&this->normalOptions, 0, sizeof(MeshNormalsOptions));
+  this->fileName = fileName;
+  this->fileSize = 0;
+  this->loadSeconds = 0;
+  this->bodyBytes = 0;
+  this->sourceFaces = 0;
+  this->normals = null;
+  this->colors = null;
+  this->cache = null;
+  atomic_init(&this->loadedFaces, 0);
+  atomic_init(&this->builtFaces, 0);
+  atomic_init(&this->decodedBytes, 0);
+  atomic_init(&this->isLoading, false);
+  this->hasLoader = false;
   return this;
 }
 
-void __Model_checkBoundary(Model* this, Point* point) {
-  /// Init if it hasn't.
-  if (this->minX == null || this->maxX == null) {
-    this->minX = new_Number(point->x);
-    this->maxX = new_Number(point->x);
-    return;
-  } else if (this->minY == null || this->maxY == null) {
-    this->minY = new_Number(point->y);
-    this->maxY = new_Number(point->y);
-    return;
-  } else if (this->minZ == null || this->maxZ == null) {
-    this->minZ = new_Number(point->z);
-    this->maxZ = new_Number(point->z);
-    return;
-  }
+/**
+ * Make room in the arena for a vertex buffer, its values
+ * left to fill.
+ * @return the vertex buffer, or null if out of memory.
+ */
+static VertexBuffer* __Model_allocateVertices(ModelArena* arena, int count,
+                                              VertexLayout layout,
+                                              VertexPrecision precision) {
+  VertexBuffer* vertices = ModelArena_alloc(arena, sizeof(VertexBuffer));
+  size_t bytes = VertexBuffer_getByteLength(count, layout, precision);
+  void* data = ModelArena_alloc(arena, bytes);
+  if (vertices == null || data == null) return null;
+  *vertices = VertexBuffer_of(count, layout, precision, data);
+  return vertices;
+}
 
-  // Check if it's is min or max;
-  if (*this->minX > point->x) this->minX = new_Number(point->x);
-  if (*this->maxX < point->x) this->maxX = new_Number(point->x);
-  if (*this->minY > point->y) this->minY = new_Number(point->y);
-  if (*this->maxY < point->y) this->maxY = new_Number(point->y);
-  if (*this->minZ > point->z) this->minZ = new_Number(point->z);
-  if (*this->maxZ < point->z) this->maxZ = new_Number(point->z);
+/**
+ * Make room in the arena for xyz per vertex, when the
+ * model has the attribute.
+ * @param attribute of the model, or null when it has none.
+ * @return false if the arena is out of memory.
+ */
+static bool __Model_allocateAttribute(ModelArena* arena, const float* attribute,
+                                      int count, float** out) {
+  *out = null;
+  if (attribute == null) return true;
+  *out = ModelArena_alloc(arena, sizeof(float) * 3 * (count + 1));
+  return *out != null;
 }
 
-Model* new_Model(String filePath) {
-  const bool DEBUG = false;
+/**
+ * Copy faces into the arena.
+ * @return the copy, or null if out of memory.
+ */
+static FaceBuffer* __Model_copyFaces(ModelArena* arena,
+                                     const FaceBuffer* faces) {
+  FaceBuffer* copy = ModelArena_alloc(arena, sizeof(FaceBuffer));
+  uint32_t* indices =
+      ModelArena_alloc(arena, sizeof(uint32_t) * (faces->length + 1));
+  uint32_t* offsets = null;
+  if (faces->offsets != null) {
+    offsets = ModelArena_alloc(arena, sizeof(uint32_t) * (faces->count + 1));
+    if (offsets == null) return null;
+    memcpy(offsets, faces->offsets, sizeof(uint32_t) * (faces->count + 1));
+  }
+  if (copy == null || indices == null) return null;
+  memcpy(indices, faces->indices, sizeof(uint32_t) * faces->length);
+  *copy = FaceBuffer_of(faces->count, faces->arity, offsets, indices);
+  return copy;
+}
 
-  // Initialize the data.
-  FileReader* file = new_FileReader(filePath);
-  Model* this = __new_Model();
-  $$(this->fileName, filePath);
-  if (file == null) {
-    this->hasError = true;
-    return this;
+/**
+ * Make the triangles of the faces in the arena.
+ * @param corners cut before, or null to make room to cut.
+ * @return the triangles, or null if out of memory.
+ */
+static MeshTriangles* __Model_newTriangles(Model* this, uint32_t* corners) {
+  const FaceBuffer* faces = this->faces;
+  MeshTriangles* triangles =
+      ModelArena_alloc(this->arena, sizeof(MeshTriangles));
+  uint32_t* faceStarts = null;
+  if (faces->arity == 0) {
+    faceStarts =
+        ModelArena_alloc(this->arena, sizeof(uint32_t) * (faces->count + 1));
+    if (faceStarts == null) return null;
+  }
+  if (triangles == null) return null;
+  *triangles = MeshTriangles_of(faces, faceStarts, corners);
+  if (corners == null && faces->arity != 3) {
+    triangles->corners = ModelArena_alloc(
+        this->arena, sizeof(uint32_t) * 3 * ((size_t)triangles->count + 1));
+    if (triangles->corners == null) return null;
   }
+  return triangles;
+}
 
-  // Initialize
-  int faceCounter = 0;
-  int vertexCounter = 0;
-  bool isEndHeader = false;
-
-  // Get through each file.
-  for_in(next, file) {
-    String eachLine = FileReader_getLineAt(file, next);
-    if (eachLine == null) continue;
-    if (DEBUG) print("Line[", _(next), "]: ", eachLine);
-    Splitter* lineSplit = new_Splitter(eachLine, " ");
-
-    // Determine the number of faces and vertex.
-    if (isStringEqual("element", lineSplit->at[0])) {
-      if (isStringEqual("face", lineSplit->at[1]))
-        this->numOfFaces = atof(lineSplit->at[2]);
-      else if (isStringEqual("vertex", lineSplit->at[1]))
-        this->numOfVertices = atof(lineSplit->at[2]);
-      Splitter_free(lineSplit);
-      dispose(eachLine);
-      continue;
-    }
+/**
+ * Find the property that holds the indices of a face.
+ * @return the property or null.
+ */
+static PlyProperty* __Model_getIndexProperty(PlyElement* element) {
+  if (element == null) return null;
+  PlyProperty* property = PlyElement_findProperty(element, "vertex_indices");
+  if (property == null)
+    property = PlyElement_findProperty(element, "vertex_index");
+  if (property != null && property->countType != PLY_NONE) return property;
+  for_in(next, element->properties) {
+    property = PlyElement_getProperty(element, next);
+    if (property->countType != PLY_NONE) return property;
+  }
+  return null;
+}
 
-    // Check if the header ended.
-    if (isStringEqual("end_header", eachLine)) {
-      isEndHeader = true;
-      Splitter_free(lineSplit);
-      dispose(eachLine);
-      continue;
+/**
+ * Interleave three scalar columns of the vertex element
+ * into a float array in the arena, for the normals and
+ * the colors.
+ * @param isNormalized to map integer values such as uint8 colors to
+ * [0, 1], and signed ones to [-1, 1].
+ * @param out the array, left null if any of the columns is missing.
+ * @return false if the arena is out of memory.
+ */
+static bool __Model_readVertexAttribute(ModelArena* arena, PlyElement* element,
+                                        const char* names[3],
+                                        bool isNormalized, float** out) {
+  PlyProperty* columns[3];
+  for (int axis = 0; axis < 3; axis++) {
+    columns[axis] = PlyElement_findProperty(element, names[axis]);
+    if (!PlyProperty_isScalar(columns[axis])) return true;
+  }
+  float* attribute =
+      ModelArena_alloc(arena, sizeof(float) * 3 * (element->count + 1));
+  if (attribute == null) return false;
+  for (int axis = 0; axis < 3; axis++) {
+    PlyProperty* column = columns[axis];
+    bool isScaled = isNormalized && PlyType_isInteger(column->type);
+    double scale = isScaled ? 1.0 / PlyType_getMax(column->type) : 1;
+    // The lowest signed value is one past -max, so it is clamped.
+    double lowest = isScaled && PlyType_isSigned(column->type) ? -1 : -INFINITY;
+    for (int next = 0; next < element->count; next++) {
+      double value = PlyProperty_getValue(column, next) * scale;
+      attribute[next * 3 + axis] = value < lowest ? lowest : value;
     }
+  }
+  *out = attribute;
+  return true;
+}
+
+/**
+ * Fit the model in the scene once, so the draw loop reads
+ * the positions as they are.
+ * @return false if the arena is out of memory.
+ */
+static bool __Model_bake(Model* this) {
+  this->transform = ModelTransform_of(&this->stats);
+  int count = this->vertices != null ? this->vertices->count : 0;
+  this->renderVertices =
+      ModelArena_alloc(this->arena, sizeof(float) * 3 * (count + 1));
+  if (this->renderVertices == null) return false;
+  ModelTransform_bake(&this->transform, this->vertices, this->renderVertices);
+  return true;
+}
+
+/**
+ * Check if the faces can be drawn while they are built.
+ * Every buffer the draw loop reads must be final before
+ * the first face, so nothing replaces the faces or splits
+ * their corners. Without normals in the file, each face
+ * is lit by its own normal until the vertices have theirs.
+ */
+static bool __Model_isStreamed(const Model* this) {
+  return this->cache == null &&
+         MeshWeld_getDefaultDistance() < 0 &&
+         MeshOrder_getDefaultMode() != MESH_ORDER_LOAD &&
+         MeshNormals_getDefaultOptions().creaseAngle <= 0;
+}
+
+/**
+ * Build the model from the decoded columns of the schema,
+ * into buffers in the arena.
+ * @return false if the vertex or face element is unusable.
+ */
+static bool __Model_buildFromSchema(Model* this, PlySchema* schema) {
+  PlyElement* vertexElement = PlySchema_getElement(schema, "vertex");
+  PlyElement* faceElement = PlySchema_getElement(schema, "face");
+  if (vertexElement == null) return false;
+
+  // Positions fall back to the first three values when they are not named.
+  const char* names[3] = {"x", "y", "z"};
+  PlyProperty* position[3];
+  for (int axis = 0; axis < 3; axis++) {
+    position[axis] = PlyElement_findProperty(vertexElement, names[axis]);
+    if (position[axis] == null)
+      position[axis] = PlyElement_getProperty(vertexElement, axis);
+    if (!PlyProperty_isScalar(position[axis])) return false;
+  }
+  VertexLayout layout = VertexBuffer_getDefaultLayout();
+  VertexPrecision precision = VertexBuffer_getDefaultPrecision();
+  VertexBuffer* vertices = __Model_allocateVertices(
+      this->arena, vertexElement->count, layout, precision);
+  if (vertices == null) return false;
+  for (int axis = 0; axis < 3; axis++)
+    for (int next = 0; next < vertexElement->count; next++)
+      VertexBuffer_set(vertices, next, axis,
+                       PlyProperty_getValue(position[axis], next));
+  this->vertices = vertices;
 
-    // Parse the face and vertex
-    if (isEndHeader) {
-      if (this->numOfVertices > vertexCounter) {
-        vertexCounter++;
-        if (DEBUG) print("vertexCounter: ", _(vertexCounter));
-        // Add the point.
-        Splitter* vertexData = new_Splitter(eachLine, " ");
-        Point* curPoint =
-            new_PointOf(atof(vertexData->at[0]), atof(vertexData->at[1]),
-                        atof(vertexData->at[2]));
-        Array_add(this->vertices, curPoint);
-        __Model_checkBoundary(this, curPoint);
-        // Check the  max width and height.
-        Splitter_free(vertexData);
-      } else if (this->numOfFaces > faceCounter) {
-        faceCounter++;
-        if (DEBUG) print("faceCounter: ", _(faceCounter));
-        Array_add(this->faceList, new_Splitter(eachLine, " "));
-      }
+  // Use the normals and the colors of the file when they exist, with
+  // integer columns scaled the same way for both.
+  const char* normalNames[3] = {"nx", "ny", "nz"};
+  const char* colorNames[3] = {"red", "green", "blue"};
+  if (!__Model_readVertexAttribute(this->arena, vertexElement, normalNames,
+                                   true, &this->normals) ||
+      !__Model_readVertexAttribute(this->arena, vertexElement, colorNames,
+                                   true, &this->colors))
+    return false;
+
+  PlyProperty* indices = __Model_getIndexProperty(faceElement);
+  if (faceElement == null) return true;
+  if (indices == null) return false;
+
+  // The list column already is a flat buffer, only the type changes. The
+  // faces are built in batches, each checked against the vertices first.
+  int count = faceElement->count;
+  const uint32_t* listOffsets = indices->listOffsets;
+  uint32_t arity = FaceBuffer_findArity(count, listOffsets);
+  uint32_t* offsets = null;
+  if (arity == 0 && count > 0) {
+    offsets = ModelArena_alloc(this->arena, sizeof(uint32_t) * (count + 1));
+    if (offsets == null) return false;
+    memcpy(offsets, listOffsets, sizeof(uint32_t) * (count + 1));
+  }
+  size_t length = count > 0 ? listOffsets[count] : 0;
+  uint32_t* faceIndices =
+      ModelArena_alloc(this->arena, sizeof(uint32_t) * (length + 1));
+  if (faceIndices == null) return false;
+  FaceBuffer* faces = ModelArena_alloc(this->arena, sizeof(FaceBuffer));
+  if (faces == null) return false;
+  *faces = FaceBuffer_of(count, arity, offsets, faceIndices);
+  this->faces = faces;
+  bool isStreamed = __Model_isStreamed(this);
+  if (isStreamed) {
+    // The bounds only need the vertices, the full sweep comes after.
+    this->stats = MeshStats_of(vertices, null);
+    this->triangles = __Model_newTriangles(this, null);
+    if (this->triangles == null || !__Model_bake(this)) return false;
+    if (this->normals == null) {
+      this->faceNormals =
+          ModelArena_alloc(this->arena, sizeof(float) * 3 * (count + 1));
+      if (this->faceNormals == null) return false;
+    }
+  }
+  for (int face = 0; face < count; face += MODEL_FACE_BATCH) {
+    int last = face + MODEL_FACE_BATCH < count ? face + MODEL_FACE_BATCH
+                                               : count;
+    for (size_t next = listOffsets[face]; next < listOffsets[last]; next++) {
+      // A face that uses a missing vertex fails the load before it is
+      // drawn. The value is checked before the cast, which is only
+      // defined in range.
+      double index = PlyProperty_getValue(indices, next);
+      if (!(index >= 0 && index < vertices->count)) return false;
+      faces->indices[next] = (uint32_t)index;
+    }
+    if (isStreamed) {
+      MeshTriangles_cut(this->triangles, faces, vertices, face, last);
+      if (this->faceNormals != null)
+        MeshNormals_ofFaces(vertices, faces, face, last, this->faceNormals);
+      // The draw loop takes every face as the finished model, so the
+      // last batch waits until the model is prepared.
+      if (last < count)
+        atomic_store_explicit(&this->loadedFaces, last, memory_order_release);
     }
+    atomic_store_explicit(&this->builtFaces, last, memory_order_relaxed);
+  }
+  return true;
+}
 
-    // Free.
-    Splitter_free(lineSplit);
-    dispose(eachLine);
+/**
+ * Build the model from a mapped cache. The normals and
+ * the colors are used in place from the mapping.
+ * @return false if the arena is out of memory.
+ */
+static bool __Model_buildFromCache(Model* this, MappedFile* cache) {
+  const ModelCacheHeader* header = ModelCache_getHeader(cache);
+  VertexBuffer cached = VertexBuffer_of(
+      header->numOfVertices, header->vertexLayout, header->vertexPrecision,
+      (void*)ModelCache_getSection(cache, MODEL_CACHE_VERTICES));
+  VertexLayout layout = VertexBuffer_getDefaultLayout();
+  VertexPrecision precision = VertexBuffer_getDefaultPrecision();
+  bool isConverted = cached.layout != layout || cached.precision != precision;
+  VertexBuffer* vertices;
+  if (!isConverted) {
+    vertices = ModelArena_alloc(this->arena, sizeof(VertexBuffer));
+    if (vertices == null) return false;
+    *vertices = cached;
+  } else {
+    // Cached in another format, convert it once into the arena.
+    vertices =
+        __Model_allocateVertices(this->arena, cached.count, layout, precision);
+    if (vertices == null) return false;
+    for (int axis = 0; axis < 3; axis++)
+      for (int next = 0; next < cached.count; next++)
+        VertexBuffer_set(vertices, next, axis,
+                         VertexBuffer_get(&cached, next, axis));
   }
+  this->vertices = vertices;
+
+  this->normals = (float*)ModelCache_getSection(cache, MODEL_CACHE_NORMALS);
+  this->colors = (float*)ModelCache_getSection(cache, MODEL_CACHE_COLORS);
+  this->hasGeneratedNormals = header->hasGeneratedNormals != 0;
+  this->normalOptions.weighting = header->normalWeighting;
+  this->normalOptions.isFlipped = header->isNormalsFlipped != 0;
+
+  uint32_t* indices =
+      (uint32_t*)ModelCache_getSection(cache, MODEL_CACHE_FACE_INDICES);
+  if (indices != null) {
+    this->faces = ModelArena_alloc(this->arena, sizeof(FaceBuffer));
+    if (this->faces == null) return false;
+    *this->faces = FaceBuffer_of(
+        header->numOfFaces, header->faceArity,
+        (uint32_t*)ModelCache_getSection(cache, MODEL_CACHE_FACE_OFFSETS),
+        indices);
+  }
+  // Polygons reordered for the cache are cut again on load.
+  uint32_t* corners =
+      (uint32_t*)ModelCache_getSection(cache, MODEL_CACHE_TRIANGLES);
+  if (this->faces != null && (corners != null || this->faces->arity == 3)) {
+    this->triangles = __Model_newTriangles(this, corners);
+    if (this->triangles == null) return false;
+  }
+  this->stats = isConverted ? MeshStats_of(this->vertices, this->faces)
+                            : header->stats;
+  return true;
+}
+
+/**
+ * Generate the normals in the arena when the file has
+ * none, and the corner normals when a crease angle is set.
+ * @return false if the arena is out of memory.
+ */
+static bool __Model_generateNormals(Model* this) {
+  MeshNormalsOptions options = MeshNormals_getDefaultOptions();
+  // Faces wound clockwise enclose a negative volume.
+  options.isFlipped = this->stats.volume < 0;
+  bool hasCorners = options.creaseAngle > 0 && this->faces != null &&
+                    this->faces->count > 0;
+  bool hasFileNormals = this->normals != null;
+  if (hasFileNormals && !hasCorners) return true;
+  MeshNormals normals = {null, null};
+  if (!hasFileNormals) {
+    normals.vertices = ModelArena_alloc(
+        this->arena, sizeof(float) * 3 * (this->vertices->count + 1));
+    if (normals.vertices == null) return false;
+  }
+  if (hasCorners) {
+    normals.corners = ModelArena_alloc(
+        this->arena, sizeof(float) * 3 * (this->faces->length + 1));
+    if (normals.corners == null) return false;
+  }
+  MeshNormals_generate(this->vertices, this->faces, options, &normals);
+  if (!hasFileNormals) {
+    this->normals = normals.vertices;
+    this->hasGeneratedNormals = true;
+    this->normalOptions = options;
+  }
+  this->cornerNormals = normals.corners;
+  return true;
+}
+
+/**
+ * Weld the vertices that coincide and remove the faces
+ * without area and the repeated ones. The welded buffers
+ * are moved into the arena, which keeps the old ones until
+ * the model is freed.
+ * @param fraction of the bounding box diagonal to weld within.
+ * @return false if the arena is out of memory.
+ */
+static bool __Model_weld(Model* this, float fraction) {
+  VertexBuffer* vertices = this->vertices;
+  FaceBuffer* faces = this->faces;
+  float* normals = this->normals;
+  float* colors = this->colors;
+  double diagonal = 0;
+  for (int axis = 0; axis < 3; axis++) {
+    double size = this->stats.max[axis] - this->stats.min[axis];
+    diagonal += size * size;
+  }
+  this->weld = MeshWeld_apply(&vertices, &faces, &normals, &colors,
+                              fraction * sqrt(diagonal));
+  int count = vertices->count;
+  this->vertices = __Model_allocateVertices(this->arena, count,
+                                            vertices->layout,
+                                            vertices->precision);
+  this->faces = __Model_copyFaces(this->arena, faces);
+  bool isCopied =
+      this->vertices != null && this->faces != null &&
+      __Model_allocateAttribute(this->arena, normals, count, &this->normals) &&
+      __Model_allocateAttribute(this->arena, colors, count, &this->colors);
+  if (isCopied) {
+    memcpy(this->vertices->data, vertices->data, vertices->bytes);
+    if (normals != null)
+      memcpy(this->normals, normals, sizeof(float) * 3 * count);
+    if (colors != null) memcpy(this->colors, colors, sizeof(float) * 3 * count);
+  }
+  VertexBuffer_free(vertices);
+  FaceBuffer_free(faces);
+  dispose(normals, colors);
+  if (!isCopied) return false;
+  this->numOfVertices = this->vertices->count;
+  this->numOfFaces = this->faces->count;
+  this->stats = MeshStats_of(this->vertices, this->faces);
+  return true;
+}
+
+/**
+ * Reorder the faces for the vertex cache and number the
+ * vertices in the order the faces use them. The positions,
+ * the normals and the colors are replaced with moved
+ * copies in the arena, which keeps the old ones.
+ * @return false if out of memory.
+ */
+static bool __Model_reorder(Model* this) {
+  if (this->faces == null || this->faces->count == 0) return true;
+  int vertexCount = this->vertices->count;
+  VertexBuffer* vertices =
+      __Model_allocateVertices(this->arena, vertexCount,
+                               this->vertices->layout,
+                               this->vertices->precision);
+  float *normals, *colors;
+  uint32_t* remap = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  if (vertices == null || remap == null ||
+      !__Model_allocateAttribute(this->arena, this->normals, vertexCount,
+                                 &normals) ||
+      !__Model_allocateAttribute(this->arena, this->colors, vertexCount,
+                                 &colors)) {
+    free(remap);
+    return false;
+  }
+  this->order = MeshOrder_optimize(this->faces, vertexCount, remap);
+  MeshOrder_remapVertices(this->vertices, remap, vertices);
+  MeshOrder_remap(this->normals, sizeof(float) * 3, remap, vertexCount,
+                  normals);
+  MeshOrder_remap(this->colors, sizeof(float) * 3, remap, vertexCount, colors);
+  free(remap);
+  this->vertices = vertices;
+  this->normals = normals;
+  this->colors = colors;
+  this->stats = MeshStats_of(this->vertices, this->faces);
+  return true;
+}
+
+/**
+ * Check that the faces only use existing vertices, then
+ * get the model ready to draw.
+ * @return false if a face uses a missing vertex.
+ */
+static bool __Model_prepare(Model* this) {
+  if (this->faces != null && this->faces->length > 0 &&
+      this->stats.maxIndex >= (uint32_t)this->vertices->count)
+    return false;
+  float weldDistance = MeshWeld_getDefaultDistance();
+  if (this->cache == null && this->faces != null && weldDistance >= 0 &&
+      !__Model_weld(this, weldDistance))
+    return false;
+  if (this->cache == null && MeshOrder_getDefaultMode() == MESH_ORDER_LOAD &&
+      !__Model_reorder(this))
+    return false;
+  if (!__Model_generateNormals(this)) return false;
+  if (this->faces != null && this->triangles == null) {
+    this->triangles = __Model_newTriangles(this, null);
+    if (this->triangles == null) return false;
+    MeshTriangles_cut(this->triangles, this->faces, this->vertices, 0,
+                      this->faces->count);
+  }
+  // Streamed faces were drawn from the positions baked before them.
+  return this->renderVertices != null || __Model_bake(this);
+}
+
+/**
+ * Write the cache of a model as it is.
+ */
+static void __Model_writeCache(Model* this, MappedFile* source) {
+  VertexBuffer* vertices = this->vertices;
+  FaceBuffer* faces = this->faces;
+  MeshTriangles* triangles = this->triangles;
+  float* normals = this->normals;
+  ModelCacheContent content = {
+      .numOfVertices = vertices->count,
+      .numOfFaces = faces != null ? faces->count : 0,
+      .faceArity = faces != null ? faces->arity : 0,
+      .vertexLayout = vertices->layout,
+      .vertexPrecision = vertices->precision,
+      .isReordered = this->order.isReordered,
+      .weldDistance =
+          this->weld.isWelded ? MeshWeld_getDefaultDistance() : -1,
+      .hasGeneratedNormals = this->hasGeneratedNormals,
+      .normalOptions = this->normalOptions};
+  content.stats = this->stats;
+  const void* sections[MODEL_CACHE_SECTION_COUNT] = {
+      vertices->data,
+      faces != null ? faces->offsets : null,
+      faces != null ? faces->indices : null,
+      normals,
+      this->colors,
+      triangles != null ? triangles->corners : null};
+  size_t lengths[MODEL_CACHE_SECTION_COUNT] = {
+      vertices->bytes,
+      faces != null && faces->offsets != null
+          ? sizeof(uint32_t) * (faces->count + 1)
+          : 0,
+      faces != null ? sizeof(uint32_t) * faces->length : 0,
+      normals != null ? sizeof(float) * 3 * vertices->count : 0,
+      this->colors != null ? sizeof(float) * 3 * vertices->count : 0,
+      triangles != null && triangles->corners != null
+          ? sizeof(uint32_t) * 3 * triangles->count
+          : 0};
+  memcpy(content.sections, sections, sizeof(sections));
+  memcpy(content.lengths, lengths, sizeof(lengths));
+  ModelCache_save(this->fileName, source, &content);
+}
+
+/**
+ * Write the cache of a freshly parsed model.
+ */
+static void __Model_saveCache(Model* this, MappedFile* source) {
+  String path = ModelCache_getPath(this->fileName);
+  bool isCached = path != null;
+  free(path);
+  if (!isCached) return;
+  if (this->faces == null || this->faces->count == 0 ||
+      this->order.isReordered ||
+      MeshOrder_getDefaultMode() != MESH_ORDER_CACHE) {
+    __Model_writeCache(this, source);
+    return;
+  }
+  // The model is already drawn as parsed, reorder a copy for the cache
+  // in an arena of its own.
+  Model copy = *this;
+  copy.arena = new_ModelArena(MODEL_ARENA_BLOCK);
+  if (copy.arena == null) return;
+  copy.faces = __Model_copyFaces(copy.arena, this->faces);
+  copy.triangles = null;
+  if (copy.faces != null && __Model_reorder(&copy)) {
+    this->order = copy.order;
+    __Model_writeCache(&copy, source);
+  }
+  ModelArena_free(copy.arena);
+}
+
+/**
+ * The state handed to the loader thread.
+ */
+typedef struct {
+  Model* model;
+  MappedFile* file;
+  PlyScanner scanner;
+  PlySchema* schema;  // Freed once the model is built.
+  struct timespec startTime;
+  void (*onLoaded)(Model*);
+} __ModelLoader;
+
+/**
+ * Map the file and parse the header, which fixes the
+ * schema and the number of vertices and faces.
+ * @return the loader, or null if the file could not be read.
+ */
+static __ModelLoader* __Model_open(Model* this, String filePath) {
+  __ModelLoader* loader = ModelArena_alloc(this->arena, sizeof(__ModelLoader));
+  String fileName = ModelArena_copyString(this->arena, filePath);
+  if (loader == null || fileName == null) {
+    this->hasError = true;
+    return null;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &loader->startTime);
+  loader->model = this;
+  loader->onLoaded = null;
+  loader->file = null;
+  loader->schema = null;
+  this->fileName = fileName;
+
+  // A valid cache replaces the whole parse.
+  this->cache = ModelCache_open(filePath);
+  const ModelCacheHeader* cached =
+      this->cache != null ? ModelCache_getHeader(this->cache) : null;
+  // Generated normals are kept while they are what the options and
+  // the winding give.
+  bool isNormalsStale =
+      cached != null && cached->hasGeneratedNormals &&
+      (cached->normalWeighting != MeshNormals_getDefaultOptions().weighting ||
+       (cached->isNormalsFlipped != 0) != (cached->stats.volume < 0));
+  if (isNormalsStale ||
+      (cached != null && cached->numOfFaces > 0 &&
+       ((!cached->isReordered &&
+         MeshOrder_getDefaultMode() != MESH_ORDER_OFF) ||
+        cached->weldDistance != MeshWeld_getDefaultDistance()))) {
+    // Parse again to write the cache cleaned, ordered and lit as set.
+    MappedFile_free(this->cache);
+    this->cache = null;
+  }
+  if (this->cache != null) {
+    const ModelCacheHeader* header = ModelCache_getHeader(this->cache);
+    this->numOfVertices = header->numOfVertices;
+    this->numOfFaces = header->numOfFaces;
+    this->fileSize = header->sourceSize;
+    this->sourceFaces = header->numOfFaces;
+    return loader;
+  }
+
+  loader->file = new_MappedFile(filePath);
+  if (loader->file == null) {
+    this->hasError = true;
+    return null;
+  }
+  this->fileSize = loader->file->length;
+
+  // Parse the header into the schema.
+  loader->scanner = PlyScanner_of(loader->file->data, loader->file->length);
+  PlySchema* schema = new_PlySchema(&loader->scanner);
+  if (schema == null) {
+    MappedFile_free(loader->file);
+    this->hasError = true;
+    return null;
+  }
+  loader->schema = schema;
+  schema->decodedBytes = &this->decodedBytes;
+  this->bodyBytes = schema->bodyBytes;
+  PlyElement* vertexElement = PlySchema_getElement(schema, "vertex");
+  PlyElement* faceElement = PlySchema_getElement(schema, "face");
+  if (vertexElement != null) this->numOfVertices = vertexElement->count;
+  if (faceElement != null) this->numOfFaces = faceElement->count;
+  this->sourceFaces = this->numOfFaces;
+  return loader;
+}
+
+/**
+ * Decode every property into its column, then build the model.
+ */
+static void __Model_loadBody(__ModelLoader* loader) {
+  const bool DEBUG = false;
+  Model* this = loader->model;
+  if (this->cache != null) {
+    this->hasError = !__Model_buildFromCache(this, this->cache);
+  } else {
+    this->hasError = !PlySchema_decode(loader->schema, &loader->scanner) ||
+                     !__Model_buildFromSchema(this, loader->schema);
+    // The columns are copied into the model, so drop them before preparing.
+    PlySchema_free(loader->schema);
+    loader->schema = null;
+    if (!this->hasError)
+      this->stats = MeshStats_of(this->vertices, this->faces);
+  }
+  this->hasError = this->hasError || !__Model_prepare(this);
+  // Hand the faces to the draw loop, with the normals and the stats
+  // written by the prepare.
+  if (!this->hasError && this->faces != null)
+    atomic_store_explicit(&this->loadedFaces, this->faces->count,
+                          memory_order_release);
+  if (this->cache == null && !this->hasError)
+    __Model_saveCache(this, loader->file);
 
   // Debug the number of vertices and faces.
   if (DEBUG)
     print("vert#: ", _(this->numOfVertices), ", faces#:", _(this->numOfFaces));
 
   // Free mem.
-  FileReader_free(file);
+  MappedFile_free(loader->file);
+  struct timespec endTime;
+  clock_gettime(CLOCK_MONOTONIC, &endTime);
+  this->loadSeconds = (endTime.tv_sec - loader->startTime.tv_sec) +
+                      (endTime.tv_nsec - loader->startTime.tv_nsec) / 1e9;
+}
+
+static void* __Model_loadThread(void* argument) {
+  __ModelLoader* loader = argument;
+  __Model_loadBody(loader);
+  atomic_store(&loader->model->isLoading, false);
+  if (loader->onLoaded != null) loader->onLoaded(loader->model);
+  return null;
+}
+
+Model* new_Model(String filePath) {
+  Model* this = __new_Model();
+  if (this == null) return null;
+  __ModelLoader* loader = __Model_open(this, filePath);
+  if (loader == null) return this;
+  __Model_loadBody(loader);
+  return this;
+}
+
+Model* new_ModelAsync(String filePath, void (*onLoaded)(Model*)) {
+  Model* this = __new_Model();
+  if (this == null) {
+    if (onLoaded != null) onLoaded(null);
+    return null;
+  }
+  __ModelLoader* loader = __Model_open(this, filePath);
+  if (loader == null) {
+    if (onLoaded != null) onLoaded(this);
+    return this;
+  }
+  loader->onLoaded = onLoaded;
+  atomic_store(&this->isLoading, true);
+  this->hasLoader = true;
+  if (pthread_create(&this->loader, null, __Model_loadThread, loader) != 0) {
+    // Fall back to loading on this thread.
+    this->hasLoader = false;
+    __Model_loadThread(loader);
+  }
   return this;
 }
 
+void Model_waitLoaded(Model* this) {
+  if (this == null || !this->hasLoader) return;
+  if (pthread_equal(pthread_self(), this->loader)) return;
+  pthread_join(this->loader, null);
+  this->hasLoader = false;
+}
+
+int Model_getLoadedFaceCount(Model* this) {
+  return atomic_load_explicit(&this->loadedFaces, memory_order_acquire);
+}
+
+double Model_getLoadProgress(Model* this) {
+  if (!atomic_load(&this->isLoading)) return 1;
+  // Decoding the body and building the faces are each half of the work.
+  double decoded = 1, built = 1;
+  if (this->bodyBytes > 0)
+    decoded = (double)atomic_load(&this->decodedBytes) / this->bodyBytes;
+  // The faces of the file, as welding lowers numOfFaces while loading.
+  if (this->sourceFaces > 0)
+    built = (double)atomic_load(&this->builtFaces) / this->sourceFaces;
+  return (decoded + built) / 2.0;
+}
+
+double Model_loadThroughput(Model* this) {
+  if (this == null || this->loadSeconds <= 0) return 0;
+  return (this->fileSize / (1024.0 * 1024.0)) / this->loadSeconds;
+}
+
 String Model_toString(Model* this) {
   return $("FaceList#: ", _(this->numOfFaces),
            ", vertices#: ", _(this->numOfVertices));
@@ -157,10 +849,10 @@ String Model_toString(Model* this) {
 
 void Model_free(Model* this) {
   if (this == null) return;
-  Array_free(this->faceList);
-  Array_free(this->vertices);
-  dispose(this->minX, this->minY, this->minZ, this->minZ, this->maxY,
-          this->maxZ, this->fileName);
+  Model_waitLoaded(this);
+  MappedFile_free(this->cache);
+  // Everything else lives in the arena, the model with it.
+  ModelArena_free(this->arena);
 }
 
 void Model_print(Model* this) {
@@ -169,24 +861,28 @@ void Model_print(Model* this) {
   print("Printing the result of the all the vertex...");
 
   // Printing all the points
-  for_in(next, this->vertices) print(
-      "Vertex[", _(next), "]: ",
-      Garbage_collect(gcStr, Point_toString(Array_get(this->vertices, next))));
+  for (int next = 0; this->vertices != null && next < this->vertices->count;
+       next++)
+    print("Vertex[", _(next), "]: ",
+          Garbage_collect(gcStr, VertexBuffer_toString(this->vertices, next)));
 
   // Printing all the facelist
-  for_in(next, this->faceList)
-      print("Face[", _(next), "]: ",
-            Garbage_collect(
-                gcStr, Splitter_toString(Array_get(this->faceList, next))));
+  for (int next = 0; this->faces != null && next < this->faces->count; next++)
+    print("Face[", _(next), "]: ",
+          Garbage_collect(gcStr, FaceBuffer_toString(this->faces, next)));
 
   // Print boundary
   print("______________________________________________");
-  print("minX: ", _(*this->minX, 6));
-  print("minY: ", _(*this->minY, 6));
-  print("minZ: ", _(*this->minZ, 6));
-  print("maxX: ", _(*this->maxX, 6));
-  print("maxY: ", _(*this->maxY, 6));
-  print("maxZ: ", _(*this->maxZ, 6));
+  print("minX: ", _(this->stats.min[0], 6));
+  print("minY: ", _(this->stats.min[1], 6));
+  print("minZ: ", _(this->stats.min[2], 6));
+  print("maxX: ", _(this->stats.max[0], 6));
+  print("maxY: ", _(this->stats.max[1], 6));
+  print("maxZ: ", _(this->stats.max[2], 6));
+  print("centroid: ", _(this->stats.centroid[0], 6), ", ",
+        _(this->stats.centroid[1], 6), ", ", _(this->stats.centroid[2], 6));
+  print("area: ", _(this->stats.area, 6));
+  print("volume: ", _(this->stats.volume, 6));
   print("______________________________________________");
   print("File: ", this->fileName);
 
@@ -198,27 +894,33 @@ void Model_test() {
   print("Testing the parsing of the ant.ply model.");
   Garbage* gcStr = new_Garbage(free);
   Model* test = new_Model("./assets/ant.ply");
+  if (test == null) {
+    print("The ant model could not be allocated.");
+    Garbage_sweep(gcStr);
+    return;
+  }
   // Testing the model.
   print("The ant model parsed: ", Garbage_collect(gcStr, Model_toString(test)));
   print("Printing the result of the all the vertex...");
 
   // Printing all the points
-  for_in(next, test->vertices) print(
-      "Vertex[", _(next), "]: ",
-      Garbage_collect(gcStr, Point_toString(Array_get(test->vertices, next))));
+  for (int next = 0; test->vertices != null && next < test->vertices->count;
+       next++)
+    print("Vertex[", _(next), "]: ",
+          Garbage_collect(gcStr, VertexBuffer_toString(test->vertices, next)));
 
   // Printing all the facelist
-  for_in(next, test->faceList)
-      print("Face[", _(next), "]: ",
-            Garbage_collect(
-                gcStr, Splitter_toString(Array_get(test->faceList, next))));
+  for (int next = 0; test->faces != null && next < test->faces->count; next++)
+    print("Face[", _(next), "]: ",
+          Garbage_collect(gcStr, FaceBuffer_toString(test->faces, next)));
 
   // Determine if the vertices number is the same after parsed.
-  if (test->numOfVertices == test->vertices->length)
+  if (test->vertices != null && test->numOfVertices == test->vertices->count)
     print("Vertices number match!");
 
   // Determine if the face list number is the same after parsed
-  if (test->numOfFaces == test->faceList->length) print("Faces number match!");
+  if (test->faces != null && test->numOfFaces == test->faces->count)
+    print("Faces number match!");
 
   Garbage_sweep(gcStr);
   Model_free(test);
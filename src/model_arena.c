@@ -0,0 +1,89 @@
+#include "model_arena.h"
+
+#include <stdint.h>
+#include <string.h>
+
+struct ModelArenaBlock {
+  ModelArenaBlock* next;
+  char* data;   // Start of the block, aligned.
+  size_t size;  // Bytes from the start.
+  size_t used;  // Bytes handed out from the start.
+};
+
+static size_t __ModelArena_round(size_t bytes) {
+  return (bytes + MODEL_ARENA_ALIGN - 1) & ~(size_t)(MODEL_ARENA_ALIGN - 1);
+}
+
+/**
+ * Allocate a block with its header in front of the data.
+ * @return the block, or null if out of memory.
+ */
+static ModelArenaBlock* __new_ModelArenaBlock(size_t size) {
+  char* memory = malloc(sizeof(ModelArenaBlock) + MODEL_ARENA_ALIGN + size);
+  if (memory == null) return null;
+  ModelArenaBlock* this = (ModelArenaBlock*)memory;
+  uintptr_t start = (uintptr_t)(memory + sizeof(ModelArenaBlock));
+  this->data = (char*)__ModelArena_round(start);
+  this->size = size;
+  this->used = 0;
+  this->next = null;
+  return this;
+}
+
+ModelArena* new_ModelArena(size_t blockSize) {
+  if (blockSize < MODEL_ARENA_ALIGN * 2) blockSize = MODEL_ARENA_ALIGN * 2;
+  ModelArenaBlock* first = __new_ModelArenaBlock(blockSize);
+  if (first == null) return null;
+  ModelArena* this = (ModelArena*)first->data;
+  first->used = __ModelArena_round(sizeof(ModelArena));
+  this->blocks = first;
+  this->blockSize = blockSize;
+  this->reserved = blockSize;
+  this->used = first->used;
+  this->blockCount = 1;
+  return this;
+}
+
+void* ModelArena_alloc(ModelArena* this, size_t bytes) {
+  size_t size = __ModelArena_round(bytes > 0 ? bytes : 1);
+  ModelArenaBlock* current = this->blocks;
+  if (current->size - current->used < size) {
+    // Large allocations get a block of their own behind the shared one.
+    bool isLarge = size > this->blockSize / 2;
+    ModelArenaBlock* block =
+        __new_ModelArenaBlock(isLarge ? size : this->blockSize);
+    if (block == null) return null;
+    if (isLarge) {
+      block->next = current->next;
+      current->next = block;
+    } else {
+      block->next = current;
+      this->blocks = block;
+    }
+    this->reserved += block->size;
+    this->blockCount++;
+    current = block;
+  }
+  void* memory = current->data + current->used;
+  current->used += size;
+  this->used += size;
+  return memory;
+}
+
+String ModelArena_copyString(ModelArena* this, const char* text) {
+  size_t length = strlen(text);
+  String copy = ModelArena_alloc(this, length + 1);
+  if (copy != null) memcpy(copy, text, length + 1);
+  return copy;
+}
+
+void ModelArena_free(ModelArena* this) {
+  if (this == null) return;
+  // The arena lives in one of the blocks, so find the next one first.
+  ModelArenaBlock* block = this->blocks;
+  while (block != null) {
+    ModelArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+}
@@ -0,0 +1,433 @@
+#include "model_bvh.h"
+
+#include <float.h>
+#include <string.h>
+
+#include "parallel.h"
+
+// Faces bounded by one task.
+#define BVH_FACE_CHUNK 32768
+
+// Past this depth nodes are split in half by count, so the
+// recursion stays shallow on the most uneven meshes.
+#define BVH_MAX_DEPTH 48
+
+typedef struct {
+  float min[3], max[3];
+} __BvhBox;
+
+/**
+ * Nodes of a tree being built, grown as it is split.
+ */
+typedef struct {
+  BvhNode* nodes;
+  int count, capacity;
+} __BvhTree;
+
+/**
+ * A node left to be split into a subtree on a thread.
+ */
+typedef struct {
+  int node;
+  BvhNode root;  // Copy of the node, the tree may grow meanwhile.
+  int depth;
+  __BvhTree tree;
+} __BvhTask;
+
+typedef struct {
+  const FaceBuffer* faces;
+  const float* positions;
+  __BvhBox* boxes;  // Of every face.
+  uint32_t* order;
+  uint32_t taskFaces;  // Nodes of at most these faces become tasks.
+  __BvhTask* tasks;
+  int taskCount, taskCapacity;
+} __BvhBuild;
+
+static void __BvhBox_clear(__BvhBox* this) {
+  for (int axis = 0; axis < 3; axis++) {
+    this->min[axis] = FLT_MAX;
+    this->max[axis] = -FLT_MAX;
+  }
+}
+
+static void __BvhBox_grow(__BvhBox* this, const __BvhBox* box) {
+  for (int axis = 0; axis < 3; axis++) {
+    if (box->min[axis] < this->min[axis]) this->min[axis] = box->min[axis];
+    if (box->max[axis] > this->max[axis]) this->max[axis] = box->max[axis];
+  }
+}
+
+/**
+ * Get half the surface area of a box, 0 when empty.
+ */
+static float __BvhBox_getArea(const __BvhBox* this) {
+  if (this->min[0] > this->max[0]) return 0;
+  float x = this->max[0] - this->min[0], y = this->max[1] - this->min[1],
+        z = this->max[2] - this->min[2];
+  return x * y + y * z + z * x;
+}
+
+/**
+ * Get twice the center of a box on an axis. Faces without
+ * corners have an empty box and are centered at 0.
+ */
+static float __BvhBox_getCenter(const __BvhBox* this, int axis) {
+  return this->min[axis] + this->max[axis];
+}
+
+static void __ModelBvh_boundFaces(void* context, int index) {
+  __BvhBuild* build = context;
+  const FaceBuffer* faces = build->faces;
+  int first = index * BVH_FACE_CHUNK;
+  int last = first + BVH_FACE_CHUNK;
+  if (last > faces->count) last = faces->count;
+  for (int face = first; face < last; face++) {
+    __BvhBox* box = &build->boxes[face];
+    __BvhBox_clear(box);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    uint32_t cornerCount = FaceBuffer_getCornerCount(faces, face);
+    for (uint32_t corner = 0; corner < cornerCount; corner++) {
+      const float* position = &build->positions[corners[corner] * 3];
+      for (int axis = 0; axis < 3; axis++) {
+        if (position[axis] < box->min[axis]) box->min[axis] = position[axis];
+        if (position[axis] > box->max[axis]) box->max[axis] = position[axis];
+      }
+    }
+  }
+}
+
+/**
+ * Add nodes to a tree.
+ * @return the index of the first.
+ */
+static int __BvhTree_add(__BvhTree* this, int count) {
+  if (this->count + count > this->capacity) {
+    this->capacity = this->capacity * 2 + count;
+    this->nodes = realloc(this->nodes, sizeof(BvhNode) * this->capacity);
+  }
+  int first = this->count;
+  this->count += count;
+  return first;
+}
+
+static void __BvhNode_setBox(BvhNode* this, const __BvhBox* box) {
+  memcpy(this->min, box->min, sizeof(this->min));
+  memcpy(this->max, box->max, sizeof(this->max));
+}
+
+/**
+ * Split the faces of a node in half by their order, with
+ * the boxes of both halves.
+ * @return where the right half starts.
+ */
+static uint32_t __ModelBvh_splitHalf(__BvhBuild* build, const BvhNode* node,
+                                     __BvhBox halves[2]) {
+  uint32_t split = node->first + node->count / 2;
+  __BvhBox_clear(&halves[0]);
+  __BvhBox_clear(&halves[1]);
+  for (uint32_t at = node->first; at < node->first + node->count; at++)
+    __BvhBox_grow(&halves[at >= split], &build->boxes[build->order[at]]);
+  return split;
+}
+
+/**
+ * Split the faces of a node where the surface area
+ * heuristic is lowest, between bins of the face centers
+ * along the axis they spread the most on. The faces are
+ * partitioned in the order.
+ * @param halves to be set to the boxes of both sides.
+ * @return where the right side starts.
+ */
+static uint32_t __ModelBvh_split(__BvhBuild* build, const BvhNode* node,
+                                 int depth, __BvhBox halves[2]) {
+  uint32_t* order = build->order;
+  uint32_t first = node->first, last = node->first + node->count;
+  if (depth >= BVH_MAX_DEPTH) return __ModelBvh_splitHalf(build, node, halves);
+
+  float low[3], high[3];
+  for (int axis = 0; axis < 3; axis++) {
+    low[axis] = FLT_MAX;
+    high[axis] = -FLT_MAX;
+  }
+  for (uint32_t at = first; at < last; at++) {
+    const __BvhBox* box = &build->boxes[order[at]];
+    for (int axis = 0; axis < 3; axis++) {
+      float center = __BvhBox_getCenter(box, axis);
+      if (center < low[axis]) low[axis] = center;
+      if (center > high[axis]) high[axis] = center;
+    }
+  }
+  int axis = 0;
+  for (int next = 1; next < 3; next++)
+    if (high[next] - low[next] > high[axis] - low[axis]) axis = next;
+  float extent = high[axis] - low[axis];
+  if (!(extent > 0)) return __ModelBvh_splitHalf(build, node, halves);
+
+  // Bin the faces by their centers.
+  float scale = BVH_BINS * (1 - 1e-6f) / extent;
+  uint32_t counts[BVH_BINS] = {0};
+  __BvhBox bins[BVH_BINS];
+  for (int bin = 0; bin < BVH_BINS; bin++) __BvhBox_clear(&bins[bin]);
+  for (uint32_t at = first; at < last; at++) {
+    const __BvhBox* box = &build->boxes[order[at]];
+    int bin = (int)((__BvhBox_getCenter(box, axis) - low[axis]) * scale);
+    if (bin >= BVH_BINS) bin = BVH_BINS - 1;
+    counts[bin]++;
+    __BvhBox_grow(&bins[bin], box);
+  }
+
+  // Sweep from the right for the areas, then from the left for the cost.
+  float rightAreas[BVH_BINS];
+  __BvhBox right;
+  __BvhBox_clear(&right);
+  for (int bin = BVH_BINS - 1; bin > 0; bin--) {
+    __BvhBox_grow(&right, &bins[bin]);
+    rightAreas[bin] = __BvhBox_getArea(&right);
+  }
+  __BvhBox left;
+  __BvhBox_clear(&left);
+  uint32_t leftCount = 0;
+  int best = 0;
+  float bestCost = FLT_MAX;
+  for (int bin = 1; bin < BVH_BINS; bin++) {
+    __BvhBox_grow(&left, &bins[bin - 1]);
+    leftCount += counts[bin - 1];
+    uint32_t rightCount = node->count - leftCount;
+    if (leftCount == 0 || rightCount == 0) continue;
+    float cost = __BvhBox_getArea(&left) * leftCount +
+                 rightAreas[bin] * rightCount;
+    if (cost < bestCost) {
+      bestCost = cost;
+      best = bin;
+    }
+  }
+  if (best == 0) return __ModelBvh_splitHalf(build, node, halves);
+
+  __BvhBox_clear(&halves[0]);
+  __BvhBox_clear(&halves[1]);
+  for (int bin = 0; bin < BVH_BINS; bin++)
+    __BvhBox_grow(&halves[bin >= best], &bins[bin]);
+
+  // Partition the order, the faces below the best bin first.
+  uint32_t head = first, tail = last;
+  while (head < tail) {
+    const __BvhBox* box = &build->boxes[order[head]];
+    int bin = (int)((__BvhBox_getCenter(box, axis) - low[axis]) * scale);
+    if (bin < best) {
+      head++;
+    } else {
+      tail--;
+      uint32_t face = order[head];
+      order[head] = order[tail];
+      order[tail] = face;
+    }
+  }
+  return head;
+}
+
+/**
+ * Split a node of a tree until its leaves are clusters.
+ * @param isTop to leave the nodes small enough as tasks
+ * to be split on the threads.
+ */
+static void __ModelBvh_build(__BvhBuild* build, __BvhTree* tree, int index,
+                             int depth, bool isTop) {
+  BvhNode node = tree->nodes[index];
+  if (node.count <= BVH_CLUSTER_FACES) return;
+  if (isTop && node.count <= build->taskFaces) {
+    if (build->taskCount == build->taskCapacity) {
+      build->taskCapacity = build->taskCapacity * 2 + 8;
+      build->tasks =
+          realloc(build->tasks, sizeof(__BvhTask) * build->taskCapacity);
+    }
+    build->tasks[build->taskCount++] =
+        (__BvhTask){.node = index, .root = node, .depth = depth};
+    return;
+  }
+
+  __BvhBox halves[2];
+  uint32_t split = __ModelBvh_split(build, &node, depth, halves);
+  int left = __BvhTree_add(tree, 2);
+  tree->nodes[index].left = left;
+  for (int side = 0; side < 2; side++) {
+    BvhNode* child = &tree->nodes[left + side];
+    __BvhNode_setBox(child, &halves[side]);
+    child->first = side == 0 ? node.first : split;
+    child->count = side == 0 ? split - node.first
+                             : node.first + node.count - split;
+    child->left = 0;
+  }
+  __ModelBvh_build(build, tree, left, depth + 1, isTop);
+  __ModelBvh_build(build, tree, left + 1, depth + 1, isTop);
+}
+
+static void __ModelBvh_buildTask(void* context, int index) {
+  __BvhBuild* build = context;
+  __BvhTask* task = &build->tasks[index];
+  __BvhTree_add(&task->tree, 1);
+  task->tree.nodes[0] = task->root;
+  __ModelBvh_build(build, &task->tree, 0, task->depth, false);
+}
+
+/**
+ * Put the subtree of a task in place of its node. The
+ * root of the subtree takes the node and the rest are
+ * appended, their children moved along.
+ */
+static void __ModelBvh_attach(__BvhTree* tree, __BvhTask* task) {
+  __BvhTree* subtree = &task->tree;
+  int base = subtree->count > 1 ? __BvhTree_add(tree, subtree->count - 1) : 0;
+  for (int next = 0; next < subtree->count; next++) {
+    BvhNode node = subtree->nodes[next];
+    if (node.left != 0) node.left += base - 1;
+    tree->nodes[next == 0 ? task->node : base + next - 1] = node;
+  }
+  free(subtree->nodes);
+}
+
+static int __ModelBvh_compareFaces(const void* a, const void* b) {
+  uint32_t first = *(const uint32_t*)a, second = *(const uint32_t*)b;
+  return (first > second) - (first < second);
+}
+
+ModelBvh* new_ModelBvh(const FaceBuffer* faces, const float* positions) {
+  ModelBvh* this = malloc(sizeof(ModelBvh));
+  int faceCount = faces->count;
+  this->faceCount = faceCount;
+  this->order = malloc(sizeof(uint32_t) * (faceCount + 1));
+  for (int face = 0; face < faceCount; face++) this->order[face] = face;
+
+  __BvhBuild build = {
+      .faces = faces,
+      .positions = positions,
+      .boxes = malloc(sizeof(__BvhBox) * (faceCount + 1)),
+      .order = this->order,
+  };
+  Parallel_for((faceCount + BVH_FACE_CHUNK - 1) / BVH_FACE_CHUNK,
+               __ModelBvh_boundFaces, &build);
+
+  // Split the top serially into a few tasks per thread.
+  int threadCount = Parallel_getThreadCount();
+  build.taskFaces = threadCount > 1 ? faceCount / (threadCount * 4) : 0;
+  if (build.taskFaces < BVH_CLUSTER_FACES * 4)
+    build.taskFaces = BVH_CLUSTER_FACES * 4;
+  __BvhTree tree = {0};
+  __BvhTree_add(&tree, 1);
+  __BvhBox box;
+  __BvhBox_clear(&box);
+  for (int face = 0; face < faceCount; face++)
+    __BvhBox_grow(&box, &build.boxes[face]);
+  __BvhNode_setBox(&tree.nodes[0], &box);
+  tree.nodes[0].first = 0;
+  tree.nodes[0].count = faceCount;
+  tree.nodes[0].left = 0;
+  __ModelBvh_build(&build, &tree, 0, 0, threadCount > 1);
+
+  Parallel_for(build.taskCount, __ModelBvh_buildTask, &build);
+  for (int task = 0; task < build.taskCount; task++)
+    __ModelBvh_attach(&tree, &build.tasks[task]);
+
+  this->nodes = tree.nodes;
+  this->nodeCount = tree.count;
+  this->clusterCount = 0;
+  for (int node = 0; node < tree.count; node++) {
+    BvhNode* leaf = &tree.nodes[node];
+    if (leaf->left != 0) continue;
+    this->clusterCount++;
+    // Keep the mesh order in a cluster, it may be ordered for the vertex cache.
+    qsort(&this->order[leaf->first], leaf->count, sizeof(uint32_t),
+          __ModelBvh_compareFaces);
+  }
+  dispose(build.boxes, build.tasks);
+  return this;
+}
+
+void ModelBvh_free(ModelBvh* this) {
+  if (this == null) return;
+  dispose(this->nodes, this->order);
+  free(this);
+}
+
+void ModelBvh_getFrustum(const float projection[16], const float modelview[16],
+                         float planes[6][4]) {
+  // Rows of the projection times the modelview.
+  float rows[4][4];
+  for (int row = 0; row < 4; row++)
+    for (int column = 0; column < 4; column++) {
+      float sum = 0;
+      for (int k = 0; k < 4; k++)
+        sum += projection[k * 4 + row] * modelview[column * 4 + k];
+      rows[row][column] = sum;
+    }
+  for (int plane = 0; plane < 6; plane++) {
+    float sign = plane % 2 == 0 ? 1 : -1;
+    for (int k = 0; k < 4; k++)
+      planes[plane][k] = rows[3][k] + sign * rows[plane / 2][k];
+  }
+}
+
+typedef struct {
+  const ModelBvh* bvh;
+  const float (*planes)[4];
+  BvhRange* ranges;
+  int rangeCount;
+} __BvhCulling;
+
+/**
+ * Add the faces of a node to the ranges, joined to the
+ * last range when they follow it.
+ */
+static void __ModelBvh_take(__BvhCulling* culling, const BvhNode* node) {
+  if (culling->rangeCount > 0) {
+    BvhRange* last = &culling->ranges[culling->rangeCount - 1];
+    if (last->first + last->count == node->first) {
+      last->count += node->count;
+      return;
+    }
+  }
+  culling->ranges[culling->rangeCount++] =
+      (BvhRange){.first = node->first, .count = node->count};
+}
+
+/**
+ * Test a node against the planes it may still cross.
+ * @param mask of the planes to test, those it is inside of
+ * are cleared for the children.
+ * @return false if it is outside a plane.
+ */
+static bool __ModelBvh_isVisible(const BvhNode* node, const float planes[6][4],
+                                 int* mask) {
+  for (int plane = 0; plane < 6; plane++) {
+    if (!(*mask & (1 << plane))) continue;
+    const float* p = planes[plane];
+    float far = p[3], near = p[3];
+    for (int axis = 0; axis < 3; axis++) {
+      bool isMax = p[axis] > 0;
+      far += p[axis] * (isMax ? node->max[axis] : node->min[axis]);
+      near += p[axis] * (isMax ? node->min[axis] : node->max[axis]);
+    }
+    if (far < 0) return false;
+    if (near >= 0) *mask &= ~(1 << plane);
+  }
+  return true;
+}
+
+static void __ModelBvh_visit(__BvhCulling* culling, int index, int mask) {
+  const BvhNode* node = &culling->bvh->nodes[index];
+  if (!__ModelBvh_isVisible(node, culling->planes, &mask)) return;
+  if (mask == 0 || node->left == 0) {
+    __ModelBvh_take(culling, node);
+    return;
+  }
+  __ModelBvh_visit(culling, node->left, mask);
+  __ModelBvh_visit(culling, node->left + 1, mask);
+}
+
+int ModelBvh_cull(const ModelBvh* this, const float planes[6][4],
+                  BvhRange* ranges) {
+  if (this->faceCount == 0) return 0;
+  __BvhCulling culling = {.bvh = this, .planes = planes, .ranges = ranges};
+  __ModelBvh_visit(&culling, 0, (1 << 6) - 1);
+  return culling.rangeCount;
+}
@@ -0,0 +1,282 @@
+#include "model_cache.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Sections start on a cache line.
+#define MODEL_CACHE_ALIGNMENT 64
+
+static const uint32_t MODEL_CACHE_BYTE_ORDER = 0x01020304;
+
+static int64_t __ModelCache_getModified(struct stat* info) {
+#if defined(__APPLE__)
+  return (int64_t)info->st_mtimespec.tv_sec * 1000000000 +
+         info->st_mtimespec.tv_nsec;
+#else
+  return (int64_t)info->st_mtim.tv_sec * 1000000000 + info->st_mtim.tv_nsec;
+#endif
+}
+
+uint64_t ModelCache_hash(const char* bytes, size_t length) {
+  const uint64_t prime = 0x9E3779B97F4A7C15ull;
+  uint64_t hash = 0xCBF29CE484222325ull ^ (length * prime);
+  size_t next = 0;
+  for (; next + 8 <= length; next += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + next, 8);
+    hash = (hash ^ word) * prime;
+    hash ^= hash >> 29;
+  }
+  for (; next < length; next++) hash = (hash ^ (uint8_t)bytes[next]) * prime;
+  return hash ^ (hash >> 32);
+}
+
+String ModelCache_getPath(String sourcePath) {
+  String setting = getenv("MODEL_CACHE");
+  if (setting != null && isStringEqual(setting, "off")) return null;
+
+  String folder = getenv("MODEL_CACHE_DIR");
+  if (folder == null || isStringEqual(folder, ""))
+    return $(sourcePath, "c");  // cow.ply becomes cow.plyc
+
+  // Name it after the file and a hash of its absolute path, so files
+  // of the same name in different folders never share a cache.
+  char* absolute = realpath(sourcePath, null);
+  const char* key = absolute != null ? absolute : sourcePath;
+  char prefix[24];
+  snprintf(prefix, sizeof(prefix), "%016llx-",
+           (unsigned long long)ModelCache_hash(key, strlen(key)));
+  const char* name = sourcePath;
+  for (const char* at = sourcePath; *at != '\0'; at++)
+    if (*at == '/' || *at == '\\') name = at + 1;
+  String path = $(folder, "/", prefix, (String)name, "c");
+  free(absolute);
+  return path;
+}
+
+/**
+ * Count the triangles the faces of a cache are cut into,
+ * checking that the face offsets only grow.
+ * @return the count, or -1 if the offsets are broken.
+ */
+static int64_t __ModelCache_countTriangles(MappedFile* cache) {
+  const ModelCacheHeader* header = ModelCache_getHeader(cache);
+  uint32_t arity = header->faceArity;
+  if (arity != 0)
+    return arity >= 3 ? (int64_t)header->numOfFaces * (arity - 2) : 0;
+  const uint32_t* offsets =
+      ModelCache_getSection(cache, MODEL_CACHE_FACE_OFFSETS);
+  if (offsets[0] != 0) return -1;
+  int64_t count = 0;
+  for (uint32_t face = 0; face < header->numOfFaces; face++) {
+    if (offsets[face + 1] < offsets[face]) return -1;
+    uint32_t corners = offsets[face + 1] - offsets[face];
+    if (corners >= 3) count += corners - 2;
+  }
+  return count;
+}
+
+/**
+ * Check that every value of a uint32 section is below a
+ * limit. The largest is found first, which vectorizes.
+ */
+static bool __ModelCache_isBelow(MappedFile* cache, ModelCacheSection section,
+                                 uint64_t count, uint64_t limit) {
+  const uint32_t* values = ModelCache_getSection(cache, section);
+  uint32_t largest = 0;
+  for (uint64_t next = 0; next < count; next++)
+    if (values[next] > largest) largest = values[next];
+  return count == 0 || largest < limit;
+}
+
+/**
+ * Check that every section lies in the file and holds the
+ * bytes the counts of the header call for, and that the
+ * indices and corners in them are in range, so nothing
+ * read from the mapping later runs past it.
+ */
+static bool __ModelCache_hasValidSections(MappedFile* cache) {
+  const ModelCacheHeader* header = ModelCache_getHeader(cache);
+  for (int next = 0; next < MODEL_CACHE_SECTION_COUNT; next++) {
+    uint64_t offset = header->offsets[next], length = header->lengths[next];
+    if (length == 0) continue;
+    if (offset < sizeof(ModelCacheHeader) ||
+        offset % MODEL_CACHE_ALIGNMENT != 0 || offset > cache->length ||
+        length > cache->length - offset)
+      return false;
+  }
+  uint64_t vertexCount = header->numOfVertices;
+  uint64_t faceCount = header->numOfFaces;
+  if (vertexCount > INT_MAX || faceCount >= INT_MAX ||
+      header->vertexLayout > VERTEX_INTERLEAVED ||
+      header->vertexPrecision > VERTEX_FLOAT64 ||
+      header->normalWeighting > NORMALS_ANGLE_WEIGHTED ||
+      header->lengths[MODEL_CACHE_VERTICES] !=
+          VertexBuffer_getByteLength(header->numOfVertices,
+                                     header->vertexLayout,
+                                     header->vertexPrecision))
+    return false;
+
+  // The attributes are either absent or one per vertex.
+  uint64_t attributeLength = sizeof(float) * 3 * vertexCount;
+  for (int next = MODEL_CACHE_NORMALS; next <= MODEL_CACHE_COLORS; next++)
+    if (header->lengths[next] != 0 && header->lengths[next] != attributeLength)
+      return false;
+
+  // Faces need their indices, and the offsets when they differ in size.
+  uint64_t offsetsLength = header->lengths[MODEL_CACHE_FACE_OFFSETS];
+  uint64_t indicesLength = header->lengths[MODEL_CACHE_FACE_INDICES];
+  if (faceCount == 0)
+    return offsetsLength == 0 && indicesLength == 0 &&
+           header->lengths[MODEL_CACHE_TRIANGLES] == 0;
+  uint64_t cornerCount;
+  if (header->faceArity == 0) {
+    if (offsetsLength != sizeof(uint32_t) * (faceCount + 1)) return false;
+    const uint32_t* offsets =
+        ModelCache_getSection(cache, MODEL_CACHE_FACE_OFFSETS);
+    cornerCount = offsets[faceCount];
+  } else {
+    if (offsetsLength != 0) return false;
+    cornerCount = faceCount * header->faceArity;
+  }
+  if (cornerCount == 0 || cornerCount > UINT32_MAX ||
+      indicesLength != sizeof(uint32_t) * cornerCount ||
+      header->stats.maxIndex >= vertexCount ||
+      !__ModelCache_isBelow(cache, MODEL_CACHE_FACE_INDICES, cornerCount,
+                            vertexCount))
+    return false;
+  int64_t triangleCount = __ModelCache_countTriangles(cache);
+  if (triangleCount < 0) return false;
+
+  // Triangles are cut on load when absent, and never kept for triangles.
+  uint64_t trianglesLength = header->lengths[MODEL_CACHE_TRIANGLES];
+  if (trianglesLength == 0) return true;
+  uint64_t triangleCorners = 3 * (uint64_t)triangleCount;
+  return header->faceArity != 3 &&
+         trianglesLength == sizeof(uint32_t) * triangleCorners &&
+         __ModelCache_isBelow(cache, MODEL_CACHE_TRIANGLES, triangleCorners,
+                              cornerCount);
+}
+
+static bool __ModelCache_isValid(MappedFile* cache, String sourcePath) {
+  if (cache->length < sizeof(ModelCacheHeader)) return false;
+  const ModelCacheHeader* header = ModelCache_getHeader(cache);
+  if (memcmp(header->magic, "PLYC", 4) != 0 ||
+      header->version != MODEL_CACHE_VERSION ||
+      header->byteOrder != MODEL_CACHE_BYTE_ORDER ||
+      !__ModelCache_hasValidSections(cache))
+    return false;
+
+  struct stat info;
+  if (stat(sourcePath, &info) != 0) return false;
+  if ((uint64_t)info.st_size != header->sourceSize) return false;
+  if (__ModelCache_getModified(&info) == header->sourceModified) return true;
+
+  // Same size but touched, the content decides.
+  MappedFile* source = new_MappedFile(sourcePath);
+  if (source == null) return false;
+  bool isSame =
+      ModelCache_hash(source->data, source->length) == header->sourceHash;
+  MappedFile_free(source);
+  return isSame;
+}
+
+MappedFile* ModelCache_open(String sourcePath) {
+  String path = ModelCache_getPath(sourcePath);
+  if (path == null) return null;
+  MappedFile* cache = new_MappedFile(path);
+  free(path);
+  if (cache == null) return null;
+  if (!__ModelCache_isValid(cache, sourcePath)) {
+    MappedFile_free(cache);
+    return null;
+  }
+  return cache;
+}
+
+const ModelCacheHeader* ModelCache_getHeader(MappedFile* cache) {
+  return (const ModelCacheHeader*)cache->data;
+}
+
+const void* ModelCache_getSection(MappedFile* cache,
+                                  ModelCacheSection section) {
+  const ModelCacheHeader* header = ModelCache_getHeader(cache);
+  if (header->lengths[section] == 0) return null;
+  return cache->data + header->offsets[section];
+}
+
+static bool __ModelCache_pad(FILE* file, uint64_t* offset) {
+  static const char zeros[MODEL_CACHE_ALIGNMENT] = {0};
+  size_t padding = (MODEL_CACHE_ALIGNMENT - *offset % MODEL_CACHE_ALIGNMENT) %
+                   MODEL_CACHE_ALIGNMENT;
+  *offset += padding;
+  return fwrite(zeros, 1, padding, file) == padding;
+}
+
+bool ModelCache_save(String sourcePath, MappedFile* source,
+                     ModelCacheContent* content) {
+  String path = ModelCache_getPath(sourcePath);
+  if (path == null) return false;
+  struct stat info;
+  if (stat(sourcePath, &info) != 0) {
+    free(path);
+    return false;
+  }
+
+  ModelCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "PLYC", 4);
+  header.version = MODEL_CACHE_VERSION;
+  header.byteOrder = MODEL_CACHE_BYTE_ORDER;
+  header.numOfVertices = content->numOfVertices;
+  header.numOfFaces = content->numOfFaces;
+  header.faceArity = content->faceArity;
+  header.vertexLayout = content->vertexLayout;
+  header.vertexPrecision = content->vertexPrecision;
+  header.isReordered = content->isReordered;
+  header.weldDistance = content->weldDistance;
+  header.hasGeneratedNormals = content->hasGeneratedNormals;
+  header.normalWeighting = content->normalOptions.weighting;
+  header.isNormalsFlipped = content->normalOptions.isFlipped;
+  header.sourceSize = (uint64_t)info.st_size;
+  header.sourceModified = __ModelCache_getModified(&info);
+  header.sourceHash = ModelCache_hash(source->data, source->length);
+  header.stats = content->stats;
+
+  // Lay the sections out after the header.
+  uint64_t offset = sizeof(header);
+  for (int next = 0; next < MODEL_CACHE_SECTION_COUNT; next++) {
+    offset += (MODEL_CACHE_ALIGNMENT - offset % MODEL_CACHE_ALIGNMENT) %
+              MODEL_CACHE_ALIGNMENT;
+    header.lengths[next] = content->lengths[next];
+    header.offsets[next] = content->lengths[next] > 0 ? offset : 0;
+    offset += content->lengths[next];
+  }
+
+  // Write to a temporary file, then rename over the cache.
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+  String temporary = $(path, suffix);
+  FILE* file = fopen(temporary, "wb");
+  bool isWritten = file != null;
+  if (isWritten) {
+    offset = sizeof(header);
+    isWritten = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int next = 0; isWritten && next < MODEL_CACHE_SECTION_COUNT; next++) {
+      if (content->lengths[next] == 0) continue;
+      isWritten = __ModelCache_pad(file, &offset) &&
+                  fwrite(content->sections[next], 1, content->lengths[next],
+                         file) == content->lengths[next];
+      offset += content->lengths[next];
+    }
+    isWritten = fclose(file) == 0 && isWritten;
+  }
+  if (isWritten) isWritten = rename(temporary, path) == 0;
+  if (!isWritten) unlink(temporary);
+  dispose(temporary, path);
+  return isWritten;
+}
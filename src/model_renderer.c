@@ -0,0 +1,436 @@
+#include "model_renderer.h"
+
+#if defined(__APPLE__)
+#include <OpenGL/gl.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#endif
+
+#include "frame_stats.h"
+
+enum { POSITIONS, NORMALS, COLORS, INDICES };
+
+ModelRenderer* new_ModelRenderer(Model* model) {
+  ModelRenderer* this = malloc(sizeof(ModelRenderer));
+  this->model = model;
+  String mode = getenv("MODEL_RENDER");
+  this->mode = mode != null && isStringEqual(mode, "immediate")
+                   ? RENDER_IMMEDIATE
+                   : RENDER_BUFFERED;
+  memset(this->buffers, 0, sizeof(this->buffers));
+  this->indexCount = 0;
+  this->isUploaded = false;
+  String cull = getenv("MODEL_CULL");
+  this->isCulled = cull == null || !isStringEqual(cull, "off");
+  this->bvh = null;
+  this->ranges = null;
+  this->indexStarts = null;
+  this->counts = null;
+  this->offsets = null;
+  String lod = getenv("MODEL_LOD");
+  this->lodPixels = lod == null               ? LOD_PIXELS
+                    : isStringEqual(lod, "off") ? 0
+                                                : atof(lod);
+  this->lod = null;
+  atomic_init(&this->isLodBuilt, false);
+  this->hasLodBuilder = false;
+  this->lodBuffers = null;
+  return this;
+}
+
+static void* __ModelRenderer_buildLod(void* argument) {
+  ModelRenderer* this = argument;
+  Model* model = this->model;
+  MeshLod* lod = new_MeshLod(model->faces, model->triangles,
+                             model->renderVertices, model->colors,
+                             model->vertices->count);
+  print("Simplified into ", _(lod->levelCount), " levels of detail in ",
+        _(lod->seconds * 1000, 1), " ms (",
+        _(lod->levels[0].triangleCount / lod->seconds / 1e6, 2),
+        " M triangles/s).");
+  this->lod = lod;
+  atomic_store(&this->isLodBuilt, true);
+  return null;
+}
+
+/**
+ * Start building the levels of detail of the loaded model
+ * in the background. Models with a normal per corner keep
+ * drawing every face, as the levels share the vertices.
+ */
+static void __ModelRenderer_startLod(ModelRenderer* this) {
+  Model* model = this->model;
+  if (this->lodPixels <= 0 || model->cornerNormals != null ||
+      model->faces->count < LOD_MIN_TRIANGLES * 2)
+    return;
+  this->hasLodBuilder = true;
+  if (pthread_create(&this->lodBuilder, null, __ModelRenderer_buildLod,
+                     this) != 0) {
+    // Fall back to building on this thread.
+    this->hasLodBuilder = false;
+    __ModelRenderer_buildLod(this);
+  }
+}
+
+/**
+ * Pick the level of detail for the current transform, once
+ * the levels are built and, when buffered, uploaded.
+ * @return the level, 0 for every face.
+ */
+static int __ModelRenderer_selectLevel(ModelRenderer* this) {
+  if (!atomic_load(&this->isLodBuilt)) return 0;
+  MeshLod* lod = this->lod;
+  if (this->mode == RENDER_BUFFERED && this->lodBuffers == null) {
+    // Level 0 draws the faces themselves, so its slot stays 0.
+    this->lodBuffers = malloc(sizeof(unsigned int) * lod->levelCount);
+    this->lodBuffers[0] = 0;
+    glGenBuffers(lod->levelCount - 1, &this->lodBuffers[1]);
+    for (int level = 1; level < lod->levelCount; level++) {
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->lodBuffers[level]);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                   sizeof(uint32_t) * 3 * lod->levels[level].triangleCount,
+                   lod->levels[level].indices, GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  }
+  float projection[16], modelview[16], pixelError;
+  int viewport[4];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  int level = MeshLod_select(lod, projection, modelview, viewport[3],
+                             this->lodPixels, &pixelError);
+  FrameStats_setLod(level, pixelError);
+  return level;
+}
+
+/**
+ * Build the hierarchy of the loaded faces, which then
+ * sets the order they are uploaded and drawn in.
+ */
+static void __ModelRenderer_buildBvh(ModelRenderer* this) {
+  Model* model = this->model;
+  this->bvh = new_ModelBvh(model->faces, model->renderVertices);
+  int clusterCount = this->bvh->clusterCount;
+  this->ranges = malloc(sizeof(BvhRange) * (clusterCount + 1));
+  this->counts = malloc(sizeof(int) * (clusterCount + 1));
+  this->offsets = malloc(sizeof(void*) * (clusterCount + 1));
+}
+
+/**
+ * Find the faces in the view frustum of the current
+ * transform, and count the rest as culled.
+ * @param ranges to be set to the runs in the order of the
+ * hierarchy, or to every face when not culling.
+ * @return the number of runs.
+ */
+static int __ModelRenderer_cull(ModelRenderer* this, int faceCount,
+                                const BvhRange** ranges) {
+  static BvhRange every;
+  if (!this->isCulled || this->bvh == null) {
+    every = (BvhRange){.first = 0, .count = faceCount};
+    *ranges = &every;
+    return 1;
+  }
+  float projection[16], modelview[16], planes[6][4];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+  ModelBvh_getFrustum(projection, modelview, planes);
+  *ranges = this->ranges;
+  return ModelBvh_cull(this->bvh, planes, this->ranges);
+}
+
+/**
+ * Gather an attribute per vertex into one per corner.
+ */
+static float* __ModelRenderer_expand(const float* attribute,
+                                     const FaceBuffer* faces) {
+  float* expanded = malloc(sizeof(float) * 3 * (faces->length + 1));
+  for (size_t corner = 0; corner < faces->length; corner++)
+    memcpy(&expanded[corner * 3], &attribute[faces->indices[corner] * 3],
+           sizeof(float) * 3);
+  return expanded;
+}
+
+static void __ModelRenderer_uploadArray(unsigned int buffer, const void* data,
+                                        size_t bytes) {
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, bytes, data, GL_STATIC_DRAW);
+}
+
+/**
+ * Upload the model as the triangles of its faces, in the
+ * order of the hierarchy. With crease normals each corner
+ * is its own vertex.
+ */
+static void __ModelRenderer_upload(ModelRenderer* this) {
+  Model* model = this->model;
+  const FaceBuffer* faces = model->faces;
+  const MeshTriangles* triangles = model->triangles;
+  bool isExpanded = model->cornerNormals != null;
+
+  uint32_t* indices =
+      malloc(sizeof(uint32_t) * ((size_t)triangles->count * 3 + 1));
+  const uint32_t* order = this->bvh != null ? this->bvh->order : null;
+  if (order != null && triangles->faceStarts != null)
+    this->indexStarts = malloc(sizeof(uint32_t) * (faces->count + 1));
+  size_t at = 0;
+  for (int position = 0; position < faces->count; position++) {
+    if (this->indexStarts != null) this->indexStarts[position] = at;
+    int face = order != null ? (int)order[position] : position;
+    uint32_t end = MeshTriangles_getFaceStart(triangles, face + 1) * 3;
+    for (uint32_t next = MeshTriangles_getFaceStart(triangles, face) * 3;
+         next < end; next++) {
+      uint32_t corner = MeshTriangles_getCorner(triangles, next);
+      indices[at++] = isExpanded ? corner : faces->indices[corner];
+    }
+  }
+
+  size_t vertexCount =
+      isExpanded ? faces->length : (size_t)model->vertices->count;
+  size_t bytes = sizeof(float) * 3 * vertexCount;
+  float* positions = isExpanded
+                         ? __ModelRenderer_expand(model->renderVertices, faces)
+                         : model->renderVertices;
+  float* colors = isExpanded && model->colors != null
+                      ? __ModelRenderer_expand(model->colors, faces)
+                      : model->colors;
+  glGenBuffers(4, this->buffers);
+  __ModelRenderer_uploadArray(this->buffers[POSITIONS], positions, bytes);
+  __ModelRenderer_uploadArray(
+      this->buffers[NORMALS],
+      isExpanded ? model->cornerNormals : model->normals, bytes);
+  if (colors != null)
+    __ModelRenderer_uploadArray(this->buffers[COLORS], colors, bytes);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers[INDICES]);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * at, indices,
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+  if (isExpanded) {
+    dispose(positions, colors);
+  }
+  free(indices);
+  if (this->indexStarts != null) this->indexStarts[faces->count] = at;
+  this->indexCount = at;
+  this->isUploaded = true;
+}
+
+/**
+ * Get the first index of the triangles of a face in the
+ * order of the hierarchy.
+ * @param position of the face in the order.
+ */
+static uint32_t __ModelRenderer_getIndexStart(ModelRenderer* this,
+                                              uint32_t position) {
+  if (this->indexStarts != null) return this->indexStarts[position];
+  return MeshTriangles_getFaceStart(this->model->triangles, position) * 3;
+}
+
+static void __ModelRenderer_drawBuffered(ModelRenderer* this, int level,
+                                         bool isShadowPass) {
+  if (!this->isUploaded) __ModelRenderer_upload(this);
+  unsigned int indices = this->buffers[INDICES];
+  int indexCount = this->indexCount, rangeCount = 0;
+  if (level > 0) {
+    indices = this->lodBuffers[level];
+    indexCount = this->lod->levels[level].triangleCount * 3;
+  } else if (this->isCulled && this->bvh != null) {
+    const BvhRange* ranges;
+    rangeCount = __ModelRenderer_cull(this, this->model->faces->count, &ranges);
+    indexCount = 0;
+    for (int range = 0; range < rangeCount; range++) {
+      uint32_t first = ranges[range].first;
+      uint32_t start = __ModelRenderer_getIndexStart(this, first);
+      uint32_t end =
+          __ModelRenderer_getIndexStart(this, first + ranges[range].count);
+      this->counts[range] = end - start;
+      this->offsets[range] = (const void*)(sizeof(uint32_t) * start);
+      indexCount += end - start;
+    }
+  }
+  if (level == 0) FrameStats_countCulled((this->indexCount - indexCount) / 3);
+  if (indexCount == 0) return;
+
+  bool hasColors = this->model->colors != null && !isShadowPass;
+  FRAME_STATE(glBindBuffer(GL_ARRAY_BUFFER, this->buffers[POSITIONS]));
+  FRAME_STATE(glEnableClientState(GL_VERTEX_ARRAY));
+  FRAME_STATE(glVertexPointer(3, GL_FLOAT, 0, 0));
+  FRAME_STATE(glBindBuffer(GL_ARRAY_BUFFER, this->buffers[NORMALS]));
+  FRAME_STATE(glEnableClientState(GL_NORMAL_ARRAY));
+  FRAME_STATE(glNormalPointer(GL_FLOAT, 0, 0));
+  if (hasColors) {
+    FRAME_STATE(glBindBuffer(GL_ARRAY_BUFFER, this->buffers[COLORS]));
+    FRAME_STATE(glEnableClientState(GL_COLOR_ARRAY));
+    FRAME_STATE(glColorPointer(3, GL_FLOAT, 0, 0));
+  }
+  FRAME_STATE(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indices));
+  // The runs in the frustum go in one call.
+  if (rangeCount == 0)
+    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+  else
+    glMultiDrawElements(GL_TRIANGLES, this->counts, GL_UNSIGNED_INT,
+                        this->offsets, rangeCount);
+  FrameStats_countDraw(indexCount, indexCount / 3);
+
+  FRAME_STATE(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+  FRAME_STATE(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  FRAME_STATE(glDisableClientState(GL_VERTEX_ARRAY));
+  FRAME_STATE(glDisableClientState(GL_NORMAL_ARRAY));
+  if (hasColors) FRAME_STATE(glDisableClientState(GL_COLOR_ARRAY));
+}
+
+/**
+ * Draw a corner of a face.
+ * @param corner index into the face indices.
+ * @param isFaceLit if the normal of its face is already set.
+ */
+static inline void __ModelRenderer_drawCorner(Model* model, uint32_t corner,
+                                       bool hasColors, bool isFaceLit) {
+  uint32_t curPos = model->faces->indices[corner];
+  // Corner normals split the shading along creases.
+  if (isFaceLit) {
+    // Set once for the face.
+  } else if (model->cornerNormals != null) {
+    glNormal3fv(&model->cornerNormals[corner * 3]);
+  } else {
+    glNormal3fv(&model->normals[curPos * 3]);
+  }
+  if (hasColors) glColor3fv(&model->colors[curPos * 3]);
+  glVertex3fv(&model->renderVertices[curPos * 3]);
+}
+
+/**
+ * Draw the triangles of runs of faces in the order of the
+ * hierarchy. Always inlined with a constant isTriangleMesh,
+ * so the all-triangle path reads the corners of each face
+ * straight from the faces.
+ * @param faceNormals to light each face flat while the
+ * model loads, or null to use the normals of the model.
+ * @return the number of triangles drawn.
+ */
+static inline __attribute__((always_inline)) long __ModelRenderer_drawRuns(
+    Model* model, const BvhRange* ranges, int rangeCount,
+    const uint32_t* order, bool hasColors, const float* faceNormals,
+    bool isTriangleMesh) {
+  bool isFaceLit = faceNormals != null;
+  const MeshTriangles* triangles = model->triangles;
+  long triangleCount = 0;
+  for (int range = 0; range < rangeCount; range++) {
+    uint32_t first = ranges[range].first;
+    for (uint32_t at = first; at < first + ranges[range].count; at++) {
+      int face = order != null ? (int)order[at] : (int)at;
+      if (isFaceLit) glNormal3fv(&faceNormals[face * 3]);
+      if (isTriangleMesh) {
+        uint32_t start = (uint32_t)face * 3;
+        for (uint32_t corner = start; corner < start + 3; corner++)
+          __ModelRenderer_drawCorner(model, corner, hasColors, isFaceLit);
+        triangleCount++;
+        continue;
+      }
+      uint32_t start = MeshTriangles_getFaceStart(triangles, face) * 3;
+      uint32_t end = MeshTriangles_getFaceStart(triangles, face + 1) * 3;
+      for (uint32_t next = start; next < end; next++)
+        __ModelRenderer_drawCorner(model,
+                                   MeshTriangles_getCorner(triangles, next),
+                                   hasColors, isFaceLit);
+      triangleCount += (end - start) / 3;
+    }
+  }
+  return triangleCount;
+}
+
+/**
+ * Draw the triangles of a level of detail, whose corners
+ * are vertex indices.
+ */
+static void __ModelRenderer_drawLevel(ModelRenderer* this, int level,
+                                      bool hasColors) {
+  Model* model = this->model;
+  const LodLevel* detail = &this->lod->levels[level];
+  size_t length = (size_t)detail->triangleCount * 3;
+  glBegin(GL_TRIANGLES);
+  for (size_t corner = 0; corner < length; corner++) {
+    uint32_t vertex = detail->indices[corner];
+    glNormal3fv(&model->normals[vertex * 3]);
+    if (hasColors) glColor3fv(&model->colors[vertex * 3]);
+    glVertex3fv(&model->renderVertices[vertex * 3]);
+  }
+  glEnd();
+  FrameStats_countDraw(length, detail->triangleCount);
+}
+
+static void __ModelRenderer_drawImmediate(ModelRenderer* this, int faceCount,
+                                          int level, bool isShadowPass) {
+  Model* model = this->model;
+  FaceBuffer* faces = model->faces;
+  bool hasColors = model->colors != null && !isShadowPass;
+  // The normals of the vertices are still being generated while
+  // faces stream in without them.
+  const float* faceNormals =
+      faceCount < faces->count ? model->faceNormals : null;
+  if (level > 0) {
+    __ModelRenderer_drawLevel(this, level, hasColors);
+    return;
+  }
+
+  const BvhRange* ranges;
+  int rangeCount = __ModelRenderer_cull(this, faceCount, &ranges);
+  const uint32_t* order = this->bvh != null ? this->bvh->order : null;
+  int drawnCount = 0;
+  for (int range = 0; range < rangeCount; range++)
+    drawnCount += ranges[range].count;
+  FrameStats_countCulled(faceCount - drawnCount);
+
+  // Every face goes in a single batch of triangles.
+  if (drawnCount == 0) return;
+  glBegin(GL_TRIANGLES);
+  long triangleCount =
+      faces->arity == 3
+          ? __ModelRenderer_drawRuns(model, ranges, rangeCount, order,
+                                     hasColors, faceNormals, true)
+          : __ModelRenderer_drawRuns(model, ranges, rangeCount, order,
+                                     hasColors, faceNormals, false);
+  glEnd();
+  FrameStats_countDraw(triangleCount * 3, triangleCount);
+}
+
+void ModelRenderer_draw(ModelRenderer* this, bool isShadowPass) {
+  // Only the faces loaded so far while the model loads in the background.
+  int faceCount = Model_getLoadedFaceCount(this->model);
+  if (faceCount <= 0) return;
+  bool isLoaded = faceCount == this->model->faces->count;
+  if (isLoaded && this->isCulled && this->bvh == null)
+    __ModelRenderer_buildBvh(this);
+  if (isLoaded && !this->hasLodBuilder && this->lod == null)
+    __ModelRenderer_startLod(this);
+  int level = __ModelRenderer_selectLevel(this);
+  if (this->model->colors != null && !isShadowPass)
+    FRAME_STATE(glEnable(GL_COLOR_MATERIAL));
+  glColor3f(0.3, 0.3, 0.3);  // Shadow color
+
+  if (this->mode == RENDER_BUFFERED && isLoaded)
+    __ModelRenderer_drawBuffered(this, level, isShadowPass);
+  else
+    __ModelRenderer_drawImmediate(this, faceCount, level, isShadowPass);
+}
+
+bool ModelRenderer_isBuilding(ModelRenderer* this) {
+  return this != null && this->hasLodBuilder && !atomic_load(&this->isLodBuilt);
+}
+
+void ModelRenderer_free(ModelRenderer* this) {
+  if (this == null) return;
+  if (this->isUploaded) glDeleteBuffers(4, this->buffers);
+  if (this->hasLodBuilder) pthread_join(this->lodBuilder, null);
+  if (this->lodBuffers != null) {
+    glDeleteBuffers(this->lod->levelCount - 1, &this->lodBuffers[1]);
+    free(this->lodBuffers);
+  }
+  MeshLod_free(this->lod);
+  ModelBvh_free(this->bvh);
+  dispose(this->ranges, this->indexStarts, this->counts, this->offsets);
+  free(this);
+}
@@ -0,0 +1,420 @@
+#include "model_shadow.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include <OpenGL/gl.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#endif
+
+#include "frame_stats.h"
+#include "parallel.h"
+
+// Vertices or faces handled by one task.
+#define MODEL_SHADOW_CHUNK 32768
+
+// Edges of a loop fanned from one vertex.
+#define MODEL_SHADOW_RUN 16
+
+// Buckets up to this size are sorted by insertion.
+#define MODEL_SHADOW_SMALL_BUCKET 16
+
+typedef struct {
+  const float* matrix;
+  const float* plane;
+  const float* positions;  // Render positions of the model.
+  const FaceBuffer* faces;
+  int vertexCount;
+  int faceCount;
+  float* projected;  // Xyz of each vertex on the plane.
+  bool* isCasting;   // Whether each face casts the outline.
+} __ModelShadowJob;
+
+ModelShadow* new_ModelShadow(Model* model) {
+  ModelShadow* this = malloc(sizeof(ModelShadow));
+  this->model = model;
+  memset(this->matrix, 0, sizeof(this->matrix));
+  memset(this->plane, 0, sizeof(this->plane));
+  this->faceCount = 0;
+  this->triangles = null;
+  this->triangleCount = 0;
+  this->buffer = 0;
+  this->isUploaded = false;
+  this->isBuilt = false;
+  return this;
+}
+
+static int __ModelShadow_countTasks(int count) {
+  return (count + MODEL_SHADOW_CHUNK - 1) / MODEL_SHADOW_CHUNK;
+}
+
+static void __ModelShadow_projectTask(void* context, int index) {
+  __ModelShadowJob* job = context;
+  const float* matrix = job->matrix;
+  int first = index * MODEL_SHADOW_CHUNK;
+  int last = first + MODEL_SHADOW_CHUNK;
+  if (last > job->vertexCount) last = job->vertexCount;
+  for (int vertex = first; vertex < last; vertex++) {
+    const float* position = &job->positions[vertex * 3];
+    double point[4];
+    for (int row = 0; row < 4; row++)
+      point[row] = matrix[row] * position[0] + matrix[4 + row] * position[1] +
+                   matrix[8 + row] * position[2] + matrix[12 + row];
+    if (point[3] == 0) point[3] = 1;
+    float* projected = &job->projected[vertex * 3];
+    for (int axis = 0; axis < 3; axis++)
+      projected[axis] = point[axis] / point[3];
+  }
+}
+
+/**
+ * Find the faces turned to the side of the plane once
+ * projected, which are the ones a shadow pass would not
+ * cull, with Newell's method so polygons work too.
+ */
+static void __ModelShadow_faceTask(void* context, int index) {
+  __ModelShadowJob* job = context;
+  const FaceBuffer* faces = job->faces;
+  const float* plane = job->plane;
+  int first = index * MODEL_SHADOW_CHUNK;
+  int last = first + MODEL_SHADOW_CHUNK;
+  if (last > job->faceCount) last = job->faceCount;
+  for (int face = first; face < last; face++) {
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    double sum[3] = {0, 0, 0};
+    for (uint32_t next = 0; next < count; next++) {
+      const float* current = &job->projected[corners[next] * 3];
+      const float* following = &job->projected[corners[(next + 1) % count] * 3];
+      sum[0] += (current[1] - following[1]) * (current[2] + following[2]);
+      sum[1] += (current[2] - following[2]) * (current[0] + following[0]);
+      sum[2] += (current[0] - following[0]) * (current[1] + following[1]);
+    }
+    job->isCasting[face] =
+        sum[0] * plane[0] + sum[1] * plane[1] + sum[2] * plane[2] > 0;
+  }
+}
+
+static int __ModelShadow_compareEntries(const void* first, const void* second) {
+  uint32_t a = *(const uint32_t*)first, b = *(const uint32_t*)second;
+  return (a > b) - (a < b);
+}
+
+static void __ModelShadow_sortBucket(uint32_t* entries, uint32_t count) {
+  if (count > MODEL_SHADOW_SMALL_BUCKET) {
+    qsort(entries, count, sizeof(uint32_t), __ModelShadow_compareEntries);
+    return;
+  }
+  for (uint32_t next = 1; next < count; next++) {
+    uint32_t entry = entries[next], at = next;
+    for (; at > 0 && entries[at - 1] > entry; at--) entries[at] = entries[at - 1];
+    entries[at] = entry;
+  }
+}
+
+/**
+ * Find the outline as the edges of the casting faces that
+ * do not cancel out. Each edge is kept by its lower vertex
+ * with the other vertex and its direction, and the
+ * directions of an edge are summed, so an edge shared by
+ * two faces with the same winding is dropped.
+ * @param edgeCount to be set to the edges of the outline.
+ * @return the vertex pairs of the outline.
+ */
+static uint32_t* __ModelShadow_findOutline(__ModelShadowJob* job,
+                                           size_t* edgeCount) {
+  const FaceBuffer* faces = job->faces;
+  int vertexCount = job->vertexCount;
+  uint32_t* firstEntries = calloc(vertexCount + 1, sizeof(uint32_t));
+  size_t entryCount = 0;
+  for (int face = 0; face < job->faceCount; face++) {
+    if (!job->isCasting[face]) continue;
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    for (uint32_t next = 0; next < count; next++) {
+      uint32_t from = corners[next], to = corners[(next + 1) % count];
+      firstEntries[(from < to ? from : to) + 1]++;
+    }
+    entryCount += count;
+  }
+  for (int next = 0; next < vertexCount; next++)
+    firstEntries[next + 1] += firstEntries[next];
+
+  // Each entry is the other vertex, shifted, and 1 if the
+  // edge goes down to the lower vertex.
+  uint32_t* filled = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  memcpy(filled, firstEntries, sizeof(uint32_t) * (vertexCount + 1));
+  uint32_t* entries = malloc(sizeof(uint32_t) * (entryCount + 1));
+  for (int face = 0; face < job->faceCount; face++) {
+    if (!job->isCasting[face]) continue;
+    uint32_t count = FaceBuffer_getCornerCount(faces, face);
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    for (uint32_t next = 0; next < count; next++) {
+      uint32_t from = corners[next], to = corners[(next + 1) % count];
+      if (from < to)
+        entries[filled[from]++] = to << 1;
+      else
+        entries[filled[to]++] = from << 1 | 1;
+    }
+  }
+  free(filled);
+
+  uint32_t* edges = malloc(sizeof(uint32_t) * 2 * (entryCount + 1));
+  size_t at = 0;
+  for (int vertex = 0; vertex < vertexCount; vertex++) {
+    uint32_t first = firstEntries[vertex], last = firstEntries[vertex + 1];
+    __ModelShadow_sortBucket(&entries[first], last - first);
+    for (uint32_t next = first; next < last;) {
+      uint32_t other = entries[next] >> 1;
+      int winding = 0;
+      for (; next < last && entries[next] >> 1 == other; next++)
+        winding += entries[next] & 1 ? -1 : 1;
+      for (; winding > 0; winding--) {
+        edges[at++] = vertex;
+        edges[at++] = other;
+      }
+      for (; winding < 0; winding++) {
+        edges[at++] = other;
+        edges[at++] = vertex;
+      }
+    }
+  }
+  dispose(firstEntries, entries);
+  *edgeCount = at / 2;
+  return edges;
+}
+
+static void __ModelShadow_addTriangle(ModelShadow* this,
+                                      const float* projected, uint32_t first,
+                                      uint32_t second, uint32_t third) {
+  float* triangle = &this->triangles[this->triangleCount++ * 9];
+  memcpy(&triangle[0], &projected[first * 3], sizeof(float) * 3);
+  memcpy(&triangle[3], &projected[second * 3], sizeof(float) * 3);
+  memcpy(&triangle[6], &projected[third * 3], sizeof(float) * 3);
+}
+
+/**
+ * Fan a closed loop into triangles. A long loop is cut in
+ * runs of edges, each fanned from its start and closed back
+ * to it, then the loop through the run starts is fanned the
+ * same way. The triangles stay near the edges, rather than
+ * span the whole loop from one vertex, which keeps the
+ * stencil fill small on folded meshes.
+ * @param loop of vertices, the last joins the first. The
+ * run starts are written over it.
+ */
+static void __ModelShadow_fanLoop(ModelShadow* this, const float* projected,
+                                  uint32_t* loop, size_t count) {
+  while (count >= 3) {
+    if (count <= MODEL_SHADOW_RUN) {
+      for (size_t next = 1; next + 1 < count; next++)
+        __ModelShadow_addTriangle(this, projected, loop[0], loop[next],
+                                  loop[next + 1]);
+      return;
+    }
+    size_t startCount = 0;
+    for (size_t first = 0; first < count; first += MODEL_SHADOW_RUN) {
+      size_t last = first + MODEL_SHADOW_RUN;
+      if (last > count) last = count;
+      for (size_t next = first + 1; next < last; next++)
+        __ModelShadow_addTriangle(this, projected, loop[first], loop[next],
+                                  loop[next + 1 < count ? next + 1 : 0]);
+      loop[startCount++] = loop[first];
+    }
+    count = startCount;
+  }
+}
+
+/**
+ * Chain the outline edges into closed loops and fan them
+ * into triangles, whose windings add up to the shadow.
+ * Every vertex has as many outline edges in as out, so a
+ * walk always gets back to its start.
+ */
+static void __ModelShadow_buildFans(ModelShadow* this, const float* projected,
+                                    int vertexCount, const uint32_t* edges,
+                                    size_t edgeCount) {
+  uint32_t* firstEdges = calloc(vertexCount + 1, sizeof(uint32_t));
+  for (size_t edge = 0; edge < edgeCount; edge++)
+    firstEdges[edges[edge * 2] + 1]++;
+  for (int next = 0; next < vertexCount; next++)
+    firstEdges[next + 1] += firstEdges[next];
+  uint32_t* filled = malloc(sizeof(uint32_t) * (vertexCount + 1));
+  memcpy(filled, firstEdges, sizeof(uint32_t) * (vertexCount + 1));
+  uint32_t* targets = malloc(sizeof(uint32_t) * (edgeCount + 1));
+  for (size_t edge = 0; edge < edgeCount; edge++)
+    targets[filled[edges[edge * 2]]++] = edges[edge * 2 + 1];
+  // Filled now counts up to the first unused edge of each vertex.
+  memcpy(filled, firstEdges, sizeof(uint32_t) * (vertexCount + 1));
+
+  // Runs add at most one triangle per edge, and the loops of
+  // run starts at most half as many again, then the cover.
+  this->triangles = malloc(sizeof(float) * 9 * (edgeCount * 2 + 2));
+  this->triangleCount = 0;
+  uint32_t* loop = malloc(sizeof(uint32_t) * (edgeCount + 1));
+  for (int vertex = 0; vertex < vertexCount; vertex++) {
+    while (filled[vertex] < firstEdges[vertex + 1]) {
+      size_t count = 0;
+      uint32_t at = vertex;
+      do {
+        loop[count++] = at;
+        at = targets[filled[at]++];
+      } while (at != (uint32_t)vertex);
+      __ModelShadow_fanLoop(this, projected, loop, count);
+    }
+  }
+  dispose(firstEdges, filled, targets, loop);
+}
+
+/**
+ * Add the two triangles of a rectangle in the plane around
+ * the fans, after them. It covers every pixel the fans wind
+ * around with far less to draw than the fans.
+ */
+static void __ModelShadow_addCover(ModelShadow* this, const float plane[4]) {
+  double normal[3] = {plane[0], plane[1], plane[2]};
+  double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] +
+                       normal[2] * normal[2]);
+  if (length == 0) length = 1;
+  for (int axis = 0; axis < 3; axis++) normal[axis] /= length;
+  // Two directions along the plane, from the axis furthest
+  // from its normal.
+  int away = 0;
+  for (int axis = 1; axis < 3; axis++)
+    if (fabs(normal[axis]) < fabs(normal[away])) away = axis;
+  double other[3] = {0, 0, 0}, along[2][3];
+  other[away] = 1;
+  for (int axis = 0; axis < 3; axis++)
+    along[0][axis] = other[axis] - normal[axis] * normal[away];
+  length = sqrt(along[0][0] * along[0][0] + along[0][1] * along[0][1] +
+                along[0][2] * along[0][2]);
+  for (int axis = 0; axis < 3; axis++) along[0][axis] /= length;
+  along[1][0] = normal[1] * along[0][2] - normal[2] * along[0][1];
+  along[1][1] = normal[2] * along[0][0] - normal[0] * along[0][2];
+  along[1][2] = normal[0] * along[0][1] - normal[1] * along[0][0];
+
+  double min[2] = {INFINITY, INFINITY}, max[2] = {-INFINITY, -INFINITY};
+  for (int corner = 0; corner < this->triangleCount * 3; corner++) {
+    const float* point = &this->triangles[corner * 3];
+    for (int side = 0; side < 2; side++) {
+      double at = point[0] * along[side][0] + point[1] * along[side][1] +
+                  point[2] * along[side][2];
+      if (at < min[side]) min[side] = at;
+      if (at > max[side]) max[side] = at;
+    }
+  }
+  const float* first = this->triangles;
+  double height =
+      first[0] * normal[0] + first[1] * normal[1] + first[2] * normal[2];
+  double corners[4][2] = {
+      {min[0], min[1]}, {max[0], min[1]}, {max[0], max[1]}, {min[0], max[1]}};
+  int order[6] = {0, 1, 2, 0, 2, 3};
+  float* cover = &this->triangles[this->triangleCount * 9];
+  for (int next = 0; next < 6; next++)
+    for (int axis = 0; axis < 3; axis++)
+      cover[next * 3 + axis] = normal[axis] * height +
+                               along[0][axis] * corners[order[next]][0] +
+                               along[1][axis] * corners[order[next]][1];
+}
+
+void ModelShadow_getMatrix(float matrix[16], const float plane[4],
+                           const float light[4]) {
+  float dot = plane[0] * light[0] + plane[1] * light[1] +
+              plane[2] * light[2] + plane[3] * light[3];
+  for (int column = 0; column < 4; column++)
+    for (int row = 0; row < 4; row++)
+      matrix[column * 4 + row] =
+          (column == row ? dot : 0.f) - light[row] * plane[column];
+}
+
+bool ModelShadow_update(ModelShadow* this, const float matrix[16],
+                        const float plane[4]) {
+  int faceCount = Model_getLoadedFaceCount(this->model);
+  if (this->isBuilt && faceCount == this->faceCount &&
+      memcmp(matrix, this->matrix, sizeof(this->matrix)) == 0 &&
+      memcmp(plane, this->plane, sizeof(this->plane)) == 0)
+    return false;
+  memcpy(this->matrix, matrix, sizeof(this->matrix));
+  memcpy(this->plane, plane, sizeof(this->plane));
+  this->faceCount = faceCount;
+  this->isBuilt = true;
+  this->isUploaded = false;
+  free(this->triangles);
+  this->triangles = null;
+  this->triangleCount = 0;
+  if (faceCount <= 0) return true;
+
+  Model* model = this->model;
+  __ModelShadowJob job = {.matrix = matrix,
+                          .plane = plane,
+                          .positions = model->renderVertices,
+                          .faces = model->faces,
+                          .vertexCount = model->vertices->count,
+                          .faceCount = faceCount};
+  job.projected = malloc(sizeof(float) * 3 * (job.vertexCount + 1));
+  job.isCasting = malloc(sizeof(bool) * faceCount);
+  Parallel_for(__ModelShadow_countTasks(job.vertexCount),
+               __ModelShadow_projectTask, &job);
+  Parallel_for(__ModelShadow_countTasks(faceCount), __ModelShadow_faceTask,
+               &job);
+  size_t edgeCount;
+  uint32_t* edges = __ModelShadow_findOutline(&job, &edgeCount);
+  __ModelShadow_buildFans(this, job.projected, job.vertexCount, edges,
+                          edgeCount);
+  if (this->triangleCount > 0) __ModelShadow_addCover(this, plane);
+  dispose(edges, job.projected, job.isCasting);
+  return true;
+}
+
+void ModelShadow_draw(ModelShadow* this) {
+  if (this->triangleCount == 0) return;
+  FRAME_STATE(glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
+                           GL_ENABLE_BIT | GL_POLYGON_BIT |
+                           GL_STENCIL_BUFFER_BIT));
+  if (this->buffer == 0) glGenBuffers(1, &this->buffer);
+  FRAME_STATE(glBindBuffer(GL_ARRAY_BUFFER, this->buffer));
+  if (!this->isUploaded) {
+    glBufferData(GL_ARRAY_BUFFER,
+                 sizeof(float) * 9 * (this->triangleCount + 2),
+                 this->triangles, GL_STATIC_DRAW);
+    this->isUploaded = true;
+  }
+  FRAME_STATE(glEnableClientState(GL_VERTEX_ARRAY));
+  FRAME_STATE(glVertexPointer(3, GL_FLOAT, 0, 0));
+  int vertexCount = this->triangleCount * 3;
+
+  // Count how many times the outline winds around each
+  // visible pixel, up with the front and down with the back.
+  FRAME_STATE(glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE));
+  FRAME_STATE(glDepthMask(GL_FALSE));
+  FRAME_STATE(glDisable(GL_CULL_FACE));
+  FRAME_STATE(glEnable(GL_STENCIL_TEST));
+  FRAME_STATE(glStencilFunc(GL_ALWAYS, 0, ~0u));
+  FRAME_STATE(glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP));
+  FRAME_STATE(glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP));
+  glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+  FrameStats_countDraw(vertexCount, vertexCount / 3);
+
+  // Blend the pixels inside once under the cover, clearing
+  // the stencil.
+  FRAME_STATE(glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE));
+  FRAME_STATE(glDisable(GL_DEPTH_TEST));
+  FRAME_STATE(glStencilFunc(GL_NOTEQUAL, 0, ~0u));
+  FRAME_STATE(glStencilOp(GL_KEEP, GL_KEEP, GL_ZERO));
+  glDrawArrays(GL_TRIANGLES, vertexCount, 6);
+  FrameStats_countDraw(6, 2);
+
+  FRAME_STATE(glDisableClientState(GL_VERTEX_ARRAY));
+  FRAME_STATE(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  FRAME_STATE(glPopAttrib());
+}
+
+void ModelShadow_free(ModelShadow* this) {
+  if (this == null) return;
+  if (this->buffer != 0) glDeleteBuffers(1, &this->buffer);
+  free(this->triangles);
+  free(this);
+}
@@ -0,0 +1,53 @@
+#include "model_transform.h"
+
+#include <math.h>
+
+#include "parallel.h"
+
+// Vertices transformed by one task.
+#define MODEL_TRANSFORM_CHUNK 65536
+
+typedef struct {
+  const ModelTransform* transform;
+  const VertexBuffer* vertices;
+  float* positions;
+} __ModelTransformJob;
+
+ModelTransform ModelTransform_of(const MeshStats* stats) {
+  double sumOfBoundary = fabs(stats->max[0]) + fabs(stats->min[0]) +
+                         fabs(stats->max[1]) + fabs(stats->min[1]) +
+                         fabs(stats->max[2]) + fabs(stats->min[2]);
+  double avg = sumOfBoundary / 6.0;
+  ModelTransform this;
+  this.scale = avg > 0 ? 5.0 / avg : 1;
+  this.offset[0] = 0;
+  this.offset[1] = fabs(stats->min[1]) + fabs(stats->max[1]) +
+                   fabs(stats->min[1]) / 2.0;
+  this.offset[2] = 0;
+  return this;
+}
+
+static void __ModelTransform_task(void* context, int index) {
+  __ModelTransformJob* job = context;
+  const ModelTransform* transform = job->transform;
+  int first = index * MODEL_TRANSFORM_CHUNK;
+  int last = first + MODEL_TRANSFORM_CHUNK;
+  if (last > job->vertices->count) last = job->vertices->count;
+  double point[3];
+  for (int next = first; next < last; next++) {
+    VertexBuffer_getPoint(job->vertices, next, point);
+    for (int axis = 0; axis < 3; axis++)
+      point[axis] = (point[axis] + transform->offset[axis]) * transform->scale;
+    float* position = &job->positions[next * 3];
+    for (int axis = 0; axis < 3; axis++) position[axis] = point[axis];
+  }
+}
+
+void ModelTransform_bake(const ModelTransform* this,
+                         const VertexBuffer* vertices, float* positions) {
+  int count = vertices != null ? vertices->count : 0;
+  __ModelTransformJob job = {
+      .transform = this, .vertices = vertices, .positions = positions};
+  Parallel_for((count + MODEL_TRANSFORM_CHUNK - 1) / MODEL_TRANSFORM_CHUNK,
+               __ModelTransform_task, &job);
+}
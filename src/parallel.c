@@ -0,0 +1,127 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "dynamic_string.h"
+
+// Maximum of threads for one parallel for.
+#define PARALLEL_MAX_THREADS 64
+
+static int _threadCount = 0;
+
+typedef struct __ParallelJob {
+  void (*task)(void* context, int index);
+  void* context;
+  int taskCount;
+  atomic_int nextTask;
+  // Workers in the job and how many may join, under _poolLock.
+  int helpers;
+  int maxHelpers;
+  struct __ParallelJob* next;
+} __ParallelJob;
+
+// The workers are started once and wait for jobs, which may be
+// posted by several threads at once.
+static pthread_mutex_t _poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _poolPosted = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _poolLeft = PTHREAD_COND_INITIALIZER;
+static __ParallelJob* _poolJobs = null;
+static int _poolSize = 0;
+
+void Parallel_setThreadCount(int count) {
+  _threadCount = count < 0 ? 0 : count;
+}
+
+int Parallel_getThreadCount() {
+  int count = _threadCount;
+  if (count <= 0) {
+    String fromEnvironment = getenv("MODEL_THREADS");
+    if (fromEnvironment != null) count = atoi(fromEnvironment);
+  }
+  if (count <= 0) count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (count > PARALLEL_MAX_THREADS) count = PARALLEL_MAX_THREADS;
+  return count < 1 ? 1 : count;
+}
+
+static void __Parallel_run(__ParallelJob* job) {
+  int index;
+  while ((index = atomic_fetch_add(&job->nextTask, 1)) < job->taskCount)
+    job->task(job->context, index);
+}
+
+static __ParallelJob* __Parallel_findJob() {
+  for (__ParallelJob* job = _poolJobs; job != null; job = job->next)
+    if (job->helpers < job->maxHelpers &&
+        atomic_load(&job->nextTask) < job->taskCount)
+      return job;
+  return null;
+}
+
+static void* __Parallel_worker(void* argument) {
+  (void)argument;
+  pthread_mutex_lock(&_poolLock);
+  for (;;) {
+    __ParallelJob* job = __Parallel_findJob();
+    if (job == null) {
+      pthread_cond_wait(&_poolPosted, &_poolLock);
+      continue;
+    }
+    job->helpers++;
+    pthread_mutex_unlock(&_poolLock);
+    __Parallel_run(job);
+    pthread_mutex_lock(&_poolLock);
+    if (--job->helpers == 0) pthread_cond_broadcast(&_poolLeft);
+  }
+  return null;
+}
+
+/**
+ * Start workers until there are at least the given count.
+ * Called with _poolLock held.
+ */
+static void __Parallel_grow(int count) {
+  while (_poolSize < count) {
+    pthread_t thread;
+    if (pthread_create(&thread, null, __Parallel_worker, null) != 0) return;
+    pthread_detach(thread);
+    _poolSize++;
+  }
+}
+
+void Parallel_for(int taskCount, void (*task)(void* context, int index),
+                  void* context) {
+  if (taskCount <= 0) return;
+  __ParallelJob job = {.task = task, .context = context,
+                       .taskCount = taskCount};
+  atomic_init(&job.nextTask, 0);
+
+  int threadCount = Parallel_getThreadCount();
+  if (threadCount > taskCount) threadCount = taskCount;
+  if (threadCount <= 1) {
+    __Parallel_run(&job);
+    return;
+  }
+
+  // The calling thread is one of the workers.
+  job.maxHelpers = threadCount - 1;
+  pthread_mutex_lock(&_poolLock);
+  __Parallel_grow(job.maxHelpers);
+  __ParallelJob** last = &_poolJobs;
+  while (*last != null) last = &(*last)->next;
+  *last = &job;
+  pthread_cond_broadcast(&_poolPosted);
+  pthread_mutex_unlock(&_poolLock);
+
+  __Parallel_run(&job);
+
+  // No task is left to take, so wait for the workers still
+  // running one once no more of them can join.
+  pthread_mutex_lock(&_poolLock);
+  for (last = &_poolJobs; *last != &job; last = &(*last)->next) continue;
+  *last = job.next;
+  while (job.helpers > 0) pthread_cond_wait(&_poolLeft, &_poolLock);
+  pthread_mutex_unlock(&_poolLock);
+}
@@ -0,0 +1,797 @@
+#include "ply.h"
+
+#include <limits.h>
+#include <math.h>
+
+#include "model_arena.h"
+#include "parallel.h"
+#include "ply_number.h"
+
+static const struct {
+  const char* name;
+  PlyType type;
+} __PLY_TYPE_NAMES[] = {
+    {"char", PLY_INT8},       {"int8", PLY_INT8},      {"uchar", PLY_UINT8},
+    {"uint8", PLY_UINT8},     {"short", PLY_INT16},    {"int16", PLY_INT16},
+    {"ushort", PLY_UINT16},   {"uint16", PLY_UINT16},  {"int", PLY_INT32},
+    {"int32", PLY_INT32},     {"uint", PLY_UINT32},    {"uint32", PLY_UINT32},
+    {"float", PLY_FLOAT32},   {"float32", PLY_FLOAT32}, {"double", PLY_FLOAT64},
+    {"float64", PLY_FLOAT64},
+};
+
+static PlyType __PlyType_fromToken(PlyToken token) {
+  for (size_t i = 0; i < GET_ARRAY_SIZE(__PLY_TYPE_NAMES); i++)
+    if (PlyToken_isEqual(token, __PLY_TYPE_NAMES[i].name))
+      return __PLY_TYPE_NAMES[i].type;
+  return PLY_NONE;
+}
+
+static String __PlySchema_newString(PlySchema* this, PlyToken token) {
+  String string = ModelArena_alloc(this->arena, token.length + 1);
+  if (string == null) return null;
+  memcpy(string, token.start, token.length);
+  string[token.length] = '\0';
+  return string;
+}
+
+// The rest of an element lives in the arena of its schema.
+static void __PlyElement_free(PlyElement* this) {
+  if (this == null) return;
+  Array_free(this->properties);
+}
+
+static bool __PlySchema_addElement(PlySchema* this, PlyScanner* scanner) {
+  PlyToken name, count;
+  if (!PlyScanner_nextToken(scanner, &name) ||
+      !PlyScanner_nextToken(scanner, &count))
+    return false;
+  PlyElement* element = ModelArena_alloc(this->arena, sizeof(PlyElement));
+  if (element == null) return false;
+  element->name = __PlySchema_newString(this, name);
+  // Counts that are negative, fractional or too large are rejected.
+  double value = PlyToken_toDouble(count);
+  bool isCount = value >= 0 && value <= INT_MAX && floor(value) == value;
+  element->count = isCount ? (int)value : 0;
+  element->properties = new_Array(null);
+  element->stride = 0;
+  Array_add(this->elements, element);
+  return isCount && element->name != null;
+}
+
+static bool __PlySchema_addProperty(PlySchema* this, PlyScanner* scanner) {
+  if (this->elements->length == 0) return false;
+  PlyElement* element = this->elements->at[this->elements->length - 1];
+  PlyToken type, countType, itemType, name;
+  if (!PlyScanner_nextToken(scanner, &type)) return false;
+
+  PlyProperty* property = ModelArena_alloc(this->arena, sizeof(PlyProperty));
+  if (property == null) return false;
+  property->countType = PLY_NONE;
+  property->offset = 0;
+  property->values = null;
+  property->length = 0;
+  property->capacity = 0;
+  property->listOffsets = null;
+  if (PlyToken_isEqual(type, "list")) {
+    if (!PlyScanner_nextToken(scanner, &countType) ||
+        !PlyScanner_nextToken(scanner, &itemType) ||
+        !PlyScanner_nextToken(scanner, &name))
+      return false;
+    property->countType = __PlyType_fromToken(countType);
+    property->type = __PlyType_fromToken(itemType);
+    // A list length is a count, so it must be of an integer type.
+    if (!PlyType_isInteger(property->countType)) property->type = PLY_NONE;
+  } else {
+    if (!PlyScanner_nextToken(scanner, &name)) return false;
+    property->type = __PlyType_fromToken(type);
+  }
+  property->name = __PlySchema_newString(this, name);
+  if (property->name == null) return false;
+  Array_add(element->properties, property);
+  return property->type != PLY_NONE;
+}
+
+/**
+ * Work out the binary record layout of every element.
+ * Elements with a list property have no fixed stride.
+ */
+static void __PlySchema_computeLayout(PlySchema* this) {
+  for_in(next, this->elements) {
+    PlyElement* element = this->elements->at[next];
+    size_t offset = 0;
+    bool isFixed = true;
+    for_in(index, element->properties) {
+      PlyProperty* property = element->properties->at[index];
+      property->offset = offset;
+      if (property->countType != PLY_NONE) isFixed = false;
+      offset += PlyType_size(property->type);
+    }
+    element->stride = isFixed ? offset : 0;
+  }
+}
+
+PlySchema* new_PlySchema(PlyScanner* scanner) {
+  ModelArena* arena = new_ModelArena(MODEL_ARENA_BLOCK);
+  PlySchema* this = arena != null ? ModelArena_alloc(arena, sizeof(PlySchema))
+                                  : null;
+  if (this == null) {
+    ModelArena_free(arena);
+    return null;
+  }
+  this->arena = arena;
+  this->format = PLY_ASCII;
+  this->elements = new_Array(__PlyElement_free);
+  this->hasError = false;
+  this->bodyBytes = 0;
+  this->decodedBytes = null;
+
+  bool hasFormat = false;
+  PlyToken keyword, token;
+  while (!PlyScanner_isDone(scanner)) {
+    if (!PlyScanner_nextToken(scanner, &keyword)) {
+      PlyScanner_nextLine(scanner);
+      continue;
+    }
+
+    if (PlyToken_isEqual(keyword, "end_header")) {
+      PlyScanner_nextLine(scanner);
+      this->bodyBytes = (size_t)(scanner->end - scanner->at);
+      __PlySchema_computeLayout(this);
+      // Files without a format line are read as ascii.
+      if (!hasFormat) this->format = PLY_ASCII;
+      return this;
+    }
+
+    if (PlyToken_isEqual(keyword, "format")) {
+      if (!PlyScanner_nextToken(scanner, &token))
+        this->hasError = true;
+      else if (PlyToken_isEqual(token, "ascii"))
+        this->format = PLY_ASCII;
+      else if (PlyToken_isEqual(token, "binary_little_endian"))
+        this->format = PLY_BINARY_LITTLE_ENDIAN;
+      else if (PlyToken_isEqual(token, "binary_big_endian"))
+        this->format = PLY_BINARY_BIG_ENDIAN;
+      else
+        this->hasError = true;
+      hasFormat = true;
+    } else if (PlyToken_isEqual(keyword, "element")) {
+      if (!__PlySchema_addElement(this, scanner)) this->hasError = true;
+    } else if (PlyToken_isEqual(keyword, "property")) {
+      if (!__PlySchema_addProperty(this, scanner)) this->hasError = true;
+    }
+    // Anything else such as "ply", "comment" or "obj_info" is ignored.
+    PlyScanner_nextLine(scanner);
+  }
+
+  // The header never ended.
+  this->hasError = true;
+  return this;
+}
+
+void PlySchema_free(PlySchema* this) {
+  if (this == null) return;
+  Array_free(this->elements);
+  // The schema itself lives in the arena.
+  ModelArena_free(this->arena);
+}
+
+PlyElement* PlySchema_getElement(PlySchema* this, const char* name) {
+  for_in(next, this->elements) {
+    PlyElement* element = this->elements->at[next];
+    if (isStringEqual(element->name, name)) return element;
+  }
+  return null;
+}
+
+bool PlySchema_needsSwap(PlySchema* this) {
+  const uint16_t probe = 1;
+  bool isHostLittleEndian = *(const uint8_t*)&probe == 1;
+  if (this->format == PLY_BINARY_LITTLE_ENDIAN) return !isHostLittleEndian;
+  if (this->format == PLY_BINARY_BIG_ENDIAN) return isHostLittleEndian;
+  return false;
+}
+
+int PlyElement_getPropertyIndex(PlyElement* this, const char* name) {
+  for_in(next, this->properties) {
+    PlyProperty* property = this->properties->at[next];
+    if (isStringEqual(property->name, name)) return next;
+  }
+  return -1;
+}
+
+PlyProperty* PlyElement_getProperty(PlyElement* this, int index) {
+  if (index < 0 || index >= (int)this->properties->length) return null;
+  return this->properties->at[index];
+}
+
+static void __Ply_swapBytes(char* bytes, size_t size) {
+  for (size_t low = 0, high = size - 1; low < high; low++, high--) {
+    char temp = bytes[low];
+    bytes[low] = bytes[high];
+    bytes[high] = temp;
+  }
+}
+
+PlyProperty* PlyElement_findProperty(PlyElement* this, const char* name) {
+  if (this == null) return null;
+  return PlyElement_getProperty(this, PlyElement_getPropertyIndex(this, name));
+}
+
+double PlyProperty_getValue(PlyProperty* this, size_t index) {
+  size_t size = PlyType_size(this->type);
+  return PlyType_read((char*)this->values + index * size, this->type, false);
+}
+
+int PlyProperty_getListLength(PlyProperty* this, int record) {
+  return this->listOffsets[record + 1] - this->listOffsets[record];
+}
+
+bool PlyProperty_isScalar(PlyProperty* this) {
+  return this != null && this->countType == PLY_NONE;
+}
+
+size_t PlyType_size(PlyType type) {
+  switch (type) {
+    case PLY_INT8:
+    case PLY_UINT8:
+      return 1;
+    case PLY_INT16:
+    case PLY_UINT16:
+      return 2;
+    case PLY_INT32:
+    case PLY_UINT32:
+    case PLY_FLOAT32:
+      return 4;
+    case PLY_FLOAT64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+bool PlyType_isSigned(PlyType type) {
+  return type == PLY_INT8 || type == PLY_INT16 || type == PLY_INT32;
+}
+
+double PlyType_getMax(PlyType type) {
+  static const double maxima[] = {
+      [PLY_INT8] = INT8_MAX,   [PLY_UINT8] = UINT8_MAX,
+      [PLY_INT16] = INT16_MAX, [PLY_UINT16] = UINT16_MAX,
+      [PLY_INT32] = INT32_MAX, [PLY_UINT32] = UINT32_MAX};
+  return PlyType_isInteger(type) ? maxima[type] : 1;
+}
+
+bool PlyType_isInteger(PlyType type) {
+  return type != PLY_NONE && type != PLY_FLOAT32 && type != PLY_FLOAT64;
+}
+
+double PlyType_read(const char* bytes, PlyType type, bool swap) {
+  union {
+    char bytes[8];
+    int8_t int8;
+    uint8_t uint8;
+    int16_t int16;
+    uint16_t uint16;
+    int32_t int32;
+    uint32_t uint32;
+    float float32;
+    double float64;
+  } value;
+  size_t size = PlyType_size(type);
+  memcpy(value.bytes, bytes, size);
+  if (swap && size > 1) __Ply_swapBytes(value.bytes, size);
+  switch (type) {
+    case PLY_INT8:
+      return value.int8;
+    case PLY_UINT8:
+      return value.uint8;
+    case PLY_INT16:
+      return value.int16;
+    case PLY_UINT16:
+      return value.uint16;
+    case PLY_INT32:
+      return value.int32;
+    case PLY_UINT32:
+      return value.uint32;
+    case PLY_FLOAT32:
+      return value.float32;
+    case PLY_FLOAT64:
+      return value.float64;
+    default:
+      return 0;
+  }
+}
+
+void PlyType_write(char* bytes, PlyType type, double value) {
+  union {
+    char bytes[8];
+    int8_t int8;
+    uint8_t uint8;
+    int16_t int16;
+    uint16_t uint16;
+    int32_t int32;
+    uint32_t uint32;
+    float float32;
+    double float64;
+  } converted;
+  switch (type) {
+    case PLY_INT8:
+      converted.int8 = (int8_t)value;
+      break;
+    case PLY_UINT8:
+      converted.uint8 = (uint8_t)value;
+      break;
+    case PLY_INT16:
+      converted.int16 = (int16_t)value;
+      break;
+    case PLY_UINT16:
+      converted.uint16 = (uint16_t)value;
+      break;
+    case PLY_INT32:
+      converted.int32 = (int32_t)value;
+      break;
+    case PLY_UINT32:
+      converted.uint32 = (uint32_t)value;
+      break;
+    case PLY_FLOAT32:
+      converted.float32 = (float)value;
+      break;
+    case PLY_FLOAT64:
+      converted.float64 = value;
+      break;
+    default:
+      return;
+  }
+  memcpy(bytes, converted.bytes, PlyType_size(type));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Column decoding                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Make room for a number of values in the column. A column
+ * that grows moves to a new place in the arena, which
+ * keeps the old one until the schema is freed.
+ * @return false if the memory could not be allocated.
+ */
+static bool __PlyProperty_reserve(PlyProperty* this, ModelArena* arena,
+                                  size_t capacity) {
+  if (capacity <= this->capacity) return true;
+  if (this->capacity > 0 && capacity < this->capacity * 2)
+    capacity = this->capacity * 2;
+  size_t size = PlyType_size(this->type);
+  if (size == 0 || capacity > SIZE_MAX / size) return false;
+  void* values = ModelArena_alloc(arena, capacity * size);
+  if (values == null) return false;
+  if (this->length > 0) memcpy(values, this->values, this->length * size);
+  this->values = values;
+  this->capacity = capacity;
+  return true;
+}
+
+/**
+ * Allocate the columns of every property in the arena
+ * from the record count of the header. Lists start with
+ * room for three items per record and grow when needed.
+ * @return false if the memory could not be allocated.
+ */
+static bool __PlyElement_allocateColumns(PlyElement* this, ModelArena* arena) {
+  for_in(next, this->properties) {
+    PlyProperty* property = this->properties->at[next];
+    property->length = 0;
+    size_t count = this->count > 0 ? (size_t)this->count : 1;
+    if (property->countType == PLY_NONE) {
+      if (!__PlyProperty_reserve(property, arena, count)) return false;
+    } else {
+      property->listOffsets =
+          ModelArena_alloc(arena, sizeof(uint32_t) * (count + 1));
+      if (property->listOffsets == null) return false;
+      property->listOffsets[0] = 0;
+      if (!__PlyProperty_reserve(property, arena, count * 3)) return false;
+    }
+  }
+  return true;
+}
+
+static void __Ply_swapColumn(char* values, size_t size, size_t count) {
+  if (size <= 1) return;
+  for (size_t next = 0; next < count; next++)
+    __Ply_swapBytes(values + next * size, size);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                            Chunked ascii decoding                          */
+/* -------------------------------------------------------------------------- */
+
+// Smallest piece of an ascii body worth handing to another thread.
+#define PLY_MIN_CHUNK_BYTES (64 * 1024)
+// Largest piece of an ascii body, so the progress moves on big files.
+#define PLY_MAX_CHUNK_BYTES (4 * 1024 * 1024)
+
+typedef struct {
+  char* values;
+  size_t length;
+  size_t capacity;
+} __PlyListBuffer;
+
+/**
+ * A piece of the ascii body that starts and ends on a line
+ * boundary. Scalars are written straight into the shared
+ * columns at their record index. List items go to buffers
+ * of the chunk and are joined in chunk order afterwards.
+ */
+typedef struct {
+  const char* start;
+  const char* end;
+  size_t firstRecord;  // Index of the first record across all the elements.
+  size_t recordCount;
+  __PlyListBuffer* lists;  // One per property of the schema.
+  bool hasError;
+} __PlyChunk;
+
+typedef struct {
+  PlySchema* schema;
+  __PlyChunk* chunks;
+  size_t* elementStart;  // First record of each element, then the total.
+  int* propertyStart;    // First slot of each element in the chunk lists.
+  int propertyCount;
+} __PlyAsciiJob;
+
+/**
+ * Make room for more items at the end of a list buffer.
+ * @return where the next item goes, or null if the memory
+ * could not be allocated.
+ */
+static char* __PlyListBuffer_reserve(__PlyListBuffer* this, size_t size,
+                                     size_t count) {
+  if (this->length + count > this->capacity) {
+    size_t capacity = this->capacity == 0 ? 256 : this->capacity * 2;
+    if (capacity < this->length + count) capacity = this->length + count;
+    if (capacity > SIZE_MAX / size) return null;
+    char* values = realloc(this->values, capacity * size);
+    if (values == null) return null;
+    this->values = values;
+    this->capacity = capacity;
+  }
+  return this->values + this->length * size;
+}
+
+/**
+ * Parse the next value of the line straight into a
+ * column, with the parser that matches its type. If the
+ * line has no more value, 0 is written instead.
+ * @return false if the value does not fit its type, such
+ * as 256 for a uchar or "nan" for an int.
+ */
+static inline bool __Ply_parseValue(PlyScanner* scanner, PlyType type,
+                                    char* destination) {
+  if (!PlyScanner_skipSpaces(scanner)) {
+    PlyType_write(destination, type, 0);
+    return true;
+  }
+  if (type == PLY_FLOAT32) {
+    float value;
+    scanner->at = PlyNumber_parseFloat(scanner->at, scanner->end, &value);
+    memcpy(destination, &value, sizeof(value));
+  } else if (type == PLY_FLOAT64) {
+    double value;
+    scanner->at = PlyNumber_parseDouble(scanner->at, scanner->end, &value);
+    memcpy(destination, &value, sizeof(value));
+  } else {
+    int64_t value;
+    const char* end = PlyNumber_parseInt(scanner->at, scanner->end, &value);
+    double max = PlyType_getMax(type);
+    double min = PlyType_isSigned(type) ? -max - 1 : 0;
+    if (end == null || value < min || value > max) return false;
+    scanner->at = end;
+    PlyType_write(destination, type, (double)value);
+  }
+  return true;
+}
+
+static void __PlySchema_countChunk(void* context, int index) {
+  __PlyAsciiJob* job = context;
+  __PlyChunk* chunk = &job->chunks[index];
+  PlyScanner scanner =
+      PlyScanner_of(chunk->start, (size_t)(chunk->end - chunk->start));
+  size_t count = 0;
+  while (!PlyScanner_isDone(&scanner)) {
+    if (!PlyScanner_isBlankLine(&scanner)) count++;
+    PlyScanner_nextLine(&scanner);
+  }
+  chunk->recordCount = count;
+}
+
+/**
+ * Parse the records of a chunk. Each line is one record,
+ * and the element it belongs to comes from its index.
+ */
+static void __PlySchema_parseChunk(void* context, int index) {
+  __PlyAsciiJob* job = context;
+  __PlyChunk* chunk = &job->chunks[index];
+  Array* elements = job->schema->elements;
+  size_t total = job->elementStart[elements->length];
+  size_t record = chunk->firstRecord;
+  int elementIndex = 0;
+
+  PlyScanner scanner =
+      PlyScanner_of(chunk->start, (size_t)(chunk->end - chunk->start));
+  while (!PlyScanner_isDone(&scanner) && record < total) {
+    if (PlyScanner_isBlankLine(&scanner)) {
+      PlyScanner_nextLine(&scanner);
+      continue;
+    }
+    while (record >= job->elementStart[elementIndex + 1]) elementIndex++;
+    PlyElement* element = elements->at[elementIndex];
+    size_t local = record - job->elementStart[elementIndex];
+
+    for_in(next, element->properties) {
+      PlyProperty* property = element->properties->at[next];
+      size_t size = PlyType_size(property->type);
+      if (property->countType == PLY_NONE) {
+        if (!__Ply_parseValue(&scanner, property->type,
+                              (char*)property->values + local * size)) {
+          chunk->hasError = true;
+          break;
+        }
+        continue;
+      }
+
+      // Keep the list length for now, it becomes an offset once merged.
+      __PlyListBuffer* list =
+          &chunk->lists[job->propertyStart[elementIndex] + next];
+      int64_t count = 0;
+      if (PlyScanner_skipSpaces(&scanner)) {
+        const char* end = PlyNumber_parseInt(scanner.at, scanner.end, &count);
+        // A count that does not parse is rejected with the negative ones.
+        if (end == null) count = -1;
+        else scanner.at = end;
+      }
+      // Each item takes a digit and a space, so the rest of the
+      // chunk bounds how many there can be.
+      int64_t left = (scanner.end - scanner.at + 1) / 2;
+      char* items = count < 0 || count > left
+                        ? null
+                        : __PlyListBuffer_reserve(list, size, count);
+      if (items == null) {
+        chunk->hasError = true;
+        break;
+      }
+      int64_t parsed = 0;
+      while (parsed < count &&
+             __Ply_parseValue(&scanner, property->type, items + parsed * size))
+        parsed++;
+      if (parsed < count) {
+        chunk->hasError = true;
+        break;
+      }
+      list->length += count;
+      property->listOffsets[local + 1] = count;
+    }
+    if (chunk->hasError) break;
+    record++;
+    PlyScanner_nextLine(&scanner);
+  }
+  if (job->schema->decodedBytes != null)
+    atomic_fetch_add(job->schema->decodedBytes,
+                     (size_t)(chunk->end - chunk->start));
+}
+
+/**
+ * Turn the list lengths into offsets and join the list
+ * items of every chunk into the column, in chunk order.
+ * @return false if the memory could not be allocated, then
+ * the column keeps its old buffer.
+ */
+static bool __PlySchema_mergeLists(__PlyAsciiJob* job, int chunkCount) {
+  Array* elements = job->schema->elements;
+  for_in(elementIndex, elements) {
+    PlyElement* element = elements->at[elementIndex];
+    for_in(next, element->properties) {
+      PlyProperty* property = element->properties->at[next];
+      property->length = element->count;
+      if (property->countType == PLY_NONE) continue;
+
+      uint32_t* offsets = property->listOffsets;
+      offsets[0] = 0;
+      for (int record = 0; record < element->count; record++)
+        offsets[record + 1] += offsets[record];
+
+      int slot = job->propertyStart[elementIndex] + next;
+      size_t size = PlyType_size(property->type);
+      // The room for three items per record is kept when it is enough.
+      size_t capacity = offsets[element->count];
+      if (capacity > property->capacity) {
+        void* values = ModelArena_alloc(job->schema->arena, capacity * size);
+        if (values == null) return false;
+        property->values = values;
+        property->capacity = capacity;
+      }
+      property->length = 0;
+      for (int chunk = 0; chunk < chunkCount; chunk++) {
+        __PlyListBuffer* list = &job->chunks[chunk].lists[slot];
+        if (list->length == 0) continue;
+        memcpy((char*)property->values + property->length * size,
+               list->values, list->length * size);
+        property->length += list->length;
+      }
+    }
+  }
+  return true;
+}
+
+/**
+ * Decode an ascii body. The body is cut into chunks at line
+ * boundaries, the records of each chunk are counted in
+ * parallel to know where each chunk starts, then the
+ * chunks are parsed in parallel. The result does not
+ * depend on the number of threads.
+ */
+static bool __PlySchema_decodeAscii(PlySchema* this, PlyScanner* scanner) {
+  const char* body = scanner->at;
+  size_t bodySize = (size_t)(scanner->end - scanner->at);
+  size_t threadCount = Parallel_getThreadCount();
+  size_t threadChunks = threadCount > 1 ? threadCount * 4 : 1;
+  size_t progressChunks = bodySize / PLY_MAX_CHUNK_BYTES;
+  size_t chunkLimit =
+      threadChunks > progressChunks ? threadChunks : progressChunks;
+  size_t bySize = bodySize / PLY_MIN_CHUNK_BYTES;
+  int chunkCount = bySize < chunkLimit ? (int)bySize : (int)chunkLimit;
+  if (chunkCount < 1) chunkCount = 1;
+
+  // Each element owns a range of records and of list slots.
+  __PlyAsciiJob job = {.schema = this};
+  int elementCount = this->elements->length;
+  job.elementStart = malloc(sizeof(size_t) * (elementCount + 1));
+  job.propertyStart = malloc(sizeof(int) * (elementCount + 1));
+  if (job.elementStart == null || job.propertyStart == null) {
+    dispose(job.elementStart, job.propertyStart);
+    return false;
+  }
+  job.elementStart[0] = 0;
+  job.propertyStart[0] = 0;
+  for_in(next, this->elements) {
+    PlyElement* element = this->elements->at[next];
+    job.elementStart[next + 1] = job.elementStart[next] + element->count;
+    job.propertyStart[next + 1] =
+        job.propertyStart[next] + element->properties->length;
+  }
+  job.propertyCount = job.propertyStart[elementCount];
+
+  // Cut the body on line boundaries.
+  job.chunks = calloc(chunkCount, sizeof(__PlyChunk));
+  if (job.chunks == null) {
+    dispose(job.elementStart, job.propertyStart);
+    return false;
+  }
+  bool isDecoded = true;
+  const char* start = body;
+  for (int next = 0; next < chunkCount; next++) {
+    const char* end = body + bodySize * (next + 1) / chunkCount;
+    if (next < chunkCount - 1) {
+      const char* newLine = memchr(end, '\n', (size_t)(scanner->end - end));
+      end = newLine == null ? scanner->end : newLine + 1;
+    } else {
+      end = scanner->end;
+    }
+    if (end < start) end = start;
+    job.chunks[next].start = start;
+    job.chunks[next].end = end;
+    job.chunks[next].lists =
+        calloc(job.propertyCount + 1, sizeof(__PlyListBuffer));
+    if (job.chunks[next].lists == null) isDecoded = false;
+    start = end;
+  }
+
+  // Find the first record of each chunk.
+  if (isDecoded) Parallel_for(chunkCount, __PlySchema_countChunk, &job);
+  size_t available = 0;
+  for (int next = 0; next < chunkCount; next++) {
+    job.chunks[next].firstRecord = available;
+    available += job.chunks[next].recordCount;
+  }
+
+  isDecoded = isDecoded && available >= job.elementStart[elementCount];
+  if (isDecoded) {
+    Parallel_for(chunkCount, __PlySchema_parseChunk, &job);
+    for (int next = 0; next < chunkCount; next++)
+      if (job.chunks[next].hasError) isDecoded = false;
+  }
+  if (isDecoded) isDecoded = __PlySchema_mergeLists(&job, chunkCount);
+  if (isDecoded) scanner->at = scanner->end;
+
+  for (int next = 0; next < chunkCount; next++) {
+    if (job.chunks[next].lists == null) continue;
+    for (int slot = 0; slot < job.propertyCount; slot++) {
+      free(job.chunks[next].lists[slot].values);
+    }
+    free(job.chunks[next].lists);
+  }
+  dispose(job.chunks, job.elementStart, job.propertyStart);
+  return isDecoded;
+}
+
+/**
+ * Decode fixed size records by gathering each field into
+ * its column straight from the file bytes, then swapping
+ * each column in place if the endianness differs.
+ */
+static bool __PlySchema_decodeFixed(PlyElement* element, PlyScanner* scanner,
+                                    bool swap) {
+  size_t bytes = element->stride * (size_t)element->count;
+  if ((size_t)(scanner->end - scanner->at) < bytes) return false;
+  for_in(next, element->properties) {
+    PlyProperty* property = element->properties->at[next];
+    size_t size = PlyType_size(property->type);
+    char* column = property->values;
+    const char* field = scanner->at + property->offset;
+    for (int record = 0; record < element->count; record++) {
+      memcpy(column + record * size, field, size);
+      field += element->stride;
+    }
+    if (swap) __Ply_swapColumn(column, size, element->count);
+    property->length = element->count;
+  }
+  scanner->at += bytes;
+  return true;
+}
+
+static bool __PlySchema_decodeRecords(PlyElement* element, ModelArena* arena,
+                                      PlyScanner* scanner, bool swap) {
+  const char* at = scanner->at;
+  const char* end = scanner->end;
+  for (int record = 0; record < element->count; record++) {
+    for_in(next, element->properties) {
+      PlyProperty* property = element->properties->at[next];
+      size_t size = PlyType_size(property->type);
+      size_t count = 1;
+      if (property->countType != PLY_NONE) {
+        size_t countSize = PlyType_size(property->countType);
+        if (at + countSize > end) return false;
+        double length = PlyType_read(at, property->countType, swap);
+        at += countSize;
+        // The items must be in the body before room is made for them.
+        if (length < 0 || length > (double)(size_t)(end - at) / size)
+          return false;
+        count = (size_t)length;
+        if (!__PlyProperty_reserve(property, arena, property->length + count))
+          return false;
+      }
+      if ((size_t)(end - at) / size < count) return false;
+      char* column = (char*)property->values + property->length * size;
+      memcpy(column, at, size * count);
+      if (swap) __Ply_swapColumn(column, size, count);
+      property->length += count;
+      if (property->countType != PLY_NONE)
+        property->listOffsets[record + 1] = property->length;
+      at += size * count;
+    }
+  }
+  scanner->at = at;
+  return true;
+}
+
+bool PlySchema_decode(PlySchema* this, PlyScanner* scanner) {
+  if (this->hasError) return false;
+  bool swap = PlySchema_needsSwap(this);
+  for_in(next, this->elements)
+      if (!__PlyElement_allocateColumns(this->elements->at[next], this->arena))
+        return false;
+  if (this->format == PLY_ASCII) return __PlySchema_decodeAscii(this, scanner);
+
+  for_in(next, this->elements) {
+    PlyElement* element = this->elements->at[next];
+    const char* start = scanner->at;
+    bool isDecoded;
+    if (element->stride > 0)
+      isDecoded = __PlySchema_decodeFixed(element, scanner, swap);
+    else
+      isDecoded = __PlySchema_decodeRecords(element, this->arena, scanner,
+                                            swap);
+    if (!isDecoded) return false;
+    if (this->decodedBytes != null)
+      atomic_fetch_add(this->decodedBytes, (size_t)(scanner->at - start));
+  }
+  return true;
+}
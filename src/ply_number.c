@@ -0,0 +1,253 @@
+#include "ply_number.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Longest token the C library fallback copies on the stack.
+#define PLY_NUMBER_MAX_TOKEN 128
+
+// Powers of ten that are exact in a double, and in a float up to 1e10.
+static const double __POWERS_OF_TEN[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+static const float __FLOAT_POWERS_OF_TEN[] = {1e0f, 1e1f, 1e2f, 1e3f,
+                                              1e4f, 1e5f, 1e6f, 1e7f,
+                                              1e8f, 1e9f, 1e10f};
+
+static inline bool __PlyNumber_isSeparator(char byte) {
+  return byte == ' ' || byte == '\t' || byte == '\r' || byte == '\n';
+}
+
+static inline bool __PlyNumber_isDigit(char byte) {
+  return (unsigned char)(byte - '0') <= 9;
+}
+
+static const char* __PlyNumber_tokenEnd(const char* at, const char* end) {
+  while (at < end && !__PlyNumber_isSeparator(*at)) at++;
+  return at;
+}
+
+size_t PlyNumber_countDigits(const char* at, const char* end) {
+  size_t count = 0;
+#if defined(__SSE2__)
+  const __m128i below = _mm_set1_epi8('0' - 1);
+  const __m128i above = _mm_set1_epi8('9' + 1);
+  while (end - (at + count) >= 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(at + count));
+    __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(bytes, below),
+                                    _mm_cmplt_epi8(bytes, above));
+    unsigned int mask = ~(unsigned int)_mm_movemask_epi8(isDigit) & 0xffff;
+    if (mask != 0) return count + __builtin_ctz(mask);
+    count += 16;
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t zero = vdupq_n_u8('0');
+  const uint8x16_t nine = vdupq_n_u8(9);
+  while (end - (at + count) >= 16) {
+    uint8x16_t bytes = vld1q_u8((const uint8_t*)(at + count));
+    uint8x16_t isDigit = vcleq_u8(vsubq_u8(bytes, zero), nine);
+    // Narrow to 4 bits per byte to get a 64 bit mask.
+    uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(isDigit), 4);
+    uint64_t mask = ~vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+    if (mask != 0) return count + (__builtin_ctzll(mask) >> 2);
+    count += 16;
+  }
+#endif
+  while (at + count < end && __PlyNumber_isDigit(at[count])) count++;
+  return count;
+}
+
+/**
+ * Convert 8 ascii digits to their value with a few
+ * multiplies on one 64 bit word (little endian hosts).
+ */
+static inline uint64_t __PlyNumber_eightDigits(const char* at) {
+  uint64_t value;
+  memcpy(&value, at, 8);
+  value -= 0x3030303030303030ull;
+  value = (value * 10) + (value >> 8);
+  value = (((value & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+           (((value >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >>
+          32;
+  return value;
+}
+
+static inline bool __PlyNumber_isLittleEndian() {
+  const uint16_t probe = 1;
+  return *(const uint8_t*)&probe == 1;
+}
+
+/**
+ * Add a run of digits to the mantissa.
+ * @return false if the mantissa would not fit in 19 digits.
+ */
+static inline bool __PlyNumber_addDigits(const char* at, size_t count,
+                                         uint64_t* mantissa, int* digits) {
+  // Leading zeros do not count as significant digits.
+  if (*digits == 0)
+    while (count > 0 && *at == '0') {
+      at++;
+      count--;
+    }
+  if (*digits + count > 19) return false;
+  *digits += (int)count;
+  uint64_t value = *mantissa;
+  if (__PlyNumber_isLittleEndian())
+    while (count >= 8) {
+      value = value * 100000000ull + __PlyNumber_eightDigits(at);
+      at += 8;
+      count -= 8;
+    }
+  while (count-- > 0) value = value * 10 + (uint64_t)(*at++ - '0');
+  *mantissa = value;
+  return true;
+}
+
+/**
+ * Split a decimal token into sign, mantissa and power of ten.
+ * @return false if the token needs the C library to round it.
+ */
+static bool __PlyNumber_decompose(const char* at, const char* end,
+                                  bool* isNegative, uint64_t* mantissa,
+                                  int* exponent) {
+  *isNegative = false;
+  *mantissa = 0;
+  *exponent = 0;
+  if (at < end && (*at == '-' || *at == '+')) *isNegative = *at++ == '-';
+
+  int digits = 0;
+  size_t integer = PlyNumber_countDigits(at, end);
+  if (!__PlyNumber_addDigits(at, integer, mantissa, &digits)) return false;
+  at += integer;
+
+  size_t fraction = 0;
+  if (at < end && *at == '.') {
+    at++;
+    fraction = PlyNumber_countDigits(at, end);
+    if (!__PlyNumber_addDigits(at, fraction, mantissa, &digits)) return false;
+    at += fraction;
+    *exponent -= (int)fraction;
+  }
+  if (integer + fraction == 0) return false;
+
+  if (at < end && (*at == 'e' || *at == 'E')) {
+    at++;
+    bool isNegativeExponent = false;
+    if (at < end && (*at == '-' || *at == '+'))
+      isNegativeExponent = *at++ == '-';
+    size_t count = PlyNumber_countDigits(at, end);
+    if (count == 0 || count > 4) return false;
+    int value = 0;
+    for (size_t next = 0; next < count; next++) value = value * 10 + at[next] - '0';
+    at += count;
+    *exponent += isNegativeExponent ? -value : value;
+  }
+  // Anything else in the token, such as "inf", goes to the C library.
+  return at == end;
+}
+
+/**
+ * Copy the whole token to a null terminated string for the
+ * C library, in the buffer when it fits or else on the heap.
+ * @return the string, to be freed if it is not the buffer,
+ * or null if it could not be allocated.
+ */
+static char* __PlyNumber_copyToken(const char* at, const char* end,
+                                   char buffer[PLY_NUMBER_MAX_TOKEN]) {
+  size_t length = (size_t)(end - at);
+  char* copy = length < PLY_NUMBER_MAX_TOKEN ? buffer : malloc(length + 1);
+  if (copy == NULL) return NULL;
+  memcpy(copy, at, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+const char* PlyNumber_parseDouble(const char* at, const char* end,
+                                  double* value) {
+  const char* tokenEnd = __PlyNumber_tokenEnd(at, end);
+  bool isNegative;
+  uint64_t mantissa;
+  int exponent;
+
+  // Clinger's fast path, one correctly rounded operation on exact operands.
+  if (__PlyNumber_decompose(at, tokenEnd, &isNegative, &mantissa, &exponent) &&
+      mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+    double result = (double)mantissa;
+    if (exponent < 0)
+      result /= __POWERS_OF_TEN[-exponent];
+    else
+      result *= __POWERS_OF_TEN[exponent];
+    *value = isNegative ? -result : result;
+    return tokenEnd;
+  }
+
+  char buffer[PLY_NUMBER_MAX_TOKEN];
+  char* token = __PlyNumber_copyToken(at, tokenEnd, buffer);
+  *value = token != NULL ? strtod(token, NULL) : 0;
+  if (token != buffer) {
+    free(token);
+  }
+  return tokenEnd;
+}
+
+const char* PlyNumber_parseFloat(const char* at, const char* end,
+                                 float* value) {
+  const char* tokenEnd = __PlyNumber_tokenEnd(at, end);
+  bool isNegative;
+  uint64_t mantissa;
+  int exponent;
+
+  // The same fast path in single precision, so it is rounded only once.
+  if (__PlyNumber_decompose(at, tokenEnd, &isNegative, &mantissa, &exponent) &&
+      mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+    float result = (float)mantissa;
+    if (exponent < 0)
+      result /= __FLOAT_POWERS_OF_TEN[-exponent];
+    else
+      result *= __FLOAT_POWERS_OF_TEN[exponent];
+    *value = isNegative ? -result : result;
+    return tokenEnd;
+  }
+
+  char buffer[PLY_NUMBER_MAX_TOKEN];
+  char* token = __PlyNumber_copyToken(at, tokenEnd, buffer);
+  *value = token != NULL ? strtof(token, NULL) : 0;
+  if (token != buffer) {
+    free(token);
+  }
+  return tokenEnd;
+}
+
+const char* PlyNumber_parseInt(const char* at, const char* end,
+                               int64_t* value) {
+  const char* start = at;
+  bool isNegative = false;
+  if (at < end && (*at == '-' || *at == '+')) isNegative = *at++ == '-';
+
+  size_t count = PlyNumber_countDigits(at, end);
+  if (count > 0 && count <= 18 &&
+      (at + count == end || __PlyNumber_isSeparator(at[count]))) {
+    uint64_t mantissa = 0;
+    int digits = 0;
+    __PlyNumber_addDigits(at, count, &mantissa, &digits);
+    *value = isNegative ? -(int64_t)mantissa : (int64_t)mantissa;
+    return at + count;
+  }
+
+  // The cast is only defined in range, which NaN is never in.
+  double real;
+  const char* tokenEnd = PlyNumber_parseDouble(start, end, &real);
+  if (!(real >= -0x1p63 && real < 0x1p63)) {
+    *value = 0;
+    return NULL;
+  }
+  *value = (int64_t)real;
+  return tokenEnd;
+}
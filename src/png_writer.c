@@ -0,0 +1,361 @@
+#include "png_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bytes per pixel of the RGB rows.
+#define PNG_PIXEL_BYTES 3
+
+// LZ77 window of deflate, and the match lengths it allows.
+#define PNG_WINDOW (1 << 15)
+#define PNG_MIN_MATCH 3
+#define PNG_MAX_MATCH 258
+
+// Buckets of the 3 byte hash, and how many earlier
+// positions of a bucket are tried for a match.
+#define PNG_HASH_BITS 15
+#define PNG_CHAIN 16
+
+// Longest match whose every position is hashed, as the
+// fast levels of zlib. Longer ones are mostly background.
+#define PNG_INSERT 16
+
+static const uint16_t PNG_LENGTH_BASE[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t PNG_LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                             1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                             4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t PNG_DISTANCE_BASE[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t PNG_DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/**
+ * Growing byte buffer, with the pending bits of deflate
+ * packed from the lowest bit.
+ */
+typedef struct {
+  uint8_t* bytes;
+  size_t length, capacity;
+  uint32_t bits;
+  int bitCount;
+} __PngStream;
+
+static void __PngStream_reserve(__PngStream* this, size_t more) {
+  if (this->length + more <= this->capacity) return;
+  while (this->length + more > this->capacity)
+    this->capacity = this->capacity < 4096 ? 4096 : this->capacity * 2;
+  this->bytes = realloc(this->bytes, this->capacity);
+}
+
+static void __PngStream_putByte(__PngStream* this, uint8_t byte) {
+  __PngStream_reserve(this, 1);
+  this->bytes[this->length++] = byte;
+}
+
+static void __PngStream_putBigEndian(__PngStream* this, uint32_t value) {
+  for (int shift = 24; shift >= 0; shift -= 8)
+    __PngStream_putByte(this, value >> shift & 0xff);
+}
+
+static void __PngStream_putBits(__PngStream* this, uint32_t value, int count) {
+  this->bits |= value << this->bitCount;
+  this->bitCount += count;
+  while (this->bitCount >= 8) {
+    __PngStream_putByte(this, this->bits & 0xff);
+    this->bits >>= 8;
+    this->bitCount -= 8;
+  }
+}
+
+/**
+ * Put a Huffman code, which deflate packs from its
+ * highest bit unlike every other field.
+ */
+static void __PngStream_putCode(__PngStream* this, uint32_t code, int count) {
+  uint32_t reversed = 0;
+  for (int bit = 0; bit < count; bit++)
+    reversed |= (code >> bit & 1) << (count - 1 - bit);
+  __PngStream_putBits(this, reversed, count);
+}
+
+static void __PngStream_flushBits(__PngStream* this) {
+  if (this->bitCount > 0) __PngStream_putByte(this, this->bits & 0xff);
+  this->bits = 0;
+  this->bitCount = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Deflate                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Put a literal byte, or the end of block with 256, or a
+ * length code from 257, in the fixed Huffman code.
+ */
+static void __Png_putSymbol(__PngStream* stream, int symbol) {
+  if (symbol < 144)
+    __PngStream_putCode(stream, 0x30 + symbol, 8);
+  else if (symbol < 256)
+    __PngStream_putCode(stream, 0x190 + symbol - 144, 9);
+  else if (symbol < 280)
+    __PngStream_putCode(stream, symbol - 256, 7);
+  else
+    __PngStream_putCode(stream, 0xc0 + symbol - 280, 8);
+}
+
+static void __Png_putMatch(__PngStream* stream, int length, int distance) {
+  int code = 28;
+  while (PNG_LENGTH_BASE[code] > length) code--;
+  __Png_putSymbol(stream, 257 + code);
+  __PngStream_putBits(stream, length - PNG_LENGTH_BASE[code],
+                      PNG_LENGTH_EXTRA[code]);
+  code = 29;
+  while (PNG_DISTANCE_BASE[code] > distance) code--;
+  __PngStream_putCode(stream, code, 5);
+  __PngStream_putBits(stream, distance - PNG_DISTANCE_BASE[code],
+                      PNG_DISTANCE_EXTRA[code]);
+}
+
+static inline uint32_t __Png_hash(const uint8_t* data) {
+  uint32_t key = data[0] | data[1] << 8 | data[2] << 16;
+  return key * 2654435761u >> (32 - PNG_HASH_BITS);
+}
+
+/**
+ * Deflate data as one fixed Huffman block, taking the
+ * longest match of a few earlier positions with the same
+ * 3 byte hash, else the literal.
+ */
+static void __Png_deflate(__PngStream* stream, const uint8_t* data,
+                          size_t length) {
+  int32_t* heads = malloc(sizeof(int32_t) << PNG_HASH_BITS);
+  int32_t* previous = malloc(sizeof(int32_t) * PNG_WINDOW);
+  memset(heads, 0xff, sizeof(int32_t) << PNG_HASH_BITS);
+
+  __PngStream_putBits(stream, 1, 1);  // Last block.
+  __PngStream_putBits(stream, 1, 2);  // Fixed codes.
+  size_t position = 0;
+  while (position < length) {
+    int bestLength = 0, bestDistance = 0;
+    size_t left = length - position;
+    if (left >= PNG_MIN_MATCH) {
+      int most = left < PNG_MAX_MATCH ? (int)left : PNG_MAX_MATCH;
+      int32_t candidate = heads[__Png_hash(data + position)];
+      for (int tries = 0; candidate >= 0 && tries < PNG_CHAIN; tries++) {
+        size_t distance = position - candidate;
+        if (distance > PNG_WINDOW) break;
+        int matched = 0;
+        while (matched < most &&
+               data[candidate + matched] == data[position + matched])
+          matched++;
+        if (matched > bestLength) {
+          bestLength = matched;
+          bestDistance = (int)distance;
+          if (matched == most) break;
+        }
+        candidate = previous[candidate & (PNG_WINDOW - 1)];
+      }
+    }
+
+    int step = bestLength >= PNG_MIN_MATCH ? bestLength : 1;
+    if (step > 1)
+      __Png_putMatch(stream, bestLength, bestDistance);
+    else
+      __Png_putSymbol(stream, data[position]);
+    int inserted = step <= PNG_INSERT ? step : 1;
+    for (int next = 0; next < inserted; next++) {
+      if (length - position - next < PNG_MIN_MATCH) break;
+      uint32_t hash = __Png_hash(data + position + next);
+      previous[(position + next) & (PNG_WINDOW - 1)] = heads[hash];
+      heads[hash] = (int32_t)(position + next);
+    }
+    position += step;
+  }
+  __Png_putSymbol(stream, 256);
+  __PngStream_flushBits(stream);
+  dispose(heads, previous);
+}
+
+static uint32_t __Png_adler32(const uint8_t* data, size_t length) {
+  uint32_t low = 1, high = 0;
+  while (length > 0) {
+    // The largest run before the sums must be reduced.
+    size_t run = length < 5552 ? length : 5552;
+    length -= run;
+    while (run-- > 0) {
+      low += *data++;
+      high += low;
+    }
+    low %= 65521;
+    high %= 65521;
+  }
+  return high << 16 | low;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Filters                                  */
+/* -------------------------------------------------------------------------- */
+
+static inline uint8_t __Png_paeth(int left, int up, int upLeft) {
+  int estimate = left + up - upLeft;
+  int toLeft = abs(estimate - left), toUp = abs(estimate - up);
+  int toUpLeft = abs(estimate - upLeft);
+  if (toLeft <= toUp && toLeft <= toUpLeft) return left;
+  return toUp <= toUpLeft ? up : upLeft;
+}
+
+/**
+ * Filter a row with one of the PNG filters.
+ * @return the sum of the filtered bytes taken as signed.
+ */
+static long __Png_filterWith(int filter, const uint8_t* row,
+                             const uint8_t* above, size_t rowLength,
+                             uint8_t* out) {
+  const size_t step = PNG_PIXEL_BYTES;
+  out[0] = filter;
+  uint8_t* to = out + 1;
+  switch (filter) {
+    case 0:
+      memcpy(to, row, rowLength);
+      break;
+    case 1:
+      memcpy(to, row, step);
+      for (size_t next = step; next < rowLength; next++)
+        to[next] = row[next] - row[next - step];
+      break;
+    case 2:
+      for (size_t next = 0; next < rowLength; next++)
+        to[next] = row[next] - above[next];
+      break;
+    case 3:
+      for (size_t next = 0; next < step; next++)
+        to[next] = row[next] - above[next] / 2;
+      for (size_t next = step; next < rowLength; next++)
+        to[next] = row[next] - (row[next - step] + above[next]) / 2;
+      break;
+    default:
+      for (size_t next = 0; next < step; next++)
+        to[next] = row[next] - above[next];
+      for (size_t next = step; next < rowLength; next++)
+        to[next] = row[next] - __Png_paeth(row[next - step], above[next],
+                                           above[next - step]);
+  }
+  long cost = 0;
+  for (size_t next = 0; next < rowLength; next++)
+    cost += (int8_t)to[next] < 0 ? -(int8_t)to[next] : to[next];
+  return cost;
+}
+
+/**
+ * Filter a row with each PNG filter and keep the one with
+ * the least sum of bytes taken as signed, the usual guess
+ * of what deflates best. A row the same as the one above
+ * takes Up, which leaves only zeros.
+ * @param above row, null for the first, which only tries
+ * the filters that do not look up.
+ * @param out of 1 + the row length, the filter type first.
+ * @param trial of 1 + the row length, for the other filters.
+ */
+static void __Png_filterRow(const uint8_t* row, const uint8_t* above,
+                            size_t rowLength, uint8_t* out, uint8_t* trial) {
+  if (above != null && memcmp(row, above, rowLength) == 0) {
+    out[0] = 2;
+    memset(out + 1, 0, rowLength);
+    return;
+  }
+  long bestCost = __Png_filterWith(0, row, above, rowLength, out);
+  for (int filter = 1; filter < (above != null ? 5 : 2); filter++) {
+    long cost = __Png_filterWith(filter, row, above, rowLength, trial);
+    if (cost < bestCost) {
+      bestCost = cost;
+      memcpy(out, trial, rowLength + 1);
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    File                                    */
+/* -------------------------------------------------------------------------- */
+
+static void __Png_putChunk(__PngStream* file, const char* type,
+                           const uint8_t* data, size_t length,
+                           const uint32_t crcTable[256]) {
+  __PngStream_putBigEndian(file, (uint32_t)length);
+  __PngStream_reserve(file, 4 + length);
+  memcpy(file->bytes + file->length, type, 4);
+  if (length > 0) memcpy(file->bytes + file->length + 4, data, length);
+  uint32_t crc = 0xffffffff;
+  for (size_t next = 0; next < 4 + length; next++)
+    crc = crcTable[(crc ^ file->bytes[file->length + next]) & 0xff] ^ crc >> 8;
+  file->length += 4 + length;
+  __PngStream_putBigEndian(file, crc ^ 0xffffffff);
+}
+
+bool PngWriter_write(String filePath, const uint8_t* pixels, int width,
+                     int height, bool isBottomUp) {
+  if (width <= 0 || height <= 0) return false;
+  uint32_t crcTable[256];
+  for (uint32_t next = 0; next < 256; next++) {
+    uint32_t value = next;
+    for (int bit = 0; bit < 8; bit++)
+      value = value & 1 ? 0xedb88320 ^ value >> 1 : value >> 1;
+    crcTable[next] = value;
+  }
+
+  // Filter the rows from the top, dropping the alpha.
+  size_t rowLength = (size_t)width * PNG_PIXEL_BYTES;
+  uint8_t* rows = malloc(rowLength * 2);
+  uint8_t* filtered = malloc((rowLength + 1) * height);
+  uint8_t* trial = malloc(rowLength + 1);
+  for (int y = 0; y < height; y++) {
+    const uint8_t* source =
+        pixels + (size_t)(isBottomUp ? height - 1 - y : y) * width * 4;
+    uint8_t* row = rows + (y & 1) * rowLength;
+    for (int x = 0; x < width; x++)
+      memcpy(row + x * PNG_PIXEL_BYTES, source + x * 4, PNG_PIXEL_BYTES);
+    __Png_filterRow(row, y > 0 ? rows + (~y & 1) * rowLength : null, rowLength,
+                    filtered + (rowLength + 1) * y, trial);
+  }
+  size_t filteredLength = (rowLength + 1) * height;
+
+  __PngStream data = {0};
+  __PngStream_putByte(&data, 0x78);  // Deflate with a 32K window.
+  __PngStream_putByte(&data, 0x01);
+  __Png_deflate(&data, filtered, filteredLength);
+  __PngStream_putBigEndian(&data, __Png_adler32(filtered, filteredLength));
+
+  uint8_t header[13];
+  for (int shift = 0; shift < 4; shift++) {
+    header[shift] = (uint32_t)width >> (24 - shift * 8) & 0xff;
+    header[4 + shift] = (uint32_t)height >> (24 - shift * 8) & 0xff;
+  }
+  header[8] = 8;   // Bits per channel.
+  header[9] = 2;   // RGB.
+  header[10] = 0;  // Deflate.
+  header[11] = 0;  // Filtered per row.
+  header[12] = 0;  // Not interlaced.
+
+  static const uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+                                       '\n'};
+  __PngStream file = {0};
+  for (int next = 0; next < 8; next++)
+    __PngStream_putByte(&file, SIGNATURE[next]);
+  __Png_putChunk(&file, "IHDR", header, sizeof(header), crcTable);
+  __Png_putChunk(&file, "IDAT", data.bytes, data.length, crcTable);
+  __Png_putChunk(&file, "IEND", null, 0, crcTable);
+
+  FILE* out = fopen(filePath, "wb");
+  bool isWritten = out != null;
+  if (isWritten) {
+    isWritten = fwrite(file.bytes, 1, file.length, out) == file.length;
+    isWritten = fclose(out) == 0 && isWritten;
+  }
+  dispose(rows, filtered, trial, data.bytes, file.bytes);
+  return isWritten;
+}
@@ -0,0 +1,917 @@
+#include "software_renderer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "parallel.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Side of a square tile in pixels.
+#define SOFTWARE_TILE 64
+
+// Vertices shaded, or faces set up, by one task.
+#define SOFTWARE_CHUNK 16384
+
+// Subpixel bits of the snapped window positions, as Mesa
+// uses. The edge values then need 64 bits.
+#define SOFTWARE_SUBPIXEL_BITS 8
+#define SOFTWARE_SUBPIXELS (1 << SOFTWARE_SUBPIXEL_BITS)
+
+// Triangles are clipped to this many times the viewport in
+// x and y, and to the near plane.
+#define SOFTWARE_GUARD_BAND 2.0f
+
+// Resolvable depth difference of a 24 bit depth buffer,
+// the unit of glPolygonOffset().
+#define SOFTWARE_DEPTH_UNIT (1.0f / 16777216.0f)
+
+// Offset of the shadow, as glPolygonOffset(-2, -1) in main.c.
+#define SOFTWARE_OFFSET_FACTOR -2.0f
+#define SOFTWARE_OFFSET_UNITS -1.0f
+
+// Light the program leaves to GL defaults.
+#define SOFTWARE_SCENE_AMBIENT 0.2f
+#define SOFTWARE_MATERIAL_AMBIENT 0.2f
+#define SOFTWARE_MATERIAL_DIFFUSE 0.8f
+
+// Planes a triangle interpolates: depth, 1 / w, and red,
+// green and blue over w.
+enum { PLANE_DEPTH, PLANE_INVERSE_W, PLANE_RED, PLANE_COUNT = PLANE_RED + 3 };
+
+typedef enum {
+  SOFTWARE_LIT,    // Depth tested, writes depth and color.
+  SOFTWARE_COUNT,  // Depth tested, adds its winding to the stencil.
+  SOFTWARE_COVER,  // Blends where the stencil is set and clears it.
+} SoftwarePass;
+
+typedef struct {
+  float position[4];  // Clip space.
+  float color[4];
+} __SoftwareVertex;
+
+typedef struct {
+  int32_t x[3], y[3];             // Snapped window position, counter clockwise.
+  float planes[PLANE_COUNT][3];   // Value at pixel 0, then per pixel in x, y.
+  float offset;                   // Polygon offset of the depth.
+  float alpha;                    // Blended by, in the cover pass.
+  int minX, minY, maxX, maxY;     // Pixels, inclusive, in the frame.
+  int8_t winding;                 // 1 or -1 as drawn before the reorder.
+  uint8_t pass;
+} __SoftwareTriangle;
+
+typedef struct {
+  uint32_t* triangles;
+  int count, capacity;
+} __SoftwareBin;
+
+struct __SoftwareBatch {
+  __SoftwareTriangle* triangles;
+  int count, capacity;
+  __SoftwareBin* bins;  // One per tile.
+};
+
+typedef struct {
+  SoftwareRenderer* renderer;
+  const SoftwareScene* scene;
+  double modelView[16];  // Model into eye space.
+  double transform[16];  // Model into clip space.
+  float light[4];        // Eye space light.
+  int faceCount;         // Faces loaded.
+  int faceBatches;       // Batches of model faces, then the shadow.
+  bool isExpanded;       // Shaded per corner, for crease normals.
+  const float* faceNormals;  // Lighting each face while the model loads.
+} __SoftwareJob;
+
+SoftwareScene SoftwareScene_getDefault() {
+  SoftwareScene scene = {
+      .fieldOfView = 40,
+      .aspect = 1,
+      .zNear = 20,
+      .zFar = 100,
+      .eye = {0, 8, 60},
+      .center = {0, 8, 0},
+      .up = {0, 1, 0},
+      .angleTwo = 30,
+      .angle = -150,
+      .rotate = 0,
+      .lightPosition = {0, 20, 0, 0},
+      .lightColor = {1, 0.3, 0.3, 1.0},
+      .lightAttenuation = {0.1, 0.05, 0},
+      .floorPlane = {0, 1, 0, 0},
+      .shadowColor = {0.3, 0.3, 0.3, 1.0},
+      .hasShadow = true,
+  };
+  return scene;
+}
+
+bool SoftwareRenderer_isRequested() {
+  String mode = getenv("MODEL_RENDER");
+  return mode != null && isStringEqual(mode, "software");
+}
+
+SoftwareRenderer* new_SoftwareRenderer(Model* model, int width, int height) {
+  SoftwareRenderer* this = malloc(sizeof(SoftwareRenderer));
+  this->model = model;
+  this->shadow = new_ModelShadow(model);
+  this->width = width;
+  this->height = height;
+  size_t pixels = (size_t)width * height;
+  this->color = malloc(pixels * 4);
+  this->depth = malloc(sizeof(float) * pixels);
+  this->stencil = calloc(pixels, 1);
+  this->tileColumns = (width + SOFTWARE_TILE - 1) / SOFTWARE_TILE;
+  this->tileRows = (height + SOFTWARE_TILE - 1) / SOFTWARE_TILE;
+  this->clip = null;
+  this->shades = null;
+  this->shadeCount = 0;
+  this->batches = null;
+  this->batchCount = 0;
+  return this;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Matrices                                  */
+/* -------------------------------------------------------------------------- */
+
+// Matrices are in column major, as GL keeps them.
+
+static void __SoftwareRenderer_multiply(const double* first,
+                                        const double* second, double* result) {
+  double product[16];
+  for (int column = 0; column < 4; column++)
+    for (int row = 0; row < 4; row++) {
+      double sum = 0;
+      for (int next = 0; next < 4; next++)
+        sum += first[next * 4 + row] * second[column * 4 + next];
+      product[column * 4 + row] = sum;
+    }
+  memcpy(result, product, sizeof(product));
+}
+
+/**
+ * Multiply a matrix by the rotation of glRotatef().
+ */
+static void __SoftwareRenderer_rotate(double* matrix, double degrees, double x,
+                                      double y, double z) {
+  double length = sqrt(x * x + y * y + z * z);
+  x /= length, y /= length, z /= length;
+  double c = cos(degrees * M_PI / 180), s = sin(degrees * M_PI / 180);
+  double rotation[16] = {x * x * (1 - c) + c,
+                         y * x * (1 - c) + z * s,
+                         x * z * (1 - c) - y * s,
+                         0,
+                         x * y * (1 - c) - z * s,
+                         y * y * (1 - c) + c,
+                         y * z * (1 - c) + x * s,
+                         0,
+                         x * z * (1 - c) + y * s,
+                         y * z * (1 - c) - x * s,
+                         z * z * (1 - c) + c,
+                         0,
+                         0,
+                         0,
+                         0,
+                         1};
+  __SoftwareRenderer_multiply(matrix, rotation, matrix);
+}
+
+/**
+ * Make the matrix of gluLookAt().
+ */
+static void __SoftwareRenderer_lookAt(const SoftwareScene* scene,
+                                      double* matrix) {
+  double forward[3], side[3], up[3];
+  for (int axis = 0; axis < 3; axis++)
+    forward[axis] = scene->center[axis] - scene->eye[axis];
+  double length = sqrt(forward[0] * forward[0] + forward[1] * forward[1] +
+                       forward[2] * forward[2]);
+  for (int axis = 0; axis < 3; axis++) forward[axis] /= length;
+  side[0] = forward[1] * scene->up[2] - forward[2] * scene->up[1];
+  side[1] = forward[2] * scene->up[0] - forward[0] * scene->up[2];
+  side[2] = forward[0] * scene->up[1] - forward[1] * scene->up[0];
+  length = sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+  for (int axis = 0; axis < 3; axis++) side[axis] /= length;
+  up[0] = side[1] * forward[2] - side[2] * forward[1];
+  up[1] = side[2] * forward[0] - side[0] * forward[2];
+  up[2] = side[0] * forward[1] - side[1] * forward[0];
+
+  memset(matrix, 0, sizeof(double) * 16);
+  for (int axis = 0; axis < 3; axis++) {
+    matrix[axis * 4 + 0] = side[axis];
+    matrix[axis * 4 + 1] = up[axis];
+    matrix[axis * 4 + 2] = -forward[axis];
+  }
+  for (int row = 0; row < 3; row++)
+    matrix[12 + row] = -(matrix[row] * scene->eye[0] +
+                         matrix[4 + row] * scene->eye[1] +
+                         matrix[8 + row] * scene->eye[2]);
+  matrix[15] = 1;
+}
+
+/**
+ * Make the matrix of gluPerspective().
+ */
+static void __SoftwareRenderer_perspective(const SoftwareScene* scene,
+                                           double* matrix) {
+  double focal = 1 / tan(scene->fieldOfView * M_PI / 360);
+  double near = scene->zNear, far = scene->zFar;
+  memset(matrix, 0, sizeof(double) * 16);
+  matrix[0] = focal / scene->aspect;
+  matrix[5] = focal;
+  matrix[10] = (far + near) / (near - far);
+  matrix[11] = -1;
+  matrix[14] = 2 * far * near / (near - far);
+}
+
+static void __SoftwareRenderer_transform(const double* matrix,
+                                         const float* point, float w,
+                                         float* result) {
+  for (int row = 0; row < 4; row++)
+    result[row] = matrix[row] * point[0] + matrix[4 + row] * point[1] +
+                  matrix[8 + row] * point[2] + matrix[12 + row] * w;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Vertices                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Light a vertex as fixed function GL does with the
+ * program's state: the scene ambient, and the diffuse of a
+ * light without ambient, on the default material or the
+ * vertex color. Normals are not normalized, as GL_NORMALIZE
+ * is off.
+ */
+static void __SoftwareRenderer_light(const __SoftwareJob* job,
+                                     const float* eyePosition,
+                                     const float* normal, const float* color,
+                                     float* shade) {
+  const SoftwareScene* scene = job->scene;
+  const double* modelView = job->modelView;
+  float eyeNormal[3];
+  for (int row = 0; row < 3; row++)
+    eyeNormal[row] = modelView[row] * normal[0] +
+                     modelView[4 + row] * normal[1] +
+                     modelView[8 + row] * normal[2];
+
+  float direction[3], attenuation = 1;
+  if (job->light[3] == 0) {
+    memcpy(direction, job->light, sizeof(direction));
+  } else {
+    for (int axis = 0; axis < 3; axis++)
+      direction[axis] =
+          job->light[axis] / job->light[3] - eyePosition[axis] / eyePosition[3];
+    float distance = sqrtf(direction[0] * direction[0] +
+                           direction[1] * direction[1] +
+                           direction[2] * direction[2]);
+    attenuation = 1 / (scene->lightAttenuation[0] +
+                       scene->lightAttenuation[1] * distance +
+                       scene->lightAttenuation[2] * distance * distance);
+  }
+  float length = sqrtf(direction[0] * direction[0] +
+                       direction[1] * direction[1] +
+                       direction[2] * direction[2]);
+  if (length == 0) length = 1;
+  float diffuse = (eyeNormal[0] * direction[0] + eyeNormal[1] * direction[1] +
+                   eyeNormal[2] * direction[2]) /
+                  length;
+  if (diffuse < 0) diffuse = 0;
+
+  for (int channel = 0; channel < 3; channel++) {
+    float ambient = color != null ? color[channel] : SOFTWARE_MATERIAL_AMBIENT;
+    float material = color != null ? color[channel] : SOFTWARE_MATERIAL_DIFFUSE;
+    float value = SOFTWARE_SCENE_AMBIENT * ambient +
+                  attenuation * diffuse * scene->lightColor[channel] * material;
+    shade[channel] = value < 0 ? 0 : value > 1 ? 1 : value;
+  }
+  shade[3] = 1;
+}
+
+static void __SoftwareRenderer_vertexTask(void* context, int index) {
+  __SoftwareJob* job = context;
+  SoftwareRenderer* renderer = job->renderer;
+  Model* model = renderer->model;
+  int first = index * SOFTWARE_CHUNK;
+  int last = first + SOFTWARE_CHUNK;
+  if (last > renderer->shadeCount) last = renderer->shadeCount;
+  for (int next = first; next < last; next++) {
+    // Per corner with crease normals, else per vertex.
+    uint32_t vertex =
+        job->isExpanded ? model->faces->indices[next] : (uint32_t)next;
+    const float* position = &model->renderVertices[vertex * 3];
+    const float* normal = job->isExpanded ? &model->cornerNormals[next * 3]
+                                          : &model->normals[vertex * 3];
+    const float* color =
+        model->colors != null ? &model->colors[vertex * 3] : null;
+    float eyePosition[4];
+    __SoftwareRenderer_transform(job->modelView, position, 1, eyePosition);
+    __SoftwareRenderer_transform(job->transform, position, 1,
+                                 &renderer->clip[next * 4]);
+    __SoftwareRenderer_light(job, eyePosition, normal, color,
+                             &renderer->shades[next * 4]);
+  }
+}
+
+/**
+ * Shade every corner of the loaded faces with the normal
+ * of its face, while the normals of the vertices are
+ * still being generated.
+ */
+static void __SoftwareRenderer_faceTask(void* context, int index) {
+  __SoftwareJob* job = context;
+  SoftwareRenderer* renderer = job->renderer;
+  Model* model = renderer->model;
+  const FaceBuffer* faces = model->faces;
+  int first = index * SOFTWARE_CHUNK;
+  int last = first + SOFTWARE_CHUNK;
+  if (last > job->faceCount) last = job->faceCount;
+  for (int face = first; face < last; face++) {
+    const float* normal = &job->faceNormals[face * 3];
+    uint32_t start = FaceBuffer_getStart(faces, face);
+    uint32_t end = start + FaceBuffer_getCornerCount(faces, face);
+    for (uint32_t next = start; next < end; next++) {
+      uint32_t vertex = faces->indices[next];
+      const float* position = &model->renderVertices[vertex * 3];
+      const float* color =
+          model->colors != null ? &model->colors[vertex * 3] : null;
+      float eyePosition[4];
+      __SoftwareRenderer_transform(job->modelView, position, 1, eyePosition);
+      __SoftwareRenderer_transform(job->transform, position, 1,
+                                   &renderer->clip[next * 4]);
+      __SoftwareRenderer_light(job, eyePosition, normal, color,
+                               &renderer->shades[next * 4]);
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Triangles                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Get how far in a vertex is of a clip plane: the near
+ * plane, then the guard band left, right, bottom and top.
+ */
+static float __SoftwareRenderer_inside(const float* position, int plane) {
+  switch (plane) {
+    case 0:
+      return position[2] + position[3];
+    case 1:
+      return SOFTWARE_GUARD_BAND * position[3] + position[0];
+    case 2:
+      return SOFTWARE_GUARD_BAND * position[3] - position[0];
+    case 3:
+      return SOFTWARE_GUARD_BAND * position[3] + position[1];
+    default:
+      return SOFTWARE_GUARD_BAND * position[3] - position[1];
+  }
+}
+
+static void __SoftwareRenderer_addTriangle(struct __SoftwareBatch* batch,
+                                           const __SoftwareTriangle* triangle,
+                                           int tileColumns) {
+  if (batch->count == batch->capacity) {
+    batch->capacity = batch->capacity * 2 + 64;
+    batch->triangles = realloc(batch->triangles, sizeof(__SoftwareTriangle) *
+                                                     batch->capacity);
+  }
+  uint32_t index = batch->count++;
+  batch->triangles[index] = *triangle;
+  for (int row = triangle->minY / SOFTWARE_TILE;
+       row <= triangle->maxY / SOFTWARE_TILE; row++)
+    for (int column = triangle->minX / SOFTWARE_TILE;
+         column <= triangle->maxX / SOFTWARE_TILE; column++) {
+      __SoftwareBin* bin = &batch->bins[row * tileColumns + column];
+      if (bin->count == bin->capacity) {
+        bin->capacity = bin->capacity * 2 + 16;
+        bin->triangles =
+            realloc(bin->triangles, sizeof(uint32_t) * bin->capacity);
+      }
+      bin->triangles[bin->count++] = index;
+    }
+}
+
+/**
+ * Snap a clipped triangle to the frame, find the planes of
+ * its depth and colors, and bin it to the tiles it covers.
+ */
+static void __SoftwareRenderer_setup(SoftwareRenderer* renderer,
+                                     struct __SoftwareBatch* batch,
+                                     const __SoftwareVertex* vertices[3],
+                                     SoftwarePass pass) {
+  __SoftwareTriangle triangle;
+  float x[3], y[3], values[PLANE_COUNT][3];
+  for (int corner = 0; corner < 3; corner++) {
+    const float* position = vertices[corner]->position;
+    float inverseW = 1 / position[3];
+    float windowX = (position[0] * inverseW + 1) * 0.5f * renderer->width;
+    float windowY = (position[1] * inverseW + 1) * 0.5f * renderer->height;
+    triangle.x[corner] = lrintf(windowX * SOFTWARE_SUBPIXELS);
+    triangle.y[corner] = lrintf(windowY * SOFTWARE_SUBPIXELS);
+    values[PLANE_DEPTH][corner] = (position[2] * inverseW + 1) * 0.5f;
+    values[PLANE_INVERSE_W][corner] = inverseW;
+    for (int channel = 0; channel < 3; channel++)
+      values[PLANE_RED + channel][corner] =
+          vertices[corner]->color[channel] * inverseW;
+  }
+  int64_t area =
+      (int64_t)(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+      (int64_t)(triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+  if (area == 0) return;
+  // Back faces are culled from the lit pass, the others
+  // keep their winding and are turned counter clockwise.
+  triangle.winding = area > 0 ? 1 : -1;
+  if (area < 0) {
+    if (pass == SOFTWARE_LIT) return;
+    int32_t swap = triangle.x[1];
+    triangle.x[1] = triangle.x[2], triangle.x[2] = swap;
+    swap = triangle.y[1];
+    triangle.y[1] = triangle.y[2], triangle.y[2] = swap;
+    for (int plane = 0; plane < PLANE_COUNT; plane++) {
+      float value = values[plane][1];
+      values[plane][1] = values[plane][2], values[plane][2] = value;
+    }
+    area = -area;
+  }
+
+  int32_t minX = triangle.x[0], maxX = minX, minY = triangle.y[0], maxY = minY;
+  for (int corner = 0; corner < 3; corner++) {
+    x[corner] = (float)triangle.x[corner] / SOFTWARE_SUBPIXELS;
+    y[corner] = (float)triangle.y[corner] / SOFTWARE_SUBPIXELS;
+    if (triangle.x[corner] < minX) minX = triangle.x[corner];
+    if (triangle.x[corner] > maxX) maxX = triangle.x[corner];
+    if (triangle.y[corner] < minY) minY = triangle.y[corner];
+    if (triangle.y[corner] > maxY) maxY = triangle.y[corner];
+  }
+  // Pixels whose centers may be inside.
+  int half = SOFTWARE_SUBPIXELS / 2;
+  triangle.minX = (minX - half + SOFTWARE_SUBPIXELS - 1) >> SOFTWARE_SUBPIXEL_BITS;
+  triangle.minY = (minY - half + SOFTWARE_SUBPIXELS - 1) >> SOFTWARE_SUBPIXEL_BITS;
+  triangle.maxX = (maxX - half) >> SOFTWARE_SUBPIXEL_BITS;
+  triangle.maxY = (maxY - half) >> SOFTWARE_SUBPIXEL_BITS;
+  if (triangle.minX < 0) triangle.minX = 0;
+  if (triangle.minY < 0) triangle.minY = 0;
+  if (triangle.maxX >= renderer->width) triangle.maxX = renderer->width - 1;
+  if (triangle.maxY >= renderer->height) triangle.maxY = renderer->height - 1;
+  if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) return;
+
+  float pixelArea = (float)area / (SOFTWARE_SUBPIXELS * SOFTWARE_SUBPIXELS);
+  for (int plane = 0; plane < PLANE_COUNT; plane++) {
+    float* value = values[plane];
+    float alongX = ((value[1] - value[0]) * (y[2] - y[0]) -
+                    (value[2] - value[0]) * (y[1] - y[0])) /
+                   pixelArea;
+    float alongY = ((value[2] - value[0]) * (x[1] - x[0]) -
+                    (value[1] - value[0]) * (x[2] - x[0])) /
+                   pixelArea;
+    // At the center of pixel 0.
+    triangle.planes[plane][0] =
+        value[0] + alongX * (0.5f - x[0]) + alongY * (0.5f - y[0]);
+    triangle.planes[plane][1] = alongX;
+    triangle.planes[plane][2] = alongY;
+  }
+  triangle.offset = 0;
+  if (pass != SOFTWARE_LIT) {
+    float slope = fmaxf(fabsf(triangle.planes[PLANE_DEPTH][1]),
+                        fabsf(triangle.planes[PLANE_DEPTH][2]));
+    triangle.offset = SOFTWARE_OFFSET_FACTOR * slope +
+                      SOFTWARE_OFFSET_UNITS * SOFTWARE_DEPTH_UNIT;
+  }
+  triangle.alpha = vertices[0]->color[3];
+  triangle.pass = pass;
+  __SoftwareRenderer_addTriangle(batch, &triangle, renderer->tileColumns);
+}
+
+/**
+ * Clip a triangle to the near plane and the guard band,
+ * then set up the fan of what is left.
+ */
+static void __SoftwareRenderer_clip(SoftwareRenderer* renderer,
+                                    struct __SoftwareBatch* batch,
+                                    const __SoftwareVertex* triangle[3],
+                                    SoftwarePass pass) {
+  int outside = 0;
+  for (int plane = 0; plane < 5; plane++) {
+    int count = 0;
+    for (int corner = 0; corner < 3; corner++)
+      if (__SoftwareRenderer_inside(triangle[corner]->position, plane) < 0)
+        count++;
+    if (count == 3) return;
+    if (count > 0) outside |= 1 << plane;
+  }
+  if (outside == 0) {
+    __SoftwareRenderer_setup(renderer, batch, triangle, pass);
+    return;
+  }
+
+  // Each plane adds at most one corner to the polygon.
+  __SoftwareVertex polygons[2][8];
+  int count = 3;
+  for (int corner = 0; corner < 3; corner++)
+    polygons[0][corner] = *triangle[corner];
+  int from = 0;
+  for (int plane = 0; plane < 5; plane++) {
+    if (!(outside & 1 << plane)) continue;
+    __SoftwareVertex* input = polygons[from];
+    __SoftwareVertex* output = polygons[1 - from];
+    int kept = 0;
+    for (int corner = 0; corner < count; corner++) {
+      const __SoftwareVertex* current = &input[corner];
+      const __SoftwareVertex* following = &input[(corner + 1) % count];
+      float currentIn = __SoftwareRenderer_inside(current->position, plane);
+      float followingIn = __SoftwareRenderer_inside(following->position, plane);
+      if (currentIn >= 0) output[kept++] = *current;
+      if ((currentIn >= 0) != (followingIn >= 0)) {
+        float t = currentIn / (currentIn - followingIn);
+        __SoftwareVertex* cut = &output[kept++];
+        for (int axis = 0; axis < 4; axis++) {
+          cut->position[axis] =
+              current->position[axis] +
+              t * (following->position[axis] - current->position[axis]);
+          cut->color[axis] = current->color[axis] +
+                             t * (following->color[axis] - current->color[axis]);
+        }
+      }
+    }
+    count = kept;
+    from = 1 - from;
+    if (count < 3) return;
+  }
+  for (int corner = 1; corner + 1 < count; corner++) {
+    const __SoftwareVertex* fan[3] = {&polygons[from][0],
+                                      &polygons[from][corner],
+                                      &polygons[from][corner + 1]};
+    __SoftwareRenderer_setup(renderer, batch, fan, pass);
+  }
+}
+
+/**
+ * Set up the triangles of the faces of a chunk of the model.
+ */
+static void __SoftwareRenderer_setupFaces(__SoftwareJob* job,
+                                          struct __SoftwareBatch* batch,
+                                          int index) {
+  SoftwareRenderer* renderer = job->renderer;
+  const FaceBuffer* faces = renderer->model->faces;
+  const MeshTriangles* triangles = renderer->model->triangles;
+  int first = index * SOFTWARE_CHUNK;
+  int last = first + SOFTWARE_CHUNK;
+  if (last > job->faceCount) last = job->faceCount;
+  uint32_t end = MeshTriangles_getFaceStart(triangles, last) * 3;
+  __SoftwareVertex corners[3];
+  const __SoftwareVertex* triangle[3];
+  for (uint32_t next = MeshTriangles_getFaceStart(triangles, first) * 3;
+       next < end; next += 3) {
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t at = MeshTriangles_getCorner(triangles, next + corner);
+      uint32_t shade = job->isExpanded ? at : faces->indices[at];
+      memcpy(corners[corner].position, &renderer->clip[shade * 4],
+             sizeof(float) * 4);
+      memcpy(corners[corner].color, &renderer->shades[shade * 4],
+             sizeof(float) * 4);
+      triangle[corner] = &corners[corner];
+    }
+    __SoftwareRenderer_clip(renderer, batch, triangle, SOFTWARE_LIT);
+  }
+}
+
+/**
+ * Set up a chunk of the shadow fans, and the cover after
+ * the last of them.
+ */
+static void __SoftwareRenderer_setupShadow(__SoftwareJob* job,
+                                           struct __SoftwareBatch* batch,
+                                           int index) {
+  SoftwareRenderer* renderer = job->renderer;
+  const ModelShadow* shadow = renderer->shadow;
+  int first = index * SOFTWARE_CHUNK;
+  int last = first + SOFTWARE_CHUNK;
+  bool hasCover = last >= shadow->triangleCount;
+  if (hasCover) last = shadow->triangleCount + 2;
+  __SoftwareVertex corners[3];
+  for (int next = first; next < last; next++) {
+    const __SoftwareVertex* triangle[3];
+    for (int corner = 0; corner < 3; corner++) {
+      __SoftwareRenderer_transform(job->transform,
+                                   &shadow->triangles[(next * 3 + corner) * 3],
+                                   1, corners[corner].position);
+      memcpy(corners[corner].color, job->scene->shadowColor,
+             sizeof(float) * 4);
+      triangle[corner] = &corners[corner];
+    }
+    __SoftwareRenderer_clip(
+        renderer, batch, triangle,
+        next < shadow->triangleCount ? SOFTWARE_COUNT : SOFTWARE_COVER);
+  }
+}
+
+static void __SoftwareRenderer_setupTask(void* context, int index) {
+  __SoftwareJob* job = context;
+  struct __SoftwareBatch* batch = &job->renderer->batches[index];
+  batch->count = 0;
+  int tileCount = job->renderer->tileColumns * job->renderer->tileRows;
+  for (int tile = 0; tile < tileCount; tile++) batch->bins[tile].count = 0;
+  if (index < job->faceBatches)
+    __SoftwareRenderer_setupFaces(job, batch, index);
+  else
+    __SoftwareRenderer_setupShadow(job, batch, index - job->faceBatches);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Tiles                                   */
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+  int64_t start;  // At the center of the first pixel.
+  int64_t alongX, alongY;
+  bool isInside;  // Over the whole rectangle, so not tested.
+} __SoftwareEdge;
+
+/**
+ * Get the color of a triangle at a pixel, perspective
+ * correct as GL interpolates it.
+ */
+static void __SoftwareRenderer_interpolate(const __SoftwareTriangle* triangle,
+                                           int x, int y, float* color) {
+  const float(*planes)[3] = triangle->planes;
+  float inverseW = planes[PLANE_INVERSE_W][0] +
+                   planes[PLANE_INVERSE_W][1] * x +
+                   planes[PLANE_INVERSE_W][2] * y;
+  for (int channel = 0; channel < 3; channel++) {
+    const float* plane = planes[PLANE_RED + channel];
+    float value = (plane[0] + plane[1] * x + plane[2] * y) / inverseW;
+    color[channel] = value < 0 ? 0 : value > 1 ? 1 : value;
+  }
+}
+
+static void __SoftwareRenderer_shade(SoftwareRenderer* renderer,
+                                     const __SoftwareTriangle* triangle, int x,
+                                     int y) {
+  size_t pixel = (size_t)y * renderer->width + x;
+  const float(*planes)[3] = triangle->planes;
+  uint8_t* color = &renderer->color[pixel * 4];
+  float shade[3];
+  if (triangle->pass == SOFTWARE_COVER) {
+    if (renderer->stencil[pixel] == 0) return;
+    renderer->stencil[pixel] = 0;
+    __SoftwareRenderer_interpolate(triangle, x, y, shade);
+    float alpha = triangle->alpha;
+    for (int channel = 0; channel < 3; channel++)
+      color[channel] = lrintf(
+          (shade[channel] * alpha + color[channel] / 255.0f * (1 - alpha)) *
+          255);
+    return;
+  }
+
+  // Depth outside 0 to 1 is what GL clips away.
+  float depth = planes[PLANE_DEPTH][0] + planes[PLANE_DEPTH][1] * x +
+                planes[PLANE_DEPTH][2] * y;
+  if (depth < 0 || depth > 1) return;
+  depth += triangle->offset;
+  if (depth < 0) depth = 0;
+  if (!(depth < renderer->depth[pixel])) return;
+  if (triangle->pass == SOFTWARE_COUNT) {
+    renderer->stencil[pixel] += triangle->winding;
+    return;
+  }
+  renderer->depth[pixel] = depth;
+  __SoftwareRenderer_interpolate(triangle, x, y, shade);
+  for (int channel = 0; channel < 3; channel++)
+    color[channel] = lrintf(shade[channel] * 255);
+  color[3] = 255;
+}
+
+/**
+ * Get which of 4 pixels in a row are inside every edge,
+ * from the edge values at the first and their steps over
+ * the 4 pixels. The lanes are 64 bits, so 2 per register.
+ * @return a bit per pixel, the first in the lowest bit.
+ */
+static inline int __SoftwareRenderer_testQuad(const int64_t values[3],
+                                              const int64_t steps[3][4]) {
+  int mask = 0;
+#if defined(__SSE2__)
+  for (int half = 0; half < 2; half++) {
+    __m128i inside = _mm_setzero_si128();
+    for (int edge = 0; edge < 3; edge++)
+      inside = _mm_or_si128(
+          inside,
+          _mm_add_epi64(_mm_set1_epi64x(values[edge]),
+                        _mm_loadu_si128((const __m128i*)&steps[edge][half * 2])));
+    mask |= (~_mm_movemask_pd(_mm_castsi128_pd(inside)) & 3) << half * 2;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (int half = 0; half < 2; half++) {
+    int64x2_t inside = vdupq_n_s64(0);
+    for (int edge = 0; edge < 3; edge++)
+      inside = vorrq_s64(inside, vaddq_s64(vdupq_n_s64(values[edge]),
+                                           vld1q_s64(&steps[edge][half * 2])));
+    uint64x2_t outside = vshrq_n_u64(vreinterpretq_u64_s64(inside), 63);
+    mask |= (!vgetq_lane_u64(outside, 0) | !vgetq_lane_u64(outside, 1) << 1)
+            << half * 2;
+  }
+#else
+  for (int lane = 0; lane < 4; lane++)
+    if ((values[0] + steps[0][lane] | values[1] + steps[1][lane] |
+         values[2] + steps[2][lane]) >= 0)
+      mask |= 1 << lane;
+#endif
+  return mask;
+}
+
+/**
+ * Fill the pixels of a triangle in a rectangle of a tile.
+ * Edges the rectangle is all inside of are not tested.
+ */
+static void __SoftwareRenderer_fill(SoftwareRenderer* renderer,
+                                    const __SoftwareTriangle* triangle,
+                                    int minX, int minY, int maxX, int maxY) {
+  __SoftwareEdge edges[3];
+  int64_t centerX = ((int64_t)minX << SOFTWARE_SUBPIXEL_BITS) +
+                    SOFTWARE_SUBPIXELS / 2;
+  int64_t centerY = ((int64_t)minY << SOFTWARE_SUBPIXEL_BITS) +
+                    SOFTWARE_SUBPIXELS / 2;
+  bool isAllInside = true;
+  for (int edge = 0; edge < 3; edge++) {
+    int from = (edge + 1) % 3, to = (edge + 2) % 3;
+    int64_t deltaX = triangle->x[to] - triangle->x[from];
+    int64_t deltaY = triangle->y[to] - triangle->y[from];
+    // Inside is on the left of the edge. Centers on the left
+    // or the bottom edges are in, as with GL's lower left
+    // origin, so the others are moved in by one.
+    int64_t value = deltaX * (centerY - triangle->y[from]) -
+                    deltaY * (centerX - triangle->x[from]);
+    if (!(deltaY < 0 || (deltaY == 0 && deltaX > 0))) value--;
+    int64_t alongX = -deltaY * SOFTWARE_SUBPIXELS;
+    int64_t alongY = deltaX * SOFTWARE_SUBPIXELS;
+    int64_t spanX = alongX * (maxX - minX), spanY = alongY * (maxY - minY);
+    int64_t least = value + (spanX < 0 ? spanX : 0) + (spanY < 0 ? spanY : 0);
+    int64_t most = value + (spanX > 0 ? spanX : 0) + (spanY > 0 ? spanY : 0);
+    if (most < 0) return;
+    edges[edge].isInside = least >= 0;
+    edges[edge].start = value;
+    edges[edge].alongX = alongX;
+    edges[edge].alongY = alongY;
+    isAllInside &= edges[edge].isInside;
+  }
+
+  if (isAllInside) {
+    for (int y = minY; y <= maxY; y++)
+      for (int x = minX; x <= maxX; x++)
+        __SoftwareRenderer_shade(renderer, triangle, x, y);
+    return;
+  }
+  int64_t rows[3], steps[3][4];
+  for (int edge = 0; edge < 3; edge++) {
+    bool isTested = !edges[edge].isInside;
+    rows[edge] = isTested ? edges[edge].start : 0;
+    for (int lane = 0; lane < 4; lane++)
+      steps[edge][lane] = isTested ? edges[edge].alongX * lane : 0;
+  }
+  for (int y = minY; y <= maxY; y++) {
+    int64_t values[3] = {rows[0], rows[1], rows[2]};
+    for (int x = minX; x <= maxX; x += 4) {
+      int mask = __SoftwareRenderer_testQuad(values, steps);
+      if (x + 4 > maxX + 1) mask &= (1 << (maxX + 1 - x)) - 1;
+      for (int lane = 0; mask != 0; lane++, mask >>= 1)
+        if (mask & 1) __SoftwareRenderer_shade(renderer, triangle, x + lane, y);
+      for (int edge = 0; edge < 3; edge++)
+        if (!edges[edge].isInside) values[edge] += edges[edge].alongX * 4;
+    }
+    for (int edge = 0; edge < 3; edge++)
+      if (!edges[edge].isInside) rows[edge] += edges[edge].alongY;
+  }
+}
+
+/**
+ * Draw the triangles binned to a tile, batch by batch so
+ * they keep the order of the faces.
+ */
+static void __SoftwareRenderer_tileTask(void* context, int index) {
+  __SoftwareJob* job = context;
+  SoftwareRenderer* renderer = job->renderer;
+  int tileX = index % renderer->tileColumns * SOFTWARE_TILE;
+  int tileY = index / renderer->tileColumns * SOFTWARE_TILE;
+  int lastX = tileX + SOFTWARE_TILE - 1, lastY = tileY + SOFTWARE_TILE - 1;
+  for (int batch = 0; batch < renderer->batchCount; batch++) {
+    const struct __SoftwareBatch* current = &renderer->batches[batch];
+    const __SoftwareBin* bin = &current->bins[index];
+    for (int next = 0; next < bin->count; next++) {
+      const __SoftwareTriangle* triangle =
+          &current->triangles[bin->triangles[next]];
+      __SoftwareRenderer_fill(
+          renderer, triangle,
+          triangle->minX > tileX ? triangle->minX : tileX,
+          triangle->minY > tileY ? triangle->minY : tileY,
+          triangle->maxX < lastX ? triangle->maxX : lastX,
+          triangle->maxY < lastY ? triangle->maxY : lastY);
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Frame                                   */
+/* -------------------------------------------------------------------------- */
+
+static void __SoftwareRenderer_clear(SoftwareRenderer* this) {
+  size_t pixels = (size_t)this->width * this->height;
+  memset(this->color, 255, pixels * 4);
+  for (size_t pixel = 0; pixel < pixels; pixel++) this->depth[pixel] = 1;
+}
+
+static void __SoftwareRenderer_growBatches(SoftwareRenderer* this, int count) {
+  if (count <= this->batchCount) return;
+  int tileCount = this->tileColumns * this->tileRows;
+  this->batches =
+      realloc(this->batches, sizeof(struct __SoftwareBatch) * count);
+  for (int next = this->batchCount; next < count; next++) {
+    this->batches[next].triangles = null;
+    this->batches[next].count = 0;
+    this->batches[next].capacity = 0;
+    this->batches[next].bins = calloc(tileCount, sizeof(__SoftwareBin));
+  }
+  this->batchCount = count;
+}
+
+static int __SoftwareRenderer_countTasks(int count) {
+  return (count + SOFTWARE_CHUNK - 1) / SOFTWARE_CHUNK;
+}
+
+void SoftwareRenderer_draw(SoftwareRenderer* this, const SoftwareScene* scene) {
+  __SoftwareRenderer_clear(this);
+  Model* model = this->model;
+  __SoftwareJob job = {.renderer = this, .scene = scene};
+  job.faceCount = Model_getLoadedFaceCount(model);
+  if (job.faceCount <= 0) return;
+
+  // The scene turns, where the light is set, then the model turn.
+  double turned[16], projection[16];
+  __SoftwareRenderer_lookAt(scene, turned);
+  __SoftwareRenderer_rotate(turned, scene->angleTwo, 1, 0, 0);
+  __SoftwareRenderer_rotate(turned, scene->angle, 0, 1, 0);
+  __SoftwareRenderer_transform(turned, scene->lightPosition,
+                               scene->lightPosition[3], job.light);
+  memcpy(job.modelView, turned, sizeof(turned));
+  __SoftwareRenderer_rotate(job.modelView, scene->rotate, 0, 1, 0);
+  __SoftwareRenderer_perspective(scene, projection);
+  __SoftwareRenderer_multiply(projection, job.modelView, job.transform);
+
+  // Faces that stream in without normals are shaded per corner too,
+  // the normals of the vertices are only read once they are done.
+  if (job.faceCount < model->faces->count)
+    job.faceNormals = model->faceNormals;
+  job.isExpanded = job.faceNormals != null || model->cornerNormals != null;
+  int shadeCount = job.isExpanded ? (int)model->faces->length
+                                   : model->vertices->count;
+  if (shadeCount > this->shadeCount) {
+    this->clip = realloc(this->clip, sizeof(float) * 4 * shadeCount);
+    this->shades = realloc(this->shades, sizeof(float) * 4 * shadeCount);
+  }
+  this->shadeCount = shadeCount;
+  if (job.faceNormals != null)
+    Parallel_for(__SoftwareRenderer_countTasks(job.faceCount),
+                 __SoftwareRenderer_faceTask, &job);
+  else
+    Parallel_for(__SoftwareRenderer_countTasks(shadeCount),
+                 __SoftwareRenderer_vertexTask, &job);
+
+  int shadowBatches = 0;
+  if (scene->hasShadow) {
+    float matrix[16];
+    ModelShadow_getMatrix(matrix, scene->floorPlane, scene->lightPosition);
+    ModelShadow_update(this->shadow, matrix, scene->floorPlane);
+    if (this->shadow->triangleCount > 0)
+      shadowBatches =
+          __SoftwareRenderer_countTasks(this->shadow->triangleCount + 2);
+  }
+  job.faceBatches = __SoftwareRenderer_countTasks(job.faceCount);
+  int batchCount = job.faceBatches + shadowBatches;
+  __SoftwareRenderer_growBatches(this, batchCount);
+  // Batches past the ones of this frame are left empty.
+  int tileCount = this->tileColumns * this->tileRows;
+  for (int next = batchCount; next < this->batchCount; next++)
+    for (int tile = 0; tile < tileCount; tile++)
+      this->batches[next].bins[tile].count = 0;
+  Parallel_for(batchCount, __SoftwareRenderer_setupTask, &job);
+  Parallel_for(tileCount, __SoftwareRenderer_tileTask, &job);
+}
+
+void SoftwareRenderer_free(SoftwareRenderer* this) {
+  if (this == null) return;
+  int tileCount = this->tileColumns * this->tileRows;
+  for (int next = 0; next < this->batchCount; next++) {
+    for (int tile = 0; tile < tileCount; tile++) {
+      free(this->batches[next].bins[tile].triangles);
+    }
+    dispose(this->batches[next].triangles, this->batches[next].bins);
+  }
+  dispose(this->batches, this->clip, this->shades, this->color, this->depth,
+          this->stencil);
+  ModelShadow_free(this->shadow);
+  free(this);
+}
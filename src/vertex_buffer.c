@@ -0,0 +1,101 @@
+#include "vertex_buffer.h"
+
+// Each axis of a SoA block starts on a cache line.
+#define VERTEX_BUFFER_ALIGNMENT 64
+
+static int _defaultLayout = -1;
+static int _defaultPrecision = -1;
+
+void VertexBuffer_setDefaultLayout(VertexLayout layout) {
+  _defaultLayout = layout;
+}
+
+VertexLayout VertexBuffer_getDefaultLayout() {
+  if (_defaultLayout >= 0) return _defaultLayout;
+  String fromEnvironment = getenv("MODEL_VERTEX_LAYOUT");
+  if (fromEnvironment != null && isStringEqual(fromEnvironment, "interleaved"))
+    return VERTEX_INTERLEAVED;
+  return VERTEX_SOA;
+}
+
+void VertexBuffer_setDefaultPrecision(VertexPrecision precision) {
+  _defaultPrecision = precision;
+}
+
+VertexPrecision VertexBuffer_getDefaultPrecision() {
+  if (_defaultPrecision >= 0) return _defaultPrecision;
+  String fromEnvironment = getenv("MODEL_VERTEX_PRECISION");
+  if (fromEnvironment != null && isStringEqual(fromEnvironment, "float64"))
+    return VERTEX_FLOAT64;
+  return VERTEX_FLOAT32;
+}
+
+/**
+ * Get the bytes from one axis to the next of a SoA block.
+ */
+static size_t __VertexBuffer_getAxisBytes(int count,
+                                          VertexPrecision precision) {
+  size_t size = precision == VERTEX_FLOAT32 ? sizeof(float) : sizeof(double);
+  size_t bytes = (size_t)(count > 0 ? count : 0) * size;
+  return (bytes + VERTEX_BUFFER_ALIGNMENT - 1) / VERTEX_BUFFER_ALIGNMENT *
+         VERTEX_BUFFER_ALIGNMENT;
+}
+
+size_t VertexBuffer_getByteLength(int count, VertexLayout layout,
+                                  VertexPrecision precision) {
+  if (layout == VERTEX_SOA)
+    return __VertexBuffer_getAxisBytes(count, precision) * 3;
+  size_t size = precision == VERTEX_FLOAT32 ? sizeof(float) : sizeof(double);
+  return (size_t)(count > 0 ? count : 0) * 3 * size;
+}
+
+VertexBuffer VertexBuffer_of(int count, VertexLayout layout,
+                             VertexPrecision precision, void* data) {
+  VertexBuffer this;
+  this.count = count > 0 ? count : 0;
+  this.layout = layout;
+  this.precision = precision;
+  this.data = data;
+  this.bytes = VertexBuffer_getByteLength(count, layout, precision);
+  this.isOwned = false;
+  size_t size = precision == VERTEX_FLOAT32 ? sizeof(float) : sizeof(double);
+  size_t axisBytes = layout == VERTEX_SOA
+                         ? __VertexBuffer_getAxisBytes(count, precision)
+                         : size;
+  this.stride = layout == VERTEX_SOA ? 1 : 3;
+  for (int axis = 0; axis < 3; axis++)
+    this.axes[axis] = (char*)data + axis * axisBytes;
+  return this;
+}
+
+VertexBuffer* new_VertexBufferOf(int count, VertexLayout layout,
+                                 VertexPrecision precision, void* data) {
+  VertexBuffer* this = malloc(sizeof(VertexBuffer));
+  *this = VertexBuffer_of(count, layout, precision, data);
+  return this;
+}
+
+VertexBuffer* new_VertexBuffer(int count, VertexLayout layout,
+                               VertexPrecision precision) {
+  size_t bytes = VertexBuffer_getByteLength(count, layout, precision);
+  // aligned_alloc() needs a multiple of the alignment.
+  bytes = (bytes / VERTEX_BUFFER_ALIGNMENT + 1) * VERTEX_BUFFER_ALIGNMENT;
+  void* data = aligned_alloc(VERTEX_BUFFER_ALIGNMENT, bytes);
+  VertexBuffer* this = new_VertexBufferOf(count, layout, precision, data);
+  this->isOwned = true;
+  return this;
+}
+
+void VertexBuffer_free(VertexBuffer* this) {
+  if (this == null) return;
+  if (this->isOwned) {
+    free(this->data);
+  }
+  free(this);
+}
+
+String VertexBuffer_toString(VertexBuffer* this, int index) {
+  return $("{\"x\": ", _(VertexBuffer_get(this, index, 0), 4),
+           ", \"y\": ", _(VertexBuffer_get(this, index, 1), 4),
+           ", \"z\": ", _(VertexBuffer_get(this, index, 2), 4), "}");
+}
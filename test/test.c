@@ -1,8 +1,425 @@
+#include <math.h>
+
+#include "mapped_file.h"
+#include "mesh_lod.h"
+#include "mesh_order.h"
+#include "mesh_triangles.h"
+#include "model.h"
+#include "ply.h"
 #include "point.h"
 
+static int _failures = 0;
+
+// Count and print a failed check, then go on with the next one.
+#define CHECK(condition)                                          \
+  if (!(condition)) {                                             \
+    print("  Failed: ", #condition, " on line ", _(__LINE__));    \
+    _failures++;                                                  \
+  }
+
+/**
+ * Parse the header and decode the body of some bytes.
+ * @return the schema, hasError is set if either failed, or
+ * null if out of memory.
+ */
+static PlySchema* decodeBytes(const char* data, size_t length) {
+  PlyScanner scanner = PlyScanner_of(data, length);
+  PlySchema* schema = new_PlySchema(&scanner);
+  if (schema != null && !PlySchema_decode(schema, &scanner))
+    schema->hasError = true;
+  return schema;
+}
+
+static PlySchema* decodeFile(String path) {
+  MappedFile* file = new_MappedFile(path);
+  if (file == null) return null;
+  PlySchema* schema = decodeBytes(file->data, file->length);
+  MappedFile_free(file);
+  return schema;
+}
+
+static bool isSameColumn(PlyProperty* a, PlyProperty* b, int records) {
+  if (a == null || b == null || a->length != b->length) return false;
+  for (size_t next = 0; next < a->length; next++)
+    if (PlyProperty_getValue(a, next) != PlyProperty_getValue(b, next))
+      return false;
+  if (a->countType == PLY_NONE) return b->countType == PLY_NONE;
+  for (int record = 0; record <= records; record++)
+    if (a->listOffsets[record] != b->listOffsets[record]) return false;
+  return true;
+}
+
+static void testBinaryFormats() {
+  print("_____Testing binary little and big endian_____");
+  PlySchema* ascii = decodeFile("./assets/cube.ply");
+  String paths[] = {"./test/cube_little_endian.ply",
+                    "./test/cube_big_endian.ply"};
+  for (size_t path = 0; path < GET_ARRAY_SIZE(paths); path++) {
+    PlySchema* binary = decodeFile(paths[path]);
+    CHECK(ascii != null && !ascii->hasError);
+    CHECK(binary != null && !binary->hasError);
+    if (ascii == null || binary == null) continue;
+    CHECK(binary->format == (path == 0 ? PLY_BINARY_LITTLE_ENDIAN
+                                       : PLY_BINARY_BIG_ENDIAN));
+    CHECK(binary->elements->length == ascii->elements->length);
+    for_in(next, ascii->elements) {
+      PlyElement* element = ascii->elements->at[next];
+      PlyElement* decoded = PlySchema_getElement(binary, element->name);
+      CHECK(decoded != null && decoded->count == element->count);
+      if (decoded == null) continue;
+      for_in(index, element->properties) {
+        PlyProperty* property = element->properties->at[index];
+        CHECK(isSameColumn(property,
+                           PlyElement_findProperty(decoded, property->name),
+                           element->count));
+      }
+    }
+    PlySchema_free(binary);
+  }
+  PlySchema_free(ascii);
+}
+
+static void testListCountTypes() {
+  print("_____Testing list count types_____");
+  // A face of three corners written in the byte order of the
+  // host. PLY list lengths are integers.
+  const uint16_t probe = 1;
+  String format = *(const uint8_t*)&probe == 1 ? "binary_little_endian"
+                                               : "binary_big_endian";
+  struct {
+    String name;
+    PlyType type;
+    bool isValid;
+  } counts[] = {{"uchar", PLY_UINT8, true},
+                {"int", PLY_INT32, true},
+                {"float", PLY_FLOAT32, false},
+                {"double", PLY_FLOAT64, false}};
+  for (size_t next = 0; next < GET_ARRAY_SIZE(counts); next++) {
+    String header = $("ply\nformat ", format,
+                      " 1.0\nelement face 1\nproperty list ",
+                      counts[next].name, " int vertex_indices\nend_header\n");
+    size_t headerLength = strlen(header);
+    size_t countSize = PlyType_size(counts[next].type);
+    size_t length = headerLength + countSize + 3 * sizeof(int32_t);
+    char* file = malloc(length);
+    memcpy(file, header, headerLength);
+    PlyType_write(file + headerLength, counts[next].type, 3);
+    for (int corner = 0; corner < 3; corner++)
+      PlyType_write(file + headerLength + countSize + corner * 4, PLY_INT32,
+                    corner);
+    PlySchema* schema = decodeBytes(file, length);
+    CHECK(schema != null && schema->hasError == !counts[next].isValid);
+    PlySchema_free(schema);
+    dispose(header, file);
+  }
+}
+
+/**
+ * Make one face of 2D corners in the z = 0 plane, whose
+ * face indices are the corners in order.
+ */
+static FaceBuffer* newPolygon(const double (*points)[2], uint32_t count,
+                              VertexBuffer** vertices) {
+  *vertices = new_VertexBuffer(count, VERTEX_SOA, VERTEX_FLOAT64);
+  uint32_t offsets[2] = {0, count};
+  FaceBuffer* faces = new_FaceBuffer(1, offsets);
+  for (uint32_t corner = 0; corner < count; corner++) {
+    VertexBuffer_set(*vertices, corner, 0, points[corner][0]);
+    VertexBuffer_set(*vertices, corner, 1, points[corner][1]);
+    VertexBuffer_set(*vertices, corner, 2, 0);
+    faces->indices[corner] = corner;
+  }
+  return faces;
+}
+
+/**
+ * Check the triangles of a polygon: n - 2 of them, every
+ * corner in the face, none turning against it, and their
+ * areas adding up to the area of the polygon.
+ */
+static void checkPolygon(const MeshTriangles* triangles,
+                         const double (*points)[2], uint32_t count) {
+  CHECK(triangles->count == (int)count - 2);
+  CHECK(MeshTriangles_getFaceStart(triangles, 1) == count - 2);
+  double area = 0, polygonArea = 0;
+  bool isInside = true, isLeft = true;
+  for (uint32_t corner = 0; corner < count; corner++) {
+    const double* a = points[corner];
+    const double* b = points[(corner + 1) % count];
+    polygonArea += a[0] * b[1] - b[0] * a[1];
+  }
+  for (int triangle = 0; triangle < triangles->count; triangle++) {
+    uint32_t at[3];
+    for (int corner = 0; corner < 3; corner++) {
+      at[corner] = MeshTriangles_getCorner(triangles, triangle * 3 + corner);
+      isInside = isInside && at[corner] < count;
+    }
+    if (!isInside) break;
+    const double *a = points[at[0]], *b = points[at[1]], *c = points[at[2]];
+    double cross =
+        (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+    isLeft = isLeft && cross >= 0;
+    area += cross;
+  }
+  CHECK(isInside);
+  CHECK(isLeft);
+  CHECK(fabs(area - polygonArea) < 1e-9);
+}
+
+static void testTriangulation() {
+  print("_____Testing triangulation_____");
+  VertexBuffer* vertices;
+
+  // An arrow, concave at its second corner, is ear clipped.
+  const double arrow[5][2] = {{0, 0}, {2, 1}, {4, 0}, {4, 3}, {0, 3}};
+  FaceBuffer* faces = newPolygon(arrow, 5, &vertices);
+  MeshTriangles* triangles = new_MeshTriangles(faces, vertices);
+  checkPolygon(triangles, arrow, 5);
+  CHECK(triangles->clippedCount == 1);
+  MeshTriangles_free(triangles);
+  FaceBuffer_free(faces);
+  VertexBuffer_free(vertices);
+
+  // A square is fanned, and its corners wrapped again give the same.
+  const double square[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+  faces = newPolygon(square, 4, &vertices);
+  triangles = new_MeshTriangles(faces, vertices);
+  checkPolygon(triangles, square, 4);
+  CHECK(triangles->clippedCount == 0);
+  const uint32_t fan[6] = {0, 1, 2, 0, 2, 3};
+  CHECK(memcmp(triangles->corners, fan, sizeof(fan)) == 0);
+  MeshTriangles* wrapped = new_MeshTrianglesOf(faces, triangles->corners);
+  CHECK(wrapped->count == triangles->count);
+  for (uint32_t at = 0; at < 6; at++)
+    CHECK(MeshTriangles_getCorner(wrapped, at) ==
+          MeshTriangles_getCorner(triangles, at));
+  MeshTriangles_free(wrapped);
+  MeshTriangles_free(triangles);
+  FaceBuffer_free(faces);
+  VertexBuffer_free(vertices);
+
+  // A face with no area still gives its triangles, fanned.
+  const double line[4][2] = {{0, 0}, {1, 0}, {2, 0}, {3, 0}};
+  faces = newPolygon(line, 4, &vertices);
+  triangles = new_MeshTriangles(faces, vertices);
+  checkPolygon(triangles, line, 4);
+  CHECK(triangles->clippedCount == 0);
+  MeshTriangles_free(triangles);
+  FaceBuffer_free(faces);
+  VertexBuffer_free(vertices);
+
+  // A star of more corners than fit on the stack while clipping.
+  enum { STAR_CORNERS = 80 };
+  double star[STAR_CORNERS][2];
+  for (int corner = 0; corner < STAR_CORNERS; corner++) {
+    double angle = 2 * 3.14159265358979323846 * corner / STAR_CORNERS;
+    double radius = corner % 2 == 0 ? 2 : 1;
+    star[corner][0] = radius * cos(angle);
+    star[corner][1] = radius * sin(angle);
+  }
+  faces = newPolygon((const double (*)[2])star, STAR_CORNERS, &vertices);
+  triangles = new_MeshTriangles(faces, vertices);
+  checkPolygon(triangles, (const double (*)[2])star, STAR_CORNERS);
+  CHECK(triangles->clippedCount == 1);
+  MeshTriangles_free(triangles);
+  FaceBuffer_free(faces);
+  VertexBuffer_free(vertices);
+}
+
+/**
+ * Check that the normals generated for a closed mesh are of
+ * unit length and point away from its centroid.
+ */
+static void checkNormals(String path) {
+  Model* model = new_Model(path);
+  CHECK(model != null && !model->hasError && model->hasGeneratedNormals);
+  if (model == null || model->normals == null) {
+    Model_free(model);
+    return;
+  }
+  bool isUnit = true, isOutward = true;
+  for (int vertex = 0; vertex < model->vertices->count; vertex++) {
+    const float* normal = &model->normals[vertex * 3];
+    double length = 0, outward = 0;
+    for (int axis = 0; axis < 3; axis++) {
+      double position = VertexBuffer_get(model->vertices, vertex, axis);
+      length += normal[axis] * normal[axis];
+      outward += normal[axis] * (position - model->stats.centroid[axis]);
+    }
+    isUnit = isUnit && fabs(sqrt(length) - 1) < 1e-5;
+    isOutward = isOutward && outward > 0;
+  }
+  CHECK(isUnit);
+  CHECK(isOutward);
+  Model_free(model);
+}
+
+static void testNormals() {
+  print("_____Testing generated normals_____");
+  checkNormals("./assets/cube.ply");
+  // The same cube wound clockwise has its normals flipped to match.
+  checkNormals("./test/cube_clockwise.ply");
+}
+
+static void testWeld() {
+  print("_____Testing welding_____");
+  // A cube of 6 faces with 4 vertices each, the first face repeated
+  // and a face left with 2 distinct corners once welded.
+  setenv("MODEL_WELD", "on", 1);
+  Model* model = new_Model("./test/cube_soup.ply");
+  unsetenv("MODEL_WELD");
+  CHECK(model != null && !model->hasError);
+  if (model == null || model->hasError) {
+    Model_free(model);
+    return;
+  }
+  CHECK(model->weld.isWelded);
+  CHECK(model->weld.vertexCount == 24 && model->weld.faceCount == 8);
+  CHECK(model->weld.weldedVertices == 16);
+  CHECK(model->weld.duplicateFaces == 1);
+  CHECK(model->weld.degenerateFaces == 1);
+  CHECK(model->numOfVertices == 8 && model->vertices->count == 8);
+  CHECK(model->numOfFaces == 6 && model->faces->count == 6);
+  CHECK(model->stats.maxIndex < 8);
+  Model_free(model);
+}
+
+/**
+ * Make a bumpy grid of quads, size by size, with size + 1
+ * vertices along each side.
+ */
+static FaceBuffer* newGrid(int size, VertexBuffer** vertices) {
+  int side = size + 1;
+  *vertices = new_VertexBuffer(side * side, VERTEX_SOA, VERTEX_FLOAT32);
+  for (int row = 0; row < side; row++)
+    for (int column = 0; column < side; column++) {
+      int vertex = row * side + column;
+      VertexBuffer_set(*vertices, vertex, 0, column);
+      VertexBuffer_set(*vertices, vertex, 1, row);
+      double height = sin(column * 0.3) * cos(row * 0.2);
+      VertexBuffer_set(*vertices, vertex, 2, height);
+    }
+  int count = size * size;
+  uint32_t* offsets = malloc(sizeof(uint32_t) * (count + 1));
+  for (int face = 0; face <= count; face++) offsets[face] = face * 4;
+  FaceBuffer* faces = new_FaceBuffer(count, offsets);
+  free(offsets);
+  for (int face = 0; face < count; face++) {
+    uint32_t corner = (face / size) * side + face % size;
+    uint32_t* at = &faces->indices[face * 4];
+    at[0] = corner;
+    at[1] = corner + 1;
+    at[2] = corner + side + 1;
+    at[3] = corner + side;
+  }
+  return faces;
+}
+
+static int compareQuads(const void* a, const void* b) {
+  return memcmp(a, b, sizeof(uint32_t) * 4);
+}
+
+/**
+ * Get the quads sorted, each turned to start at its lowest
+ * corner so the winding is kept.
+ */
+static uint32_t* newSortedQuads(const FaceBuffer* faces,
+                                const uint32_t* remap) {
+  uint32_t* quads = malloc(sizeof(uint32_t) * 4 * faces->count);
+  for (int face = 0; face < faces->count; face++) {
+    const uint32_t* corners = FaceBuffer_getCorners(faces, face);
+    int lowest = 0;
+    for (int corner = 0; corner < 4; corner++) {
+      uint32_t index = remap != null ? remap[corners[corner]] : corners[corner];
+      quads[face * 4 + corner] = index;
+      if (index < quads[face * 4 + lowest]) lowest = corner;
+    }
+    uint32_t turned[4];
+    for (int corner = 0; corner < 4; corner++)
+      turned[corner] = quads[face * 4 + (lowest + corner) % 4];
+    memcpy(&quads[face * 4], turned, sizeof(turned));
+  }
+  qsort(quads, faces->count, sizeof(uint32_t) * 4, compareQuads);
+  return quads;
+}
+
+static void testOrder() {
+  print("_____Testing vertex cache order_____");
+  VertexBuffer* vertices;
+  FaceBuffer* faces = newGrid(32, &vertices);
+  FaceBuffer* ordered = new_FaceBufferCopy(faces);
+  int vertexCount = vertices->count;
+  uint32_t* remap = malloc(sizeof(uint32_t) * vertexCount);
+  MeshOrder order = MeshOrder_optimize(ordered, vertexCount, remap);
+  CHECK(order.isReordered);
+  CHECK(order.after.acmr <= order.before.acmr);
+
+  // Every vertex gets a new index of its own.
+  bool* isTaken = calloc(vertexCount, sizeof(bool));
+  bool isPermutation = true;
+  for (int vertex = 0; vertex < vertexCount; vertex++) {
+    isPermutation = isPermutation && remap[vertex] < (uint32_t)vertexCount &&
+                    !isTaken[remap[vertex]];
+    if (isPermutation) isTaken[remap[vertex]] = true;
+  }
+  CHECK(isPermutation);
+
+  // The faces are the same, renumbered, in another order.
+  CHECK(ordered->count == faces->count);
+  if (isPermutation && ordered->count == faces->count) {
+    uint32_t* before = newSortedQuads(faces, remap);
+    uint32_t* after = newSortedQuads(ordered, null);
+    CHECK(memcmp(before, after, sizeof(uint32_t) * 4 * faces->count) == 0);
+    dispose(before, after);
+  }
+  dispose(remap, isTaken);
+  FaceBuffer_free(ordered);
+  FaceBuffer_free(faces);
+  VertexBuffer_free(vertices);
+}
+
+static void testLod() {
+  print("_____Testing levels of detail_____");
+  VertexBuffer* vertices;
+  FaceBuffer* faces = newGrid(64, &vertices);
+  MeshTriangles* triangles = new_MeshTriangles(faces, vertices);
+  int vertexCount = vertices->count;
+  float* positions = malloc(sizeof(float) * 3 * vertexCount);
+  for (int vertex = 0; vertex < vertexCount; vertex++)
+    for (int axis = 0; axis < 3; axis++)
+      positions[vertex * 3 + axis] = VertexBuffer_get(vertices, vertex, axis);
+  MeshLod* lod = new_MeshLod(faces, triangles, positions, null, vertexCount);
+  CHECK(lod->levelCount > 1);
+  CHECK(lod->levels[0].triangleCount == triangles->count);
+
+  // Each level is coarser than the one before and indexes the vertices.
+  for (int level = 1; level < lod->levelCount; level++) {
+    const LodLevel* detail = &lod->levels[level];
+    CHECK(detail->triangleCount < lod->levels[level - 1].triangleCount);
+    bool isIndexed = true;
+    for (int corner = 0; corner < detail->triangleCount * 3; corner++)
+      isIndexed = isIndexed && detail->indices[corner] < (uint32_t)vertexCount;
+    CHECK(isIndexed);
+  }
+  MeshLod_free(lod);
+  free(positions);
+  MeshTriangles_free(triangles);
+  FaceBuffer_free(faces);
+  VertexBuffer_free(vertices);
+}
+
 int main(int argc, char** argv) {
   print("Running script...");
   print("_____Testign point object_____");
+  // Models are loaded from the files, never from or into a cache.
+  setenv("MODEL_CACHE", "off", 1);
+  testBinaryFormats();
+  testListCountTypes();
+  testTriangulation();
+  testNormals();
+  testWeld();
+  testOrder();
+  testLod();
   print("Script complete.");
-  return 0;
-}
\ No newline at end of file
+  return _failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,370 @@
+/**
+ * Render a PNG preview of every PLY file given, framed as
+ * the program first shows a model, without a window or GPU.
+ * Folders are searched for .ply files, and "-" reads more
+ * paths from the standard input, one per line. No .plyc
+ * cache is read or written unless --cache is given, as it
+ * would go next to the inputs or in $MODEL_CACHE_DIR.
+ * Usage: thumbnails [--size 256 | --size 320x240] [--jobs N]
+ *        [--memory MB] [--out folder] [--no-shadow] [--cache]
+ *        paths...
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "array_map.h"
+#include "dynamic_string.h"
+#include "model.h"
+#include "parallel.h"
+#include "png_writer.h"
+#include "software_renderer.h"
+
+// Megabytes of source files loaded at once, by default.
+#define THUMBNAILS_MEMORY 1024
+
+typedef struct {
+  String path;    // PLY file to render.
+  String output;  // PNG file to write.
+} Thumbnail;
+
+/**
+ * Work shared by the workers. Each takes the next file,
+ * loads, renders and writes it, then frees the model, so
+ * while some workers parse others render, and at most one
+ * model per worker is held.
+ */
+typedef struct {
+  Array* thumbnails;
+  atomic_int next;
+  int width, height;
+  bool hasShadow;
+  size_t memoryLimit;  // Source bytes in flight, before waiting.
+  size_t memoryUsed;
+  pthread_mutex_t lock;  // Over the memory and the printing.
+  pthread_cond_t freed;
+  int failed;
+  size_t bytes;  // Of the source files rendered.
+  long faces;
+  double loadSeconds, renderSeconds, writeSeconds;
+} Thumbnails;
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void Thumbnail_free(Thumbnail* this) {
+  dispose(this->path, this->output);
+  free(this);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Files                                   */
+/* -------------------------------------------------------------------------- */
+
+static bool isPly(const char* name) {
+  size_t length = strlen(name);
+  return length > 4 && strcasecmp(name + length - 4, ".ply") == 0;
+}
+
+static int compareNames(const void* a, const void* b) {
+  return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * Add a thumbnail for a file, written to the folder under
+ * the same relative path with a .png extension.
+ * @param relative path of the file inside the given folder,
+ * or its name if it was given alone.
+ */
+static void addFile(Array* thumbnails, const char* path, const char* relative,
+                    const char* folder) {
+  Thumbnail* thumbnail = malloc(sizeof(Thumbnail));
+  thumbnail->path = $(path);
+  String name = $(relative);
+  if (isPly(name)) name[strlen(name) - 4] = '\0';
+  thumbnail->output = $(folder, "/", name, ".png");
+  free(name);
+  Array_add(thumbnails, thumbnail);
+}
+
+/**
+ * Add every PLY file below a folder, in name order so the
+ * runs are repeatable.
+ * @param prefix of the relative paths, "" at the top.
+ */
+static void addFolder(Array* thumbnails, const char* path, const char* prefix,
+                      const char* folder) {
+  DIR* directory = opendir(path);
+  if (directory == null) return;
+  Array* names = new_Array(free);
+  struct dirent* entry;
+  while ((entry = readdir(directory)) != null)
+    if (entry->d_name[0] != '.') Array_add(names, $(entry->d_name));
+  closedir(directory);
+  qsort(names->at, names->length, sizeof(void*), compareNames);
+
+  for_in(next, names) {
+    String name = names->at[next];
+    String child = $(path, "/", name);
+    String relative = $(prefix, name);
+    struct stat info;
+    if (stat(child, &info) == 0) {
+      if (S_ISDIR(info.st_mode)) {
+        String inner = $(relative, "/");
+        addFolder(thumbnails, child, inner, folder);
+        free(inner);
+      } else if (isPly(name)) {
+        addFile(thumbnails, child, relative, folder);
+      }
+    }
+    dispose(child, relative);
+  }
+  Array_free(names);
+}
+
+/**
+ * Add a file, or the files of a folder under the name of
+ * the folder, so folders with the same file names do not
+ * write over each other.
+ */
+static void addPath(Array* thumbnails, const char* path, const char* folder) {
+  String trimmed = $(path);
+  size_t length = strlen(trimmed);
+  while (length > 1 && trimmed[length - 1] == '/') trimmed[--length] = '\0';
+  const char* slash = strrchr(trimmed, '/');
+  const char* name = slash != null ? slash + 1 : trimmed;
+
+  struct stat info;
+  if (stat(trimmed, &info) == 0 && S_ISDIR(info.st_mode)) {
+    bool isNamed = name[0] != '\0' && !isStringEqual(name, ".") &&
+                   !isStringEqual(name, "..");
+    String prefix = isNamed ? $(name, "/") : $("");
+    addFolder(thumbnails, trimmed, prefix, folder);
+    free(prefix);
+  } else {
+    addFile(thumbnails, trimmed, name, folder);
+  }
+  free(trimmed);
+}
+
+/**
+ * Make the folders of a file path that do not exist yet.
+ */
+static bool makeFolders(const char* filePath) {
+  String path = $(filePath);
+  bool isMade = true;
+  for (char* slash = strchr(path + 1, '/'); isMade && slash != null;
+       slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    isMade = mkdir(path, 0777) == 0 || errno == EEXIST;
+    *slash = '/';
+  }
+  free(path);
+  return isMade;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                   Workers                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Wait until the source fits the memory left, then hold
+ * it. A file larger than the limit waits for the others
+ * to finish, then loads alone.
+ */
+static void reserveMemory(Thumbnails* this, size_t bytes) {
+  pthread_mutex_lock(&this->lock);
+  while (this->memoryUsed > 0 && this->memoryUsed + bytes > this->memoryLimit)
+    pthread_cond_wait(&this->freed, &this->lock);
+  this->memoryUsed += bytes;
+  pthread_mutex_unlock(&this->lock);
+}
+
+static void releaseMemory(Thumbnails* this, size_t bytes) {
+  pthread_mutex_lock(&this->lock);
+  this->memoryUsed -= bytes;
+  pthread_cond_broadcast(&this->freed);
+  pthread_mutex_unlock(&this->lock);
+}
+
+static void render(Thumbnails* this, Thumbnail* thumbnail) {
+  struct stat info;
+  size_t bytes = stat(thumbnail->path, &info) == 0 ? (size_t)info.st_size : 0;
+  reserveMemory(this, bytes);
+
+  double start = now();
+  Model* model = new_Model(thumbnail->path);
+  double loaded = now(), rendered = loaded;
+  bool isRendered = model != null && !model->hasError;
+  bool isWritten = false;
+  if (isRendered) {
+    SoftwareRenderer* renderer =
+        new_SoftwareRenderer(model, this->width, this->height);
+    SoftwareScene scene = SoftwareScene_getDefault();
+    scene.aspect = (double)this->width / this->height;
+    scene.hasShadow = this->hasShadow;
+    SoftwareRenderer_draw(renderer, &scene);
+    rendered = now();
+    isWritten = makeFolders(thumbnail->output) &&
+                PngWriter_write(thumbnail->output, renderer->color,
+                                this->width, this->height, true);
+    SoftwareRenderer_free(renderer);
+  }
+  double written = now();
+  int faces = model != null ? model->numOfFaces : 0;
+  Model_free(model);
+  releaseMemory(this, bytes);
+
+  pthread_mutex_lock(&this->lock);
+  if (!isRendered) {
+    this->failed++;
+    print(thumbnail->path, ": could not parse");
+  } else if (!isWritten) {
+    this->failed++;
+    print(thumbnail->path, ": could not write ", thumbnail->output);
+  } else {
+    this->bytes += bytes;
+    this->faces += faces;
+    this->loadSeconds += loaded - start;
+    this->renderSeconds += rendered - loaded;
+    this->writeSeconds += written - rendered;
+    print(thumbnail->path, ": ", _(faces), " faces, ", _(bytes / 1024.0, 1),
+          " KB, load ", _((loaded - start) * 1000, 2), " ms, render ",
+          _((rendered - loaded) * 1000, 2), " ms, write ",
+          _((written - rendered) * 1000, 2), " ms -> ", thumbnail->output);
+  }
+  pthread_mutex_unlock(&this->lock);
+}
+
+static void* work(void* argument) {
+  Thumbnails* this = argument;
+  int count = this->thumbnails->length, index;
+  while ((index = atomic_fetch_add(&this->next, 1)) < count)
+    render(this, this->thumbnails->at[index]);
+  return null;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Main                                    */
+/* -------------------------------------------------------------------------- */
+
+static void printUsage() {
+  print(
+      "Usage: thumbnails [--size 256 | --size 320x240] [--jobs N] "
+      "[--memory MB] [--out folder] [--no-shadow] [--cache] paths...\n"
+      "Paths are PLY files, folders to search, or - to read paths from the "
+      "standard input.\n"
+      "--cache reads and writes the .plyc cache of each file, next to it or "
+      "in $MODEL_CACHE_DIR, which is off by default.");
+}
+
+int main(int argc, char** argv) {
+  int width = 256, height = 256, jobs = 0;
+  int memory = THUMBNAILS_MEMORY;
+  bool hasShadow = true, isCached = false;
+  const char* folder = "thumbnails";
+  Array* paths = new_Array(free);
+  for (int next = 1; next < argc; next++) {
+    String argument = argv[next];
+    bool hasValue = next + 1 < argc;
+    if (isStringEqual(argument, "--size") && hasValue) {
+      String size = argv[++next];
+      width = atoi(size);
+      String cross = strchr(size, 'x');
+      height = cross != null ? atoi(cross + 1) : width;
+    } else if (isStringEqual(argument, "--jobs") && hasValue) {
+      jobs = atoi(argv[++next]);
+    } else if (isStringEqual(argument, "--memory") && hasValue) {
+      memory = atoi(argv[++next]);
+    } else if (isStringEqual(argument, "--out") && hasValue) {
+      folder = argv[++next];
+    } else if (isStringEqual(argument, "--no-shadow")) {
+      hasShadow = false;
+    } else if (isStringEqual(argument, "--cache")) {
+      isCached = true;
+    } else if (argument[0] == '-' && argument[1] != '\0') {
+      printUsage();
+      Array_free(paths);
+      return 2;
+    } else {
+      Array_add(paths, $(argument));
+    }
+  }
+  if (paths->length == 0 || width < 1 || height < 1 || width > 8192 ||
+      height > 8192 || memory < 1) {
+    printUsage();
+    Array_free(paths);
+    return 2;
+  }
+
+  Array* thumbnails = new_Array(Thumbnail_free);
+  for_in(next, paths) {
+    String path = paths->at[next];
+    if (!isStringEqual(path, "-")) {
+      addPath(thumbnails, path, folder);
+      continue;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), stdin) != null) {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] != '\0') addPath(thumbnails, line, folder);
+    }
+  }
+  Array_free(paths);
+  // Leave the folders of the inputs as they were.
+  if (!isCached) setenv("MODEL_CACHE", "off", 1);
+
+  // The workers share the cores with the parallel passes of
+  // each load and render.
+  int cores = Parallel_getThreadCount();
+  if (jobs <= 0) jobs = cores;
+  if (jobs > (int)thumbnails->length) jobs = thumbnails->length;
+  if (jobs < 1) jobs = 1;
+  Parallel_setThreadCount(cores / jobs > 1 ? cores / jobs : 1);
+
+  Thumbnails this = {.thumbnails = thumbnails,
+                     .width = width,
+                     .height = height,
+                     .hasShadow = hasShadow,
+                     .memoryLimit = (size_t)memory * 1024 * 1024};
+  atomic_init(&this.next, 0);
+  pthread_mutex_init(&this.lock, null);
+  pthread_cond_init(&this.freed, null);
+
+  double start = now();
+  pthread_t* threads = malloc(sizeof(pthread_t) * jobs);
+  int started = 0;
+  for (int next = 1; next < jobs; next++)
+    if (pthread_create(&threads[started], null, work, &this) == 0) started++;
+  work(&this);
+  for (int next = 0; next < started; next++) pthread_join(threads[next], null);
+  double seconds = now() - start;
+
+  int rendered = thumbnails->length - this.failed;
+  print(_(rendered), " of ", _(thumbnails->length), " files in ",
+        _(seconds, 2), " s on ", _(started + 1), " workers: ",
+        _(rendered / seconds, 1), " files/s, ",
+        _(this.bytes / (1024.0 * 1024.0) / seconds, 2), " MB/s, ",
+        _(this.faces / seconds / 1e6, 2), " M faces/s");
+  if (rendered > 0)
+    print("Per file: load ", _(this.loadSeconds * 1000 / rendered, 2),
+          " ms, render ", _(this.renderSeconds * 1000 / rendered, 2),
+          " ms, write ", _(this.writeSeconds * 1000 / rendered, 2), " ms");
+
+  pthread_mutex_destroy(&this.lock);
+  pthread_cond_destroy(&this.freed);
+  free(threads);
+  bool hasFailed = this.failed > 0;
+  Array_free(thumbnails);
+  return hasFailed ? 1 : 0;
+}